@@ -0,0 +1,123 @@
+#ifndef HRK_ARRIVAL_LOG_HPP
+#define HRK_ARRIVAL_LOG_HPP
+
+/*!
+  \file
+  \brief 受信データの到着時刻の記録 (Linux, Mac)
+
+  受信バッファに格納したデータの先頭からの位置と、その到着時刻を
+  記録し、読み出した行がいつ届いたかを返す。記録は固定長の配列に
+  循環して格納し、受信中にメモリを確保しない。
+
+  読み出されずに Max_entries 回を越えて格納されたときは、古い記録から
+  上書きする。上書きされた位置の到着時刻は 0 (不明) を返す。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstddef>
+#include <time.h>
+
+
+namespace hrk
+{
+    //! 受信データの到着時刻の記録
+    class Arrival_log
+    {
+    public:
+        enum {
+            Max_entries = 256,
+        };
+
+
+        Arrival_log(void) : first_(0), size_(0), received_(0)
+        {
+        }
+
+
+        //! 現在の UNIX 時刻 [nsec]
+        static long long now(void)
+        {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            return (static_cast<long long>(ts.tv_sec) * 1000000000LL) +
+                ts.tv_nsec;
+        }
+
+
+        void clear(void)
+        {
+            first_ = 0;
+            size_ = 0;
+            received_ = 0;
+        }
+
+
+        /*!
+          \brief 受信データを格納したときに呼び出す
+
+          \param[in] size 格納した byte 数
+          \param[in] time 到着時刻 [nsec]
+        */
+        void add(size_t size, long long time)
+        {
+            if (size_ == Max_entries) {
+                // 最も古い記録を上書きする
+                first_ = (first_ + 1) % Max_entries;
+                --size_;
+            }
+            entry_t& entry = entries_[(first_ + size_) % Max_entries];
+            entry.position = received_;
+            entry.time = time;
+            ++size_;
+            received_ += size;
+        }
+
+
+        //! これまでに格納した byte 数
+        unsigned long long received(void) const
+        {
+            return received_;
+        }
+
+
+        /*!
+          \brief position byte 目のデータの到着時刻
+
+          position より前の記録は破棄する。
+
+          \return 到着時刻 [nsec]。記録が無いか、上書きされたときは 0
+        */
+        long long time(unsigned long long position)
+        {
+            if ((size_ == 0) || (position < entries_[first_].position) ||
+                (position >= received_)) {
+                return 0;
+            }
+            while ((size_ > 1) &&
+                   (entries_[(first_ + 1) % Max_entries].position <=
+                    position)) {
+                first_ = (first_ + 1) % Max_entries;
+                --size_;
+            }
+            return entries_[first_].time;
+        }
+
+
+    private:
+        typedef struct
+        {
+            unsigned long long position;
+            long long time;
+        } entry_t;
+
+        entry_t entries_[Max_entries];
+        size_t first_;
+        size_t size_;
+        unsigned long long received_;
+    };
+}
+
+#endif
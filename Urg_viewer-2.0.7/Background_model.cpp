@@ -0,0 +1,335 @@
+/*!
+  \file
+  \brief 静止した背景の学習と除去
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "Background_model.h"
+#include "Scan_frame.h"
+
+using namespace hrk;
+using namespace std;
+
+
+namespace
+{
+    const char Magic[] = "URGBG001";
+
+    enum {
+        Magic_size = 8,
+        Layout_size = 4,
+
+        // これより小さい値はエラーコードとして扱う
+        Min_valid_distance = 20,
+        No_background = 0x7fffffff,
+    };
+
+
+    void write_int(ofstream& fout, long value)
+    {
+        unsigned char buffer[4];
+        for (int i = 0; i < 4; ++i) {
+            buffer[i] = static_cast<unsigned char>(value >> (8 * i));
+        }
+        fout.write(reinterpret_cast<char*>(buffer), sizeof(buffer));
+    }
+
+
+    bool read_int(ifstream& fin, long& value)
+    {
+        unsigned char buffer[4];
+        if (!fin.read(reinterpret_cast<char*>(buffer), sizeof(buffer))) {
+            return false;
+        }
+        unsigned long bits = 0;
+        for (int i = 0; i < 4; ++i) {
+            bits |= static_cast<unsigned long>(buffer[i]) << (8 * i);
+        }
+        value = static_cast<long>(static_cast<int>(bits));
+        return true;
+    }
+}
+
+
+struct Background_model::pImpl
+{
+    long layout_[Layout_size];
+    long learned_layout_[Layout_size];
+    long margin_;
+    size_t max_size_;
+
+    // 学習済みの背景の距離。0 は背景が無いことを示す
+    vector<long> background_;
+    // background_ から margin_ を引いた、前景と判定する距離の上限
+    vector<uint32_t> threshold_;
+
+    size_t learning_scans_;
+    size_t learned_scans_;
+    size_t learning_size_;
+    vector<long> samples_;
+    vector<long> column_;
+
+
+    pImpl(void)
+        : margin_(Default_margin_mm), max_size_(0),
+          learning_scans_(0), learned_scans_(0), learning_size_(0)
+    {
+        fill(layout_, layout_ + Layout_size, 0);
+        fill(learned_layout_, learned_layout_ + Layout_size, -1);
+    }
+
+
+    bool is_valid(void) const
+    {
+        return !background_.empty() &&
+            equal(layout_, layout_ + Layout_size, learned_layout_);
+    }
+
+
+    void update_threshold(void)
+    {
+        size_t n = background_.size();
+        threshold_.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            long background = background_[i];
+            threshold_[i] = static_cast<uint32_t>((background == 0) ?
+                static_cast<long>(No_background) :
+                min(max(background - margin_, 0L),
+                    static_cast<long>(No_background)));
+        }
+    }
+
+
+    bool add_learning_scan(const Scan_frame& frame)
+    {
+        if (learning_scans_ == 0) {
+            return false;
+        }
+
+        if (learned_scans_ == 0) {
+            learning_size_ = frame.size();
+            samples_.resize(learning_scans_ * learning_size_);
+        } else if (frame.size() != learning_size_) {
+            // 途中でデータ配置が変わったら、最初から学習し直す
+            learned_scans_ = 0;
+            return add_learning_scan(frame);
+        }
+
+        copy(frame.distance(), frame.distance() + frame.size(),
+             samples_.begin() + (learned_scans_ * learning_size_));
+        if (++learned_scans_ < learning_scans_) {
+            return false;
+        }
+
+        // 有効な値が半数以上ある点のみ、その中央値を背景とする
+        background_.resize(learning_size_);
+        column_.reserve(learning_scans_);
+        for (size_t i = 0; i < learning_size_; ++i) {
+            column_.clear();
+            for (size_t scan = 0; scan < learning_scans_; ++scan) {
+                long value = samples_[(scan * learning_size_) + i];
+                if (value >= Min_valid_distance) {
+                    column_.push_back(value);
+                }
+            }
+
+            if ((2 * column_.size()) < learning_scans_) {
+                background_[i] = 0;
+                continue;
+            }
+            vector<long>::iterator median =
+                column_.begin() + (column_.size() / 2);
+            nth_element(column_.begin(), median, column_.end());
+            background_[i] = *median;
+        }
+        copy(layout_, layout_ + Layout_size, learned_layout_);
+        update_threshold();
+
+        learning_scans_ = 0;
+        learned_scans_ = 0;
+        vector<long>().swap(samples_);
+
+        return true;
+    }
+
+
+    size_t apply(Scan_frame& frame) const
+    {
+        const size_t n = frame.size();
+        if (!is_valid() || (n != threshold_.size())) {
+            return n;
+        }
+
+        uint32_t* data = frame.distance();
+        const uint32_t* threshold = &threshold_[0];
+        size_t foreground = 0;
+
+        size_t i = 0;
+#if defined(__SSE2__)
+        // 距離と閾値は 31 bit に収まるため、符号付きで比較してよい
+        const size_t lanes = sizeof(__m128i) / sizeof(uint32_t);
+        for (; i + lanes <= n; i += lanes) {
+            __m128i* p = reinterpret_cast<__m128i*>(&data[i]);
+            const __m128i value = _mm_loadu_si128(p);
+            const __m128i limit = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(&threshold[i]));
+            const __m128i is_foreground = _mm_cmplt_epi32(value, limit);
+            _mm_storeu_si128(p, _mm_and_si128(value, is_foreground));
+        }
+        for (size_t j = 0; j < i; ++j) {
+            foreground += (data[j] != 0);
+        }
+#endif
+        for (; i < n; ++i) {
+            if (data[i] >= threshold[i]) {
+                data[i] = 0;
+            } else if (data[i] != 0) {
+                ++foreground;
+            }
+        }
+        return foreground;
+    }
+};
+
+
+Background_model::Background_model(void) : pimpl(new pImpl)
+{
+}
+
+
+Background_model::~Background_model(void)
+{
+}
+
+
+void Background_model::set_layout(int first_step, int last_step,
+                                  int group_steps, int echo_size)
+{
+    pimpl->layout_[0] = first_step;
+    pimpl->layout_[1] = last_step;
+    pimpl->layout_[2] = group_steps;
+    pimpl->layout_[3] = echo_size;
+}
+
+
+void Background_model::set_max_size(size_t max_size)
+{
+    pimpl->max_size_ = max_size;
+}
+
+
+void Background_model::set_margin(long margin_mm)
+{
+    pimpl->margin_ = max(margin_mm, 0L);
+    pimpl->update_threshold();
+}
+
+
+void Background_model::start_learning(size_t scans)
+{
+    pimpl->learning_scans_ = max(scans, static_cast<size_t>(1));
+    pimpl->learned_scans_ = 0;
+}
+
+
+bool Background_model::is_learning(void) const
+{
+    return pimpl->learning_scans_ > 0;
+}
+
+
+bool Background_model::add_learning_scan(const Scan_frame& frame)
+{
+    return pimpl->add_learning_scan(frame);
+}
+
+
+bool Background_model::is_valid(void) const
+{
+    return pimpl->is_valid();
+}
+
+
+size_t Background_model::apply(Scan_frame& frame) const
+{
+    return pimpl->apply(frame);
+}
+
+
+bool Background_model::load(const char* file_path)
+{
+    ifstream fin(file_path, ios::in | ios::binary);
+    if (!fin.is_open()) {
+        return false;
+    }
+
+    char magic[Magic_size];
+    if (!fin.read(magic, Magic_size) ||
+        !equal(magic, magic + Magic_size, Magic)) {
+        return false;
+    }
+
+    long layout[Layout_size];
+    for (int i = 0; i < Layout_size; ++i) {
+        if (!read_int(fin, layout[i])) {
+            return false;
+        }
+    }
+
+    long n;
+    if (!read_int(fin, n) || (n <= 0)) {
+        return false;
+    }
+    if (static_cast<size_t>(n) > pimpl->max_size_) {
+        cerr << "Background_model: too many values in " << file_path
+             << " (" << n << " > " << pimpl->max_size_ << ")." << endl;
+        return false;
+    }
+    vector<long> background(n);
+    for (long i = 0; i < n; ++i) {
+        if (!read_int(fin, background[i])) {
+            return false;
+        }
+    }
+
+    copy(layout, layout + Layout_size, pimpl->learned_layout_);
+    pimpl->background_.swap(background);
+    pimpl->update_threshold();
+
+    return true;
+}
+
+
+bool Background_model::save(const char* file_path) const
+{
+    if (pimpl->background_.empty()) {
+        return false;
+    }
+
+    ofstream fout(file_path, ios::out | ios::binary | ios::trunc);
+    if (!fout.is_open()) {
+        return false;
+    }
+
+    fout.write(Magic, Magic_size);
+    for (int i = 0; i < Layout_size; ++i) {
+        write_int(fout, pimpl->learned_layout_[i]);
+    }
+
+    size_t n = pimpl->background_.size();
+    write_int(fout, n);
+    for (size_t i = 0; i < n; ++i) {
+        write_int(fout, pimpl->background_[i]);
+    }
+
+    return fout.good();
+}
@@ -0,0 +1,88 @@
+#ifndef BACKGROUND_MODEL_H
+#define BACKGROUND_MODEL_H
+
+/*!
+  \file
+  \brief 静止した背景の学習と除去
+
+  ステップ、エコー毎に学習したスキャンの距離の中央値を背景とし、
+  背景より手前にある点のみを前景として残す。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <memory>
+#include <vector>
+
+namespace hrk
+{
+    class Scan_frame;
+}
+
+
+class Background_model
+{
+ public:
+    enum {
+        Default_learning_scans = 100,
+        Default_margin_mm = 50,
+    };
+
+    Background_model(void);
+    ~Background_model(void);
+
+    /*!
+      \brief スキャンのデータ配置を設定する
+
+      学習済みの背景は、同じデータ配置のスキャンにのみ適用する。
+    */
+    void set_layout(int first_step, int last_step, int group_steps,
+                    int echo_size);
+
+    /*!
+      \brief 1 スキャンの値の最大個数を設定する
+
+      load() はこれを越える個数の背景を読み込まない。
+    */
+    void set_max_size(size_t max_size);
+
+    //! 背景からこの距離以内の点も背景とみなす
+    void set_margin(long margin_mm);
+
+    //! scans 回分のスキャンで背景を学習し直す
+    void start_learning(size_t scans);
+    bool is_learning(void) const;
+
+    /*!
+      \brief 学習用のスキャンを追加する
+
+      \retval true 学習が完了した
+    */
+    bool add_learning_scan(const hrk::Scan_frame& frame);
+
+    //! 学習済みで、データ配置が一致するか
+    bool is_valid(void) const;
+
+    /*!
+      \brief 背景の点の距離を 0 にする
+
+      frame の点毎に、背景より手前ならば前景としてそのまま残す。
+
+      \return 前景の点の数
+    */
+    size_t apply(hrk::Scan_frame& frame) const;
+
+    bool load(const char* file_path);
+    bool save(const char* file_path) const;
+
+ private:
+    Background_model(const Background_model& rhs);
+    Background_model& operator = (const Background_model& rhs);
+
+    struct pImpl;
+    std::auto_ptr<pImpl> pimpl;
+};
+
+#endif
@@ -0,0 +1,281 @@
+/*!
+  \file
+  \brief 点群からの物体 (blob) の検出
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <algorithm>
+#include <cmath>
+#include "Blob_detector.h"
+
+using namespace std;
+
+
+namespace
+{
+    enum {
+        Default_max_step_gap = 2,
+        Reserved_cursors = 64,
+
+        // センサのタイムスタンプは 24 bit で一周する
+        Timestamp_mask = 0xffffff,
+        Max_dt_msec = 1000,
+    };
+
+    const float Default_max_jump_mm = 100.0;
+    const float Default_min_width_mm = 20.0;
+    const float Default_max_width_mm = 500.0;
+    const float Default_match_distance_mm = 300.0;
+    const float Default_area_mm = 1300.0;
+
+
+    typedef struct
+    {
+        float distance2;
+        size_t current;
+        size_t previous;
+    } match_t;
+
+
+    bool operator < (const match_t& lhs, const match_t& rhs)
+    {
+        return lhs.distance2 < rhs.distance2;
+    }
+}
+
+
+struct Blob_detector::pImpl
+{
+    parameter_t parameter_;
+    float max_jump2_;
+    float min_width2_;
+    float max_width2_;
+    float match_distance2_;
+
+    long frame_;
+    long next_id_;
+    long last_timestamp_;
+    vector<cursor_t> cursors_;
+    vector<cursor_t> previous_;
+    vector<match_t> matches_;
+    vector<char> is_previous_matched_;
+
+
+    pImpl(void)
+        : frame_(0), next_id_(0), last_timestamp_(0)
+    {
+        set_parameter(default_parameter());
+
+        cursors_.reserve(Reserved_cursors);
+        previous_.reserve(Reserved_cursors);
+        matches_.reserve(Reserved_cursors * Reserved_cursors);
+        is_previous_matched_.reserve(Reserved_cursors);
+    }
+
+
+    void set_parameter(const parameter_t& parameter)
+    {
+        parameter_ = parameter;
+        parameter_.max_step_gap = max(1, parameter.max_step_gap);
+        if ((parameter_.area_width_mm <= 0.0) ||
+            (parameter_.area_height_mm <= 0.0)) {
+            parameter_t default_value = default_parameter();
+            parameter_.area_width_mm = default_value.area_width_mm;
+            parameter_.area_height_mm = default_value.area_height_mm;
+        }
+
+        // 距離は 2 乗のまま比較する
+        max_jump2_ = parameter_.max_jump_mm * parameter_.max_jump_mm;
+        min_width2_ = parameter_.min_width_mm * parameter_.min_width_mm;
+        max_width2_ = parameter_.max_width_mm * parameter_.max_width_mm;
+        match_distance2_ =
+            parameter_.match_distance_mm * parameter_.match_distance_mm;
+    }
+
+
+    void add_blob(const float* x, const float* y, size_t first, size_t last)
+    {
+        float dx = x[last] - x[first];
+        float dy = y[last] - y[first];
+        float width2 = (dx * dx) + (dy * dy);
+        if ((width2 < min_width2_) || (width2 > max_width2_)) {
+            return;
+        }
+
+        float sum_x = 0.0;
+        float sum_y = 0.0;
+        for (size_t i = first; i <= last; ++i) {
+            sum_x += x[i];
+            sum_y += y[i];
+        }
+        float points = static_cast<float>(last - first + 1);
+
+        cursor_t cursor;
+        cursor.id = -1;
+        cursor.x_mm = sum_x / points;
+        cursor.y_mm = sum_y / points;
+        cursor.width_mm = sqrt(width2);
+        // TUIO は左上が原点になる
+        cursor.x = (cursor.x_mm - parameter_.area_x_mm) /
+            parameter_.area_width_mm;
+        cursor.y = 1.0 - ((cursor.y_mm - parameter_.area_y_mm) /
+                          parameter_.area_height_mm);
+        cursor.velocity_x = 0.0;
+        cursor.velocity_y = 0.0;
+        cursor.acceleration = 0.0;
+        cursors_.push_back(cursor);
+    }
+
+
+    void segment(const float* x, const float* y, const int* step, size_t n)
+    {
+        if (n == 0) {
+            return;
+        }
+
+        size_t first = 0;
+        for (size_t i = 1; i < n; ++i) {
+            float dx = x[i] - x[i - 1];
+            float dy = y[i] - y[i - 1];
+            if (((step[i] - step[i - 1]) > parameter_.max_step_gap) ||
+                (((dx * dx) + (dy * dy)) > max_jump2_)) {
+                add_blob(x, y, first, i - 1);
+                first = i;
+            }
+        }
+        add_blob(x, y, first, n - 1);
+    }
+
+
+    void associate(long timestamp)
+    {
+        // 距離の近い組から順に、前回のカーソルの ID を引き継ぐ
+        matches_.clear();
+        size_t n = cursors_.size();
+        size_t previous_n = previous_.size();
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t j = 0; j < previous_n; ++j) {
+                float dx = cursors_[i].x_mm - previous_[j].x_mm;
+                float dy = cursors_[i].y_mm - previous_[j].y_mm;
+                float distance2 = (dx * dx) + (dy * dy);
+                if (distance2 <= match_distance2_) {
+                    match_t match;
+                    match.distance2 = distance2;
+                    match.current = i;
+                    match.previous = j;
+                    matches_.push_back(match);
+                }
+            }
+        }
+        sort(matches_.begin(), matches_.end());
+
+        is_previous_matched_.assign(previous_n, 0);
+        // 間隔が空きすぎたときは、速度を更新しない
+        long dt_msec = (timestamp - last_timestamp_) & Timestamp_mask;
+        float dt = (dt_msec > Max_dt_msec) ? 0.0 : dt_msec / 1000.0;
+        vector<match_t>::const_iterator end_it = matches_.end();
+        for (vector<match_t>::const_iterator it = matches_.begin();
+             it != end_it; ++it) {
+            cursor_t& cursor = cursors_[it->current];
+            if ((cursor.id >= 0) || is_previous_matched_[it->previous]) {
+                continue;
+            }
+            const cursor_t& previous = previous_[it->previous];
+            is_previous_matched_[it->previous] = 1;
+            cursor.id = previous.id;
+            if (dt > 0.0) {
+                cursor.velocity_x = (cursor.x - previous.x) / dt;
+                cursor.velocity_y = (cursor.y - previous.y) / dt;
+                float speed = sqrt((cursor.velocity_x * cursor.velocity_x) +
+                                   (cursor.velocity_y * cursor.velocity_y));
+                float previous_speed =
+                    sqrt((previous.velocity_x * previous.velocity_x) +
+                         (previous.velocity_y * previous.velocity_y));
+                cursor.acceleration = (speed - previous_speed) / dt;
+            }
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            if (cursors_[i].id < 0) {
+                cursors_[i].id = next_id_++;
+            }
+        }
+        last_timestamp_ = timestamp;
+    }
+
+
+    size_t detect(const float* x, const float* y, const int* step, size_t n,
+                  long timestamp)
+    {
+        // 確保済みの領域を使い回すため、swap() で前回の結果を退避する
+        previous_.swap(cursors_);
+        cursors_.clear();
+
+        segment(x, y, step, n);
+        associate(timestamp);
+        ++frame_;
+
+        return cursors_.size();
+    }
+};
+
+
+Blob_detector::Blob_detector(void) : pimpl(new pImpl)
+{
+}
+
+
+Blob_detector::~Blob_detector(void)
+{
+}
+
+
+Blob_detector::parameter_t Blob_detector::default_parameter(void)
+{
+    parameter_t parameter;
+    parameter.max_jump_mm = Default_max_jump_mm;
+    parameter.max_step_gap = Default_max_step_gap;
+    parameter.min_width_mm = Default_min_width_mm;
+    parameter.max_width_mm = Default_max_width_mm;
+    parameter.match_distance_mm = Default_match_distance_mm;
+    parameter.area_x_mm = -Default_area_mm;
+    parameter.area_y_mm = -Default_area_mm;
+    parameter.area_width_mm = 2 * Default_area_mm;
+    parameter.area_height_mm = 2 * Default_area_mm;
+
+    return parameter;
+}
+
+
+void Blob_detector::set_parameter(const parameter_t& parameter)
+{
+    pimpl->set_parameter(parameter);
+}
+
+
+const Blob_detector::parameter_t& Blob_detector::parameter(void) const
+{
+    return pimpl->parameter_;
+}
+
+
+size_t Blob_detector::detect(const float* x, const float* y, const int* step,
+                             size_t n, long timestamp)
+{
+    return pimpl->detect(x, y, step, n, timestamp);
+}
+
+
+const vector<Blob_detector::cursor_t>& Blob_detector::cursors(void) const
+{
+    return pimpl->cursors_;
+}
+
+
+long Blob_detector::frame(void) const
+{
+    return pimpl->frame_;
+}
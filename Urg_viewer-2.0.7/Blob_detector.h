@@ -0,0 +1,91 @@
+#ifndef BLOB_DETECTOR_H
+#define BLOB_DETECTOR_H
+
+/*!
+  \file
+  \brief 点群からの物体 (blob) の検出
+
+  隣接するステップの点をまとめて blob とし、前回のスキャンの blob と
+  対応付けて TUIO のカーソルとして扱える ID, 速度を求める。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <memory>
+#include <vector>
+
+
+class Blob_detector
+{
+ public:
+    //! TUIO /tuio/2Dcur のカーソル。位置、速度は set_area() の範囲で正規化する
+    typedef struct
+    {
+        long id;
+        float x;
+        float y;
+        float velocity_x;
+        float velocity_y;
+        float acceleration;
+        float x_mm;
+        float y_mm;
+        float width_mm;
+    } cursor_t;
+
+    /*!
+      \brief 検出の条件
+
+      隣接する点の距離が max_jump_mm を越えるか、ステップの間隔が
+      max_step_gap を越えると、別の blob とする。両端の点の距離が
+      min_width_mm, max_width_mm の範囲外の blob は無視する。
+      前回のカーソルとは match_distance_mm 以内で対応付ける。
+      (area_x_mm, area_y_mm) から area_width_mm, area_height_mm の範囲を
+      TUIO の (0, 1) に正規化する。
+    */
+    typedef struct
+    {
+        float max_jump_mm;
+        int max_step_gap;
+        float min_width_mm;
+        float max_width_mm;
+        float match_distance_mm;
+        float area_x_mm;
+        float area_y_mm;
+        float area_width_mm;
+        float area_height_mm;
+    } parameter_t;
+
+    Blob_detector(void);
+    ~Blob_detector(void);
+
+    static parameter_t default_parameter(void);
+    void set_parameter(const parameter_t& parameter);
+    const parameter_t& parameter(void) const;
+
+    /*!
+      \brief blob を検出する
+
+      x, y, step はステップ順に並んだ n 点。領域外などで除かれた点は
+      含まなくてよい。確保済みの領域が足りる限り、メモリ確保は行わない。
+
+      \return 検出したカーソルの数
+    */
+    size_t detect(const float* x, const float* y, const int* step, size_t n,
+                  long timestamp);
+
+    const std::vector<cursor_t>& cursors(void) const;
+
+    //! detect() の呼び出し毎に増加する TUIO の fseq
+    long frame(void) const;
+
+ private:
+    Blob_detector(const Blob_detector& rhs);
+    Blob_detector& operator = (const Blob_detector& rhs);
+
+    struct pImpl;
+    std::auto_ptr<pImpl> pimpl;
+};
+
+#endif
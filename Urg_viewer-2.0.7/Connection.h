@@ -29,6 +29,13 @@ namespace hrk
             Timeout_infinity = -1, //!< read() で無限に受信を待つ場合に利用する
         };
 
+        //! 受信バッファ内のデータの参照
+        typedef struct
+        {
+            const char* data;
+            size_t size;
+        } span_t;
+
 
         virtual ~Connection(void)
         {
@@ -55,6 +62,41 @@ namespace hrk
           \brief １文字だけ受信バッファに書き戻す
         */
         virtual void ungetc(int ch) = 0;
+
+        /*!
+          \brief 改行 (CR または LF) までの 1 行を受信する
+
+          受信データを複製せず、内部のバッファ上の 1 行を参照する。
+          line は次に read(), read_line() を呼び出すまで有効。
+
+          \param[out] line 改行を含む 1 行。タイムアウトしたときは、それまでに受信したデータ
+          \param[in] timeout 受信を待つ時間 [msec]
+
+          \retval >=0 改行を除いた行の byte 数
+          \retval <0 何も受信せずにタイムアウトした
+        */
+        virtual int read_line(span_t& line, int timeout) = 0;
+
+        /*!
+          \brief 受信済みで、まだ読み出していないデータを参照する
+
+          データは取り出さない。バッファ内で連続している部分のみを返す。
+
+          \return 参照できる byte 数
+        */
+        virtual size_t peek_buffer(span_t& buffer) = 0;
+
+        /*!
+          \brief 最後に read_line(), read_some() で読み出したデータの到着時刻
+
+          読み出したデータの先頭の byte の時刻を返す。
+
+          カーネルの受信時刻を取得できないときは、受信バッファに読み出した
+          時刻を返す。
+
+          \return UNIX 時刻 [nsec]。計測していないときは 0
+        */
+        virtual long long line_arrival_time(void) const = 0;
     };
 }
 
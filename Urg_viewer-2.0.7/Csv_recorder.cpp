@@ -10,14 +10,15 @@
 #include <fstream>
 #include "Csv_recorder.h"
 #include "Scan_setting.h"
+#include "Scan_frame.h"
 
+using namespace hrk;
 using namespace std;
 
 
 namespace
 {
-    typedef vector<vector<long> > Distances;
-    typedef vector<vector<unsigned short> > Intensities;
+    typedef vector<Scan_frame> Scans;
 
     const int Exel_max_column_size = 255;
     const int Max_record_times = 100;
@@ -30,12 +31,13 @@ struct Csv_recorder::pImpl
     Scan_setting setting_;
     int steps_;
     int max_echo_size_;
-    Distances distances_;
-    Intensities intensities_;
+    // 記録できるスキャンの数だけ確保しておき、受信したスキャンを上書きする
+    Scans scans_;
+    size_t recorded_scans_;
 
 
     pImpl(void)
-        : steps_(0), max_echo_size_(1)
+        : steps_(0), max_echo_size_(1), recorded_scans_(0)
     {
         setting_.with_intensity = false;
         setting_.is_multiecho = false;
@@ -44,8 +46,27 @@ struct Csv_recorder::pImpl
 
     void clear_data(void)
     {
-        distances_.clear();
-        intensities_.clear();
+        recorded_scans_ = 0;
+    }
+
+
+    // 記録の途中でスキャンを受信するときに、領域を確保しないようにする
+    void reserve_scans(void)
+    {
+        int echo_size = setting_.is_multiecho ? max_echo_size_ : 1;
+        scans_.resize(recordable_scan_times());
+        for (Scans::iterator it = scans_.begin(); it != scans_.end(); ++it) {
+            it->resize(steps_, echo_size, setting_.with_intensity);
+            it->clear();
+        }
+    }
+
+
+    void add_scan(const Scan_frame& frame)
+    {
+        if (recorded_scans_ < scans_.size()) {
+            scans_[recorded_scans_++] = frame;
+        }
     }
 
 
@@ -69,12 +90,12 @@ struct Csv_recorder::pImpl
     bool save_csv(ofstream& fout)
     {
         const size_t scan_times =
-            min(recordable_scan_times(), distances_.size());
+            min(recordable_scan_times(), recorded_scans_);
 
         save_header_line(fout, scan_times);
         for (int y = 0; y < steps_; ++y) {
             for (size_t x = 0; x < scan_times; ++x) {
-                save_raw_data(fout, distances_[x], intensities_[x], y);
+                save_raw_data(fout, scans_[x], y);
             }
             fout << endl;
         }
@@ -110,20 +131,27 @@ struct Csv_recorder::pImpl
     }
 
 
-    void save_raw_data(ofstream& fout,
-                       const vector<long>& distance,
-                       const vector<unsigned short>& intensity,
+    void save_raw_data(ofstream& fout, const Scan_frame& frame,
                        int step_index)
     {
         int echo_size = setting_.is_multiecho ? max_echo_size_ : 1;
-        int index = step_index * (setting_.is_multiecho ? max_echo_size_ : 1);
+        size_t index = step_index * frame.echo_size;
+        bool is_received = static_cast<size_t>(step_index) < frame.steps();
+        const uint32_t* distance = frame.distance();
+        const uint16_t* intensity = frame.intensity();
 
         for (int i = 0; i < echo_size; ++i) {
-            fout << distance[index + i] << ",";
+            if (is_received && (i < frame.echo_size)) {
+                fout << distance[index + i];
+            }
+            fout << ",";
         }
         if (setting_.with_intensity) {
             for (int i = 0; i < echo_size; ++i) {
-                fout << intensity[index + i] << ",";
+                if (is_received && intensity && (i < frame.echo_size)) {
+                    fout << intensity[index + i];
+                }
+                fout << ",";
             }
         }
     }
@@ -161,6 +189,7 @@ void Csv_recorder::set_scan_setting(const std::string& product_type,
     pimpl->setting_ = setting;
     pimpl->steps_ = setting.last_step - setting.first_step + 1;
     pimpl->max_echo_size_ = max_echo_size;
+    pimpl->reserve_scans();
 }
 
 
@@ -170,14 +199,9 @@ size_t Csv_recorder::recordable_scan_times(void) const
 }
 
 
-void Csv_recorder::set_receive_data(const std::vector<long>& distance,
-                                    const std::vector<unsigned short>&
-                                    intensity)
+void Csv_recorder::set_receive_data(const Scan_frame& frame)
 {
-    pimpl->distances_.push_back(distance);
-    if (pimpl->setting_.with_intensity) {
-        pimpl->intensities_.push_back(intensity);
-    }
+    pimpl->add_scan(frame);
 }
 
 
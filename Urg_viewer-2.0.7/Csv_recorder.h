@@ -13,6 +13,11 @@
 #include <memory>
 #include <vector>
 
+namespace hrk
+{
+    class Scan_frame;
+}
+
 class Scan_setting;
 
 
@@ -25,8 +30,7 @@ class Csv_recorder
     void set_scan_setting(const std::string& product_type,
                           Scan_setting& setting, int max_echo_size);
     size_t recordable_scan_times(void) const;
-    void set_receive_data(const std::vector<long>& distance,
-                          const std::vector<unsigned short>& intensity);
+    void set_receive_data(const hrk::Scan_frame& frame);
     bool save_file(const char* file_path);
 
  private:
@@ -0,0 +1,867 @@
+/*!
+  \file
+  \brief 受信データを複数の TCP クライアントに配信するサーバ
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include "detect_os.h"
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include <stdint.h>
+#include <QMutex>
+#if defined(WINDOWS_OS)
+#include <winsock2.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#endif
+#include "Fanout_server.h"
+#include "Scan_frame.h"
+#include "ip/NetworkingUtils.h"
+
+using namespace hrk;
+using namespace std;
+
+
+namespace
+{
+#if defined(WINDOWS_OS)
+    typedef SOCKET socket_t;
+    typedef int socklen_t;
+    const socket_t Invalid_socket = INVALID_SOCKET;
+
+    enum { Send_flags = 0 };
+
+
+    void close_socket(socket_t socket)
+    {
+        closesocket(socket);
+    }
+
+
+    void set_nonblock_mode(socket_t socket)
+    {
+        u_long on = 1;
+        ioctlsocket(socket, FIONBIO, &on);
+    }
+
+
+    bool is_would_block(void)
+    {
+        return (WSAGetLastError() == WSAEWOULDBLOCK) ? true : false;
+    }
+
+
+    string socket_error_message(const char* operation)
+    {
+        return string(operation) + " failed.";
+    }
+#else
+    typedef int socket_t;
+    const socket_t Invalid_socket = -1;
+
+#if defined(MSG_NOSIGNAL)
+    enum { Send_flags = MSG_NOSIGNAL };
+#else
+    enum { Send_flags = 0 };
+#endif
+
+
+    void close_socket(socket_t socket)
+    {
+        ::close(socket);
+    }
+
+
+    void set_nonblock_mode(socket_t socket)
+    {
+        int flag = fcntl(socket, F_GETFL, 0);
+        fcntl(socket, F_SETFL, flag | O_NONBLOCK);
+    }
+
+
+    bool is_would_block(void)
+    {
+        return ((errno == EAGAIN) || (errno == EWOULDBLOCK) ||
+                (errno == EINTR)) ? true : false;
+    }
+
+
+    string socket_error_message(const char* operation)
+    {
+        return string(operation) + ": " + strerror(errno);
+    }
+#endif
+
+    const char Frame_magic[] = "USF1";
+
+    enum {
+        Select_timeout_msec = 100,
+        Listen_backlog = 8,
+        Receive_buffer_size = 256,
+        Frame_header_size = 28,
+        Max_raw_packet_size = 64 * 1024,
+    };
+
+
+    // 全てのクライアントで共有する送信データ
+    typedef struct
+    {
+        vector<char> data;
+        size_t references;
+    } packet_t;
+
+
+    // 長さが一定の送信キュー。deque と違い、追加と削除で確保をしない
+    class Packet_queue
+    {
+    public:
+        explicit Packet_queue(size_t capacity)
+            : packets_(capacity, NULL), first_(0), size_(0)
+        {
+        }
+
+
+        bool empty(void) const
+        {
+            return (size_ == 0) ? true : false;
+        }
+
+
+        bool full(void) const
+        {
+            return (size_ >= packets_.size()) ? true : false;
+        }
+
+
+        size_t size(void) const
+        {
+            return size_;
+        }
+
+
+        packet_t* at(size_t index) const
+        {
+            return packets_[(first_ + index) % packets_.size()];
+        }
+
+
+        packet_t* front(void) const
+        {
+            return packets_[first_];
+        }
+
+
+        void push_back(packet_t* packet)
+        {
+            packets_[(first_ + size_) % packets_.size()] = packet;
+            ++size_;
+        }
+
+
+        void pop_front(void)
+        {
+            first_ = (first_ + 1) % packets_.size();
+            --size_;
+        }
+
+    private:
+        vector<packet_t*> packets_;
+        size_t first_;
+        size_t size_;
+    };
+
+
+    typedef struct
+    {
+        socket_t socket;
+        Packet_queue* queue;
+        // queue->front() の送信済みの byte 数。サーバのスレッドでのみ参照する
+        size_t sent_size;
+        bool is_evicted;
+        bool is_closed;
+    } client_t;
+
+
+    void set_uint32(char* p, uint32_t value)
+    {
+        p[0] = static_cast<char>(value & 0xff);
+        p[1] = static_cast<char>((value >> 8) & 0xff);
+        p[2] = static_cast<char>((value >> 16) & 0xff);
+        p[3] = static_cast<char>((value >> 24) & 0xff);
+    }
+
+
+    void set_uint16(char* p, uint16_t value)
+    {
+        p[0] = static_cast<char>(value & 0xff);
+        p[1] = static_cast<char>((value >> 8) & 0xff);
+    }
+
+
+    // SCIP の応答を LF LF まで溜めてから送信する
+    class Raw_stream : public Stream
+    {
+    public:
+        Raw_stream(Fanout_server& server) : server_(server)
+        {
+        }
+
+
+        bool is_open(void) const
+        {
+            return true;
+        }
+
+
+        void close(void)
+        {
+            pending_.clear();
+        }
+
+
+        int write(const char* data, size_t data_size)
+        {
+            for (size_t i = 0; i < data_size; ++i) {
+                pending_.push_back(data[i]);
+                size_t n = pending_.size();
+                bool is_response_end = (n >= 2) && (data[i] == '\n') &&
+                    (pending_[n - 2] == '\n');
+                if (is_response_end || (n >= Max_raw_packet_size)) {
+                    if (server_.payload() == Fanout_server::Raw_scip) {
+                        server_.publish(&pending_[0], n);
+                    }
+                    pending_.clear();
+                }
+            }
+            return static_cast<int>(data_size);
+        }
+
+
+        int read(char* data, size_t max_data_size, int timeout)
+        {
+            static_cast<void>(data);
+            static_cast<void>(max_data_size);
+            static_cast<void>(timeout);
+            return 0;
+        }
+
+
+        int read_some(char* data, size_t max_data_size, int timeout)
+        {
+            return read(data, max_data_size, timeout);
+        }
+
+    private:
+        Fanout_server& server_;
+        vector<char> pending_;
+    };
+}
+
+
+struct Fanout_server::pImpl
+{
+    NetworkInitializer network_initializer_;
+    mutable QMutex mutex_;
+    string error_message_;
+    bool quit_;
+    payload_t payload_;
+    size_t max_clients_;
+    size_t queue_packets_;
+    size_t evicted_clients_;
+    uint32_t frame_sequence_;
+    string bind_address_;
+
+    socket_t listen_socket_;
+    socket_t wakeup_socket_;
+    bool is_wakeup_pending_;
+
+    // 追加と削除はサーバのスレッドでのみ、mutex_ をロックして行う
+    vector<client_t*> clients_;
+
+    // 送信し終えたパケット。次のスキャンの送信で領域ごと使い回す
+    vector<packet_t*> free_packets_;
+
+    Raw_stream raw_stream_;
+
+
+    pImpl(Fanout_server& server)
+        : error_message_("not listening."), quit_(false),
+          payload_(Scan_frame), max_clients_(Default_max_clients),
+          queue_packets_(Default_queue_packets), evicted_clients_(0),
+          frame_sequence_(0), bind_address_("127.0.0.1"),
+          listen_socket_(Invalid_socket),
+          wakeup_socket_(Invalid_socket), is_wakeup_pending_(false),
+          raw_stream_(server)
+    {
+    }
+
+
+    ~pImpl(void)
+    {
+        close();
+        for (vector<packet_t*>::iterator it = free_packets_.begin();
+             it != free_packets_.end(); ++it) {
+            delete *it;
+        }
+    }
+
+
+    bool listen(long port)
+    {
+        close();
+
+        unsigned long bind_address = inet_addr(bind_address_.c_str());
+        if ((bind_address == INADDR_NONE) &&
+            (bind_address_ != "255.255.255.255")) {
+            error_message_ = "invalid bind address: " + bind_address_;
+            return false;
+        }
+
+        listen_socket_ = socket(AF_INET, SOCK_STREAM, 0);
+        if (listen_socket_ == Invalid_socket) {
+            error_message_ = socket_error_message("socket()");
+            return false;
+        }
+
+        int on = 1;
+        setsockopt(listen_socket_, SOL_SOCKET, SO_REUSEADDR,
+                   reinterpret_cast<const char*>(&on), sizeof(on));
+
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = bind_address;
+        address.sin_port = htons(static_cast<unsigned short>(port));
+        if (bind(listen_socket_, reinterpret_cast<struct sockaddr*>(&address),
+                 sizeof(address)) != 0) {
+            error_message_ = socket_error_message("bind()");
+            close();
+            return false;
+        }
+        if (::listen(listen_socket_, Listen_backlog) != 0) {
+            error_message_ = socket_error_message("listen()");
+            close();
+            return false;
+        }
+        set_nonblock_mode(listen_socket_);
+
+        if (!open_wakeup_socket()) {
+            close();
+            return false;
+        }
+
+        error_message_ = "no error.";
+        return true;
+    }
+
+
+    // 自分自身に接続した UDP のソケットで、select() の待機を解除する
+    bool open_wakeup_socket(void)
+    {
+        wakeup_socket_ = socket(AF_INET, SOCK_DGRAM, 0);
+        if (wakeup_socket_ == Invalid_socket) {
+            error_message_ = socket_error_message("socket()");
+            return false;
+        }
+
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = 0;
+        socklen_t address_size = sizeof(address);
+        struct sockaddr* p = reinterpret_cast<struct sockaddr*>(&address);
+        if ((bind(wakeup_socket_, p, sizeof(address)) != 0) ||
+            (getsockname(wakeup_socket_, p, &address_size) != 0) ||
+            (connect(wakeup_socket_, p, sizeof(address)) != 0)) {
+            error_message_ = socket_error_message("wakeup socket");
+            return false;
+        }
+        set_nonblock_mode(wakeup_socket_);
+        return true;
+    }
+
+
+    void close(void)
+    {
+        QMutexLocker locker(&mutex_);
+
+        for (vector<client_t*>::iterator it = clients_.begin();
+             it != clients_.end(); ++it) {
+            delete_client(*it);
+        }
+        clients_.clear();
+
+        if (listen_socket_ != Invalid_socket) {
+            close_socket(listen_socket_);
+            listen_socket_ = Invalid_socket;
+        }
+        if (wakeup_socket_ != Invalid_socket) {
+            close_socket(wakeup_socket_);
+            wakeup_socket_ = Invalid_socket;
+        }
+        is_wakeup_pending_ = false;
+    }
+
+
+    // mutex_ をロックして呼び出す
+    void wakeup(void)
+    {
+        if (is_wakeup_pending_ || (wakeup_socket_ == Invalid_socket)) {
+            return;
+        }
+        is_wakeup_pending_ = true;
+        char ch = 0;
+        send(wakeup_socket_, &ch, 1, 0);
+    }
+
+
+    // 使い回すパケットを取り出す。data は前回の領域を保持している
+    packet_t* new_packet(void)
+    {
+        QMutexLocker locker(&mutex_);
+        if (free_packets_.empty()) {
+            return new packet_t;
+        }
+        packet_t* packet = free_packets_.back();
+        free_packets_.pop_back();
+        return packet;
+    }
+
+
+    // mutex_ をロックして呼び出す
+    void recycle(packet_t* packet)
+    {
+        // 送信中のパケットは、いずれかのキューに queue_packets_ 個までしかない
+        if (free_packets_.size() > queue_packets_) {
+            delete packet;
+            return;
+        }
+        free_packets_.push_back(packet);
+    }
+
+
+    // mutex_ をロックして呼び出す
+    void release(packet_t* packet)
+    {
+        if (--packet->references == 0) {
+            recycle(packet);
+        }
+    }
+
+
+    // mutex_ をロックして呼び出す
+    void delete_client(client_t* client)
+    {
+        close_socket(client->socket);
+        for (size_t i = 0; i < client->queue->size(); ++i) {
+            release(client->queue->at(i));
+        }
+        delete client->queue;
+        delete client;
+    }
+
+
+    bool has_clients(void) const
+    {
+        QMutexLocker locker(&mutex_);
+        return !clients_.empty();
+    }
+
+
+    // データは複製せず、全てのクライアントのキューで共有する
+    void enqueue(packet_t* packet)
+    {
+        QMutexLocker locker(&mutex_);
+
+        packet->references = 0;
+        for (vector<client_t*>::iterator it = clients_.begin();
+             it != clients_.end(); ++it) {
+            client_t* client = *it;
+            if (client->is_evicted || client->is_closed) {
+                continue;
+            }
+            if (client->queue->full()) {
+                // 受信の遅いクライアントは切断する
+                client->is_evicted = true;
+                continue;
+            }
+            client->queue->push_back(packet);
+            ++packet->references;
+        }
+
+        if (packet->references == 0) {
+            recycle(packet);
+        }
+        wakeup();
+    }
+
+
+    void publish(const char* data, size_t data_size)
+    {
+        if ((data_size == 0) || !has_clients()) {
+            return;
+        }
+
+        packet_t* packet = new_packet();
+        packet->data.assign(data, data + data_size);
+        enqueue(packet);
+    }
+
+
+    template <class Distance, class Intensity>
+    void push_scan(Lidar::measurement_t type,
+                   Distance distance, size_t distance_size,
+                   Intensity intensity, size_t intensity_size,
+                   long timestamp)
+    {
+        mutex_.lock();
+        bool is_frame = (payload_ == Scan_frame) && !clients_.empty();
+        uint32_t sequence = frame_sequence_++;
+        mutex_.unlock();
+        if (!is_frame) {
+            return;
+        }
+
+        size_t frame_size = Frame_header_size +
+            (4 * distance_size) + (2 * intensity_size);
+
+        packet_t* packet = new_packet();
+        packet->data.resize(frame_size);
+        char* p = &packet->data[0];
+        memcpy(p, Frame_magic, 4);
+        set_uint32(&p[4], static_cast<uint32_t>(frame_size));
+        set_uint32(&p[8], sequence);
+        set_uint32(&p[12], static_cast<uint32_t>(type));
+        set_uint32(&p[16], static_cast<uint32_t>(timestamp));
+        set_uint32(&p[20], static_cast<uint32_t>(distance_size));
+        set_uint32(&p[24], static_cast<uint32_t>(intensity_size));
+        p += Frame_header_size;
+        for (size_t i = 0; i < distance_size; ++i, p += 4) {
+            set_uint32(p, static_cast<uint32_t>(distance[i]));
+        }
+        for (size_t i = 0; i < intensity_size; ++i, p += 2) {
+            set_uint16(p, intensity[i]);
+        }
+        enqueue(packet);
+    }
+
+
+    void serve_thread(void)
+    {
+        while (true) {
+            fd_set read_fds;
+            fd_set write_fds;
+            FD_ZERO(&read_fds);
+            FD_ZERO(&write_fds);
+            socket_t max_socket;
+            {
+                QMutexLocker locker(&mutex_);
+                if (quit_ || (listen_socket_ == Invalid_socket)) {
+                    break;
+                }
+                max_socket = max(listen_socket_, wakeup_socket_);
+                remove_clients();
+
+                FD_SET(listen_socket_, &read_fds);
+                FD_SET(wakeup_socket_, &read_fds);
+                for (vector<client_t*>::iterator it = clients_.begin();
+                     it != clients_.end(); ++it) {
+                    client_t* client = *it;
+                    FD_SET(client->socket, &read_fds);
+                    if (!client->queue->empty()) {
+                        FD_SET(client->socket, &write_fds);
+                    }
+                    max_socket = max(max_socket, client->socket);
+                }
+            }
+
+            struct timeval tv = { 0, Select_timeout_msec * 1000 };
+            int n = select(static_cast<int>(max_socket + 1),
+                           &read_fds, &write_fds, NULL, &tv);
+            if (n <= 0) {
+                continue;
+            }
+
+            if (FD_ISSET(wakeup_socket_, &read_fds)) {
+                drain_wakeup();
+            }
+            if (FD_ISSET(listen_socket_, &read_fds)) {
+                accept_client();
+            }
+
+            // clients_ はこのスレッドでのみ変更するため、ロックせずに走査できる
+            for (vector<client_t*>::iterator it = clients_.begin();
+                 it != clients_.end(); ++it) {
+                client_t* client = *it;
+                if (FD_ISSET(client->socket, &read_fds)) {
+                    discard_received(client);
+                }
+                if (FD_ISSET(client->socket, &write_fds)) {
+                    send_queue(client);
+                }
+            }
+        }
+        close();
+    }
+
+
+    void drain_wakeup(void)
+    {
+        QMutexLocker locker(&mutex_);
+        char buffer[Receive_buffer_size];
+        while (recv(wakeup_socket_, buffer, sizeof(buffer), 0) > 0) {
+            ;
+        }
+        is_wakeup_pending_ = false;
+    }
+
+
+    void accept_client(void)
+    {
+        socket_t socket = accept(listen_socket_, NULL, NULL);
+        if (socket == Invalid_socket) {
+            return;
+        }
+
+        QMutexLocker locker(&mutex_);
+        if (clients_.size() >= max_clients_) {
+            close_socket(socket);
+            return;
+        }
+
+        set_nonblock_mode(socket);
+        int on = 1;
+        setsockopt(socket, IPPROTO_TCP, TCP_NODELAY,
+                   reinterpret_cast<const char*>(&on), sizeof(on));
+#if defined(SO_NOSIGPIPE)
+        setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+        client_t* client = new client_t;
+        client->socket = socket;
+        client->queue = new Packet_queue(queue_packets_);
+        client->sent_size = 0;
+        client->is_evicted = false;
+        client->is_closed = false;
+        clients_.push_back(client);
+    }
+
+
+    // クライアントからの受信データは読み捨てる
+    void discard_received(client_t* client)
+    {
+        char buffer[Receive_buffer_size];
+        int n = recv(client->socket, buffer, sizeof(buffer), 0);
+        if ((n == 0) || ((n < 0) && !is_would_block())) {
+            QMutexLocker locker(&mutex_);
+            client->is_closed = true;
+        }
+    }
+
+
+    void send_queue(client_t* client)
+    {
+        while (true) {
+            packet_t* packet;
+            {
+                QMutexLocker locker(&mutex_);
+                if (client->is_evicted || client->is_closed ||
+                    client->queue->empty()) {
+                    return;
+                }
+                packet = client->queue->front();
+            }
+
+            // packet は queue に残っている間は解放されない
+            size_t left_size = packet->data.size() - client->sent_size;
+            int n = send(client->socket, &packet->data[client->sent_size],
+                         static_cast<int>(left_size), Send_flags);
+            if (n < 0) {
+                if (!is_would_block()) {
+                    QMutexLocker locker(&mutex_);
+                    client->is_closed = true;
+                }
+                return;
+            }
+
+            client->sent_size += n;
+            if (client->sent_size < packet->data.size()) {
+                // 送信バッファが一杯
+                return;
+            }
+
+            QMutexLocker locker(&mutex_);
+            client->queue->pop_front();
+            client->sent_size = 0;
+            release(packet);
+        }
+    }
+
+
+    // mutex_ をロックして呼び出す
+    void remove_clients(void)
+    {
+        vector<client_t*>::iterator it = clients_.begin();
+        while (it != clients_.end()) {
+            client_t* client = *it;
+            if (client->is_evicted || client->is_closed) {
+                if (client->is_evicted) {
+                    ++evicted_clients_;
+                }
+                delete_client(client);
+                it = clients_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+};
+
+
+Fanout_server::Fanout_server(void) : pimpl(new pImpl(*this))
+{
+}
+
+
+Fanout_server::~Fanout_server(void)
+{
+    stop();
+    wait();
+}
+
+
+string Fanout_server::what(void) const
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    return pimpl->error_message_;
+}
+
+
+void Fanout_server::set_bind_address(const string& address)
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    pimpl->bind_address_ = address;
+}
+
+
+string Fanout_server::bind_address(void) const
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    return pimpl->bind_address_;
+}
+
+
+bool Fanout_server::listen(long port)
+{
+    return pimpl->listen(port);
+}
+
+
+bool Fanout_server::is_listening(void) const
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    return (pimpl->listen_socket_ != Invalid_socket) ? true : false;
+}
+
+
+void Fanout_server::set_payload(payload_t payload)
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    pimpl->payload_ = payload;
+}
+
+
+Fanout_server::payload_t Fanout_server::payload(void) const
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    return pimpl->payload_;
+}
+
+
+void Fanout_server::set_max_clients(size_t clients)
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    pimpl->max_clients_ = max(clients, static_cast<size_t>(1));
+}
+
+
+void Fanout_server::set_queue_packets(size_t packets)
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    pimpl->queue_packets_ = max(packets, static_cast<size_t>(1));
+}
+
+
+size_t Fanout_server::clients(void) const
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    return pimpl->clients_.size();
+}
+
+
+size_t Fanout_server::evicted_clients(void) const
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    return pimpl->evicted_clients_;
+}
+
+
+void Fanout_server::publish(const char* data, size_t data_size)
+{
+    pimpl->publish(data, data_size);
+}
+
+
+void Fanout_server::push_scan(Lidar::measurement_t type,
+                              const vector<long>& distance,
+                              const vector<unsigned short>& intensity,
+                              long timestamp)
+{
+    pimpl->push_scan(type, distance.begin(), distance.size(),
+                     intensity.begin(), intensity.size(), timestamp);
+}
+
+
+void Fanout_server::push_scan(Lidar::measurement_t type,
+                              const hrk::Scan_frame& frame, long timestamp)
+{
+    size_t intensity_size = frame.has_intensity() ? frame.size() : 0;
+    pimpl->push_scan(type, frame.distance(), frame.size(),
+                     frame.intensity(), intensity_size, timestamp);
+}
+
+
+Stream* Fanout_server::raw_stream(void)
+{
+    return &pimpl->raw_stream_;
+}
+
+
+void Fanout_server::run(void)
+{
+    pimpl->mutex_.lock();
+    pimpl->quit_ = false;
+    pimpl->mutex_.unlock();
+
+    pimpl->serve_thread();
+}
+
+
+void Fanout_server::stop(void)
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    pimpl->quit_ = true;
+    pimpl->wakeup();
+}
@@ -0,0 +1,120 @@
+#ifndef FANOUT_SERVER_H
+#define FANOUT_SERVER_H
+
+/*!
+  \file
+  \brief 受信データを複数の TCP クライアントに配信するサーバ
+
+  センサには 1 つの SCIP セッションしか接続できないため、受信したデータを
+  TCP で複数のクライアントに配信する。送信するデータは 1 度だけ生成し、
+  全てのクライアントの送信キューで共有する。
+
+  Scan_frame で送信するフレームは、以下の little endian の列になる。
+  - "USF1"
+  - uint32 フレーム全体の byte 数
+  - uint32 フレーム番号
+  - int32 hrk::Lidar::measurement_t
+  - int32 タイムスタンプ [msec]
+  - uint32 距離データの数, uint32 強度データの数
+  - int32 距離データ [mm], uint16 強度データ
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <QThread>
+#include "Lidar.h"
+#include "Stream.h"
+
+namespace hrk
+{
+    class Scan_frame;
+}
+
+
+class Fanout_server : public QThread
+{
+ public:
+    enum {
+        Default_port = 10941,
+        Default_max_clients = 16,
+        Default_queue_packets = 8,
+    };
+
+    //! 配信するデータ
+    typedef enum {
+        Raw_scip,   //!< Receive_recorder が受信した SCIP の応答をそのまま送信する
+        Scan_frame, //!< 受信したスキャンをフレームにして送信する
+    } payload_t;
+
+    Fanout_server(void);
+    ~Fanout_server(void);
+
+    //! 送信スレッドが書き換えるため、複製を返す
+    std::string what(void) const;
+
+    /*!
+      \brief 接続を待つアドレスを設定する
+
+      既定では同じ計算機からの接続のみ受け付ける ("127.0.0.1")。
+      他の計算機に配信するときは "0.0.0.0" やインターフェースの
+      アドレスを指定する。listen() の前に呼び出す。
+    */
+    void set_bind_address(const std::string& address);
+    std::string bind_address(void) const;
+
+    //! クライアントの接続を待つ。run() の前に呼び出す
+    bool listen(long port);
+    bool is_listening(void) const;
+
+    void set_payload(payload_t payload);
+    payload_t payload(void) const;
+
+    void set_max_clients(size_t clients);
+
+    /*!
+      \brief クライアント毎の送信キューの長さを設定する
+
+      キューが満杯のクライアントは、受信が遅れているとみなして切断する。
+      受信の遅いクライアントがセンサからの受信を止めることはない。
+    */
+    void set_queue_packets(size_t packets);
+
+    size_t clients(void) const;
+    size_t evicted_clients(void) const;
+
+    //! 全てのクライアントに data を送信する
+    void publish(const char* data, size_t data_size);
+
+    //! Scan_frame のときのみ、スキャンをフレームにして送信する
+    void push_scan(hrk::Lidar::measurement_t type,
+                   const std::vector<long>& distance,
+                   const std::vector<unsigned short>& intensity,
+                   long timestamp);
+    void push_scan(hrk::Lidar::measurement_t type,
+                   const hrk::Scan_frame& frame, long timestamp);
+
+    /*!
+      \brief Raw_scip のときに SCIP の応答を送信する Stream
+
+      write() されたデータを SCIP の応答の終端 (LF LF) までまとめて送信する。
+      Receive_recorder::set_mirror() に渡して使う。
+    */
+    hrk::Stream* raw_stream(void);
+
+    void run(void);
+    void stop(void);
+
+ private:
+    Fanout_server(const Fanout_server& rhs);
+    Fanout_server& operator = (const Fanout_server& rhs);
+
+    struct pImpl;
+    std::auto_ptr<pImpl> pimpl;
+};
+
+#endif
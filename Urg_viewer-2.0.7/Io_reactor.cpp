@@ -0,0 +1,172 @@
+/*!
+  \file
+  \brief 受信待ち (Linux, Mac)
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include "detect_os.h"
+#include <unistd.h>
+#include <cerrno>
+#include <time.h>
+#include <sys/time.h>
+#if defined(LINUX_OS)
+#include <sys/epoll.h>
+#else
+#include <sys/select.h>
+#endif
+#include "Io_reactor.h"
+
+using namespace hrk;
+
+
+namespace
+{
+    enum {
+        Invalid_fd = -1,
+        No_deadline = -1,
+    };
+
+
+    long ticks_msec(void)
+    {
+#if defined(CLOCK_MONOTONIC)
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+#else
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        return (tv.tv_sec * 1000) + (tv.tv_usec / 1000);
+#endif
+    }
+}
+
+
+struct Io_reactor::pImpl
+{
+    int fd_;
+    int epoll_fd_;
+    long deadline_;
+
+
+    pImpl(void) : fd_(Invalid_fd), epoll_fd_(Invalid_fd),
+                  deadline_(No_deadline)
+    {
+    }
+
+
+    ~pImpl(void)
+    {
+        close();
+    }
+
+
+    bool open(int fd)
+    {
+        close();
+
+#if defined(LINUX_OS)
+        epoll_fd_ = epoll_create(1);
+        if (epoll_fd_ < 0) {
+            epoll_fd_ = Invalid_fd;
+            return false;
+        }
+
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+            close();
+            return false;
+        }
+#endif
+        fd_ = fd;
+        return true;
+    }
+
+
+    void close(void)
+    {
+        if (epoll_fd_ != Invalid_fd) {
+            ::close(epoll_fd_);
+            epoll_fd_ = Invalid_fd;
+        }
+        fd_ = Invalid_fd;
+    }
+
+
+    bool wait(int timeout)
+    {
+        if (fd_ == Invalid_fd) {
+            return false;
+        }
+
+#if defined(LINUX_OS)
+        struct epoll_event event;
+        int n;
+        do {
+            n = epoll_wait(epoll_fd_, &event, 1, timeout);
+        } while ((n < 0) && (errno == EINTR));
+        return (n > 0) ? true : false;
+#else
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(fd_, &rfds);
+
+        struct timeval tv;
+        tv.tv_sec = timeout / 1000;
+        tv.tv_usec = (timeout % 1000) * 1000;
+        return (select(fd_ + 1, &rfds, NULL, NULL,
+                       (timeout < 0) ? NULL : &tv) > 0) ? true : false;
+#endif
+    }
+};
+
+
+Io_reactor::Io_reactor(void) : pimpl(new pImpl)
+{
+}
+
+
+Io_reactor::~Io_reactor(void)
+{
+}
+
+
+bool Io_reactor::open(int fd)
+{
+    return pimpl->open(fd);
+}
+
+
+void Io_reactor::close(void)
+{
+    pimpl->close();
+}
+
+
+void Io_reactor::set_timeout(int timeout)
+{
+    pimpl->deadline_ = (timeout < 0) ?
+        static_cast<long>(No_deadline) : ticks_msec() + timeout;
+}
+
+
+bool Io_reactor::wait(void)
+{
+    if (pimpl->deadline_ == No_deadline) {
+        return pimpl->wait(-1);
+    }
+
+    long left = pimpl->deadline_ - ticks_msec();
+    return pimpl->wait((left > 0) ? static_cast<int>(left) : 0);
+}
+
+
+bool Io_reactor::wait(int timeout)
+{
+    return pimpl->wait(timeout);
+}
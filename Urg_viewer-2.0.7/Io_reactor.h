@@ -0,0 +1,75 @@
+#ifndef HRK_IO_REACTOR_H
+#define HRK_IO_REACTOR_H
+
+/*!
+  \file
+  \brief 受信待ち (Linux, Mac)
+
+  ディスクリプタは open() で一度だけ登録し、受信待ちの度に登録し直さない。
+  Linux では epoll、それ以外では select() で待つ。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <memory>
+
+
+namespace hrk
+{
+    //! 受信待ち
+    class Io_reactor
+    {
+    public:
+        Io_reactor(void);
+        ~Io_reactor(void);
+
+        /*!
+          \brief ディスクリプタの登録
+
+          \param[in] fd 受信を待つディスクリプタ
+
+          \retval true 成功
+          \retval false エラー
+        */
+        bool open(int fd);
+
+        //! 登録の解除。ディスクリプタは close しない
+        void close(void);
+
+        /*!
+          \brief 受信を待つ期限の設定
+
+          \param[in] timeout 現在からの待ち時間 [msec]。負のときは無限に待つ
+        */
+        void set_timeout(int timeout);
+
+        /*!
+          \brief set_timeout() の期限まで受信を待つ
+
+          \retval true 受信データがある
+          \retval false 期限を過ぎた
+        */
+        bool wait(void);
+
+        /*!
+          \brief 受信を待つ
+
+          \param[in] timeout 待ち時間 [msec]。負のときは無限に待つ
+
+          \retval true 受信データがある
+          \retval false タイムアウト
+        */
+        bool wait(int timeout);
+
+    private:
+        Io_reactor(const Io_reactor& rhs);
+        Io_reactor& operator = (const Io_reactor& rhs);
+
+        struct pImpl;
+        std::auto_ptr<pImpl> pimpl;
+    };
+}
+
+#endif
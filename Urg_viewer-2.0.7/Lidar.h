@@ -54,18 +54,27 @@ namespace hrk
 
         virtual bool start_measurement(measurement_t type,
                                        int scan_times, int skip_scan) = 0;
+        /*!
+          time_stamp にはセンサのタイムスタンプ [msec]、arrival_time には
+          スキャンの先頭のデータが届いた UNIX 時刻 [nsec] を格納する。
+          到着時刻を計測していない接続では arrival_time は 0 になる。
+        */
         virtual bool get_distance(std::vector<long>& data,
-                                  long *time_stamp) = 0;
+                                  long *time_stamp,
+                                  long long* arrival_time) = 0;
         virtual bool get_distance_intensity(std::vector<long>& data,
                                             std::vector<unsigned short>&
                                             intensity,
-                                            long *time_stamp) = 0;
+                                            long *time_stamp,
+                                            long long* arrival_time) = 0;
         virtual bool get_multiecho(std::vector<long>& data_multi,
-                                   long* time_stamp) = 0;
+                                   long* time_stamp,
+                                   long long* arrival_time) = 0;
         virtual bool get_multiecho_intensity(std::vector<long>& data_multiecho,
                                              std::vector<unsigned short>&
                                              intensity_multiecho,
-                                             long* time_stamp) = 0;
+                                             long* time_stamp,
+                                             long long* arrival_time) = 0;
         virtual bool set_scanning_parameter(int first_step, int last_step,
                                             int skip_step) = 0;
         virtual void stop_measurement(void) = 0;
@@ -0,0 +1,1074 @@
+/*!
+  \file
+  \brief OSC 送信用のスレッド
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cmath>
+#include <cstring>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QTime>
+#include "osc/OscOutboundPacketStream.h"
+#include "ip/UdpSocket.h"
+#include "Osc_publisher.h"
+#include "Scan_setting.h"
+#include "Scan_frame.h"
+
+using namespace hrk;
+using namespace std;
+
+
+namespace
+{
+    enum {
+        // Ethernet の MTU (1500) から IP, UDP ヘッダを除いた大きさ
+        Max_datagram_size = 1500 - 20 - 8,
+        // IPv4 の UDP で送信できる最大の大きさ
+        Max_blob_datagram_size = 65535 - 20 - 8,
+
+        // "#bundle" + time tag
+        Bundle_header_size = 8 + 8,
+        // size + "/scan/frame" + ",iiii" + 4 * int32
+        Frame_element_size = 4 + 12 + 8 + 16,
+        // size + "/xy" + ",ffi" + 2 * float32 + int32
+        Xy_element_size = 4 + 4 + 8 + 12,
+        Points_per_bundle = (Max_datagram_size - Bundle_header_size -
+                             Frame_element_size) / Xy_element_size,
+
+        // "/scan" + ",iiiib" + 4 * int32 + blob size
+        Blob_message_header_size = 8 + 8 + 16 + 4,
+        Blob_point_size = 4 + 4 + 4,
+
+        // TUIO の 1 bundle に格納する /tuio/2Dcur set の数
+        Tuio_cursors_per_bundle = 16,
+
+        // size + "/tracks/frame" + ",iiii" + 4 * int32
+        Tracks_frame_element_size = 4 + 16 + 8 + 16,
+        // size + "/track" + ",iffff" + int32 + 4 * float32
+        Track_element_size = 4 + 8 + 8 + 20,
+        Tracks_per_bundle = (Max_datagram_size - Bundle_header_size -
+                             Tracks_frame_element_size) / Track_element_size,
+        Points_per_blob = (Max_blob_datagram_size -
+                           Blob_message_header_size) / Blob_point_size,
+
+        // "/scan/delta" + ",b" + blob size
+        Delta_message_header_size = 12 + 4 + 4,
+        Max_delta_size = Max_blob_datagram_size - Delta_message_header_size,
+    };
+
+
+    typedef struct
+    {
+        Lidar::measurement_t type;
+        long timestamp;
+        long sequence;
+        int received_msec;
+        vector<long> distance;
+        vector<unsigned short> intensity;
+    } scan_t;
+
+
+    void swap_scan(scan_t& a, scan_t& b)
+    {
+        swap(a.type, b.type);
+        swap(a.timestamp, b.timestamp);
+        swap(a.sequence, b.sequence);
+        swap(a.received_msec, b.received_msec);
+        a.distance.swap(b.distance);
+        a.intensity.swap(b.intensity);
+    }
+
+
+    // OSC の blob 内の値もビッグエンディアンで格納する
+    char* store_int(char* p, unsigned int bits)
+    {
+        *p++ = static_cast<char>(bits >> 24);
+        *p++ = static_cast<char>(bits >> 16);
+        *p++ = static_cast<char>(bits >> 8);
+        *p++ = static_cast<char>(bits);
+        return p;
+    }
+
+
+    char* store_float(char* p, float value)
+    {
+        unsigned int bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return store_int(p, bits);
+    }
+
+
+    bool resolve_destinations(vector<Osc_publisher::destination_t>&
+                              resolved_destinations,
+                              vector<IpEndpointName>& endpoints,
+                              const vector<Osc_publisher::destination_t>&
+                              destinations)
+    {
+        bool is_resolved = true;
+        vector<Osc_publisher::destination_t>::const_iterator end_it =
+            destinations.end();
+        for (vector<Osc_publisher::destination_t>::const_iterator it =
+                 destinations.begin(); it != end_it; ++it) {
+            IpEndpointName endpoint(it->address.c_str(), it->port);
+            if ((endpoint.address == 0) || (it->port <= 0)) {
+                is_resolved = false;
+                continue;
+            }
+            resolved_destinations.push_back(*it);
+            endpoints.push_back(endpoint);
+        }
+        return is_resolved;
+    }
+}
+
+
+struct Osc_publisher::pImpl
+{
+    QMutex mutex_;
+    QWaitCondition scan_pushed_;
+    bool quit_;
+
+    // 送信待ちのスキャン。満杯のときは古いものから上書きする
+    vector<scan_t> queue_;
+    size_t queue_first_;
+    size_t queue_filled_;
+    size_t dropped_scans_;
+    long pushed_scans_;
+    QTime clock_;
+    framing_t framing_;
+    vector<destination_t> destinations_;
+    vector<destination_t> resolved_destinations_;
+    vector<IpEndpointName> endpoints_;
+    bool is_destinations_updated_;
+    vector<unsigned long> sent_packets_;
+    vector<unsigned long> error_packets_;
+    vector<Region_filter::zone_t> zones_;
+    bool is_zones_updated_;
+    bool is_zones_reported_;    //!< 送信スレッドのみが参照する
+    vector<size_t> occupancy_;
+    vector<destination_t> tuio_destinations_;
+    vector<destination_t> resolved_tuio_destinations_;
+    vector<IpEndpointName> tuio_endpoints_;
+    bool is_tuio_destinations_updated_;
+    Blob_detector::parameter_t blob_parameter_;
+    bool is_blob_parameter_updated_;
+    bool is_tracking_;
+    Target_tracker::parameter_t tracker_parameter_;
+    bool is_tracker_parameter_updated_;
+    Scan_delta_encoder::parameter_t delta_parameter_;
+    bool is_delta_parameter_updated_;
+
+    Scan_setting setting_;
+    bool is_setting_updated_;
+    bool is_sensor_open_;
+    vector<double> step_radians_;
+    long scan_usec_;
+    long min_distance_;
+    int max_echo_size_;
+
+    // スレッド側でのみ参照する
+    Scan_setting current_setting_;
+    bool current_is_sensor_open_;
+    long current_scan_usec_;
+    int current_echo_size_;
+    long current_min_distance_;
+    vector<double> step_cos_;
+    vector<double> step_sin_;
+    framing_t current_framing_;
+    vector<IpEndpointName> current_endpoints_;
+    vector<IpEndpointName> current_tuio_endpoints_;
+    vector<unsigned long> current_sent_packets_;
+    vector<unsigned long> current_error_packets_;
+    Region_filter region_filter_;
+    vector<float> xs_;
+    vector<float> ys_;
+    vector<int> tags_;
+    Blob_detector blob_detector_;
+    vector<float> blob_xs_;
+    vector<float> blob_ys_;
+    vector<int> blob_steps_;
+    bool current_is_tracking_;
+    Target_tracker tracker_;
+    vector<float> track_xs_;
+    vector<float> track_ys_;
+    vector<char> blob_buffer_;
+    Scan_delta_encoder delta_encoder_;
+    vector<char> delta_buffer_;
+
+    // 1 スキャン分のパケットを連続した領域に格納し、まとめて送信する
+    vector<char> packet_buffer_;
+    size_t packet_buffer_used_;
+    vector<size_t> packet_offsets_;
+    vector<size_t> packet_sizes_;
+    vector<const char*> packet_data_;
+    UdpSocket socket_;
+
+
+    pImpl(void)
+        : quit_(false),
+          queue_(Default_queue_scans), queue_first_(0), queue_filled_(0),
+          dropped_scans_(0), pushed_scans_(0), framing_(Point_message),
+          is_destinations_updated_(false),
+          zones_(Region_filter::default_zones()), is_zones_updated_(false),
+          is_zones_reported_(false),
+          is_tuio_destinations_updated_(false),
+          blob_parameter_(Blob_detector::default_parameter()),
+          is_blob_parameter_updated_(false), is_tracking_(false),
+          tracker_parameter_(Target_tracker::default_parameter()),
+          is_tracker_parameter_updated_(false),
+          delta_parameter_(Scan_delta_encoder::default_parameter()),
+          is_delta_parameter_updated_(false),
+          is_setting_updated_(true), is_sensor_open_(false), scan_usec_(0),
+          min_distance_(0), max_echo_size_(1),
+          current_is_sensor_open_(false), current_scan_usec_(0),
+          current_echo_size_(1), current_min_distance_(0),
+          current_framing_(Point_message), current_is_tracking_(false),
+          blob_buffer_(Points_per_blob * Blob_point_size),
+          packet_buffer_(Max_blob_datagram_size), packet_buffer_used_(0)
+    {
+        setting_.first_step = 0;
+        setting_.last_step = 0;
+        setting_.group_steps = 1;
+        setting_.with_intensity = false;
+        setting_.is_multiecho = false;
+        current_setting_ = setting_;
+        clock_.start();
+    }
+
+
+    template <class Distance, class Intensity>
+    void push_scan(Lidar::measurement_t type,
+                   Distance distance_first, Distance distance_last,
+                   Intensity intensity_first, Intensity intensity_last,
+                   long timestamp)
+    {
+        QMutexLocker locker(&mutex_);
+
+        if (queue_filled_ >= queue_.size()) {
+            // 最も古いスキャンを破棄する
+            queue_first_ = (queue_first_ + 1) % queue_.size();
+            --queue_filled_;
+            ++dropped_scans_;
+        }
+
+        // 確保済みの領域を使い回すため、assign() で複製する
+        size_t last = (queue_first_ + queue_filled_) % queue_.size();
+        scan_t& scan = queue_[last];
+        scan.type = type;
+        scan.timestamp = timestamp;
+        scan.sequence = pushed_scans_++;
+        scan.received_msec = clock_.elapsed();
+        scan.distance.assign(distance_first, distance_last);
+        scan.intensity.assign(intensity_first, intensity_last);
+        ++queue_filled_;
+
+        scan_pushed_.wakeOne();
+    }
+
+
+    bool pop_scan(scan_t& scan)
+    {
+        QMutexLocker locker(&mutex_);
+
+        while (!quit_ && (queue_filled_ == 0)) {
+            scan_pushed_.wait(&mutex_);
+        }
+        if (quit_) {
+            return false;
+        }
+
+        swap_scan(scan, queue_[queue_first_]);
+        queue_first_ = (queue_first_ + 1) % queue_.size();
+        --queue_filled_;
+
+        if ((current_framing_ != framing_) && (framing_ == Scan_delta)) {
+            delta_encoder_.request_keyframe();
+        }
+        current_framing_ = framing_;
+
+        if (is_delta_parameter_updated_) {
+            is_delta_parameter_updated_ = false;
+            delta_encoder_.set_parameter(delta_parameter_);
+        }
+
+        if (current_is_tracking_ != is_tracking_) {
+            current_is_tracking_ = is_tracking_;
+            tracker_.clear();
+        }
+
+        if (is_tracker_parameter_updated_) {
+            is_tracker_parameter_updated_ = false;
+            tracker_.set_parameter(tracker_parameter_);
+        }
+
+        if (is_destinations_updated_) {
+            is_destinations_updated_ = false;
+            current_endpoints_ = endpoints_;
+        }
+
+        if (is_zones_updated_) {
+            is_zones_updated_ = false;
+            region_filter_.set_zones(zones_);
+            // 既定の領域では /scan/zones を送信せず、従来の出力を保つ
+            is_zones_reported_ = !zones_.empty();
+        }
+
+        if (is_tuio_destinations_updated_) {
+            is_tuio_destinations_updated_ = false;
+            current_tuio_endpoints_ = tuio_endpoints_;
+        }
+
+        if (is_blob_parameter_updated_) {
+            is_blob_parameter_updated_ = false;
+            blob_detector_.set_parameter(blob_parameter_);
+        }
+
+        if (is_setting_updated_) {
+            is_setting_updated_ = false;
+            current_setting_ = setting_;
+            current_is_sensor_open_ = is_sensor_open_;
+            current_scan_usec_ = scan_usec_;
+            current_echo_size_ =
+                current_setting_.is_multiecho ? max(1, max_echo_size_) : 1;
+            current_min_distance_ = min_distance_;
+            update_step_table();
+            delta_encoder_.request_keyframe();
+        }
+        return true;
+    }
+
+
+    // mutex_ をロックして呼び出す
+    void update_step_table(void)
+    {
+        // ステップ毎の角度を計算しておき、スキャン毎の cos(), sin() を省く
+        size_t n = step_radians_.size();
+        step_cos_.resize(n);
+        step_sin_.resize(n);
+        for (size_t step = 0; step < n; ++step) {
+            const double radian = step_radians_[step] + (M_PI / 2.0);
+            step_cos_[step] = cos(radian);
+            step_sin_[step] = sin(radian);
+        }
+    }
+
+
+    void publish_thread(void)
+    {
+        scan_t scan = scan_t();
+        while (pop_scan(scan)) {
+            publish(scan);
+        }
+    }
+
+
+    void publish(const scan_t& scan)
+    {
+        if (!current_is_sensor_open_ || step_cos_.empty() ||
+            (current_endpoints_.empty() && current_tuio_endpoints_.empty())) {
+            return;
+        }
+
+        // Lidar::step2rad() と同じく、範囲外のステップは最後のステップにする
+        int grouping_add_size = max(1, current_setting_.group_steps);
+        int n = scan.distance.size();
+        int echo_size = current_echo_size_;
+        int last_step = static_cast<int>(step_cos_.size()) - 1;
+
+        // 点毎に、ステップとエコーの番号を (step * echo_size + echo) で記録する
+        xs_.clear();
+        ys_.clear();
+        tags_.clear();
+        for (int index = 0; index < n; ++index) {
+            long distance = scan.distance[index];
+            if (distance <= current_min_distance_) {
+                continue;
+            }
+
+            for (int i = 0; i < grouping_add_size; ++i) {
+                int step = (grouping_add_size * (index / echo_size)) + i;
+                int table_step = min(step, last_step);
+                xs_.push_back(distance * step_cos_[table_step]);
+                ys_.push_back(distance * step_sin_[table_step]);
+                tags_.push_back((step * echo_size) + (index % echo_size));
+            }
+        }
+        region_filter_.filter(xs_, ys_, tags_);
+
+        mutex_.lock();
+        occupancy_ = region_filter_.occupancy();
+        mutex_.unlock();
+
+        bool is_tracking = current_is_tracking_ && !current_endpoints_.empty();
+        if (!current_tuio_endpoints_.empty() || is_tracking) {
+            detect_blobs(scan);
+        }
+        if (is_tracking) {
+            update_tracks(scan);
+        }
+
+        if (!current_tuio_endpoints_.empty()) {
+            clear_packets();
+            pack_tuio_bundles();
+            send_packets(current_tuio_endpoints_, false);
+        }
+
+        if (current_endpoints_.empty()) {
+            return;
+        }
+        clear_packets();
+        if (is_zones_reported_) {
+            pack_zones(scan);
+        }
+        if (is_tracking) {
+            pack_tracks(scan);
+        }
+        switch (current_framing_) {
+        case Point_message:
+            pack_point_messages();
+            break;
+
+        case Scan_bundle:
+            pack_scan_bundles(scan);
+            break;
+
+        case Scan_blob:
+            pack_scan_blobs(scan);
+            break;
+
+        case Scan_delta:
+            pack_scan_delta(scan);
+            break;
+        }
+        send_packets(current_endpoints_, true);
+    }
+
+
+    void detect_blobs(const scan_t& scan)
+    {
+        // 最初のエコーの点のみで blob を検出する
+        int echo_size = current_echo_size_;
+        blob_xs_.clear();
+        blob_ys_.clear();
+        blob_steps_.clear();
+        size_t n = tags_.size();
+        for (size_t i = 0; i < n; ++i) {
+            if ((tags_[i] % echo_size) != 0) {
+                continue;
+            }
+            blob_xs_.push_back(xs_[i]);
+            blob_ys_.push_back(ys_[i]);
+            blob_steps_.push_back(tags_[i] / echo_size);
+        }
+
+        size_t points = blob_xs_.size();
+        if (points == 0) {
+            blob_detector_.detect(NULL, NULL, NULL, 0, scan.timestamp);
+        } else {
+            blob_detector_.detect(&blob_xs_[0], &blob_ys_[0], &blob_steps_[0],
+                                  points, scan.timestamp);
+        }
+    }
+
+
+    void clear_packets(void)
+    {
+        packet_buffer_used_ = 0;
+        packet_offsets_.clear();
+        packet_sizes_.clear();
+    }
+
+
+    char* begin_packet(size_t max_size)
+    {
+        // 領域は次のスキャンでも使い回すため、縮小はしない
+        if (packet_buffer_.size() < packet_buffer_used_ + max_size) {
+            packet_buffer_.resize(2 * (packet_buffer_used_ + max_size));
+        }
+        return &packet_buffer_[packet_buffer_used_];
+    }
+
+
+    void end_packet(const osc::OutboundPacketStream& p)
+    {
+        packet_offsets_.push_back(packet_buffer_used_);
+        packet_sizes_.push_back(p.Size());
+
+        // 後続のパケットも 4 byte 境界から格納する
+        packet_buffer_used_ += (p.Size() + 3) & ~3;
+    }
+
+
+    void update_tracks(const scan_t& scan)
+    {
+        const vector<Blob_detector::cursor_t>& cursors =
+            blob_detector_.cursors();
+        size_t n = cursors.size();
+        track_xs_.resize(n);
+        track_ys_.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            track_xs_[i] = cursors[i].x_mm;
+            track_ys_[i] = cursors[i].y_mm;
+        }
+
+        // 遅延時間は、スキャンの中央の計測からデータの受信までの時間と
+        // 受信から送信までの時間の和とする
+        long latency_msec = (current_scan_usec_ / 2 / 1000) +
+            (clock_.elapsed() - scan.received_msec);
+        if (n == 0) {
+            tracker_.update(NULL, NULL, 0, scan.timestamp, latency_msec);
+        } else {
+            tracker_.update(&track_xs_[0], &track_ys_[0], n,
+                            scan.timestamp, latency_msec);
+        }
+    }
+
+
+    void send_packets(const vector<IpEndpointName>& endpoint_names,
+                      bool is_counted)
+    {
+        size_t n = packet_offsets_.size();
+        packet_data_.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            packet_data_[i] = &packet_buffer_[packet_offsets_[i]];
+        }
+
+        size_t endpoints = endpoint_names.size();
+        current_sent_packets_.assign(endpoints, 0);
+        current_error_packets_.assign(endpoints, 0);
+        if ((n > 0) && (endpoints > 0)) {
+            socket_.SendToMany(&endpoint_names[0], endpoints,
+                               &packet_data_[0], &packet_sizes_[0], n,
+                               &current_sent_packets_[0],
+                               &current_error_packets_[0]);
+        }
+        if (!is_counted) {
+            return;
+        }
+
+        QMutexLocker locker(&mutex_);
+        if (is_destinations_updated_) {
+            // 送信中に送信先が変更された
+            return;
+        }
+        for (size_t i = 0; i < endpoints; ++i) {
+            sent_packets_[i] += current_sent_packets_[i];
+            error_packets_[i] += current_error_packets_[i];
+        }
+    }
+
+
+    void pack_zones(const scan_t& scan)
+    {
+        osc::OutboundPacketStream p(begin_packet(Max_blob_datagram_size),
+                                    Max_blob_datagram_size);
+
+        p << osc::BeginMessage("/scan/zones")
+          << static_cast<osc::int32>(scan.sequence);
+        const vector<Region_filter::zone_t>& zones = region_filter_.zones();
+        const vector<size_t>& occupancy = region_filter_.occupancy();
+        size_t n = zones.size();
+        for (size_t i = 0; i < n; ++i) {
+            p << zones[i].name.c_str() << static_cast<osc::int32>(occupancy[i]);
+        }
+        p << osc::EndMessage;
+
+        end_packet(p);
+    }
+
+
+    void pack_tracks(const scan_t& scan)
+    {
+        // 位置は遅延時間分だけ外挿した値を送信する
+        const vector<Target_tracker::track_t>& tracks = tracker_.tracks();
+        int confirmed = 0;
+        int n = tracks.size();
+        for (int i = 0; i < n; ++i) {
+            if (tracks[i].is_confirmed) {
+                ++confirmed;
+            }
+        }
+
+        int parts =
+            max(1, (confirmed + Tracks_per_bundle - 1) / Tracks_per_bundle);
+        int index = 0;
+        for (int part = 0; part < parts; ++part) {
+            osc::OutboundPacketStream p(begin_packet(Max_datagram_size),
+                                        Max_datagram_size);
+
+            p << osc::BeginBundleImmediate
+              << osc::BeginMessage("/tracks/frame")
+              << static_cast<osc::int32>(scan.sequence)
+              << static_cast<osc::int32>(scan.timestamp)
+              << static_cast<osc::int32>(part)
+              << static_cast<osc::int32>(parts)
+              << osc::EndMessage;
+
+            int packed = 0;
+            for (; (index < n) && (packed < Tracks_per_bundle); ++index) {
+                const Target_tracker::track_t& track = tracks[index];
+                if (!track.is_confirmed) {
+                    continue;
+                }
+                p << osc::BeginMessage("/track")
+                  << static_cast<osc::int32>(track.id)
+                  << track.predicted_x << track.predicted_y
+                  << track.velocity_x << track.velocity_y
+                  << osc::EndMessage;
+                ++packed;
+            }
+            p << osc::EndBundle;
+
+            end_packet(p);
+        }
+    }
+
+
+    void pack_tuio_bundles(void)
+    {
+        // 全ての bundle に alive と fseq を含め、set のみを分割する
+        const vector<Blob_detector::cursor_t>& cursors =
+            blob_detector_.cursors();
+        int n = cursors.size();
+        int parts = max(1, (n + Tuio_cursors_per_bundle - 1) /
+                        Tuio_cursors_per_bundle);
+        for (int part = 0; part < parts; ++part) {
+            // alive は全てのカーソルを含むため、MTU を越えることがある
+            osc::OutboundPacketStream p(begin_packet(Max_blob_datagram_size),
+                                        Max_blob_datagram_size);
+
+            p << osc::BeginBundleImmediate
+              << osc::BeginMessage("/tuio/2Dcur") << "alive";
+            for (int i = 0; i < n; ++i) {
+                p << static_cast<osc::int32>(cursors[i].id);
+            }
+            p << osc::EndMessage;
+
+            int first = part * Tuio_cursors_per_bundle;
+            int last = min(n, first + Tuio_cursors_per_bundle);
+            for (int i = first; i < last; ++i) {
+                const Blob_detector::cursor_t& cursor = cursors[i];
+                p << osc::BeginMessage("/tuio/2Dcur") << "set"
+                  << static_cast<osc::int32>(cursor.id)
+                  << cursor.x << cursor.y
+                  << cursor.velocity_x << cursor.velocity_y
+                  << cursor.acceleration
+                  << osc::EndMessage;
+            }
+
+            p << osc::BeginMessage("/tuio/2Dcur") << "fseq"
+              << static_cast<osc::int32>(blob_detector_.frame())
+              << osc::EndMessage
+              << osc::EndBundle;
+
+            end_packet(p);
+        }
+    }
+
+
+    void pack_point_messages(void)
+    {
+        size_t n = xs_.size();
+        for (size_t i = 0; i < n; ++i) {
+            osc::OutboundPacketStream p(begin_packet(Max_datagram_size),
+                                        Max_datagram_size);
+
+            p << osc::BeginBundleImmediate
+              << osc::BeginMessage("/xy") << xs_[i] << ys_[i]
+              << osc::EndMessage
+              << osc::EndBundle;
+
+            end_packet(p);
+        }
+    }
+
+
+    void pack_scan_bundles(const scan_t& scan)
+    {
+        // 受信側がスキャンの区切りと欠落を判定できるよう、
+        // 各 bundle の先頭に /scan/frame を格納する
+        const vector<unsigned int>& masks = region_filter_.zone_masks();
+        int points = xs_.size();
+        int parts =
+            max(1, (points + Points_per_bundle - 1) / Points_per_bundle);
+        for (int part = 0; part < parts; ++part) {
+            osc::OutboundPacketStream p(begin_packet(Max_datagram_size),
+                                        Max_datagram_size);
+
+            p << osc::BeginBundleImmediate
+              << osc::BeginMessage("/scan/frame")
+              << static_cast<osc::int32>(scan.sequence)
+              << static_cast<osc::int32>(scan.timestamp)
+              << static_cast<osc::int32>(part)
+              << static_cast<osc::int32>(parts)
+              << osc::EndMessage;
+
+            int first = part * Points_per_bundle;
+            int last = min(points, first + Points_per_bundle);
+            for (int i = first; i < last; ++i) {
+                p << osc::BeginMessage("/xy") << xs_[i] << ys_[i]
+                  << static_cast<osc::int32>(masks[i]) << osc::EndMessage;
+            }
+            p << osc::EndBundle;
+
+            end_packet(p);
+        }
+    }
+
+
+    void pack_scan_blobs(const scan_t& scan)
+    {
+        const vector<unsigned int>& masks = region_filter_.zone_masks();
+        int points = xs_.size();
+        int parts = max(1, (points + Points_per_blob - 1) / Points_per_blob);
+        for (int part = 0; part < parts; ++part) {
+            int first = part * Points_per_blob;
+            int last = min(points, first + Points_per_blob);
+
+            char* blob_p = &blob_buffer_[0];
+            for (int i = first; i < last; ++i) {
+                blob_p = store_float(blob_p, xs_[i]);
+                blob_p = store_float(blob_p, ys_[i]);
+                blob_p = store_int(blob_p, masks[i]);
+            }
+
+            osc::OutboundPacketStream p(begin_packet(Max_blob_datagram_size),
+                                        Max_blob_datagram_size);
+            p << osc::BeginMessage("/scan")
+              << static_cast<osc::int32>(scan.sequence)
+              << static_cast<osc::int32>(scan.timestamp)
+              << static_cast<osc::int32>(part)
+              << static_cast<osc::int32>(parts)
+              << osc::Blob(&blob_buffer_[0], blob_p - &blob_buffer_[0])
+              << osc::EndMessage;
+
+            end_packet(p);
+        }
+    }
+
+
+    void pack_scan_delta(const scan_t& scan)
+    {
+        // 領域による選別の前の、距離と強度をそのまま符号化する
+        delta_encoder_.encode(delta_buffer_, scan.type, scan.timestamp,
+                              current_setting_.first_step,
+                              max(1, current_setting_.group_steps),
+                              current_echo_size_,
+                              scan.distance, scan.intensity);
+        if (delta_buffer_.size() > Max_delta_size) {
+            // 1 つの datagram に収まらないスキャンは送信しない
+            delta_encoder_.request_keyframe();
+            return;
+        }
+
+        osc::OutboundPacketStream p(begin_packet(Max_blob_datagram_size),
+                                    Max_blob_datagram_size);
+        p << osc::BeginMessage("/scan/delta")
+          << osc::Blob(&delta_buffer_[0], delta_buffer_.size())
+          << osc::EndMessage;
+
+        end_packet(p);
+    }
+};
+
+
+Osc_publisher::Osc_publisher(void) : pimpl(new pImpl)
+{
+}
+
+
+Osc_publisher::~Osc_publisher(void)
+{
+    stop();
+    wait();
+}
+
+
+void Osc_publisher::set_scan_setting(const Scan_setting& setting)
+{
+    QMutexLocker locker(&pimpl->mutex_);
+
+    pimpl->setting_ = setting;
+    pimpl->is_setting_updated_ = true;
+
+    // 設定の異なるスキャンは送信しない
+    pimpl->queue_first_ = 0;
+    pimpl->queue_filled_ = 0;
+}
+
+
+void Osc_publisher::set_sensor(const hrk::Lidar& lidar)
+{
+    // lidar はロックの外で、呼び出し元のスレッドでのみ参照する
+    int steps = max(lidar.max_data_size(), 0);
+    vector<double> step_radians(steps);
+    for (int step = 0; step < steps; ++step) {
+        step_radians[step] = lidar.step2rad(step);
+    }
+    long scan_usec = lidar.scan_usec();
+    long min_distance = lidar.min_distance();
+    int max_echo_size = lidar.max_echo_size();
+    bool is_open = lidar.is_open();
+
+    QMutexLocker locker(&pimpl->mutex_);
+    pimpl->step_radians_.swap(step_radians);
+    pimpl->scan_usec_ = scan_usec;
+    pimpl->min_distance_ = min_distance;
+    pimpl->max_echo_size_ = max_echo_size;
+    pimpl->is_sensor_open_ = is_open;
+    pimpl->is_setting_updated_ = true;
+
+    pimpl->queue_first_ = 0;
+    pimpl->queue_filled_ = 0;
+}
+
+
+void Osc_publisher::close_sensor(void)
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    pimpl->is_sensor_open_ = false;
+    pimpl->is_setting_updated_ = true;
+
+    pimpl->queue_first_ = 0;
+    pimpl->queue_filled_ = 0;
+}
+
+
+void Osc_publisher::set_framing(framing_t framing)
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    pimpl->framing_ = framing;
+}
+
+
+Osc_publisher::framing_t Osc_publisher::framing(void) const
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    return pimpl->framing_;
+}
+
+
+bool Osc_publisher::set_destinations(const vector<destination_t>&
+                                     destinations)
+{
+    // 名前解決はロックの外で行う
+    vector<destination_t> resolved_destinations;
+    vector<IpEndpointName> endpoints;
+    bool is_resolved =
+        resolve_destinations(resolved_destinations, endpoints, destinations);
+
+    // 設定を保存するときに消えないよう、名前解決できなかった送信先も保持する
+    QMutexLocker locker(&pimpl->mutex_);
+    pimpl->destinations_ = destinations;
+    pimpl->resolved_destinations_ = resolved_destinations;
+    pimpl->endpoints_ = endpoints;
+    pimpl->sent_packets_.assign(endpoints.size(), 0);
+    pimpl->error_packets_.assign(endpoints.size(), 0);
+    pimpl->is_destinations_updated_ = true;
+
+    return is_resolved;
+}
+
+
+vector<Osc_publisher::destination_t> Osc_publisher::destinations(void) const
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    return pimpl->destinations_;
+}
+
+
+vector<Osc_publisher::destination_t>
+Osc_publisher::resolved_destinations(void) const
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    return pimpl->resolved_destinations_;
+}
+
+
+void Osc_publisher::destination_counters(vector<unsigned long>& sent_packets,
+                                         vector<unsigned long>& error_packets)
+    const
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    sent_packets = pimpl->sent_packets_;
+    error_packets = pimpl->error_packets_;
+}
+
+
+bool Osc_publisher::set_tuio_destinations(const vector<destination_t>&
+                                          destinations)
+{
+    vector<destination_t> resolved_destinations;
+    vector<IpEndpointName> endpoints;
+    bool is_resolved =
+        resolve_destinations(resolved_destinations, endpoints, destinations);
+
+    QMutexLocker locker(&pimpl->mutex_);
+    pimpl->tuio_destinations_ = destinations;
+    pimpl->resolved_tuio_destinations_ = resolved_destinations;
+    pimpl->tuio_endpoints_ = endpoints;
+    pimpl->is_tuio_destinations_updated_ = true;
+
+    return is_resolved;
+}
+
+
+vector<Osc_publisher::destination_t>
+Osc_publisher::tuio_destinations(void) const
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    return pimpl->tuio_destinations_;
+}
+
+
+vector<Osc_publisher::destination_t>
+Osc_publisher::resolved_tuio_destinations(void) const
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    return pimpl->resolved_tuio_destinations_;
+}
+
+
+void Osc_publisher::set_blob_parameter(const Blob_detector::parameter_t&
+                                       parameter)
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    pimpl->blob_parameter_ = parameter;
+    pimpl->is_blob_parameter_updated_ = true;
+}
+
+
+Blob_detector::parameter_t Osc_publisher::blob_parameter(void) const
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    return pimpl->blob_parameter_;
+}
+
+
+void Osc_publisher::set_delta_parameter(const Scan_delta_encoder::parameter_t&
+                                        parameter)
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    pimpl->delta_parameter_ = parameter;
+    pimpl->is_delta_parameter_updated_ = true;
+}
+
+
+Scan_delta_encoder::parameter_t Osc_publisher::delta_parameter(void) const
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    return pimpl->delta_parameter_;
+}
+
+
+void Osc_publisher::set_tracking(bool on)
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    pimpl->is_tracking_ = on;
+}
+
+
+bool Osc_publisher::is_tracking(void) const
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    return pimpl->is_tracking_;
+}
+
+
+void Osc_publisher::set_tracker_parameter(const Target_tracker::parameter_t&
+                                          parameter)
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    pimpl->tracker_parameter_ = parameter;
+    pimpl->is_tracker_parameter_updated_ = true;
+}
+
+
+Target_tracker::parameter_t Osc_publisher::tracker_parameter(void) const
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    return pimpl->tracker_parameter_;
+}
+
+
+void Osc_publisher::set_zones(const vector<Region_filter::zone_t>& zones)
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    pimpl->zones_ = zones;
+    pimpl->occupancy_.clear();
+    pimpl->is_zones_updated_ = true;
+}
+
+
+vector<Region_filter::zone_t> Osc_publisher::zones(void) const
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    return pimpl->zones_;
+}
+
+
+vector<size_t> Osc_publisher::zone_occupancy(void) const
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    return pimpl->occupancy_;
+}
+
+
+void Osc_publisher::set_queue_scans(size_t scans)
+{
+    QMutexLocker locker(&pimpl->mutex_);
+
+    pimpl->queue_.resize(max(scans, static_cast<size_t>(1)));
+    pimpl->queue_first_ = 0;
+    pimpl->queue_filled_ = 0;
+}
+
+
+void Osc_publisher::push_scan(hrk::Lidar::measurement_t type,
+                              const std::vector<long>& distance,
+                              const std::vector<unsigned short>& intensity,
+                              long timestamp)
+{
+    pimpl->push_scan(type, distance.begin(), distance.end(),
+                     intensity.begin(), intensity.end(), timestamp);
+}
+
+
+void Osc_publisher::push_scan(hrk::Lidar::measurement_t type,
+                              const hrk::Scan_frame& frame, long timestamp)
+{
+    const uint16_t* intensity = frame.intensity();
+    size_t intensity_size = frame.has_intensity() ? frame.size() : 0;
+    pimpl->push_scan(type, frame.distance(), frame.distance() + frame.size(),
+                     intensity, intensity + intensity_size, timestamp);
+}
+
+
+size_t Osc_publisher::dropped_scans(void) const
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    return pimpl->dropped_scans_;
+}
+
+
+void Osc_publisher::run(void)
+{
+    pimpl->mutex_.lock();
+    pimpl->quit_ = false;
+    pimpl->mutex_.unlock();
+
+    pimpl->publish_thread();
+}
+
+
+void Osc_publisher::stop(void)
+{
+    pimpl->mutex_.lock();
+    pimpl->quit_ = true;
+    pimpl->scan_pushed_.wakeAll();
+    pimpl->mutex_.unlock();
+}
@@ -0,0 +1,173 @@
+#ifndef OSC_PUBLISHER_H
+#define OSC_PUBLISHER_H
+
+/*!
+  \file
+  \brief OSC 送信用のスレッド
+
+  Receive_thread から受け取ったスキャンを、描画とは独立に OSC で送信する。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <QThread>
+#include "Lidar.h"
+#include "Region_filter.h"
+#include "Blob_detector.h"
+#include "Target_tracker.h"
+#include "Scan_delta_codec.h"
+
+namespace hrk
+{
+    class Scan_frame;
+}
+
+class Scan_setting;
+
+
+class Osc_publisher : public QThread
+{
+ public:
+    enum {
+        Default_queue_scans = 4,
+    };
+
+    //! 送信パケットの構成
+    typedef enum {
+        Point_message, //!< 点毎に /xy を含む bundle を送信する
+        Scan_bundle,   //!< スキャン毎に /scan/frame と /xy (x, y, 領域) を MTU に収まる bundle にまとめる
+        Scan_blob,     //!< スキャン毎に (x, y, 領域) の列を blob にした /scan を送信する
+        Scan_delta,    //!< スキャン毎に距離、強度を差分符号化した /scan/delta を送信する
+    } framing_t;
+
+    //! 送信先。マルチキャストのアドレスも指定できる
+    typedef struct
+    {
+        std::string address;
+        int port;
+    } destination_t;
+
+    Osc_publisher(void);
+    ~Osc_publisher(void);
+
+    void set_scan_setting(const Scan_setting& setting);
+
+    /*!
+      \brief 点の座標の計算に使うセンサの情報を複製する
+
+      ステップ毎の角度、スキャン周期、最小距離、エコー数を複製し、
+      送信スレッドからは lidar を参照しない。角度は計測の範囲に
+      よって変わるため、計測を開始したスレッドで開始後に呼び出す。
+      close_sensor() を呼び出すまでスキャンを送信する。
+    */
+    void set_sensor(const hrk::Lidar& lidar);
+
+    //! 計測を停止したときに呼び出す。送信待ちのスキャンは破棄する
+    void close_sensor(void);
+    void set_framing(framing_t framing);
+    framing_t framing(void) const;
+
+    /*!
+      \brief 送信先を設定する
+
+      1 スキャン分のパケットは、全ての送信先に対してまとめて送信される。
+      送信先を設定すると、送信先毎のカウンタは 0 に戻る。
+
+      \retval false 名前解決できない送信先があった。その送信先には
+      送信しないが、destinations() には残る
+    */
+    bool set_destinations(const std::vector<destination_t>& destinations);
+
+    //! 設定された送信先。名前解決できなかった送信先も含む
+    std::vector<destination_t> destinations(void) const;
+
+    //! 名前解決でき、送信している送信先
+    std::vector<destination_t> resolved_destinations(void) const;
+
+    //! resolved_destinations() 毎の送信パケット数とエラー数を取得する
+    void destination_counters(std::vector<unsigned long>& sent_packets,
+                              std::vector<unsigned long>& error_packets) const;
+
+    /*!
+      \brief 送信待ちキューの長さを設定する
+
+      キューが満杯のときは、最も古いスキャンを破棄して新しいスキャンを格納する。
+    */
+    void set_queue_scans(size_t scans);
+
+    /*!
+      \brief 送信する点を選別する領域を設定する
+
+      領域を設定したときは、スキャン毎に領域毎の点の数を /scan/zones で
+      送信する。既定の領域のままのときは送信しない。
+    */
+    void set_zones(const std::vector<Region_filter::zone_t>& zones);
+    std::vector<Region_filter::zone_t> zones(void) const;
+
+    //! 直前に送信したスキャンの、領域毎の点の数
+    std::vector<size_t> zone_occupancy(void) const;
+
+    /*!
+      \brief TUIO の送信先を設定する
+
+      送信先があるときのみ、選別後の点から blob を検出し、
+      /tuio/2Dcur の alive, set, fseq を送信する。名前解決できない
+      送信先の扱いは set_destinations() と同じ。
+    */
+    bool set_tuio_destinations(const std::vector<destination_t>& destinations);
+    std::vector<destination_t> tuio_destinations(void) const;
+    std::vector<destination_t> resolved_tuio_destinations(void) const;
+
+    void set_blob_parameter(const Blob_detector::parameter_t& parameter);
+    Blob_detector::parameter_t blob_parameter(void) const;
+
+    /*!
+      \brief 物体の追跡を有効にする
+
+      有効なときは、blob をトラックとして追跡し、確定したトラックを
+      /tracks/frame と /track (id, x, y, vx, vy) の bundle で送信する。
+      位置は計測から送信までの遅延時間だけ外挿した値になる。
+    */
+    void set_tracking(bool on);
+    bool is_tracking(void) const;
+
+    void set_tracker_parameter(const Target_tracker::parameter_t& parameter);
+    Target_tracker::parameter_t tracker_parameter(void) const;
+
+    //! Scan_delta で送信するときの keyframe の間隔と閾値を設定する
+    void set_delta_parameter(const Scan_delta_encoder::parameter_t& parameter);
+    Scan_delta_encoder::parameter_t delta_parameter(void) const;
+
+    /*!
+      \brief 送信するスキャンを登録する
+
+      データは複製して格納するため、呼び出し元の distance, intensity は変更されない。
+    */
+    void push_scan(hrk::Lidar::measurement_t type,
+                   const std::vector<long>& distance,
+                   const std::vector<unsigned short>& intensity,
+                   long timestamp);
+
+    //! Scan_frame から直接複製する。long への複製を挟まない
+    void push_scan(hrk::Lidar::measurement_t type,
+                   const hrk::Scan_frame& frame, long timestamp);
+
+    size_t dropped_scans(void) const;
+
+    void run(void);
+    void stop(void);
+
+ private:
+    Osc_publisher(const Osc_publisher& rhs);
+    Osc_publisher& operator = (const Osc_publisher& rhs);
+
+    struct pImpl;
+    std::auto_ptr<pImpl> pimpl;
+};
+
+#endif
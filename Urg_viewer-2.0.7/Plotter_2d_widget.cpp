@@ -14,12 +14,6 @@
 #define GL3_PROTOTYPES 1
 #endif
 
-#define ADDRESS "127.0.0.1"
-#define PORT 7000
-
-#define OUTPUT_BUFFER_SIZE 1024
-#include "osc/OscOutboundPacketStream.h"
-#include "ip/UdpSocket.h"
 #include <QtCore/qmath.h>
 
 #include "detect_os.h"
@@ -38,6 +32,8 @@
 #include "Plotter_2d_widget.h"
 #include "Step_value_widget.h"
 #include "Scan_setting.h"
+#include "Scan_frame.h"
+#include "Scan_frame_pool.h"
 #include "Color.h"
 
 #include <cstdio>
@@ -56,14 +52,6 @@ namespace
 
     const double Required_minimum_GL_version = 1.6;
 
-    typedef struct
-    {
-        Lidar::measurement_t type;
-        long timestamp;
-        vector<long> distance;
-        vector<unsigned short> intensity;
-    } plot_data_t;
-
     typedef struct
     {
         GLfloat x;
@@ -79,8 +67,6 @@ namespace
     typedef vector<Points> Points_group;
 }
 
-UdpTransmitSocket transmitSocket( IpEndpointName( ADDRESS, PORT ) );
-
 struct Plotter_2d_widget::pImpl
 {
     Plotter_2d_widget* widget_;
@@ -88,7 +74,8 @@ struct Plotter_2d_widget::pImpl
     QMutex mutex_;
     Lidar& lidar_;
     QColor clear_color_;
-    plot_data_t plot_data_;
+    Scan_frame* plot_frame_;
+    Scan_frame_pool* frame_pool_;
     bool is_step_value_requested_;
     state_t current_state_;
     Scan_setting setting_;
@@ -105,6 +92,7 @@ struct Plotter_2d_widget::pImpl
     bool is_plot_data_updated_;
     vector<GLuint> scans_buffer_ids_;
     vector<int> scans_points_size_;
+    scans_t scans_;
     int echo_size_;
     long min_distance_;
     vector<Color> plot_distance_colors_;
@@ -137,6 +125,7 @@ struct Plotter_2d_widget::pImpl
           Lidar& lidar)
         : widget_(widget), step_value_widget_(step_value_widget),
           lidar_(lidar), clear_color_(Qt::white),
+          plot_frame_(NULL), frame_pool_(NULL),
           is_step_value_requested_(false), is_old_gl_(false),
           is_arc_discarded_(false), exist_step_line_(false),
           is_plot_data_updated_(false), echo_size_(1), min_distance_(0),
@@ -461,16 +450,30 @@ struct Plotter_2d_widget::pImpl
     }
 
 
+    bool has_plot_data(void) const
+    {
+        return (plot_frame_ && !plot_frame_->empty()) ? true : false;
+    }
+
+
+    void release_plot_data(void)
+    {
+        if (frame_pool_) {
+            frame_pool_->release(plot_frame_);
+        }
+        plot_frame_ = NULL;
+        frame_pool_ = NULL;
+    }
+
+
     void set_value_data(void)
     {
-        if (plot_data_.distance.empty()) {
-            // distance が empty ならばデータが格納されていないと判断して戻る
+        if (!has_plot_data()) {
+            // データが格納されていなければ戻る
             return;
         }
 
-        if (step_value_widget_.
-            set_value_data(plot_data_.type,
-                           plot_data_.distance, plot_data_.intensity)) {
+        if (step_value_widget_.set_value_data(*plot_frame_)) {
             is_step_value_requested_ = false;
         }
     }
@@ -482,18 +485,21 @@ struct Plotter_2d_widget::pImpl
             return;
         }
 
+        // 確保済みの領域を使い回すため、前回の点は要素のみを消す
         int scan_data_size = echo_size_ * (setting_.with_intensity ? 2 : 1);
-        scans_t scans(scan_data_size);
+        scans_.resize(scan_data_size);
+        for (scans_t::iterator it = scans_.begin(); it != scans_.end(); ++it) {
+            it->clear();
+        }
         scans_points_size_.clear();
 
         // 距離データを描画用のデータに変換する
-        vector<unsigned short>::const_iterator intensity_it =
-            plot_data_.intensity.begin();
+        const uint32_t* distance_data = plot_frame_->distance();
+        const uint16_t* intensity_data = plot_frame_->intensity();
         int grouping_add_size = max(1, setting_.group_steps);
-        int index = 0;
-        for (vector<long>::const_iterator it = plot_data_.distance.begin();
-             it != plot_data_.distance.end(); ++it, ++intensity_it, ++index) {
-            long distance = *it;
+        int n = static_cast<int>(plot_frame_->size());
+        for (int index = 0; index < n; ++index) {
+            long distance = distance_data[index];
             if (distance <= min_distance_) {
                 continue;
             }
@@ -506,36 +512,18 @@ struct Plotter_2d_widget::pImpl
                 v.x = distance * cos(radian);
                 v.y = distance * sin(radian);
                 const int scans_index = index % echo_size_;
-                scans[scans_index].push_back(v);
-
-                if(abs((int)v.x) > 75 && abs((int)v.y) > 75 && abs((int)v.x) < 1300 && abs((int)v.y) < 1300 )
-                {
-                    char buffer[OUTPUT_BUFFER_SIZE];
-                    osc::OutboundPacketStream p( buffer, OUTPUT_BUFFER_SIZE );
-
-                    p << osc::BeginBundleImmediate
-                        /*
-                        << osc::BeginMessage( "/test1" )
-                            << true << 23 << (float)3.1415 << "hello" << osc::EndMessage
-                        << osc::BeginMessage( "/test2" )
-                            << true << 24 << (float)10.8 << "world" << osc::EndMessage
-                        */
-                        << osc::BeginMessage( "/xy" )
-                            << (float)v.x << (float)v.y << osc::EndMessage
-                        << osc::EndBundle;
-
-                    transmitSocket.Send( p.Data(), p.Size() );
-                }
-                if (setting_.with_intensity) {
+                scans_[scans_index].push_back(v);
+
+                if (setting_.with_intensity && intensity_data) {
                     // 強度データを描画用のデータに変換する
-                    unsigned short intensity = *intensity_it;
+                    unsigned short intensity = intensity_data[index];
                     v.x = intensity * cos(radian);
                     v.y = intensity * sin(radian);
-                    scans[echo_size_ + scans_index].push_back(v);
+                    scans_[echo_size_ + scans_index].push_back(v);
                 }
             }
         }
-        set_data_to_buffer(scans);
+        set_data_to_buffer(scans_);
     }
 
 
@@ -588,7 +576,9 @@ struct Plotter_2d_widget::pImpl
 
     void clear_plot_data(void)
     {
-        plot_data_.distance.clear();
+        if (plot_frame_) {
+            plot_frame_->clear();
+        }
         echo_size_ = 1;
         exist_step_line_ = false;
         is_updated_ = true;
@@ -710,8 +700,8 @@ struct Plotter_2d_widget::pImpl
 
         glTranslatef(moved_mm_.x, moved_mm_.y, 0.0);
 
-        // distance が empty ならばデータが格納されていないと判断する
-        bool is_invalid_data = plot_data_.distance.empty();
+        // データが格納されていなければ描画しない
+        bool is_invalid_data = !has_plot_data();
         if (!is_invalid_data) {
             if (is_step_value_requested_ || is_auto_update_ ||
                 (current_state_ == State::Playing)) {
@@ -828,23 +818,28 @@ void Plotter_2d_widget::set_scan_setting(const Scan_setting& setting)
 }
 
 
-void Plotter_2d_widget::set_plot_data(hrk::Lidar::measurement_t type,
-                                      std::vector<long>& distance,
-                                      std::vector<unsigned short>& intensity,
-                                      long timestamp)
+void Plotter_2d_widget::set_plot_data(hrk::Scan_frame* frame,
+                                      hrk::Scan_frame_pool& pool)
 {
     QMutexLocker locker(&pimpl->mutex_);
 
-    pimpl->plot_data_.type = type;
-    pimpl->plot_data_.distance.swap(distance);
-    pimpl->plot_data_.intensity.swap(intensity);
-    pimpl->plot_data_.timestamp = timestamp;
+    pimpl->release_plot_data();
+    pimpl->plot_frame_ = frame;
+    pimpl->frame_pool_ = &pool;
 
     pimpl->is_plot_data_updated_ = true;
     pimpl->is_updated_ = true;
 }
 
 
+void Plotter_2d_widget::release_plot_data(void)
+{
+    QMutexLocker locker(&pimpl->mutex_);
+    pimpl->release_plot_data();
+    pimpl->is_updated_ = true;
+}
+
+
 void Plotter_2d_widget::clear_message(void)
 {
     pimpl->draw_message_.clear();
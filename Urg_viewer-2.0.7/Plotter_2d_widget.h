@@ -15,6 +15,12 @@
 #include "State.h"
 #include "Lidar.h"
 
+namespace hrk
+{
+    class Scan_frame;
+    class Scan_frame_pool;
+}
+
 class Scan_setting;
 class Step_value_widget;
 
@@ -39,10 +45,18 @@ class Plotter_2d_widget : public QGLWidget, public State
     void set_step_value_auto_update(bool on);
 
     void set_scan_setting(const Scan_setting& setting);
-    void set_plot_data(hrk::Lidar::measurement_t type,
-                       std::vector<long>& distance,
-                       std::vector<unsigned short>& intensity,
-                       long timestamp);
+
+    /*!
+      \brief 描画するスキャンを登録する
+
+      frame は次のスキャンが登録されるか release_plot_data() が呼ばれる
+      まで保持し、その後 pool に戻す。
+    */
+    void set_plot_data(hrk::Scan_frame* frame, hrk::Scan_frame_pool& pool);
+
+    //! 保持しているスキャンを取り出し元に戻す
+    void release_plot_data(void);
+
     void clear_message(void);
     void set_message(const QString& message);
     void set_icon(icon_t icon);
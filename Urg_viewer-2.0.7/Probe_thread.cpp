@@ -0,0 +1,58 @@
+/*!
+  \file
+  \brief シリアルポートに URG が接続されているかを調べるスレッド
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include "Probe_thread.h"
+#include "Urg_driver.h"
+
+using namespace hrk;
+using namespace std;
+
+
+struct Probe_thread::pImpl
+{
+    vector<string> ports_;
+    vector<string> found_ports_;
+};
+
+
+Probe_thread::Probe_thread(void) : pimpl(new pImpl)
+{
+}
+
+
+Probe_thread::~Probe_thread(void)
+{
+    // ポートへの接続を試している間に終了しないよう、完了を待つ
+    wait();
+}
+
+
+void Probe_thread::set_ports(const std::vector<std::string>& ports)
+{
+    pimpl->ports_ = ports;
+    pimpl->found_ports_.clear();
+}
+
+
+std::vector<std::string> Probe_thread::ports(void) const
+{
+    return pimpl->ports_;
+}
+
+
+std::vector<std::string> Probe_thread::found_ports(void) const
+{
+    return pimpl->found_ports_;
+}
+
+
+void Probe_thread::run(void)
+{
+    pimpl->found_ports_ = Urg_driver::probe_ports(pimpl->ports_);
+}
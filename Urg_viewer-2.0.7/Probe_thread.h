@@ -0,0 +1,44 @@
+#ifndef PROBE_THREAD_H
+#define PROBE_THREAD_H
+
+/*!
+  \file
+  \brief シリアルポートに URG が接続されているかを調べるスレッド
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <QThread>
+
+
+class Probe_thread : public QThread
+{
+public:
+    Probe_thread(void);
+    ~Probe_thread(void);
+
+    //! 調べるポートを設定する。start() の前に呼び出す
+    void set_ports(const std::vector<std::string>& ports);
+
+    //! set_ports() で設定したポート
+    std::vector<std::string> ports(void) const;
+
+    //! URG が応答したポート。finished() の後に参照する
+    std::vector<std::string> found_ports(void) const;
+
+    void run(void);
+
+private:
+    Probe_thread(const Probe_thread& rhs);
+    Probe_thread& operator = (const Probe_thread& rhs);
+
+    struct pImpl;
+    std::auto_ptr<pImpl> pimpl;
+};
+
+#endif
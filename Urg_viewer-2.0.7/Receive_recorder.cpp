@@ -20,9 +20,10 @@ struct Receive_recorder::pImpl
     Connection* connection_;
     string error_message_;
     ofstream* fout_;
+    Stream* mirror_;
 
 
-    pImpl(void) : connection_(NULL), fout_(NULL)
+    pImpl(void) : connection_(NULL), fout_(NULL), mirror_(NULL)
     {
     }
 
@@ -42,8 +43,38 @@ struct Receive_recorder::pImpl
     int read(char* data, size_t max_data_size, int timeout)
     {
         int n = connection_->read(data, max_data_size, timeout);
-        if (n > 0) {
-            fout_->write(data, n);
+        record(data, n);
+        return n;
+    }
+
+
+    int read_some(char* data, size_t max_data_size, int timeout)
+    {
+        int n = connection_->read_some(data, max_data_size, timeout);
+        record(data, n);
+        return n;
+    }
+
+
+    void record(const char* data, int size)
+    {
+        if (size > 0) {
+            fout_->write(data, size);
+            if (mirror_) {
+                mirror_->write(data, size);
+            }
+        }
+    }
+
+
+    int read_line(span_t& line, int timeout)
+    {
+        int n = connection_->read_line(line, timeout);
+        if (line.size > 0) {
+            fout_->write(line.data, line.size);
+            if (mirror_) {
+                mirror_->write(line.data, line.size);
+            }
         }
         return n;
     }
@@ -77,6 +108,12 @@ bool Receive_recorder::open(Connection* connection, const char* file_path)
 }
 
 
+void Receive_recorder::set_mirror(Stream* mirror)
+{
+    pimpl->mirror_ = mirror;
+}
+
+
 const char* Receive_recorder::what(void) const
 {
     if (!pimpl->connection_) {
@@ -145,6 +182,49 @@ int Receive_recorder::read(char* data, size_t max_data_size, int timeout)
 }
 
 
+int Receive_recorder::read_some(char* data, size_t max_data_size,
+                                int timeout)
+{
+    if (!pimpl->connection_) {
+        return -1;
+    }
+
+    return pimpl->read_some(data, max_data_size, timeout);
+}
+
+
+int Receive_recorder::read_line(span_t& line, int timeout)
+{
+    if (!pimpl->connection_) {
+        line.size = 0;
+        return -1;
+    }
+
+    return pimpl->read_line(line, timeout);
+}
+
+
+size_t Receive_recorder::peek_buffer(span_t& buffer)
+{
+    if (!pimpl->connection_) {
+        buffer.size = 0;
+        return 0;
+    }
+
+    return pimpl->connection_->peek_buffer(buffer);
+}
+
+
+long long Receive_recorder::line_arrival_time(void) const
+{
+    if (!pimpl->connection_) {
+        return 0;
+    }
+
+    return pimpl->connection_->line_arrival_time();
+}
+
+
 void Receive_recorder::ungetc(int ch)
 {
     if (!pimpl->connection_) {
@@ -33,13 +33,25 @@ namespace hrk
         */
         bool open(Connection* connection, const char* file_path);
 
+        /*!
+          \brief 受信データの複製先を登録する
+
+          ファイルへの記録に加えて、受信したデータを mirror に write() する。
+          NULL を指定すると複製しない。
+        */
+        void set_mirror(Stream* mirror);
+
         const char* what(void) const;
         bool change_baudrate(long baudrate);
         bool is_open(void) const;
         void close(void);
         int write(const char* data, size_t data_size);
         int read(char* data, size_t max_data_size, int timeout);
+        int read_some(char* data, size_t max_data_size, int timeout);
         void ungetc(int ch);
+        int read_line(span_t& line, int timeout);
+        size_t peek_buffer(span_t& buffer);
+        long long line_arrival_time(void) const;
 
     private:
         Receive_recorder(const Receive_recorder& rhs);
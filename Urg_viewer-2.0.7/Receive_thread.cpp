@@ -8,14 +8,21 @@
 */
 
 #include <cmath>
+#include <iostream>
 #include <QMutex>
 #include <QTime>
 #include "Receive_thread.h"
 #include "Plotter_2d_widget.h"
+#include "Osc_publisher.h"
+#include "Fanout_server.h"
 #include "Scan_setting.h"
 #include "Urg_driver.h"
 #include "Urg_log_reader.h"
+#include "Scan_frame.h"
+#include "Scan_frame_pool.h"
 #include "Csv_recorder.h"
+#include "Background_model.h"
+#include "Shm_scan_ring.h"
 #include "product_utils.h"
 #include "plugin.h"
 
@@ -28,6 +35,22 @@ namespace
     enum {
         Invalid_scan_index = -1,
     };
+
+
+    // プラグインに渡すために、スキャンを long に広げて複製する
+    void copy_to_vectors(const Scan_frame& frame, vector<long>& distance,
+                         vector<unsigned short>& intensity)
+    {
+        const uint32_t* distance_data = frame.distance();
+        distance.assign(distance_data, distance_data + frame.size());
+
+        const uint16_t* intensity_data = frame.intensity();
+        if (intensity_data) {
+            intensity.assign(intensity_data, intensity_data + frame.size());
+        } else {
+            intensity.clear();
+        }
+    }
 }
 
 
@@ -37,6 +60,8 @@ struct Receive_thread::pImpl
     Urg_driver& urg_;
     Urg_log_reader& urg_log_reader_;
     Plotter_2d_widget& plotter_2d_widget_;
+    Osc_publisher& osc_publisher_;
+    Fanout_server& fanout_server_;
     mode_t mode_;
     QMutex mutex_;
     bool quit_;
@@ -53,16 +78,48 @@ struct Receive_thread::pImpl
     Csv_recorder csv_recorder_;
     size_t csv_recording_scans_;
 
+    bool is_background_subtraction_;
+    bool is_background_updated_;
+    string background_file_;
+    size_t background_learning_scans_;
+    long background_margin_;
+
+    // スレッド側でのみ参照する
+    bool is_background_loaded_;
+    string current_background_file_;
+    size_t current_learning_scans_;
+    Background_model background_;
+
+    bool is_shm_updated_;
+    string shm_name_;
+    size_t shm_slots_;
+
+    // スレッド側でのみ参照する
+    Shm_scan_writer shm_writer_;
+    int shm_echo_size_;
+
+    // 受信に使う Scan_frame。描画側に渡すまではスレッド側で保持する
+    Scan_frame_pool frame_pool_;
+    Scan_frame* frame_;
+
 
     pImpl(Receive_thread* thread,
           Urg_driver& urg, Urg_log_reader& urg_log_reader,
-          Plotter_2d_widget& plotter_2d_widget)
+          Plotter_2d_widget& plotter_2d_widget, Osc_publisher& osc_publisher,
+          Fanout_server& fanout_server)
         : thread_(thread), urg_(urg), urg_log_reader_(urg_log_reader),
-          plotter_2d_widget_(plotter_2d_widget),
+          plotter_2d_widget_(plotter_2d_widget), osc_publisher_(osc_publisher),
+          fanout_server_(fanout_server),
           mode_(Normal), quit_(false), pause_(false), receive_one_scan_(false),
           scan_interval_(0),
           next_scan_index_(Invalid_scan_index), add_scan_index_(0),
-          play_speed_magnification_(1.0), csv_recording_scans_(0)
+          play_speed_magnification_(1.0), csv_recording_scans_(0),
+          is_background_subtraction_(false), is_background_updated_(false),
+          background_learning_scans_(Background_model::Default_learning_scans),
+          background_margin_(Background_model::Default_margin_mm),
+          is_background_loaded_(false), current_learning_scans_(0),
+          is_shm_updated_(false), shm_slots_(Shm_scan_writer::Default_slots),
+          shm_echo_size_(1), frame_(NULL)
     {
     }
 
@@ -81,6 +138,16 @@ struct Receive_thread::pImpl
         }
         Lidar::measurement_t type = measurement_type();
 
+        // 受信中にメモリを確保しないよう、先に全ての領域を確保しておく
+        frame_pool_.release(frame_);
+        frame_ = NULL;
+        int echo_size = setting_.is_multiecho ? urg_.max_echo_size() : 1;
+        frame_pool_.reserve(urg_.max_data_size(), echo_size,
+                            setting_.with_intensity);
+
+        // 送信スレッドは urg_ を参照せず、計測の開始後の値を複製して使う
+        osc_publisher_.set_sensor(urg_);
+
         enum {
             Retry_timeout_msec = 1000,
             Retry_wait_msec = 100,
@@ -89,7 +156,6 @@ struct Receive_thread::pImpl
         int retry_count = 0;
         vector<long> distance;
         vector<unsigned short> intensity;
-        long timestamp;
         bool is_pause = false;
         size_t scan_count = 0;
         size_t loss_count = 0;
@@ -100,30 +166,48 @@ struct Receive_thread::pImpl
         long previous_timestamp = 0;
         QTime cycle_timer;
         int consecutive_loss_times = 0;
+        bool is_startup_logged = (mode_ == Seekable);
+
+        // スキャンの設定が変わっている可能性があるため、背景を読み込み直す
+        mutex_.lock();
+        bool is_background_subtraction = is_background_subtraction_;
+        is_background_updated_ = true;
+        update_background_setting();
+        is_shm_updated_ = true;
+        update_shm_setting();
+        mutex_.unlock();
 
         while (true) {
             msleep(1);
 
-            if (!is_pause) {
+            if (!frame_) {
+                frame_ = frame_pool_.acquire();
+            }
+
+            if (!is_pause && frame_) {
                 // データの受信
-                if (!receive_data(distance, intensity, timestamp)) {
+                Scan_frame& frame = *frame_;
+                if (!urg_.get_scan(frame)) {
                     if (mode_ == Seekable) {
                         emit thread_->play_completed();
                         if (left_recording_scans > 0) {
                             emit thread_->csv_recording_completed();
                         }
+                        osc_publisher_.close_sensor();
                         return;
                     }
 
                     // 数秒のリトライ後に計測をあきらめる
                     ++retry_count;
                     if ((retry_count * Retry_wait_msec) > Retry_timeout_msec) {
+                        osc_publisher_.close_sensor();
                         emit thread_->receive_failed(urg_.what());
                         return;
                     }
                     msleep(Retry_wait_msec);
 
                     if (!start_scanning(false)) {
+                        osc_publisher_.close_sensor();
                         emit thread_->receive_failed(urg_.what());
                         return;
                     }
@@ -142,10 +226,21 @@ struct Receive_thread::pImpl
                                          scan_count);
                 }
                 ++scan_count;
+                long timestamp = frame.sensor_timestamp;
+
+                if (!is_startup_logged) {
+                    log_startup_timing();
+                    is_startup_logged = true;
+                }
+
+                // 背景の除去。以降の処理には前景の点のみを渡す
+                if (is_background_subtraction) {
+                    subtract_background(frame);
+                }
 
                 // CSV 保存のためのデータ登録
                 if (left_recording_scans > 0) {
-                    csv_recorder_.set_receive_data(distance, intensity);
+                    csv_recorder_.set_receive_data(frame);
                     if (--left_recording_scans == 0) {
                         emit thread_->csv_recording_percent(100);
                         emit thread_->csv_recording_completed();
@@ -158,13 +253,27 @@ struct Receive_thread::pImpl
 
                 // 描画のためのデータ登録
                 long msec_timestamp = timestamp / timestamp_unit;
-                plugin_get_measurement_data(type, distance.size(),
-                                            &distance[0], &intensity[0],
-                                            msec_timestamp);
+                if (plugin_is_loaded()) {
+                    copy_to_vectors(frame, distance, intensity);
+                    plugin_get_measurement_data(type, distance.size(),
+                                                &distance[0], &intensity[0],
+                                                msec_timestamp);
+                }
+
+                // OSC と TCP の送信は描画の周期によらず、受信したスキャン毎に行う
+                osc_publisher_.push_scan(type, frame, msec_timestamp);
+                fanout_server_.push_scan(type, frame, msec_timestamp);
 
-                // データを登録すると distance, intensity は空になる
-                plotter_2d_widget_.
-                    set_plot_data(type, distance, intensity, msec_timestamp);
+                // 共有メモリの読み出し側は、描画の周期によらず全てのスキャンを受け取る
+                if (shm_writer_.is_open()) {
+                    shm_writer_.write(type, shm_echo_size_, setting_.first_step,
+                                      setting_.group_steps, frame,
+                                      msec_timestamp);
+                }
+
+                // frame は描画側が保持し、次のスキャンの登録時に戻される
+                plotter_2d_widget_.set_plot_data(frame_, frame_pool_);
+                frame_ = NULL;
                 if (mode_ == Recording) {
                     emit thread_->recorded(scan_count, loss_count);
                 }
@@ -201,6 +310,10 @@ struct Receive_thread::pImpl
                 break;
             }
 
+            is_background_subtraction = is_background_subtraction_;
+            update_background_setting();
+            update_shm_setting();
+
             is_pause = (receive_one_scan_) ? false : pause_;
             receive_one_scan_ = false;
             if (mode_ == Seekable) {
@@ -234,6 +347,7 @@ struct Receive_thread::pImpl
         }
 
         // 計測停止コマンドの発行
+        osc_publisher_.close_sensor();
         urg_.stop_measurement();
 
         if (mode_ == Recording) {
@@ -242,6 +356,85 @@ struct Receive_thread::pImpl
     }
 
 
+    // mutex_ をロックして呼び出す
+    void update_background_setting(void)
+    {
+        if (!is_background_updated_) {
+            return;
+        }
+        is_background_updated_ = false;
+
+        int echo_size = setting_.is_multiecho ? urg_.max_echo_size() : 1;
+        background_.set_layout(setting_.first_step, setting_.last_step,
+                               setting_.group_steps, echo_size);
+        background_.set_max_size(max(urg_.max_data_size(),
+                                     urg_.total_steps()) *
+                                 max(1, urg_.max_echo_size()));
+        background_.set_margin(background_margin_);
+        current_background_file_ = background_file_;
+        current_learning_scans_ = background_learning_scans_;
+        is_background_loaded_ = false;
+    }
+
+
+    // mutex_ をロックして呼び出す
+    void update_shm_setting(void)
+    {
+        if (!is_shm_updated_) {
+            return;
+        }
+        is_shm_updated_ = false;
+
+        shm_echo_size_ = setting_.is_multiecho ? urg_.max_echo_size() : 1;
+        if (shm_name_.empty()) {
+            shm_writer_.close();
+            return;
+        }
+
+        // 名前と大きさが変わらなければ、読み出し側はそのまま読み出しを続ける
+        size_t max_values = max(urg_.max_data_size(), urg_.total_steps()) *
+            max(1, urg_.max_echo_size());
+        if (!shm_writer_.open(shm_name_.c_str(), shm_slots_, max_values)) {
+            // 共有メモリが使えなくても、受信と描画は継続する
+            cerr << "Receive_thread: " << shm_writer_.what() << endl;
+        }
+    }
+
+
+    void subtract_background(Scan_frame& frame)
+    {
+        if (!is_background_loaded_) {
+            // 背景がスキャンの設定と一致しなければ、学習し直す
+            is_background_loaded_ = true;
+            if (!background_.load(current_background_file_.c_str()) ||
+                !background_.is_valid()) {
+                background_.start_learning(current_learning_scans_);
+            }
+        }
+
+        if (background_.is_learning()) {
+            if (background_.add_learning_scan(frame)) {
+                background_.save(current_background_file_.c_str());
+            }
+            return;
+        }
+        background_.apply(frame);
+    }
+
+
+    // 接続から最初のデータを受信するまでの時間を出力する
+    void log_startup_timing(void)
+    {
+        Urg_driver::startup_timing_t timing = urg_.startup_timing();
+        cerr << "Urg_driver: startup [msec]"
+             << " connect " << timing.connect_usec / 1000.0
+             << ", baudrate " << timing.baudrate_usec / 1000.0
+             << ", parameter " << timing.parameter_usec / 1000.0
+             << ", laser on " << timing.laser_on_usec / 1000.0
+             << ", first scan " << timing.first_scan_usec / 1000.0 << endl;
+    }
+
+
     bool start_scanning(bool range_updated)
     {
         if (range_updated) {
@@ -277,33 +470,6 @@ struct Receive_thread::pImpl
     }
 
 
-    bool receive_data(vector<long>& distance,
-                      vector<unsigned short>& intensity, long& timestamp)
-    {
-        bool ret;
-
-        if (setting_.with_intensity) {
-            if (setting_.is_multiecho) {
-                ret = urg_.get_multiecho_intensity(distance, intensity,
-                                                   &timestamp);
-            } else {
-                ret = urg_.get_distance_intensity(distance, intensity,
-                                                  &timestamp);
-            }
-        } else {
-            intensity.clear();
-
-            if (setting_.is_multiecho) {
-                ret = urg_.get_multiecho(distance, &timestamp);
-            } else {
-                ret = urg_.get_distance(distance, &timestamp);
-            }
-        }
-
-        return ret;
-    }
-
-
     void start_csv_recording(void)
     {
         csv_recorder_.set_scan_setting(urg_.sensor_product_type(),
@@ -315,14 +481,19 @@ struct Receive_thread::pImpl
 
 Receive_thread::Receive_thread(hrk::Urg_driver& urg,
                                hrk::Urg_log_reader& urg_log_reader,
-                               Plotter_2d_widget& plotter_2d_widget)
-    : pimpl(new pImpl(this, urg, urg_log_reader, plotter_2d_widget))
+                               Plotter_2d_widget& plotter_2d_widget,
+                               Osc_publisher& osc_publisher,
+                               Fanout_server& fanout_server)
+    : pimpl(new pImpl(this, urg, urg_log_reader, plotter_2d_widget,
+                      osc_publisher, fanout_server))
 {
 }
 
 
 Receive_thread::~Receive_thread(void)
 {
+    // 描画側が保持する Scan_frame は frame_pool_ の領域のため、先に戻す
+    pimpl->plotter_2d_widget_.release_plot_data();
 }
 
 
@@ -343,6 +514,31 @@ void Receive_thread::set_scan_setting(const Scan_setting& setting,
 }
 
 
+void Receive_thread::set_background_subtraction(bool on,
+                                                const string& file_path,
+                                                size_t learning_scans,
+                                                long margin_mm)
+{
+    pimpl->mutex_.lock();
+    pimpl->is_background_subtraction_ = on;
+    pimpl->background_file_ = file_path;
+    pimpl->background_learning_scans_ = learning_scans;
+    pimpl->background_margin_ = margin_mm;
+    pimpl->is_background_updated_ = true;
+    pimpl->mutex_.unlock();
+}
+
+
+void Receive_thread::set_shared_memory(const string& name, size_t slots)
+{
+    pimpl->mutex_.lock();
+    pimpl->shm_name_ = name;
+    pimpl->shm_slots_ = slots;
+    pimpl->is_shm_updated_ = true;
+    pimpl->mutex_.unlock();
+}
+
+
 void Receive_thread::set_play_speed(double magnification)
 {
     pimpl->mutex_.lock();
@@ -11,6 +11,7 @@
 */
 
 #include <memory>
+#include <string>
 #include <QThread>
 
 namespace hrk
@@ -21,6 +22,8 @@ namespace hrk
 
 class Scan_setting;
 class Plotter_2d_widget;
+class Osc_publisher;
+class Fanout_server;
 
 
 class Receive_thread : public QThread
@@ -35,7 +38,9 @@ class Receive_thread : public QThread
     } mode_t;
 
     Receive_thread(hrk::Urg_driver& urg, hrk::Urg_log_reader& urg_log_reader,
-                   Plotter_2d_widget& plotter_2d_widget);
+                   Plotter_2d_widget& plotter_2d_widget,
+                   Osc_publisher& osc_publisher,
+                   Fanout_server& fanout_server);
     ~Receive_thread(void);
 
     void set_mode(mode_t mode);
@@ -51,6 +56,24 @@ class Receive_thread : public QThread
     void start_csv_recording(void);
     void save_csv_file(const char* file_path);
 
+    /*!
+      \brief 背景の除去を設定する
+
+      有効なときは、背景より手前の点のみを描画、記録、OSC に渡す。
+      file_path の背景がスキャンの設定と一致しなければ learning_scans 回の
+      スキャンで学習し直し、file_path に保存する。
+    */
+    void set_background_subtraction(bool on, const std::string& file_path,
+                                    size_t learning_scans, long margin_mm);
+
+    /*!
+      \brief 受信したスキャンを共有メモリに書き込む
+
+      name が空のときは書き込まない。同じ計算機上の他のプロセスは
+      Shm_scan_reader で name を開いてスキャンを読み出す。
+    */
+    void set_shared_memory(const std::string& name, size_t slots);
+
  signals:
     void receive_failed(const char* error_message);
     void received(void);
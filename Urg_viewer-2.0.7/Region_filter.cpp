@@ -0,0 +1,288 @@
+/*!
+  \file
+  \brief 領域による点の選別
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <algorithm>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "Region_filter.h"
+
+using namespace std;
+
+
+namespace
+{
+    enum {
+        Legacy_min_mm = 75,
+        Legacy_max_mm = 1300,
+    };
+
+
+    Region_filter::zone_t box_zone(const char* name, bool is_exclude,
+                                   float x0, float y0, float x1, float y1)
+    {
+        Region_filter::zone_t zone;
+        zone.name = name;
+        zone.shape = Region_filter::Polygon;
+        zone.is_exclude = is_exclude;
+        zone.radius = 0.0;
+
+        float xs[] = { x0, x1, x1, x0 };
+        float ys[] = { y0, y0, y1, y1 };
+        zone.x.assign(xs, xs + 4);
+        zone.y.assign(ys, ys + 4);
+
+        return zone;
+    }
+
+
+    // 多角形の 1 辺について、点から +x 方向への半直線と交差するかを求め、
+    // 交差したら inside[] を反転する。inside[] は 0 か全ビット 1 を格納する
+    void cross_edge(unsigned int* inside, const float* x, const float* y,
+                    size_t n, float x0, float y0, float x1, float y1)
+    {
+        if (y0 == y1) {
+            return;
+        }
+        const float slope = (x1 - x0) / (y1 - y0);
+
+        size_t i = 0;
+#if defined(__SSE2__)
+        const __m128 x0_4 = _mm_set1_ps(x0);
+        const __m128 y0_4 = _mm_set1_ps(y0);
+        const __m128 y1_4 = _mm_set1_ps(y1);
+        const __m128 slope_4 = _mm_set1_ps(slope);
+        for (; i + 4 <= n; i += 4) {
+            const __m128 py = _mm_loadu_ps(&y[i]);
+            const __m128 px = _mm_loadu_ps(&x[i]);
+            const __m128 is_straddle =
+                _mm_xor_ps(_mm_cmpgt_ps(y0_4, py), _mm_cmpgt_ps(y1_4, py));
+            const __m128 cross_x =
+                _mm_add_ps(x0_4, _mm_mul_ps(_mm_sub_ps(py, y0_4), slope_4));
+            const __m128 is_left = _mm_cmplt_ps(px, cross_x);
+
+            __m128i* p = reinterpret_cast<__m128i*>(&inside[i]);
+            const __m128i crossed =
+                _mm_castps_si128(_mm_and_ps(is_straddle, is_left));
+            _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), crossed));
+        }
+#endif
+        for (; i < n; ++i) {
+            const float py = y[i];
+            const unsigned int is_straddle = (y0 > py) != (y1 > py);
+            const unsigned int is_left = x[i] < x0 + (py - y0) * slope;
+            inside[i] ^= 0u - (is_straddle & is_left);
+        }
+    }
+
+
+    void inside_circle(unsigned int* inside, const float* x, const float* y,
+                       size_t n, float cx, float cy, float radius)
+    {
+        const float radius2 = radius * radius;
+
+        size_t i = 0;
+#if defined(__SSE2__)
+        const __m128 cx_4 = _mm_set1_ps(cx);
+        const __m128 cy_4 = _mm_set1_ps(cy);
+        const __m128 radius2_4 = _mm_set1_ps(radius2);
+        for (; i + 4 <= n; i += 4) {
+            const __m128 dx = _mm_sub_ps(_mm_loadu_ps(&x[i]), cx_4);
+            const __m128 dy = _mm_sub_ps(_mm_loadu_ps(&y[i]), cy_4);
+            const __m128 distance2 =
+                _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&inside[i]),
+                             _mm_castps_si128(_mm_cmple_ps(distance2,
+                                                           radius2_4)));
+        }
+#endif
+        for (; i < n; ++i) {
+            const float dx = x[i] - cx;
+            const float dy = y[i] - cy;
+            inside[i] = 0u - ((dx * dx + dy * dy) <= radius2);
+        }
+    }
+}
+
+
+struct Region_filter::pImpl
+{
+    vector<zone_t> zones_;
+    bool has_include_;
+    vector<unsigned int> inside_;
+    vector<unsigned int> masks_;
+    vector<size_t> occupancy_;
+
+
+    pImpl(void) : has_include_(false)
+    {
+    }
+
+
+    void set_zones(const vector<zone_t>& zones)
+    {
+        zones_.clear();
+        has_include_ = false;
+        vector<zone_t>::const_iterator end_it = zones.end();
+        for (vector<zone_t>::const_iterator it = zones.begin();
+             (it != end_it) && (zones_.size() < Max_zones); ++it) {
+            if (it->x.empty() || (it->x.size() != it->y.size()) ||
+                ((it->shape == Polygon) && (it->x.size() < 3))) {
+                continue;
+            }
+            zones_.push_back(*it);
+            has_include_ |= !it->is_exclude;
+        }
+        occupancy_.assign(zones_.size(), 0);
+    }
+
+
+    void test_zone(const zone_t& zone, const float* x, const float* y,
+                   size_t n)
+    {
+        unsigned int* inside = &inside_[0];
+        if (zone.shape == Circle) {
+            inside_circle(inside, x, y, n, zone.x[0], zone.y[0], zone.radius);
+            return;
+        }
+
+        fill(inside_.begin(), inside_.begin() + n, 0);
+        size_t vertices = zone.x.size();
+        for (size_t i = 0, j = vertices - 1; i < vertices; j = i++) {
+            cross_edge(inside, x, y, n,
+                       zone.x[j], zone.y[j], zone.x[i], zone.y[i]);
+        }
+    }
+
+
+    size_t filter(vector<float>& x, vector<float>& y, vector<int>* tags)
+    {
+        size_t n = min(x.size(), y.size());
+        if (tags) {
+            n = min(n, tags->size());
+        }
+        if (inside_.size() < n) {
+            inside_.resize(n);
+        }
+        masks_.assign(n, 0);
+
+        size_t zones = zones_.size();
+        for (size_t zone = 0; zone < zones; ++zone) {
+            size_t count = 0;
+            if (n > 0) {
+                test_zone(zones_[zone], &x[0], &y[0], n);
+                const unsigned int bit = 1u << zone;
+                for (size_t i = 0; i < n; ++i) {
+                    masks_[i] |= inside_[i] & bit;
+                    count += inside_[i] & 1;
+                }
+            }
+            occupancy_[zone] = count;
+        }
+
+        unsigned int include_mask = 0;
+        unsigned int exclude_mask = 0;
+        for (size_t zone = 0; zone < zones; ++zone) {
+            if (zones_[zone].is_exclude) {
+                exclude_mask |= 1u << zone;
+            } else {
+                include_mask |= 1u << zone;
+            }
+        }
+
+        // 出力する点を前に詰める
+        size_t filled = 0;
+        for (size_t i = 0; i < n; ++i) {
+            unsigned int mask = masks_[i];
+            if ((has_include_ && !(mask & include_mask)) ||
+                (mask & exclude_mask)) {
+                continue;
+            }
+            x[filled] = x[i];
+            y[filled] = y[i];
+            if (tags) {
+                (*tags)[filled] = (*tags)[i];
+            }
+            masks_[filled] = mask;
+            ++filled;
+        }
+        x.resize(filled);
+        y.resize(filled);
+        if (tags) {
+            tags->resize(filled);
+        }
+        masks_.resize(filled);
+
+        return filled;
+    }
+};
+
+
+Region_filter::Region_filter(void) : pimpl(new pImpl)
+{
+    pimpl->set_zones(default_zones());
+}
+
+
+Region_filter::~Region_filter(void)
+{
+}
+
+
+void Region_filter::set_zones(const vector<zone_t>& zones)
+{
+    pimpl->set_zones(zones);
+}
+
+
+const vector<Region_filter::zone_t>& Region_filter::zones(void) const
+{
+    return pimpl->zones_;
+}
+
+
+vector<Region_filter::zone_t> Region_filter::default_zones(void)
+{
+    const float min_mm = Legacy_min_mm;
+    const float max_mm = Legacy_max_mm;
+
+    vector<zone_t> zones;
+    zones.push_back(box_zone("area", false,
+                             -max_mm, -max_mm, max_mm, max_mm));
+    zones.push_back(box_zone("x_axis", true,
+                             -max_mm, -min_mm, max_mm, min_mm));
+    zones.push_back(box_zone("y_axis", true,
+                             -min_mm, -max_mm, min_mm, max_mm));
+    return zones;
+}
+
+
+size_t Region_filter::filter(vector<float>& x, vector<float>& y)
+{
+    return pimpl->filter(x, y, NULL);
+}
+
+
+size_t Region_filter::filter(vector<float>& x, vector<float>& y,
+                             vector<int>& tags)
+{
+    return pimpl->filter(x, y, &tags);
+}
+
+
+const vector<unsigned int>& Region_filter::zone_masks(void) const
+{
+    return pimpl->masks_;
+}
+
+
+const vector<size_t>& Region_filter::occupancy(void) const
+{
+    return pimpl->occupancy_;
+}
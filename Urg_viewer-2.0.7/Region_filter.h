@@ -0,0 +1,86 @@
+#ifndef REGION_FILTER_H
+#define REGION_FILTER_H
+
+/*!
+  \file
+  \brief 領域による点の選別
+
+  名前付きの多角形、円の領域で点を選別し、点毎に含まれる領域を記録する。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <memory>
+#include <string>
+#include <vector>
+
+
+class Region_filter
+{
+ public:
+    enum {
+        Max_zones = 32,         //!< zone_masks() のビット数
+    };
+
+    typedef enum {
+        Polygon,
+        Circle,
+    } shape_t;
+
+    /*!
+      \brief 領域
+
+      Polygon では x, y に頂点を並べる。Circle では x[0], y[0] が中心になる。
+    */
+    typedef struct
+    {
+        std::string name;
+        shape_t shape;
+        bool is_exclude;        //!< true ならば、この領域内の点を除外する
+        std::vector<float> x;
+        std::vector<float> y;
+        float radius;
+    } zone_t;
+
+    Region_filter(void);
+    ~Region_filter(void);
+
+    //! 先頭の Max_zones 個の領域のみを使う
+    void set_zones(const std::vector<zone_t>& zones);
+    const std::vector<zone_t>& zones(void) const;
+
+    //! 従来の |x|, |y| が 75 [mm] より大きく 1300 [mm] より小さい範囲
+    static std::vector<zone_t> default_zones(void);
+
+    /*!
+      \brief 点を選別する
+
+      出力される点は、いずれかの Include 領域に含まれ (Include 領域が
+      無いときは全ての点)、どの Exclude 領域にも含まれない点となる。
+      x, y は出力される点のみに詰め直される。
+
+      \return 出力される点の数
+    */
+    size_t filter(std::vector<float>& x, std::vector<float>& y);
+
+    //! 点毎の値 tags も、出力される点に合わせて詰め直す
+    size_t filter(std::vector<float>& x, std::vector<float>& y,
+                  std::vector<int>& tags);
+
+    //! 出力された点毎の、含まれる領域のビット列 (bit i が zones()[i])
+    const std::vector<unsigned int>& zone_masks(void) const;
+
+    //! 領域毎の、直前の filter() で領域内にあった点の数
+    const std::vector<size_t>& occupancy(void) const;
+
+ private:
+    Region_filter(const Region_filter& rhs);
+    Region_filter& operator = (const Region_filter& rhs);
+
+    struct pImpl;
+    std::auto_ptr<pImpl> pimpl;
+};
+
+#endif
@@ -5,13 +5,21 @@
   \file
   \brief リングバッファ
 
+  容量を 2 のべき乗に切り上げた連続領域に格納する。write_span(),
+  read_span() で格納位置、取り出し位置の連続した領域を直接参照できるため、
+  受信データを複製せずに格納、走査できる。
+
+  push(), ungetc() は容量が足りなければ領域を広げ、データを捨てない。
+  write_span() は領域を広げないため、満杯のときは受信を待たせる。
+
   \author Satofumi KAMIMURA
 
   $Id$
 */
 
 #include <cstddef>
-#include <deque>
+#include <algorithm>
+#include <vector>
 
 
 namespace hrk
@@ -21,7 +29,14 @@ namespace hrk
     class Ring_buffer
     {
     public:
-        Ring_buffer(void)
+        enum {
+            Default_capacity = 64 * 1024,
+        };
+
+
+        explicit Ring_buffer(size_t capacity = Default_capacity)
+            : buffer_(round_up_capacity(capacity)), mask_(buffer_.size() - 1),
+              first_(0), last_(0)
         {
         }
 
@@ -29,7 +44,14 @@ namespace hrk
         //! バッファサイズの取得
         size_t size(void) const
         {
-            return ring_buffer_.size();
+            return last_ - first_;
+        }
+
+
+        //! 格納できるデータの最大個数
+        size_t capacity(void) const
+        {
+            return buffer_.size();
         }
 
 
@@ -41,7 +63,7 @@ namespace hrk
         */
         bool empty(void) const
         {
-            return ring_buffer_.empty();
+            return (first_ == last_);
         }
 
 
@@ -55,9 +77,18 @@ namespace hrk
         */
         size_t push(const T* data, size_t size)
         {
-            const T* last_p = data + size;
-            ring_buffer_.insert(ring_buffer_.end(), data, last_p);
-            return size;
+            reserve_space(size);
+            size_t n = size;
+            size_t filled = 0;
+            while (filled < n) {
+                size_t span_size;
+                T* span = write_span(span_size);
+                size_t copy_size = std::min(span_size, n - filled);
+                std::copy(data + filled, data + filled + copy_size, span);
+                commit(copy_size);
+                filled += copy_size;
+            }
+            return n;
         }
 
 
@@ -71,9 +102,16 @@ namespace hrk
         */
         size_t pop(T* data, size_t size)
         {
-            size_t n = std::min(size, ring_buffer_.size());
-            std::copy(ring_buffer_.begin(), ring_buffer_.begin() + n, data);
-            ring_buffer_.erase(ring_buffer_.begin(), ring_buffer_.begin() + n);
+            size_t n = std::min(size, this->size());
+            size_t filled = 0;
+            while (filled < n) {
+                size_t span_size;
+                const T* span = read_span(span_size);
+                size_t copy_size = std::min(span_size, n - filled);
+                std::copy(span, span + copy_size, data + filled);
+                consume(copy_size);
+                filled += copy_size;
+            }
             return n;
         }
 
@@ -85,14 +123,129 @@ namespace hrk
         */
         void ungetc(const T ch)
         {
-            ring_buffer_.push_front(ch);
+            reserve_space(1);
+            --first_;
+            buffer_[first_ & mask_] = ch;
         }
 
 
         //! 格納データのクリア
         void clear(void)
         {
-            ring_buffer_.clear();
+            first_ = 0;
+            last_ = 0;
+        }
+
+
+        /*!
+          \brief 先頭から連続して読み出せる領域を返す
+
+          格納位置が領域の終端で折り返しているときは、折り返しまでを返す。
+
+          \param[out] size 領域のデータ個数
+        */
+        const T* read_span(size_t& size) const
+        {
+            size_t offset = first_ & mask_;
+            size = std::min(this->size(), capacity() - offset);
+            return &buffer_[offset];
+        }
+
+
+        //! read_span() で参照したデータのうち、先頭の n 個を取り除く
+        void consume(size_t n)
+        {
+            first_ += std::min(n, size());
+            if (first_ == last_) {
+                // 空になったときは、次の書き込み領域を最大にする
+                clear();
+            }
+        }
+
+
+        /*!
+          \brief 末尾に連続して書き込める領域を返す
+
+          \param[out] size 書き込める最大のデータ個数
+        */
+        T* write_span(size_t& size)
+        {
+            size_t offset = last_ & mask_;
+            size = std::min(capacity() - this->size(), capacity() - offset);
+            return &buffer_[offset];
+        }
+
+
+        //! write_span() の領域に書き込んだ n 個のデータを格納する
+        void commit(size_t n)
+        {
+            last_ += std::min(n, capacity() - size());
+        }
+
+
+        //! 格納データが領域の終端で折り返しているときは、連続した配置に並べ直す
+        void linearize(void)
+        {
+            size_t offset = first_ & mask_;
+            size_t n = size();
+            if ((offset + n) <= capacity()) {
+                return;
+            }
+            std::rotate(buffer_.begin(), buffer_.begin() + offset,
+                        buffer_.end());
+            first_ = 0;
+            last_ = n;
+        }
+
+
+        /*!
+          \brief 改行 (CR または LF) までの 1 行を取り出す
+
+          データは複製せず、領域内の 1 行を参照する。バッファが満杯で
+          改行が無いときは、格納データの全てを 1 行として取り出す。
+
+          \param[out] line 改行を含む 1 行。次にデータを格納するまで有効
+          \param[out] size line のデータ個数
+          \param[in,out] searched 改行を探し終えたデータ個数。最初は 0 を指定する
+
+          \retval true 1 行を取り出した
+          \retval false 改行が無い
+        */
+        bool read_line(const T*& line, size_t& size, size_t& searched)
+        {
+            linearize();
+
+            size_t n;
+            const T* p = read_span(n);
+            for (size_t i = searched; i < n; ++i) {
+                if ((p[i] == '\n') || (p[i] == '\r')) {
+                    line = p;
+                    size = i + 1;
+                    consume(size);
+                    return true;
+                }
+            }
+            searched = n;
+
+            if (n >= capacity()) {
+                line = p;
+                size = n;
+                consume(n);
+                return true;
+            }
+            return false;
+        }
+
+
+        //! 格納データの全てを、連続した領域として取り出す
+        size_t read_all(const T*& data)
+        {
+            linearize();
+
+            size_t n;
+            data = read_span(n);
+            consume(n);
+            return n;
         }
 
 
@@ -100,7 +253,39 @@ namespace hrk
         Ring_buffer(const Ring_buffer& rhs);
         Ring_buffer& operator = (const Ring_buffer& rhs);
 
-        std::deque<T> ring_buffer_;
+
+        // 空きが n 個以上になるまで領域を広げる
+        void reserve_space(size_t n)
+        {
+            size_t n_data = size();
+            if ((capacity() - n_data) >= n) {
+                return;
+            }
+
+            std::vector<T> buffer(round_up_capacity(n_data + n));
+            pop(&buffer[0], n_data);
+            buffer_.swap(buffer);
+            mask_ = buffer_.size() - 1;
+            first_ = 0;
+            last_ = n_data;
+        }
+
+
+        static size_t round_up_capacity(size_t capacity)
+        {
+            size_t n = 1;
+            while (n < capacity) {
+                n <<= 1;
+            }
+            return n;
+        }
+
+
+        std::vector<T> buffer_;
+        size_t mask_;
+        // 格納位置は折り返さずに増加させ、参照するときに mask_ を掛ける
+        size_t first_;
+        size_t last_;
     };
 }
 
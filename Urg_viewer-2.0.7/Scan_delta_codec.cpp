@@ -0,0 +1,521 @@
+/*!
+  \file
+  \brief スキャンの差分符号化
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstdlib>
+#include "Scan_delta_codec.h"
+
+using namespace std;
+
+
+namespace
+{
+    enum {
+        Format_version = 1,
+        Keyframe = 0,
+        Delta = 1,
+
+        // これ以下の間隔の run は、変化の無い値を含めて 1 つの run にまとめる
+        Merge_gap = 2,
+    };
+
+
+    typedef struct
+    {
+        size_t first;
+        size_t last;
+    } run_t;
+
+
+    void put_varint(vector<char>& output, unsigned long value)
+    {
+        while (value >= 0x80) {
+            output.push_back(static_cast<char>((value & 0x7f) | 0x80));
+            value >>= 7;
+        }
+        output.push_back(static_cast<char>(value));
+    }
+
+
+    void put_zigzag(vector<char>& output, long value)
+    {
+        unsigned long zigzag = (value < 0) ?
+            ((static_cast<unsigned long>(-(value + 1)) << 1) | 1) :
+            (static_cast<unsigned long>(value) << 1);
+        put_varint(output, zigzag);
+    }
+
+
+    bool get_varint(const unsigned char*& p, const unsigned char* end,
+                    unsigned long& value)
+    {
+        value = 0;
+        for (size_t shift = 0; (p < end) && (shift < 8 * sizeof(value));
+             shift += 7) {
+            unsigned char ch = *p++;
+            value |= static_cast<unsigned long>(ch & 0x7f) << shift;
+            if (!(ch & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+
+    bool get_zigzag(const unsigned char*& p, const unsigned char* end,
+                    long& value)
+    {
+        unsigned long zigzag;
+        if (!get_varint(p, end, zigzag)) {
+            return false;
+        }
+        value = (zigzag & 1) ?
+            -static_cast<long>(zigzag >> 1) - 1 : static_cast<long>(zigzag >> 1);
+        return true;
+    }
+
+
+    template <typename T>
+    void pack_values(vector<char>& output, const vector<T>& values)
+    {
+        long previous = 0;
+        for (typename vector<T>::const_iterator it = values.begin();
+             it != values.end(); ++it) {
+            long value = *it;
+            put_zigzag(output, value - previous);
+            previous = value;
+        }
+    }
+
+
+    template <typename T>
+    void pack_runs(vector<char>& output, vector<run_t>& runs,
+                   const vector<T>& values, const vector<T>& key,
+                   long threshold)
+    {
+        runs.clear();
+        size_t n = values.size();
+        for (size_t i = 0; i < n; ++i) {
+            long diff = static_cast<long>(values[i]) - static_cast<long>(key[i]);
+            if (labs(diff) <= threshold) {
+                continue;
+            }
+            if (!runs.empty() && ((i - runs.back().last) <= Merge_gap + 1)) {
+                runs.back().last = i;
+            } else {
+                run_t run;
+                run.first = i;
+                run.last = i;
+                runs.push_back(run);
+            }
+        }
+
+        put_varint(output, runs.size());
+        size_t next = 0;
+        for (vector<run_t>::const_iterator it = runs.begin();
+             it != runs.end(); ++it) {
+            put_varint(output, it->first - next);
+            put_varint(output, it->last - it->first + 1);
+            for (size_t i = it->first; i <= it->last; ++i) {
+                put_zigzag(output, static_cast<long>(values[i]) -
+                           static_cast<long>(key[i]));
+            }
+            next = it->last + 1;
+        }
+    }
+
+
+    template <typename T>
+    bool unpack_values(const unsigned char*& p, const unsigned char* end,
+                       vector<T>& values)
+    {
+        long previous = 0;
+        for (typename vector<T>::iterator it = values.begin();
+             it != values.end(); ++it) {
+            long diff;
+            if (!get_zigzag(p, end, diff)) {
+                return false;
+            }
+            previous += diff;
+            *it = static_cast<T>(previous);
+        }
+        return true;
+    }
+
+
+    template <typename T>
+    bool unpack_runs(const unsigned char*& p, const unsigned char* end,
+                     vector<T>& values, const vector<T>& key)
+    {
+        values = key;
+
+        unsigned long runs;
+        if (!get_varint(p, end, runs)) {
+            return false;
+        }
+        size_t next = 0;
+        for (unsigned long run = 0; run < runs; ++run) {
+            unsigned long gap;
+            unsigned long length;
+            if (!get_varint(p, end, gap) || !get_varint(p, end, length)) {
+                return false;
+            }
+            size_t first = next + gap;
+            if ((first > values.size()) || (length > values.size() - first)) {
+                return false;
+            }
+            for (size_t i = first; i < first + length; ++i) {
+                long diff;
+                if (!get_zigzag(p, end, diff)) {
+                    return false;
+                }
+                values[i] = static_cast<T>(static_cast<long>(key[i]) + diff);
+            }
+            next = first + length;
+        }
+        return true;
+    }
+}
+
+
+struct Scan_delta_encoder::pImpl
+{
+    parameter_t parameter_;
+    bool is_keyframe_requested_;
+    unsigned long sequence_;
+    unsigned long key_sequence_;
+    size_t scans_from_keyframe_;
+
+    int first_step_;
+    int group_steps_;
+    int echo_size_;
+    vector<long> key_distance_;
+    vector<unsigned short> key_intensity_;
+    vector<run_t> runs_;
+
+
+    pImpl(void)
+        : parameter_(default_parameter()), is_keyframe_requested_(true),
+          sequence_(0), key_sequence_(0), scans_from_keyframe_(0),
+          first_step_(0), group_steps_(0), echo_size_(0)
+    {
+    }
+
+
+    bool is_layout_changed(int first_step, int group_steps, int echo_size,
+                           const vector<long>& distance,
+                           const vector<unsigned short>& intensity) const
+    {
+        return (first_step != first_step_) || (group_steps != group_steps_) ||
+            (echo_size != echo_size_) ||
+            (distance.size() != key_distance_.size()) ||
+            (intensity.size() != key_intensity_.size());
+    }
+
+
+    void encode(vector<char>& output, int type, long timestamp,
+                int first_step, int group_steps, int echo_size,
+                const vector<long>& distance,
+                const vector<unsigned short>& intensity)
+    {
+        bool is_keyframe = is_keyframe_requested_ ||
+            (++scans_from_keyframe_ >= parameter_.keyframe_interval) ||
+            is_layout_changed(first_step, group_steps, echo_size,
+                              distance, intensity);
+        unsigned long sequence = sequence_++;
+        if (is_keyframe) {
+            is_keyframe_requested_ = false;
+            scans_from_keyframe_ = 0;
+            key_sequence_ = sequence;
+            first_step_ = first_step;
+            group_steps_ = group_steps;
+            echo_size_ = echo_size;
+            key_distance_ = distance;
+            key_intensity_ = intensity;
+        }
+
+        output.clear();
+        output.push_back(static_cast<char>((Format_version << 4) |
+                                           (is_keyframe ? Keyframe : Delta)));
+        put_varint(output, sequence);
+        put_varint(output, key_sequence_);
+        put_varint(output, type);
+        put_zigzag(output, timestamp);
+        put_varint(output, first_step);
+        put_varint(output, group_steps);
+        put_varint(output, echo_size);
+        put_varint(output, distance.size());
+        put_varint(output, intensity.size());
+
+        if (is_keyframe) {
+            pack_values(output, distance);
+            pack_values(output, intensity);
+        } else {
+            pack_runs(output, runs_, distance, key_distance_,
+                      parameter_.distance_threshold);
+            pack_runs(output, runs_, intensity, key_intensity_,
+                      parameter_.intensity_threshold);
+        }
+    }
+};
+
+
+Scan_delta_encoder::Scan_delta_encoder(void) : pimpl(new pImpl)
+{
+}
+
+
+Scan_delta_encoder::~Scan_delta_encoder(void)
+{
+}
+
+
+Scan_delta_encoder::parameter_t Scan_delta_encoder::default_parameter(void)
+{
+    parameter_t parameter;
+    parameter.keyframe_interval = Default_keyframe_interval;
+    parameter.distance_threshold = Default_distance_threshold;
+    parameter.intensity_threshold = Default_intensity_threshold;
+    return parameter;
+}
+
+
+void Scan_delta_encoder::set_parameter(const parameter_t& parameter)
+{
+    pimpl->parameter_ = parameter;
+    if (pimpl->parameter_.keyframe_interval < 1) {
+        pimpl->parameter_.keyframe_interval = 1;
+    }
+    pimpl->is_keyframe_requested_ = true;
+}
+
+
+Scan_delta_encoder::parameter_t Scan_delta_encoder::parameter(void) const
+{
+    return pimpl->parameter_;
+}
+
+
+void Scan_delta_encoder::request_keyframe(void)
+{
+    pimpl->is_keyframe_requested_ = true;
+}
+
+
+void Scan_delta_encoder::encode(vector<char>& output,
+                                int type, long timestamp,
+                                int first_step, int group_steps, int echo_size,
+                                const vector<long>& distance,
+                                const vector<unsigned short>& intensity)
+{
+    pimpl->encode(output, type, timestamp, first_step, group_steps, echo_size,
+                  distance, intensity);
+}
+
+
+struct Scan_delta_decoder::pImpl
+{
+    bool is_keyframe_;
+    unsigned long sequence_;
+    int type_;
+    long timestamp_;
+    int first_step_;
+    int group_steps_;
+    int echo_size_;
+    vector<long> distance_;
+    vector<unsigned short> intensity_;
+
+    bool has_keyframe_;
+    unsigned long key_sequence_;
+    vector<long> key_distance_;
+    vector<unsigned short> key_intensity_;
+
+    bool has_sequence_;
+    size_t lost_scans_;
+    size_t undecodable_scans_;
+
+
+    pImpl(void)
+        : is_keyframe_(false), sequence_(0), type_(0), timestamp_(0),
+          first_step_(0), group_steps_(0), echo_size_(0),
+          has_keyframe_(false), key_sequence_(0), has_sequence_(false),
+          lost_scans_(0), undecodable_scans_(0)
+    {
+    }
+
+
+    void count_lost_scans(unsigned long sequence)
+    {
+        if (has_sequence_ && (sequence > sequence_ + 1)) {
+            lost_scans_ += sequence - sequence_ - 1;
+        }
+        has_sequence_ = true;
+        sequence_ = sequence;
+    }
+
+
+    bool decode(const char* data, size_t data_size)
+    {
+        if (data_size < 1) {
+            return false;
+        }
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+        const unsigned char* end = p + data_size;
+
+        unsigned char kind = *p++;
+        if (((kind >> 4) != Format_version) ||
+            (((kind & 0x0f) != Keyframe) && ((kind & 0x0f) != Delta))) {
+            return false;
+        }
+        bool is_keyframe = ((kind & 0x0f) == Keyframe);
+
+        unsigned long sequence;
+        unsigned long key_sequence;
+        unsigned long type;
+        long timestamp;
+        unsigned long first_step;
+        unsigned long group_steps;
+        unsigned long echo_size;
+        unsigned long distance_size;
+        unsigned long intensity_size;
+        if (!get_varint(p, end, sequence) ||
+            !get_varint(p, end, key_sequence) ||
+            !get_varint(p, end, type) || !get_zigzag(p, end, timestamp) ||
+            !get_varint(p, end, first_step) ||
+            !get_varint(p, end, group_steps) ||
+            !get_varint(p, end, echo_size) ||
+            !get_varint(p, end, distance_size) ||
+            !get_varint(p, end, intensity_size)) {
+            return false;
+        }
+
+        // 1 つの値は少なくとも 1 byte で格納される
+        size_t left_size = end - p;
+        if (is_keyframe && ((distance_size > left_size) ||
+                            (intensity_size > left_size - distance_size))) {
+            return false;
+        }
+        count_lost_scans(sequence);
+
+        if (is_keyframe) {
+            key_distance_.resize(distance_size);
+            key_intensity_.resize(intensity_size);
+            has_keyframe_ = unpack_values(p, end, key_distance_) &&
+                unpack_values(p, end, key_intensity_);
+            if (!has_keyframe_) {
+                return false;
+            }
+            key_sequence_ = sequence;
+            distance_ = key_distance_;
+            intensity_ = key_intensity_;
+
+        } else {
+            // 参照する keyframe を受信していなければ、復元できない
+            if (!has_keyframe_ || (key_sequence != key_sequence_) ||
+                (distance_size != key_distance_.size()) ||
+                (intensity_size != key_intensity_.size())) {
+                ++undecodable_scans_;
+                return false;
+            }
+            if (!unpack_runs(p, end, distance_, key_distance_) ||
+                !unpack_runs(p, end, intensity_, key_intensity_)) {
+                return false;
+            }
+        }
+
+        is_keyframe_ = is_keyframe;
+        type_ = type;
+        timestamp_ = timestamp;
+        first_step_ = first_step;
+        group_steps_ = group_steps;
+        echo_size_ = echo_size;
+        return true;
+    }
+};
+
+
+Scan_delta_decoder::Scan_delta_decoder(void) : pimpl(new pImpl)
+{
+}
+
+
+Scan_delta_decoder::~Scan_delta_decoder(void)
+{
+}
+
+
+bool Scan_delta_decoder::decode(const char* data, size_t data_size)
+{
+    return pimpl->decode(data, data_size);
+}
+
+
+bool Scan_delta_decoder::is_keyframe(void) const
+{
+    return pimpl->is_keyframe_;
+}
+
+
+unsigned long Scan_delta_decoder::sequence(void) const
+{
+    return pimpl->sequence_;
+}
+
+
+int Scan_delta_decoder::type(void) const
+{
+    return pimpl->type_;
+}
+
+
+long Scan_delta_decoder::timestamp(void) const
+{
+    return pimpl->timestamp_;
+}
+
+
+int Scan_delta_decoder::first_step(void) const
+{
+    return pimpl->first_step_;
+}
+
+
+int Scan_delta_decoder::group_steps(void) const
+{
+    return pimpl->group_steps_;
+}
+
+
+int Scan_delta_decoder::echo_size(void) const
+{
+    return pimpl->echo_size_;
+}
+
+
+const vector<long>& Scan_delta_decoder::distance(void) const
+{
+    return pimpl->distance_;
+}
+
+
+const vector<unsigned short>& Scan_delta_decoder::intensity(void) const
+{
+    return pimpl->intensity_;
+}
+
+
+size_t Scan_delta_decoder::lost_scans(void) const
+{
+    return pimpl->lost_scans_;
+}
+
+
+size_t Scan_delta_decoder::undecodable_scans(void) const
+{
+    return pimpl->undecodable_scans_;
+}
@@ -0,0 +1,122 @@
+#ifndef SCAN_DELTA_CODEC_H
+#define SCAN_DELTA_CODEC_H
+
+/*!
+  \file
+  \brief スキャンの差分符号化
+
+  keyframe_interval スキャン毎に全ての値を送る keyframe を、その間は
+  keyframe から閾値を超えて変化したステップのみを送る delta を生成する。
+  delta は直前の keyframe のみを参照するため、delta が欠落しても後続の
+  スキャンは復元できる。keyframe が欠落したときは、次の keyframe まで
+  復元できないスキャンとして読み捨てる。
+
+  符号化したデータは以下の列になる。varint は LEB128、zigzag は符号付きの
+  値を zigzag 変換した varint を表す。
+  - uint8 (Format_version << 4) | (Keyframe = 0, Delta = 1)
+  - varint スキャン番号, varint 参照する keyframe のスキャン番号
+  - varint 計測の種類, zigzag タイムスタンプ [msec]
+  - varint first_step, varint group_steps, varint echo_size
+  - varint 距離データの数, varint 強度データの数
+  - keyframe: 距離、強度の順に、直前の値との差を zigzag で格納する
+  - delta: 距離、強度の順に varint run の数、run 毎に varint 直前の run
+    からの間隔、varint 長さ、keyframe の値との差を zigzag で格納する
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+
+
+class Scan_delta_encoder
+{
+ public:
+    typedef struct
+    {
+        size_t keyframe_interval; //!< keyframe を送るスキャンの間隔
+        long distance_threshold;  //!< 送信する距離の変化量 [mm]
+        long intensity_threshold; //!< 送信する強度の変化量
+    } parameter_t;
+
+    enum {
+        Default_keyframe_interval = 20,
+        Default_distance_threshold = 30,
+        Default_intensity_threshold = 100,
+    };
+
+    Scan_delta_encoder(void);
+    ~Scan_delta_encoder(void);
+
+    static parameter_t default_parameter(void);
+    void set_parameter(const parameter_t& parameter);
+    parameter_t parameter(void) const;
+
+    //! 次のスキャンを keyframe にする
+    void request_keyframe(void);
+
+    /*!
+      \brief スキャンを符号化する
+
+      データの数やステップの設定が変わったときは、keyframe を生成する。
+
+      \param[out] output 符号化したデータ。以前の内容は破棄される
+    */
+    void encode(std::vector<char>& output,
+                int type, long timestamp,
+                int first_step, int group_steps, int echo_size,
+                const std::vector<long>& distance,
+                const std::vector<unsigned short>& intensity);
+
+ private:
+    Scan_delta_encoder(const Scan_delta_encoder& rhs);
+    Scan_delta_encoder& operator = (const Scan_delta_encoder& rhs);
+
+    struct pImpl;
+    std::auto_ptr<pImpl> pimpl;
+};
+
+
+//! Scan_delta_encoder で符号化したデータの復元
+class Scan_delta_decoder
+{
+ public:
+    Scan_delta_decoder(void);
+    ~Scan_delta_decoder(void);
+
+    /*!
+      \brief 符号化したデータを復元する
+
+      \retval true スキャンを復元した
+      \retval false データが不正、または参照する keyframe を受信していない
+    */
+    bool decode(const char* data, size_t data_size);
+
+    bool is_keyframe(void) const;
+    unsigned long sequence(void) const;
+    int type(void) const;
+    long timestamp(void) const;
+    int first_step(void) const;
+    int group_steps(void) const;
+    int echo_size(void) const;
+    const std::vector<long>& distance(void) const;
+    const std::vector<unsigned short>& intensity(void) const;
+
+    //! スキャン番号の欠落から求めた、受信できなかったスキャンの数
+    size_t lost_scans(void) const;
+
+    //! keyframe を受信していないために、復元できなかったスキャンの数
+    size_t undecodable_scans(void) const;
+
+ private:
+    Scan_delta_decoder(const Scan_delta_decoder& rhs);
+    Scan_delta_decoder& operator = (const Scan_delta_decoder& rhs);
+
+    struct pImpl;
+    std::auto_ptr<pImpl> pimpl;
+};
+
+#endif
@@ -0,0 +1,178 @@
+/*!
+  \file
+  \brief 1 回のスキャンの計測データ
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include "detect_os.h"
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <new>
+#if defined(WINDOWS_OS)
+#include <malloc.h>
+#endif
+#include "Scan_frame.h"
+
+using namespace hrk;
+using namespace std;
+
+
+namespace
+{
+    size_t round_up(size_t size)
+    {
+        const size_t mask = Scan_frame::Cache_line_size - 1;
+        return (size + mask) & ~mask;
+    }
+
+
+    char* aligned_allocate(size_t size)
+    {
+#if defined(WINDOWS_OS)
+        return static_cast<char*>(
+            _aligned_malloc(size, Scan_frame::Cache_line_size));
+#else
+        void* memory = NULL;
+        if (posix_memalign(&memory, Scan_frame::Cache_line_size, size)) {
+            return NULL;
+        }
+        return static_cast<char*>(memory);
+#endif
+    }
+
+
+    void aligned_free(char* memory)
+    {
+#if defined(WINDOWS_OS)
+        _aligned_free(memory);
+#else
+        free(memory);
+#endif
+    }
+}
+
+
+Scan_frame::Scan_frame(void)
+    : type(Lidar::Distance), echo_size(1),
+      first_step(0), last_step(0), group_steps(1),
+      sensor_timestamp(0), host_timestamp(0), sequence(0),
+      steps_(0), capacity_(0), has_intensity_(false),
+      memory_(NULL), distance_(NULL), intensity_(NULL)
+{
+}
+
+
+Scan_frame::Scan_frame(const Scan_frame& rhs)
+    : type(Lidar::Distance), echo_size(1),
+      first_step(0), last_step(0), group_steps(1),
+      sensor_timestamp(0), host_timestamp(0), sequence(0),
+      steps_(0), capacity_(0), has_intensity_(false),
+      memory_(NULL), distance_(NULL), intensity_(NULL)
+{
+    *this = rhs;
+}
+
+
+Scan_frame& Scan_frame::operator = (const Scan_frame& rhs)
+{
+    if (this == &rhs) {
+        return *this;
+    }
+
+    resize(rhs.steps_, rhs.echo_size, rhs.has_intensity_);
+    size_t n = rhs.size();
+    if (n > 0) {
+        memcpy(distance_, rhs.distance_, n * sizeof(distance_[0]));
+        if (has_intensity_) {
+            memcpy(intensity_, rhs.intensity_, n * sizeof(intensity_[0]));
+        }
+    }
+
+    type = rhs.type;
+    first_step = rhs.first_step;
+    last_step = rhs.last_step;
+    group_steps = rhs.group_steps;
+    sensor_timestamp = rhs.sensor_timestamp;
+    host_timestamp = rhs.host_timestamp;
+    sequence = rhs.sequence;
+
+    return *this;
+}
+
+
+Scan_frame::~Scan_frame(void)
+{
+    aligned_free(memory_);
+}
+
+
+void Scan_frame::reserve(size_t size)
+{
+    if (size <= capacity_) {
+        return;
+    }
+
+    // 距離と強度の配列を 1 つの領域に並べ、それぞれの先頭を揃える
+    size_t distance_bytes = round_up(size * sizeof(distance_[0]));
+    size_t intensity_bytes = round_up(size * sizeof(intensity_[0]));
+    char* memory = aligned_allocate(distance_bytes + intensity_bytes);
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+
+    aligned_free(memory_);
+    memory_ = memory;
+    distance_ = reinterpret_cast<uint32_t*>(memory_);
+    intensity_ = reinterpret_cast<uint16_t*>(memory_ + distance_bytes);
+    capacity_ = size;
+}
+
+
+void Scan_frame::resize(size_t steps, int echo_size, bool with_intensity)
+{
+    this->echo_size = max(echo_size, 1);
+    reserve(steps * this->echo_size);
+    steps_ = steps;
+    has_intensity_ = with_intensity;
+}
+
+
+void Scan_frame::set_steps(size_t steps)
+{
+    steps_ = min(steps, capacity_ / echo_size);
+}
+
+
+void Scan_frame::clear(void)
+{
+    steps_ = 0;
+}
+
+
+bool Scan_frame::empty(void) const
+{
+    return (steps_ == 0) ? true : false;
+}
+
+
+void Scan_frame::swap(Scan_frame& rhs)
+{
+    std::swap(type, rhs.type);
+    std::swap(echo_size, rhs.echo_size);
+    std::swap(first_step, rhs.first_step);
+    std::swap(last_step, rhs.last_step);
+    std::swap(group_steps, rhs.group_steps);
+    std::swap(sensor_timestamp, rhs.sensor_timestamp);
+    std::swap(host_timestamp, rhs.host_timestamp);
+    std::swap(sequence, rhs.sequence);
+    std::swap(steps_, rhs.steps_);
+    std::swap(capacity_, rhs.capacity_);
+    std::swap(has_intensity_, rhs.has_intensity_);
+    std::swap(memory_, rhs.memory_);
+    std::swap(distance_, rhs.distance_);
+    std::swap(intensity_, rhs.intensity_);
+}
@@ -0,0 +1,116 @@
+#ifndef HRK_SCAN_FRAME_H
+#define HRK_SCAN_FRAME_H
+
+/*!
+  \file
+  \brief 1 回のスキャンの計測データ
+
+  距離と強度を別々の配列に格納する。距離は 18 bit に収まるため
+  uint32_t、強度は uint16_t で保持する。配列の先頭はキャッシュラインの
+  境界に揃える。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstddef>
+#include <stdint.h>
+#include "Lidar.h"
+
+
+namespace hrk
+{
+    //! 1 回のスキャンの計測データ
+    class Scan_frame
+    {
+    public:
+        enum {
+            Cache_line_size = 64,
+        };
+
+        Lidar::measurement_t type;
+        int echo_size;          //!< 1 ステップ当たりのエコー数
+        int first_step;         //!< 先頭のデータのステップ
+        int last_step;          //!< 最後のデータのステップ
+        int group_steps;        //!< 1 つのデータにまとめたステップ数
+        long sensor_timestamp;  //!< センサのタイムスタンプ
+        long long host_timestamp; //!< 先頭のデータが届いた UNIX 時刻 [nsec]
+        unsigned long sequence; //!< 受信したスキャン毎に増加する番号
+
+        Scan_frame(void);
+        Scan_frame(const Scan_frame& rhs);
+        Scan_frame& operator = (const Scan_frame& rhs);
+        ~Scan_frame(void);
+
+        /*!
+          \brief steps ステップ分のデータを格納できるようにする
+
+          確保済みの領域に収まるときは、確保し直さない。格納されていた
+          データは保持しない。
+
+          \param[in] steps ステップ数
+          \param[in] echo_size 1 ステップ当たりのエコー数
+          \param[in] with_intensity 強度を格納するか
+        */
+        void resize(size_t steps, int echo_size, bool with_intensity);
+
+        //! 受信したステップ数を設定する。resize() の steps 以下にする
+        void set_steps(size_t steps);
+
+        //! データを空にする。確保済みの領域は解放しない
+        void clear(void);
+        bool empty(void) const;
+        void swap(Scan_frame& rhs);
+
+        size_t steps(void) const
+        {
+            return steps_;
+        }
+
+        //! 格納している値の個数。steps() * echo_size
+        size_t size(void) const
+        {
+            return steps_ * echo_size;
+        }
+
+        bool has_intensity(void) const
+        {
+            return has_intensity_;
+        }
+
+        //! steps() * echo_size 個の距離 [mm]
+        uint32_t* distance(void)
+        {
+            return distance_;
+        }
+
+        const uint32_t* distance(void) const
+        {
+            return distance_;
+        }
+
+        //! 強度。has_intensity() が false のときは NULL
+        uint16_t* intensity(void)
+        {
+            return has_intensity_ ? intensity_ : NULL;
+        }
+
+        const uint16_t* intensity(void) const
+        {
+            return has_intensity_ ? intensity_ : NULL;
+        }
+
+    private:
+        void reserve(size_t size);
+
+        size_t steps_;
+        size_t capacity_;
+        bool has_intensity_;
+        char* memory_;
+        uint32_t* distance_;
+        uint16_t* intensity_;
+    };
+}
+
+#endif
@@ -0,0 +1,135 @@
+/*!
+  \file
+  \brief 使い回す Scan_frame の保持
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include "detect_os.h"
+#include <vector>
+#if defined(WINDOWS_OS)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+#include "Scan_frame_pool.h"
+#include "Scan_frame.h"
+
+using namespace hrk;
+using namespace std;
+
+
+struct Scan_frame_pool::pImpl
+{
+    vector<Scan_frame> frames_;
+    vector<Scan_frame*> free_frames_;
+#if defined(WINDOWS_OS)
+    mutable CRITICAL_SECTION mutex_;
+#else
+    mutable pthread_mutex_t mutex_;
+#endif
+
+
+    pImpl(size_t frames)
+        : frames_(frames)
+    {
+#if defined(WINDOWS_OS)
+        InitializeCriticalSection(&mutex_);
+#else
+        pthread_mutex_init(&mutex_, NULL);
+#endif
+        // 全てを戻したときに push_back() で確保し直さないようにする
+        free_frames_.reserve(frames);
+        for (size_t i = 0; i < frames; ++i) {
+            free_frames_.push_back(&frames_[i]);
+        }
+    }
+
+
+    ~pImpl(void)
+    {
+#if defined(WINDOWS_OS)
+        DeleteCriticalSection(&mutex_);
+#else
+        pthread_mutex_destroy(&mutex_);
+#endif
+    }
+
+
+    void lock(void) const
+    {
+#if defined(WINDOWS_OS)
+        EnterCriticalSection(&mutex_);
+#else
+        pthread_mutex_lock(&mutex_);
+#endif
+    }
+
+
+    void unlock(void) const
+    {
+#if defined(WINDOWS_OS)
+        LeaveCriticalSection(&mutex_);
+#else
+        pthread_mutex_unlock(&mutex_);
+#endif
+    }
+};
+
+
+Scan_frame_pool::Scan_frame_pool(size_t frames) : pimpl(new pImpl(frames))
+{
+}
+
+
+Scan_frame_pool::~Scan_frame_pool(void)
+{
+}
+
+
+void Scan_frame_pool::reserve(size_t steps, int echo_size,
+                              bool with_intensity)
+{
+    pimpl->lock();
+    vector<Scan_frame*>::iterator it = pimpl->free_frames_.begin();
+    for (; it != pimpl->free_frames_.end(); ++it) {
+        (*it)->resize(steps, echo_size, with_intensity);
+        (*it)->clear();
+    }
+    pimpl->unlock();
+}
+
+
+Scan_frame* Scan_frame_pool::acquire(void)
+{
+    Scan_frame* frame = NULL;
+    pimpl->lock();
+    if (!pimpl->free_frames_.empty()) {
+        frame = pimpl->free_frames_.back();
+        pimpl->free_frames_.pop_back();
+    }
+    pimpl->unlock();
+    return frame;
+}
+
+
+void Scan_frame_pool::release(Scan_frame* frame)
+{
+    if (!frame) {
+        return;
+    }
+    pimpl->lock();
+    pimpl->free_frames_.push_back(frame);
+    pimpl->unlock();
+}
+
+
+size_t Scan_frame_pool::available(void) const
+{
+    pimpl->lock();
+    size_t n = pimpl->free_frames_.size();
+    pimpl->unlock();
+    return n;
+}
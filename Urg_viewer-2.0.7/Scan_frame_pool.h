@@ -0,0 +1,66 @@
+#ifndef HRK_SCAN_FRAME_POOL_H
+#define HRK_SCAN_FRAME_POOL_H
+
+/*!
+  \file
+  \brief 使い回す Scan_frame の保持
+
+  受信側が acquire() で取り出した Scan_frame にスキャンを受信し、
+  利用側が使い終えたら release() で戻す。reserve() で領域を確保して
+  おけば、以降のスキャンの受信ではメモリを確保しない。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <memory>
+#include <cstddef>
+
+
+namespace hrk
+{
+    class Scan_frame;
+
+
+    //! 使い回す Scan_frame の保持
+    class Scan_frame_pool
+    {
+    public:
+        enum {
+            Default_frames = 4,
+        };
+
+        explicit Scan_frame_pool(size_t frames = Default_frames);
+        ~Scan_frame_pool(void);
+
+        /*!
+          \brief 空いている全ての Scan_frame の領域を確保する
+
+          取り出されている Scan_frame は、受信するときに確保し直される。
+        */
+        void reserve(size_t steps, int echo_size, bool with_intensity);
+
+        /*!
+          \brief 空いている Scan_frame を取り出す
+
+          \return 全て取り出されているときは NULL
+        */
+        Scan_frame* acquire(void);
+
+        //! 取り出した Scan_frame を戻す。NULL のときは何もしない
+        void release(Scan_frame* frame);
+
+        //! 空いている Scan_frame の数
+        size_t available(void) const;
+
+    private:
+        Scan_frame_pool(const Scan_frame_pool& rhs);
+        Scan_frame_pool& operator = (const Scan_frame_pool& rhs);
+
+        struct pImpl;
+        std::auto_ptr<pImpl> pimpl;
+    };
+}
+
+#endif
@@ -0,0 +1,611 @@
+/*!
+  \file
+  \brief SCIP 応答のストリーム解析
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include "Scip_stream_parser.h"
+#include "scip_decode.h"
+
+using namespace hrk;
+using namespace std;
+
+
+namespace
+{
+    enum {
+        Max_line_size = 1024,
+        Decode_values_size = 24,
+        Max_unit_size = 6,
+    };
+
+
+    typedef enum {
+        Echo,
+        Status,
+        Time_stamp,
+        Data,
+        Skip,
+    } state_t;
+
+
+    long decode(const char data[], int size)
+    {
+        int value = 0;
+        for (int i = 0; i < size; ++i) {
+            value <<= 6;
+            value &= ~0x3f;
+            value |= data[i] - 0x30;
+        }
+        return value;
+    }
+
+
+    // Byte 文字エンコードの値を続けてデコードする
+    template <int Byte>
+    void decode_values(const char data[], int values_size, int values[]);
+
+
+    template <>
+    void decode_values<2>(const char data[], int values_size, int values[])
+    {
+        scip_decode2(data, values_size, values);
+    }
+
+
+    template <>
+    void decode_values<3>(const char data[], int values_size, int values[])
+    {
+        scip_decode3(data, values_size, values);
+    }
+
+
+    // Byte 文字エンコードの計測データを Scan_frame の配列にデコードする
+    template <int Byte>
+    void decode_frame(const char data[], int steps, int stride,
+                      uint32_t length[], uint16_t intensity[]);
+
+
+    template <>
+    void decode_frame<2>(const char data[], int steps, int stride,
+                         uint32_t length[], uint16_t intensity[])
+    {
+        scip_decode2(data, steps, stride, length, intensity);
+    }
+
+
+    template <>
+    void decode_frame<3>(const char data[], int steps, int stride,
+                         uint32_t length[], uint16_t intensity[])
+    {
+        scip_decode3(data, steps, stride, length, intensity);
+    }
+
+
+    int parse_parameter(const char* parameter, int size)
+    {
+        char buffer[5];
+        memcpy(buffer, parameter, size);
+        buffer[size] = '\0';
+
+        return strtol(buffer, NULL, 10);
+    }
+}
+
+
+struct Scip_stream_parser::pImpl
+{
+    typedef void (pImpl::*decode_line_t)(const char* data, size_t size);
+
+    Handler& handler_;
+    int max_echo_size_;
+
+    long* next_length_;
+    unsigned short* next_intensity_;
+    uint32_t* next_length32_;
+    uint16_t* next_intensity16_;
+    size_t next_max_size_;
+    long* length_;
+    unsigned short* intensity_;
+    uint32_t* length32_;
+    uint16_t* intensity16_;
+    size_t max_size_;
+    bool has_output_;
+
+    state_t state_;
+    string carry_;
+    bool is_dropping_line_;
+    string echo_;
+    string status_;
+    response_t response_;
+
+    // 計測データのデコードの状態
+    bool is_intensity_;
+    bool is_continuous_;
+    int data_size_;
+    char unit_[Max_unit_size];
+    int unit_size_;
+    int step_;
+    int multiecho_index_;
+    bool is_next_echo_;
+    decode_line_t decode_line_;
+
+
+    pImpl(Handler& handler, int max_echo_size)
+        : handler_(handler), max_echo_size_(max_echo_size),
+          next_length_(NULL), next_intensity_(NULL),
+          next_length32_(NULL), next_intensity16_(NULL), next_max_size_(0),
+          length_(NULL), intensity_(NULL),
+          length32_(NULL), intensity16_(NULL), max_size_(0),
+          has_output_(false), state_(Echo), is_dropping_line_(false),
+          is_intensity_(false), is_continuous_(false),
+          data_size_(3), unit_size_(0), step_(0), multiecho_index_(0),
+          is_next_echo_(false),
+          decode_line_(&pImpl::decode_line<Lidar::Distance, 3>)
+    {
+        carry_.reserve(Max_line_size);
+    }
+
+
+    void clear(void)
+    {
+        state_ = Echo;
+        carry_.clear();
+        is_dropping_line_ = false;
+        unit_size_ = 0;
+    }
+
+
+    size_t push(const char* data, size_t size)
+    {
+        const char* p = data;
+        const char* last_p = data + size;
+        while (p < last_p) {
+            const char* lf_p =
+                static_cast<const char*>(memchr(p, '\n', last_p - p));
+            if (!lf_p) {
+                // 行の残りは、次の push() で受け取る
+                if (is_dropping_line_) {
+                    return size;
+                }
+                if ((carry_.size() + (last_p - p)) > Max_line_size) {
+                    response_.error = Line_length_error;
+                    carry_.clear();
+                    is_dropping_line_ = true;
+                } else {
+                    carry_.append(p, last_p);
+                }
+                return size;
+            }
+            if (is_dropping_line_) {
+                // 長すぎた行は、改行まで読み捨てる
+                is_dropping_line_ = false;
+                p = lf_p + 1;
+                continue;
+            }
+
+            const char* line = p;
+            size_t line_size = lf_p - p;
+            if (!carry_.empty()) {
+                carry_.append(p, lf_p);
+                line = carry_.data();
+                line_size = carry_.size();
+            }
+            p = lf_p + 1;
+
+            if ((line_size > 0) && (line[line_size - 1] == '\r')) {
+                --line_size;
+            }
+            bool is_completed = parse_line(line, line_size);
+            carry_.clear();
+
+            if (is_completed) {
+                response_.echo = echo_.c_str();
+                response_.status = status_.c_str();
+                response_.steps = step_;
+                state_ = Echo;
+                handler_.response_received(response_);
+                return p - data;
+            }
+        }
+        return size;
+    }
+
+
+    bool parse_line(const char* line, size_t size)
+    {
+        switch (state_) {
+        case Echo:
+            if (size > 0) {
+                start_response(line, size);
+            }
+            return false;
+
+        case Status:
+            if (size == 0) {
+                // SCIP 1.1 の応答など、ステータスが無い
+                return true;
+            }
+            status_.assign(line, min(size, static_cast<size_t>(2)));
+            if ((size == 3) && (line[2] != scip_checksum(line, 2))) {
+                response_.error = Checksum_error;
+            }
+            response_.is_scan = response_.is_scan &&
+                (status_ == (is_continuous_ ? "99" : "00"));
+            state_ = response_.is_scan ? Time_stamp : Skip;
+            return false;
+
+        case Time_stamp:
+            if (size == 0) {
+                return true;
+            }
+            if (!is_valid_line(line, size)) {
+                response_.error = Checksum_error;
+            } else {
+                response_.time_stamp = decode(line, 4);
+            }
+            state_ = Data;
+            return false;
+
+        case Data:
+            if (size == 0) {
+                return true;
+            }
+            if (!is_valid_line(line, size)) {
+                response_.error = Checksum_error;
+            } else if (response_.error == No_error) {
+                (this->*decode_line_)(line, size - 1);
+            }
+            return false;
+
+        case Skip:
+            return (size == 0) ? true : false;
+        }
+        return false;
+    }
+
+
+    bool is_valid_line(const char* line, size_t size)
+    {
+        return (size >= 2) &&
+            (line[size - 1] == scip_checksum(line, static_cast<int>(size - 1)));
+    }
+
+
+    void start_response(const char* line, size_t size)
+    {
+        echo_.assign(line, size);
+        status_.clear();
+
+        response_.is_scan = false;
+        response_.type = Lidar::Distance;
+        response_.first_index = 0;
+        response_.last_index = 0;
+        response_.skip_step = 0;
+        response_.range_data_byte = 3;
+        response_.time_stamp = 0;
+        response_.error = No_error;
+        state_ = Status;
+
+        length_ = next_length_;
+        intensity_ = next_intensity_;
+        length32_ = next_length32_;
+        intensity16_ = next_intensity16_;
+        max_size_ = next_max_size_;
+        has_output_ = length_ || intensity_ || length32_ || intensity16_;
+        unit_size_ = 0;
+        step_ = 0;
+        multiecho_index_ = 0;
+        is_next_echo_ = false;
+
+        // Gx, Hx は 12 文字、Mx, Nx は 15 文字のエコーバック
+        char command = line[0];
+        bool is_single = (size == 12) && ((command == 'G') || (command == 'H'));
+        is_continuous_ =
+            (size == 15) && ((command == 'M') || (command == 'N'));
+        if (!is_single && !is_continuous_) {
+            return;
+        }
+
+        bool is_multiecho = (command == 'H') || (command == 'N');
+        char data_type = line[1];
+        if (data_type == 'S') {
+            response_.type = Lidar::Distance;
+            response_.range_data_byte = 2;
+        } else if (data_type == 'D') {
+            response_.type = is_multiecho ?
+                Lidar::Multiecho : Lidar::Distance;
+        } else if (data_type == 'E') {
+            response_.type = is_multiecho ?
+                Lidar::Multiecho_intensity : Lidar::Distance_intensity;
+        } else {
+            return;
+        }
+        response_.is_scan = true;
+        response_.first_index = parse_parameter(&line[2], 4);
+        response_.last_index = parse_parameter(&line[6], 4);
+        response_.skip_step = parse_parameter(&line[10], 2);
+
+        is_intensity_ = (response_.type == Lidar::Distance_intensity) ||
+            (response_.type == Lidar::Multiecho_intensity);
+        data_size_ = response_.range_data_byte * (is_intensity_ ? 2 : 1);
+        if (!is_intensity_) {
+            intensity_ = NULL;
+            intensity16_ = NULL;
+        }
+
+        // データ行のデコード方法は、応答毎に 1 度だけ選ぶ
+        decode_line_ = (response_.range_data_byte == 2) ?
+            select_decode_line<2>(response_.type) :
+            select_decode_line<3>(response_.type);
+    }
+
+
+    template <int Byte>
+    decode_line_t select_decode_line(Lidar::measurement_t type)
+    {
+        switch (type) {
+        case Lidar::Distance:
+            return &pImpl::decode_line<Lidar::Distance, Byte>;
+        case Lidar::Distance_intensity:
+            return &pImpl::decode_line<Lidar::Distance_intensity, Byte>;
+        case Lidar::Multiecho:
+            return &pImpl::decode_line<Lidar::Multiecho, Byte>;
+        case Lidar::Multiecho_intensity:
+            return &pImpl::decode_line<Lidar::Multiecho_intensity, Byte>;
+        }
+        return &pImpl::decode_line<Lidar::Distance, Byte>;
+    }
+
+
+    /*!
+      計測の種類と 1 つの値の文字数毎に生成し、マルチエコーでなければ
+      値毎の分岐を行わずにデコードする
+    */
+    template <Lidar::measurement_t Type, int Byte>
+    void decode_line(const char* data, size_t size)
+    {
+        enum {
+            Is_intensity = (Type == Lidar::Distance_intensity) ||
+                (Type == Lidar::Multiecho_intensity),
+            Is_multiecho = (Type == Lidar::Multiecho) ||
+                (Type == Lidar::Multiecho_intensity),
+            Unit_size = Byte * (Is_intensity ? 2 : 1),
+        };
+
+        const char* p = data;
+        const char* last_p = data + size;
+
+        if (!Is_multiecho) {
+            // マルチエコーでなければ '&' は現れないため、まとめてデコードする
+            if (unit_size_ > 0) {
+                if (!fill_unit(p, last_p)) {
+                    return;
+                }
+                store_unit<Byte, Is_intensity, Is_multiecho>(unit_);
+            }
+            int units = static_cast<int>(last_p - p) / Unit_size;
+            decode_units<Byte, Is_intensity>(p, units);
+            p += units * Unit_size;
+            fill_unit(p, last_p);
+            return;
+        }
+
+        while (p < last_p) {
+            if (unit_size_ == 0) {
+                if (*p == '&') {
+                    // 直前のステップの、次のエコー
+                    ++p;
+                    ++multiecho_index_;
+                    --step_;
+                    is_next_echo_ = true;
+                    continue;
+                }
+                if (!is_next_echo_) {
+                    multiecho_index_ = 0;
+                }
+                is_next_echo_ = false;
+
+                if ((last_p - p) >= Unit_size) {
+                    // 行の中に収まっている値は、複製せずにデコードする
+                    store_unit<Byte, Is_intensity, Is_multiecho>(p);
+                    p += Unit_size;
+                    continue;
+                }
+            }
+            if (fill_unit(p, last_p)) {
+                store_unit<Byte, Is_intensity, Is_multiecho>(unit_);
+            }
+        }
+    }
+
+
+    // 1 つの値 (強度付きのときは 2 つ) の文字を unit_ に集める
+    bool fill_unit(const char*& p, const char* last_p)
+    {
+        int n = min(static_cast<int>(last_p - p), data_size_ - unit_size_);
+        memcpy(&unit_[unit_size_], p, n);
+        unit_size_ += n;
+        p += n;
+        if (unit_size_ < data_size_) {
+            return false;
+        }
+        unit_size_ = 0;
+        return true;
+    }
+
+
+    template <int Byte, bool Is_intensity, bool Is_multiecho>
+    void store_unit(const char* unit)
+    {
+        long length = decode(unit, Byte);
+        long intensity = Is_intensity ? decode(unit + Byte, Byte) : 0;
+        store<Is_multiecho>(length, intensity);
+    }
+
+
+    // マルチエコーでない値を、格納先の範囲を 1 度だけ確認して格納する
+    template <int Byte, bool Is_intensity>
+    void decode_units(const char* data, int units)
+    {
+        if ((response_.error != No_error) || (units <= 0)) {
+            return;
+        }
+        if (((step_ + units - 1) >
+             (response_.last_index - response_.first_index)) ||
+            (has_output_ &&
+             (static_cast<size_t>(step_ + units) > max_size_))) {
+            response_.error = Overflow_error;
+            return;
+        }
+
+        enum {
+            Values_per_unit = Is_intensity ? 2 : 1,
+            Units_per_decode = Decode_values_size / Values_per_unit,
+        };
+        if (length32_) {
+            // Scan_frame の配列には、一時領域を介さずにデコードする
+            uint16_t* intensity =
+                (Is_intensity && intensity16_) ? &intensity16_[step_] : NULL;
+            decode_frame<Byte>(data, units, Values_per_unit,
+                               &length32_[step_], intensity);
+            step_ += units;
+            return;
+        }
+        if (!has_output_) {
+            step_ += units;
+            return;
+        }
+
+        // long の配列には、Decode_values_size 個ずつデコードして格納する
+        int values[Decode_values_size];
+        while (units > 0) {
+            int n = min(units, static_cast<int>(Units_per_decode));
+            decode_values<Byte>(data, n * Values_per_unit, values);
+            if (length_) {
+                for (int i = 0; i < n; ++i) {
+                    length_[step_ + i] = values[i * Values_per_unit];
+                }
+            }
+            if (Is_intensity && intensity16_) {
+                for (int i = 0; i < n; ++i) {
+                    intensity16_[step_ + i] =
+                        static_cast<uint16_t>(values[(i * 2) + 1]);
+                }
+            } else if (Is_intensity && intensity_) {
+                for (int i = 0; i < n; ++i) {
+                    intensity_[step_ + i] =
+                        static_cast<unsigned short>(values[(i * 2) + 1]);
+                }
+            }
+            step_ += n;
+            data += n * Byte * Values_per_unit;
+            units -= n;
+        }
+    }
+
+
+    template <bool Is_multiecho>
+    void store(long length, long intensity)
+    {
+        if (response_.error != No_error) {
+            return;
+        }
+
+        int echo_size = Is_multiecho ? max_echo_size_ : 1;
+        if ((step_ > (response_.last_index - response_.first_index)) ||
+            (multiecho_index_ >= echo_size)) {
+            response_.error = Overflow_error;
+            return;
+        }
+        size_t index = (step_ * echo_size) + multiecho_index_;
+        if (has_output_ &&
+            (static_cast<size_t>((step_ + 1) * echo_size) > max_size_)) {
+            response_.error = Overflow_error;
+            return;
+        }
+
+        if (Is_multiecho && (multiecho_index_ == 0)) {
+            // マルチエコーのデータ格納先をダミーデータで埋める
+            for (int i = 1; i < echo_size; ++i) {
+                store_value(index + i, 0, 0);
+            }
+        }
+        store_value(index, length, intensity);
+
+        ++step_;
+    }
+
+
+    void store_value(size_t index, long length, long intensity)
+    {
+        if (length32_) {
+            length32_[index] = static_cast<uint32_t>(length);
+        } else if (length_) {
+            length_[index] = length;
+        }
+        if (intensity16_) {
+            intensity16_[index] = static_cast<uint16_t>(intensity);
+        } else if (intensity_) {
+            intensity_[index] = static_cast<unsigned short>(intensity);
+        }
+    }
+};
+
+
+Scip_stream_parser::Scip_stream_parser(Handler& handler, int max_echo_size)
+    : pimpl(new pImpl(handler, max_echo_size))
+{
+}
+
+
+Scip_stream_parser::~Scip_stream_parser(void)
+{
+}
+
+
+void Scip_stream_parser::set_output(long* length, unsigned short* intensity,
+                                    size_t max_size)
+{
+    pimpl->next_length_ = length;
+    pimpl->next_intensity_ = intensity;
+    pimpl->next_length32_ = NULL;
+    pimpl->next_intensity16_ = NULL;
+    pimpl->next_max_size_ = max_size;
+}
+
+
+void Scip_stream_parser::set_output(uint32_t* length, uint16_t* intensity,
+                                    size_t max_size)
+{
+    pimpl->next_length_ = NULL;
+    pimpl->next_intensity_ = NULL;
+    pimpl->next_length32_ = length;
+    pimpl->next_intensity16_ = intensity;
+    pimpl->next_max_size_ = max_size;
+}
+
+
+size_t Scip_stream_parser::push(const char* data, size_t size)
+{
+    return pimpl->push(data, size);
+}
+
+
+bool Scip_stream_parser::is_receiving(void) const
+{
+    return (pimpl->state_ != Echo) || !pimpl->carry_.empty() ||
+        pimpl->is_dropping_line_;
+}
+
+
+void Scip_stream_parser::clear(void)
+{
+    pimpl->clear();
+}
@@ -0,0 +1,127 @@
+#ifndef HRK_SCIP_STREAM_PARSER_H
+#define HRK_SCIP_STREAM_PARSER_H
+
+/*!
+  \file
+  \brief SCIP 応答のストリーム解析
+
+  受信したデータを、行の途中や複数の応答にまたがる任意の区切りで
+  push() に渡す。応答を受信し終えるたびに Handler を呼び出す。
+
+  完全な行は渡された領域の上で解析し、複製しない。区切りをまたいだ
+  行のみを内部のバッファに複製する。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <memory>
+#include <cstddef>
+#include <stdint.h>
+#include "Lidar.h"
+
+
+namespace hrk
+{
+    //! SCIP 応答のストリーム解析
+    class Scip_stream_parser
+    {
+    public:
+        enum {
+            Default_max_echo_size = 3,
+        };
+
+        typedef enum {
+            No_error,
+            Checksum_error,     //!< チェックサムが一致しない行があった
+            Overflow_error,     //!< 格納先に収まらないデータがあった
+            Line_length_error,  //!< 改行の無い長い行を受信した
+        } error_t;
+
+        //! 受信した応答
+        typedef struct
+        {
+            const char* echo;   //!< エコーバック。改行を含まない
+            const char* status; //!< ステータス。"00", "99" など
+            bool is_scan;       //!< 計測データを含むか
+            Lidar::measurement_t type; //!< is_scan が true のときのみ有効
+            int first_index;    //!< エコーバックの開始ステップ
+            int last_index;     //!< エコーバックの終了ステップ
+            int skip_step;      //!< エコーバックのまとめるステップ数
+            int range_data_byte; //!< 1 つの値の文字数
+            long time_stamp;    //!< センサのタイムスタンプ [msec]
+            int steps;          //!< 受信したステップ数
+            error_t error;
+        } response_t;
+
+
+        //! 応答を受け取るインターフェース
+        class Handler
+        {
+        public:
+            virtual ~Handler(void)
+            {
+            }
+
+            /*!
+              \brief 応答を受信し終えたときに呼び出される
+
+              response の文字列は、次に push() を呼び出すまで有効。
+            */
+            virtual void response_received(const response_t& response) = 0;
+        };
+
+
+        explicit Scip_stream_parser(Handler& handler,
+                                    int max_echo_size = Default_max_echo_size);
+        ~Scip_stream_parser(void);
+
+        /*!
+          \brief 計測データの格納先を指定する
+
+          次に受信を始める応答から使われる。length, intensity に NULL を
+          指定したときは、その値を格納しない。
+
+          \param[out] length 距離データの格納先
+          \param[out] intensity 強度データの格納先
+          \param[in] max_size 格納できるデータの個数。マルチエコーでは
+          ステップ数 * max_echo_size
+        */
+        void set_output(long* length, unsigned short* intensity,
+                        size_t max_size);
+
+        //! Scan_frame の配列を格納先にする
+        void set_output(uint32_t* length, uint16_t* intensity,
+                        size_t max_size);
+
+        /*!
+          \brief 受信データを解析する
+
+          応答を 1 つ受信し終えた時点で Handler を呼び出し、戻る。
+          残りのデータは、もう一度 push() に渡す。
+
+          \param[in] data 受信データ
+          \param[in] size data の byte 数
+
+          \return 解析した byte 数
+        */
+        size_t push(const char* data, size_t size);
+
+        //! 応答を受信している途中か
+        bool is_receiving(void) const;
+
+        //! 解析途中のデータを破棄する
+        void clear(void);
+
+    private:
+        Scip_stream_parser(void);
+        Scip_stream_parser(const Scip_stream_parser& rhs);
+        Scip_stream_parser& operator = (const Scip_stream_parser& rhs);
+
+        struct pImpl;
+        std::auto_ptr<pImpl> pimpl;
+    };
+}
+
+#endif
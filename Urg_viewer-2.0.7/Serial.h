@@ -22,6 +22,11 @@ namespace hrk
     class Serial : public Connection
     {
     public:
+        typedef enum {
+            Default_profile,      //!< OS の設定のまま
+            Low_latency_profile,  //!< ドライバの受信遅延を短くする
+        } serial_profile_t;
+
         Serial(void);
         ~Serial(void);
 
@@ -34,11 +39,35 @@ namespace hrk
 
         static std::string port_driver_name(const std::string& port_name);
 
+        /*!
+          \brief USB シリアルのベンダー ID, プロダクト ID を返す
+
+          Linux では sysfs から読み出す。それ以外の OS では取得しない。
+
+          \param[in] port_name ポート名
+          \param[out] vendor_id ベンダー ID
+          \param[out] product_id プロダクト ID
+
+          \retval true 取得した
+          \retval false USB デバイスでない、または取得できない
+        */
+        static bool port_usb_id(const std::string& port_name,
+                                int& vendor_id, int& product_id);
+
+        /*!
+          \brief 以降に開くポートの設定を指定する
+
+          Low_latency_profile では、USB シリアル (FTDI など) のドライバが
+          受信データを溜めて送る時間 (latency timer) を最短にする。
+          Linux 以外では何もしない。
+        */
+        static void set_serial_profile(serial_profile_t profile);
+
         /*!
           \brief 接続を開く
 
           \param[in] device_name デバイス名
-          \param[in] baudrate ボーレート
+          \param[in] baudrate ボーレート。Linux では表に無い値も指定できる
 
           \retval true 成功
           \retval false エラー
@@ -51,7 +80,11 @@ namespace hrk
         void close(void);
         int write(const char* data, size_t data_size);
         int read(char* data, size_t max_data_size, int timeout);
+        int read_some(char* data, size_t max_data_size, int timeout);
         void ungetc(int ch);
+        int read_line(span_t& line, int timeout);
+        size_t peek_buffer(span_t& buffer);
+        long long line_arrival_time(void) const;
 
     private:
         Serial(const Serial& rhs);
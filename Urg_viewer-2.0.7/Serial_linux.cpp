@@ -7,13 +7,23 @@
   $Id$
 */
 
+#include "detect_os.h"
 #include <unistd.h>
 #include <cerrno>
 #include <cstring>
 #include <fcntl.h>
 #include <termios.h>
 #include <dirent.h>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#if defined(LINUX_OS)
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+#endif
+#include "Io_reactor.h"
 #include "Ring_buffer.hpp"
+#include "Arrival_log.hpp"
 #include "Serial.h"
 
 using namespace hrk;
@@ -25,6 +35,145 @@ namespace
     enum {
         Invalid_fd = -1,
     };
+
+    Serial::serial_profile_t default_serial_profile = Serial::Default_profile;
+
+
+    string read_sysfs_line(const string& file_name)
+    {
+        ifstream fin(file_name.c_str());
+        string line;
+        getline(fin, line);
+        return line;
+    }
+
+
+    // ポートが属する USB デバイスの sysfs ディレクトリを返す
+    string usb_device_directory(const string& port_name)
+    {
+        enum { Max_depth = 4 };
+
+        string::size_type slash = port_name.rfind('/');
+        string base_name = (slash == string::npos) ?
+            port_name : port_name.substr(slash + 1);
+        string link = "/sys/class/tty/" + base_name + "/device";
+
+        char resolved[PATH_MAX];
+        if (!realpath(link.c_str(), resolved)) {
+            return "";
+        }
+
+        // ttyACM はインターフェース、ttyUSB はその下のディレクトリを指すため、
+        // idVendor のあるディレクトリまで遡る
+        string directory = resolved;
+        for (int i = 0; i < Max_depth; ++i) {
+            if (access((directory + "/idVendor").c_str(), R_OK) == 0) {
+                return directory;
+            }
+            string::size_type parent = directory.rfind('/');
+            if ((parent == string::npos) || (parent == 0)) {
+                break;
+            }
+            directory.erase(parent);
+        }
+        return "";
+    }
+
+#if defined(LINUX_OS)
+    // <asm/termbits.h> は <termios.h> と同時に include できないため、
+    // 任意のボーレートの指定に必要な定義をここで行う
+    struct termios2_t
+    {
+        tcflag_t c_iflag;
+        tcflag_t c_oflag;
+        tcflag_t c_cflag;
+        tcflag_t c_lflag;
+        cc_t c_line;
+        cc_t c_cc[19];
+        speed_t c_ispeed;
+        speed_t c_ospeed;
+    };
+
+    enum {
+        Termios2_get = _IOR('T', 0x2A, termios2_t),
+        Termios2_set = _IOW('T', 0x2B, termios2_t),
+        Termios2_baud_mask = 0010017,  // CBAUD
+        Termios2_baud_other = 0010000, // BOTHER
+        Max_divisor_error_percent = 3,
+    };
+
+
+    bool set_custom_baudrate(int fd, long baudrate)
+    {
+        termios2_t tio;
+        if (ioctl(fd, Termios2_get, &tio) < 0) {
+            return false;
+        }
+        tio.c_cflag &= ~Termios2_baud_mask;
+        tio.c_cflag |= Termios2_baud_other;
+        tio.c_ispeed = baudrate;
+        tio.c_ospeed = baudrate;
+        return (ioctl(fd, Termios2_set, &tio) == 0) ? true : false;
+    }
+
+
+    // TCSETS2 を受け付けないドライバでは、B38400 を baud_base の分周比で
+    // 置き換える (ASYNC_SPD_CUST)。分周後の誤差が大きいときは失敗とする
+    bool set_custom_divisor(int fd, struct termios& sio, long baudrate)
+    {
+        struct serial_struct serial;
+        if ((ioctl(fd, TIOCGSERIAL, &serial) < 0) || (serial.baud_base <= 0)) {
+            return false;
+        }
+        long divisor = (serial.baud_base + (baudrate / 2)) / baudrate;
+        if (divisor <= 0) {
+            return false;
+        }
+        long actual = serial.baud_base / divisor;
+        long error = (actual > baudrate) ?
+            (actual - baudrate) : (baudrate - actual);
+        if ((error * 100) > (baudrate * Max_divisor_error_percent)) {
+            return false;
+        }
+
+        serial.flags = (serial.flags & ~ASYNC_SPD_MASK) | ASYNC_SPD_CUST;
+        serial.custom_divisor = static_cast<int>(divisor);
+        if (ioctl(fd, TIOCSSERIAL, &serial) < 0) {
+            return false;
+        }
+        cfsetospeed(&sio, B38400);
+        cfsetispeed(&sio, B38400);
+        return (tcsetattr(fd, TCSADRAIN, &sio) == 0) ? true : false;
+    }
+
+
+    // ASYNC_SPD_CUST はポートを閉じても残るため、表のボーレートを
+    // 使うときは解除する
+    void clear_custom_divisor(int fd)
+    {
+        struct serial_struct serial;
+        if ((ioctl(fd, TIOCGSERIAL, &serial) < 0) ||
+            ((serial.flags & ASYNC_SPD_MASK) != ASYNC_SPD_CUST)) {
+            return;
+        }
+        serial.flags &= ~ASYNC_SPD_MASK;
+        serial.custom_divisor = 0;
+        ioctl(fd, TIOCSSERIAL, &serial);
+    }
+
+
+    // USB シリアルのドライバに、受信データを溜めずに渡させる
+    void set_low_latency(int fd)
+    {
+        struct serial_struct serial;
+        if (ioctl(fd, TIOCGSERIAL, &serial) < 0) {
+            // pty など、対応していないデバイス
+            return;
+        }
+        serial.flags |= ASYNC_LOW_LATENCY;
+        ioctl(fd, TIOCSSERIAL, &serial);
+    }
+#endif
 }
 
 
@@ -33,10 +182,17 @@ struct Serial::pImpl
     string error_message_;
     int fd_;
     struct termios sio_;
+    Io_reactor reactor_;
     Ring_buffer<char> ring_buffer_;
+    char last_received_;
+    bool is_block_end_;
+    long long line_arrival_time_;
+    Arrival_log arrival_log_;
 
 
-    pImpl(void) : error_message_("no error."), fd_(Invalid_fd)
+    pImpl(void) : error_message_("no error."), fd_(Invalid_fd),
+                  last_received_('\0'), is_block_end_(false),
+                  line_arrival_time_(0)
     {
     }
 
@@ -59,6 +215,12 @@ struct Serial::pImpl
         int flags = fcntl(fd_, F_GETFL, 0);
         fcntl(fd_, F_SETFL, flags & ~O_NONBLOCK);
 
+        if (!reactor_.open(fd_)) {
+            error_message_ = string(device_name) + ": " + strerror(errno);
+            close();
+            return false;
+        }
+
         // シリアル通信の初期化
         tcgetattr(fd_, &sio_);
         sio_.c_iflag = 0;
@@ -67,9 +229,18 @@ struct Serial::pImpl
         sio_.c_cflag |= CS8 | CREAD | CLOCAL;
         sio_.c_lflag &= ~(ICANON | ECHO | ISIG | IEXTEN);
 
+        // read() は受信済みのデータを返してすぐに戻り、受信の待ちは
+        // reactor_ で行う。VMIN > 0 にすると、応答の末尾が VMIN byte に
+        // 満たないときに epoll が通知しなくなる
         sio_.c_cc[VMIN] = 0;
         sio_.c_cc[VTIME] = 0;
 
+#if defined(LINUX_OS)
+        if (default_serial_profile == Serial::Low_latency_profile) {
+            set_low_latency(fd_);
+        }
+#endif
+
         // ボーレートの変更
         return set_baudrate(baudrate);
     }
@@ -78,6 +249,7 @@ struct Serial::pImpl
     void close(void)
     {
         if (is_open()) {
+            reactor_.close();
             ::close(fd_);
             fd_ = Invalid_fd;
         }
@@ -105,6 +277,15 @@ struct Serial::pImpl
             { 38400, B38400 },
             { 57600, B57600 },
             { 115200, B115200 },
+#if defined(B230400)
+            { 230400, B230400 },
+#endif
+#if defined(B460800)
+            { 460800, B460800 },
+#endif
+#if defined(B921600)
+            { 921600, B921600 },
+#endif
         };
 
         enum { Invalid_value = -1 };
@@ -117,10 +298,26 @@ struct Serial::pImpl
             }
         }
         if (baudrate_value == Invalid_value) {
+#if defined(LINUX_OS)
+            // 表に無いボーレートは、値をそのままドライバに渡す。
+            // 受け付けないドライバでは分周比で指定する
+            if ((baudrate <= 0) || (tcsetattr(fd_, TCSADRAIN, &sio_) < 0) ||
+                (!set_custom_baudrate(fd_, baudrate) &&
+                 !set_custom_divisor(fd_, sio_, baudrate))) {
+                error_message_ = "invalid baudrate.";
+                return false;
+            }
+            clear();
+            return true;
+#else
             return false;
+#endif
         }
 
         // ボーレート変更
+#if defined(LINUX_OS)
+        clear_custom_divisor(fd_);
+#endif
         cfsetospeed(&sio_, baudrate_value);
         cfsetispeed(&sio_, baudrate_value);
         tcsetattr(fd_, TCSADRAIN, &sio_);
@@ -136,6 +333,9 @@ struct Serial::pImpl
         tcdrain(fd_);
         tcflush(fd_, TCIOFLUSH);
         ring_buffer_.clear();
+        arrival_log_.clear();
+        line_arrival_time_ = 0;
+        last_received_ = '\0';
     }
 
 
@@ -154,12 +354,9 @@ struct Serial::pImpl
         int read_size = max_data_size;
         int filled_size = 0;
         if (buffer_size < read_size) {
-            // リングバッファ内のデータで足りなければ、データを読み足す
-            enum { Buffer_size = 4096 };
-            char buffer[Buffer_size];
-            int n = internal_receive(buffer, Buffer_size, 0);
+            // リングバッファ内のデータで足りなければ、リングバッファに直接読み足す
+            int n = drain();
             if (n > 0) {
-                ring_buffer_.push(buffer, n);
                 buffer_size += n;
             }
         }
@@ -170,13 +367,150 @@ struct Serial::pImpl
             filled_size += ring_buffer_.pop(&data[filled_size], read_size);
         }
 
-        // データをタイムアウト付きで読み出す
+        // max_data_size byte に満たなければ、タイムアウトまで受信を待つ
+        // Urg_driver は遅延を増やさないよう、read_some() で読み出す
         filled_size += internal_receive(&data[filled_size],
                                         max_data_size - filled_size, timeout);
         return filled_size;
     }
 
 
+    int read_some(char* data, size_t max_data_size, int timeout)
+    {
+        if (!is_open()) {
+            error_message_ = "not opened.";
+            return -1;
+        }
+
+        if (max_data_size <= 0) {
+            return 0;
+        }
+
+        // リングバッファが空のときのみ、受信を待つ
+        if (ring_buffer_.empty() && wait_receive(timeout)) {
+            drain();
+        }
+        size_t n = ring_buffer_.pop(data, max_data_size);
+        if (n > 0) {
+            update_line_arrival_time(n);
+        }
+        return static_cast<int>(n);
+    }
+
+
+    int read_line(span_t& line, int timeout)
+    {
+        if (!is_open()) {
+            error_message_ = "not opened.";
+            return -1;
+        }
+
+        size_t searched = 0;
+        bool is_timeout = false;
+        bool is_waiting = false;
+        while (!ring_buffer_.read_line(line.data, line.size, searched)) {
+            if (is_timeout) {
+                // タイムアウト。それまでに受信したデータを返す
+                line.size = ring_buffer_.read_all(line.data);
+                update_line_arrival_time(line.size);
+                return (line.size > 0) ? static_cast<int>(line.size) : -1;
+            }
+            if (!is_waiting) {
+                reactor_.set_timeout(timeout);
+                is_waiting = true;
+            }
+            is_timeout = !receive_block();
+        }
+        update_line_arrival_time(line.size);
+
+        size_t n = line.size;
+        char last_ch = line.data[n - 1];
+        return static_cast<int>(((last_ch == '\n') || (last_ch == '\r')) ?
+                                n - 1 : n);
+    }
+
+
+    // 取り出した行の先頭の byte を、受信バッファに読み出した時刻を記録する
+    void update_line_arrival_time(size_t line_size)
+    {
+        // 受信していないデータが書き戻されていれば、到着時刻は不明とする
+        unsigned long long unread = ring_buffer_.size() + line_size;
+        if (unread > arrival_log_.received()) {
+            line_arrival_time_ = 0;
+            return;
+        }
+        line_arrival_time_ = arrival_log_.time(arrival_log_.received() -
+                                               unread);
+    }
+
+
+    // 応答の終端 (LF LF) を受信するか、期限を過ぎるまで受信バッファに読み足す
+    bool receive_block(void)
+    {
+        bool is_received = false;
+        is_block_end_ = false;
+        while (reactor_.wait()) {
+            int n = drain();
+            if (n < 0) {
+                break;
+            }
+            is_received |= (n > 0);
+
+            size_t span_size;
+            ring_buffer_.write_span(span_size);
+            if (is_block_end_ || (span_size == 0)) {
+                return true;
+            }
+        }
+        return is_received;
+    }
+
+
+    // 受信済みのデータを全て、受信バッファに読み出す
+    int drain(void)
+    {
+        int filled_size = 0;
+        while (true) {
+            size_t span_size;
+            char* span = ring_buffer_.write_span(span_size);
+            if (span_size == 0) {
+                break;
+            }
+
+            // VMIN, VTIME が 0 なので、受信データが無ければ 0 が返る
+            int n = ::read(fd_, span, span_size);
+            if (n <= 0) {
+                if ((n < 0) && (errno != EAGAIN) && (errno != EINTR)) {
+                    error_message_ = strerror(errno);
+                    return (filled_size > 0) ? filled_size : -1;
+                }
+                break;
+            }
+
+            find_block_end(span, n);
+            ring_buffer_.commit(n);
+            arrival_log_.add(n, Arrival_log::now());
+            filled_size += n;
+            if (static_cast<size_t>(n) < span_size) {
+                // 受信済みのデータを読み切ったので、もう一度 read() しない
+                break;
+            }
+        }
+        return filled_size;
+    }
+
+
+    void find_block_end(const char* data, int size)
+    {
+        for (int i = 0; i < size; ++i) {
+            if ((data[i] == '\n') && (last_received_ == '\n')) {
+                is_block_end_ = true;
+            }
+            last_received_ = data[i];
+        }
+    }
+
+
     int internal_receive(char data[], int data_size_max, int timeout)
     {
         int filled_size = 0;
@@ -207,21 +541,7 @@ struct Serial::pImpl
 
     bool wait_receive(int timeout)
     {
-        // タイムアウト設定
-        fd_set rfds;
-        FD_ZERO(&rfds);
-        FD_SET(fd_, &rfds);
-
-        struct timeval tv;
-        tv.tv_sec = timeout / 1000;
-        tv.tv_usec = (timeout % 1000) * 1000;
-
-        if (select(fd_ + 1, &rfds, NULL, NULL,
-                   (timeout < 0) ? NULL : &tv) <= 0) {
-            // タイムアウト発生
-            return false;
-        }
-        return true;
+        return reactor_.wait(timeout);
     }
 };
 
@@ -281,9 +601,37 @@ std::vector<std::string> Serial::find_ports(void)
 
 std::string Serial::port_driver_name(const string& port_name)
 {
-    static_cast<void>(port_name);
-    // 実装しない
-    return "";
+    // USB デバイスの製品名を返す
+    string directory = usb_device_directory(port_name);
+    if (directory.empty()) {
+        return "";
+    }
+    return read_sysfs_line(directory + "/product");
+}
+
+
+bool Serial::port_usb_id(const std::string& port_name,
+                         int& vendor_id, int& product_id)
+{
+    string directory = usb_device_directory(port_name);
+    if (directory.empty()) {
+        return false;
+    }
+
+    string vendor = read_sysfs_line(directory + "/idVendor");
+    string product = read_sysfs_line(directory + "/idProduct");
+    if (vendor.empty() || product.empty()) {
+        return false;
+    }
+    vendor_id = strtol(vendor.c_str(), NULL, 16);
+    product_id = strtol(product.c_str(), NULL, 16);
+    return true;
+}
+
+
+void Serial::set_serial_profile(serial_profile_t profile)
+{
+    default_serial_profile = profile;
 }
 
 
@@ -333,7 +681,34 @@ int Serial::read(char* data, size_t max_data_size, int timeout)
 }
 
 
+int Serial::read_some(char* data, size_t max_data_size, int timeout)
+{
+    return pimpl->read_some(data, max_data_size, timeout);
+}
+
+
+int Serial::read_line(span_t& line, int timeout)
+{
+    return pimpl->read_line(line, timeout);
+}
+
+
+long long Serial::line_arrival_time(void) const
+{
+    return pimpl->line_arrival_time_;
+}
+
+
+size_t Serial::peek_buffer(span_t& buffer)
+{
+    buffer.data = pimpl->ring_buffer_.read_span(buffer.size);
+    return buffer.size;
+}
+
+
 void Serial::ungetc(int ch)
 {
+    // 読み出したデータを書き戻すと、受信済みの byte 数に対する位置も戻る
+    // ため、到着時刻の記録をそのまま使える
     pimpl->ring_buffer_.ungetc(ch);
 }
@@ -226,12 +226,13 @@ struct Serial::pImpl
         int buffer_size = ring_buffer_.size();
         int read_size = max_data_size - filled_size;
         if (buffer_size < read_size) {
-            // リングバッファ内のデータで足りなければ、データを読み足す
-            enum { Buffer_size = 4096 };
-            char buffer[Buffer_size];
-            int n = internal_receive(buffer, Buffer_size, 0);
+            // リングバッファ内のデータで足りなければ、リングバッファに直接読み足す
+            size_t span_size;
+            char* span = ring_buffer_.write_span(span_size);
+            int n = internal_receive(span, static_cast<int>(span_size), 0);
             if (n > 0) {
-                buffer_size += ring_buffer_.push(buffer, n);
+                ring_buffer_.commit(n);
+                buffer_size += n;
             }
         }
 
@@ -241,13 +242,76 @@ struct Serial::pImpl
             filled_size += ring_buffer_.pop(&data[filled_size], read_size);
         }
 
-        // データをタイムアウト付きで読み出す
+        // max_data_size byte に満たなければ、タイムアウトまで受信を待つ
+        // Urg_driver は遅延を増やさないよう、read_some() で読み出す
         filled_size += internal_receive(&data[filled_size],
                                         max_data_size - filled_size, timeout);
         return filled_size;
     }
 
 
+    int read_some(char* data, size_t max_data_size, int timeout)
+    {
+        if (!is_open()) {
+            error_message_ = "not opened.";
+            return -1;
+        }
+
+        if (max_data_size <= 0) {
+            return 0;
+        }
+
+        // リングバッファが空のときのみ、受信を待つ
+        if (ring_buffer_.empty()) {
+            size_t span_size;
+            char* span = ring_buffer_.write_span(span_size);
+            int n = receive_some(span, static_cast<int>(span_size), timeout);
+            if (n > 0) {
+                ring_buffer_.commit(n);
+            }
+        }
+        return static_cast<int>(ring_buffer_.pop(data, max_data_size));
+    }
+
+
+    int read_line(span_t& line, int timeout)
+    {
+        if (!is_open()) {
+            error_message_ = "not opened.";
+            return -1;
+        }
+
+        size_t searched = 0;
+        while (!ring_buffer_.read_line(line.data, line.size, searched)) {
+            size_t span_size;
+            char* span = ring_buffer_.write_span(span_size);
+            int n = receive_some(span, static_cast<int>(span_size), timeout);
+            if (n <= 0) {
+                // タイムアウト。それまでに受信したデータを返す
+                line.size = ring_buffer_.read_all(line.data);
+                return (line.size > 0) ? static_cast<int>(line.size) : -1;
+            }
+            ring_buffer_.commit(n);
+        }
+
+        size_t n = line.size;
+        char last_ch = line.data[n - 1];
+        return static_cast<int>(((last_ch == '\n') || (last_ch == '\r')) ?
+                                n - 1 : n);
+    }
+
+
+    // 1 byte を受信するまで待ち、その後は受信済みのデータのみを読み出す
+    int receive_some(char data[], int data_size_max, int timeout)
+    {
+        int n = internal_receive(data, min(data_size_max, 1), timeout);
+        if (n <= 0) {
+            return n;
+        }
+        return n + internal_receive(&data[n], data_size_max - n, 0);
+    }
+
+
     int internal_receive(char data[], int data_size_max, int timeout)
     {
         if (data_size_max <= 0) {
@@ -355,6 +419,24 @@ std::string Serial::port_driver_name(const string& port_name)
 }
 
 
+bool Serial::port_usb_id(const std::string& port_name,
+                         int& vendor_id, int& product_id)
+{
+    static_cast<void>(port_name);
+    static_cast<void>(vendor_id);
+    static_cast<void>(product_id);
+    // 実装しない。URG の判定は port_driver_name() で行う
+    return false;
+}
+
+
+void Serial::set_serial_profile(serial_profile_t profile)
+{
+    // latency timer はドライバのプロパティで設定するため、何もしない
+    static_cast<void>(profile);
+}
+
+
 const char* Serial::what(void) const
 {
     return pimpl->error_message_.c_str();
@@ -409,6 +491,32 @@ int Serial::read(char* data, size_t max_data_size, int timeout)
 }
 
 
+int Serial::read_some(char* data, size_t max_data_size, int timeout)
+{
+    return pimpl->read_some(data, max_data_size, timeout);
+}
+
+
+int Serial::read_line(span_t& line, int timeout)
+{
+    return pimpl->read_line(line, timeout);
+}
+
+
+long long Serial::line_arrival_time(void) const
+{
+    // 計測しない
+    return 0;
+}
+
+
+size_t Serial::peek_buffer(span_t& buffer)
+{
+    buffer.data = pimpl->ring_buffer_.read_span(buffer.size);
+    return buffer.size;
+}
+
+
 void Serial::ungetc(int ch)
 {
     pimpl->ring_buffer_.ungetc(ch);
@@ -0,0 +1,760 @@
+/*!
+  \file
+  \brief 共有メモリによるスキャンのリングバッファ
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include "detect_os.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdint.h>
+#if !defined(WINDOWS_OS)
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "Shm_scan_ring.h"
+#include "Scan_frame.h"
+
+using namespace std;
+
+
+namespace
+{
+    const char Magic[] = "URGSCAN1";
+
+    enum {
+        Magic_size = 8,
+        Layout_version = 2,
+        Max_read_retry = 64,
+    };
+
+
+    // 共有メモリの先頭
+    typedef struct
+    {
+        char magic[Magic_size];
+        uint32_t version;
+        // データ配置の世代。配置の変更中と削除後は奇数になる
+        volatile uint32_t generation;
+        uint32_t slots;
+        uint32_t max_values;
+        uint32_t slot_size;
+        uint32_t reserved;
+        // 書き込みの完了したスキャンの数。32 bit 環境でも分断して読まない
+        // ように、上位 32 bit を下位 32 bit の前後で 2 回書く
+        volatile uint32_t published_high_first;
+        volatile uint32_t published_low;
+        volatile uint32_t published_high;
+    } ring_header_t;
+
+
+    // 各スロットの先頭。直後に int32_t の距離、uint16_t の強度が続く
+    typedef struct
+    {
+        // seqlock のカウンタ。書き込み中は奇数になる
+        volatile uint32_t lock;
+        int32_t type;
+        int32_t echo_size;
+        int32_t first_step;
+        int32_t group_steps;
+        uint32_t distance_size;
+        uint32_t intensity_size;
+        uint32_t reserved;
+        int64_t sequence;
+        int64_t sensor_timestamp;
+        double host_second;
+    } slot_header_t;
+
+
+    inline void memory_barrier(void)
+    {
+        __sync_synchronize();
+    }
+
+
+    size_t header_size(void)
+    {
+        // スロットを 64 byte 境界に配置する
+        return (sizeof(ring_header_t) + 63) & ~static_cast<size_t>(63);
+    }
+
+
+    size_t slot_size(size_t max_values)
+    {
+        size_t size = sizeof(slot_header_t) +
+            (max_values * (sizeof(int32_t) + sizeof(uint16_t)));
+        return (size + 63) & ~static_cast<size_t>(63);
+    }
+
+
+    slot_header_t* slot_header(char* base, size_t slot_size, size_t index)
+    {
+        return reinterpret_cast<slot_header_t*>(base + header_size() +
+                                                (slot_size * index));
+    }
+
+
+    void store_published(ring_header_t* header, uint64_t published)
+    {
+        uint32_t high = static_cast<uint32_t>(published >> 32);
+        header->published_high_first = high;
+        memory_barrier();
+        header->published_low = static_cast<uint32_t>(published);
+        memory_barrier();
+        header->published_high = high;
+    }
+
+
+    uint64_t load_published(const ring_header_t* header)
+    {
+        // 書き込みと逆の順に読み、上位 32 bit が一致すれば分断していない
+        while (true) {
+            uint32_t high = header->published_high;
+            memory_barrier();
+            uint32_t low = header->published_low;
+            memory_barrier();
+            if (header->published_high_first == high) {
+                return (static_cast<uint64_t>(high) << 32) | low;
+            }
+        }
+    }
+
+
+    double monotonic_second(void)
+    {
+#if defined(WINDOWS_OS)
+        return 0.0;
+#else
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return now.tv_sec + (now.tv_nsec / 1000000000.0);
+#endif
+    }
+
+
+    // 共有メモリの確保と解放
+    void* map_memory(const char* name, size_t& size, bool is_writer,
+                     string& error_message)
+    {
+#if defined(WINDOWS_OS)
+        static_cast<void>(name);
+        static_cast<void>(size);
+        static_cast<void>(is_writer);
+        error_message = "shared memory is not supported.";
+        return NULL;
+#else
+        int flags = is_writer ? (O_RDWR | O_CREAT) : O_RDONLY;
+        int fd = shm_open(name, flags, 0644);
+        if (fd < 0) {
+            error_message = string("shm_open: ") + strerror(errno);
+            return NULL;
+        }
+
+        struct stat status;
+        if (fstat(fd, &status) < 0) {
+            error_message = string("fstat: ") + strerror(errno);
+            ::close(fd);
+            return NULL;
+        }
+        size_t current_size = status.st_size;
+        if (is_writer) {
+            // 読み出し側が古い大きさで参照していても SIGBUS にならないよう、
+            // 共有メモリは縮めない
+            if ((current_size < size) && (ftruncate(fd, size) < 0)) {
+                error_message = string("ftruncate: ") + strerror(errno);
+                ::close(fd);
+                return NULL;
+            }
+        } else {
+            if (current_size < sizeof(ring_header_t)) {
+                error_message = "invalid shared memory size.";
+                ::close(fd);
+                return NULL;
+            }
+            size = current_size;
+        }
+
+        int protection = is_writer ? (PROT_READ | PROT_WRITE) : PROT_READ;
+        void* memory = mmap(NULL, size, protection, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (memory == MAP_FAILED) {
+            error_message = string("mmap: ") + strerror(errno);
+            return NULL;
+        }
+        return memory;
+#endif
+    }
+
+
+    void unmap_memory(void* memory, size_t size)
+    {
+#if !defined(WINDOWS_OS)
+        munmap(memory, size);
+#else
+        static_cast<void>(memory);
+        static_cast<void>(size);
+#endif
+    }
+
+
+    void unlink_memory(const char* name)
+    {
+#if !defined(WINDOWS_OS)
+        shm_unlink(name);
+#else
+        static_cast<void>(name);
+#endif
+    }
+}
+
+
+struct Shm_scan_writer::pImpl
+{
+    string error_message_;
+    string name_;
+    char* memory_;
+    size_t memory_size_;
+    size_t slots_;
+    size_t max_values_;
+    size_t slot_size_;
+    uint64_t published_;
+
+
+    pImpl(void)
+        : error_message_("no error."), memory_(NULL), memory_size_(0),
+          slots_(0), max_values_(0), slot_size_(0), published_(0)
+    {
+    }
+
+
+    ~pImpl(void)
+    {
+        close();
+    }
+
+
+    bool open(const char* name, size_t slots, size_t max_values)
+    {
+        slots = max(slots, static_cast<size_t>(2));
+        if (memory_ && (name_ == name) &&
+            (slots_ == slots) && (max_values_ == max_values)) {
+            return true;
+        }
+        close();
+
+        slots_ = slots;
+        max_values_ = max_values;
+        slot_size_ = slot_size(max_values_);
+        memory_size_ = header_size() + (slots_ * slot_size_);
+
+        void* memory = map_memory(name, memory_size_, true, error_message_);
+        if (!memory) {
+            return false;
+        }
+        memory_ = static_cast<char*>(memory);
+        name_ = name;
+
+        // 前回の世代を参照している読み出し側に、配置の変更を通知する
+        ring_header_t* header = reinterpret_cast<ring_header_t*>(memory_);
+        bool is_initialized =
+            (memcmp(header->magic, Magic, Magic_size) == 0) &&
+            (header->version == Layout_version);
+        uint32_t generation =
+            (is_initialized ? header->generation : 0) | 1;
+        header->generation = generation;
+        memory_barrier();
+
+        memset(memory_ + header_size(), 0, memory_size_ - header_size());
+        header->version = Layout_version;
+        header->slots = slots_;
+        header->max_values = max_values_;
+        header->slot_size = slot_size_;
+        published_ = 0;
+        store_published(header, published_);
+        memcpy(header->magic, Magic, Magic_size);
+
+        // 読み出し側は世代番号が偶数になってから他の値を参照する
+        memory_barrier();
+        header->generation = generation + 1;
+
+        return true;
+    }
+
+
+    void close(void)
+    {
+        if (!memory_) {
+            return;
+        }
+
+        // 削除後も古い共有メモリを参照し続けないよう、読み出し側に通知する
+        ring_header_t* header = reinterpret_cast<ring_header_t*>(memory_);
+        header->generation = header->generation + 1;
+        memory_barrier();
+
+        unmap_memory(memory_, memory_size_);
+        unlink_memory(name_.c_str());
+        memory_ = NULL;
+        name_.clear();
+    }
+
+
+    template <class Distance, class Intensity>
+    void write(int type, int echo_size, int first_step, int group_steps,
+               Distance distance, size_t distance_size,
+               Intensity intensity, size_t intensity_size,
+               long sensor_timestamp)
+    {
+        if (!memory_) {
+            return;
+        }
+
+        ring_header_t* header = reinterpret_cast<ring_header_t*>(memory_);
+        uint64_t sequence = published_;
+        slot_header_t* slot =
+            slot_header(memory_, slot_size_, sequence % slots_);
+
+        slot->lock = slot->lock + 1;
+        memory_barrier();
+
+        distance_size = min(distance_size, max_values_);
+        intensity_size = min(intensity_size, max_values_);
+        slot->type = type;
+        slot->echo_size = echo_size;
+        slot->first_step = first_step;
+        slot->group_steps = group_steps;
+        slot->distance_size = distance_size;
+        slot->intensity_size = intensity_size;
+        slot->sequence = sequence;
+        slot->sensor_timestamp = sensor_timestamp;
+        slot->host_second = monotonic_second();
+
+        int32_t* distance_p = reinterpret_cast<int32_t*>(slot + 1);
+        for (size_t i = 0; i < distance_size; ++i) {
+            distance_p[i] = distance[i];
+        }
+        uint16_t* intensity_p =
+            reinterpret_cast<uint16_t*>(distance_p + max_values_);
+        copy(intensity, intensity + intensity_size, intensity_p);
+
+        memory_barrier();
+        slot->lock = slot->lock + 1;
+        memory_barrier();
+        published_ = sequence + 1;
+        store_published(header, published_);
+    }
+};
+
+
+Shm_scan_writer::Shm_scan_writer(void) : pimpl(new pImpl)
+{
+}
+
+
+Shm_scan_writer::~Shm_scan_writer(void)
+{
+}
+
+
+const char* Shm_scan_writer::what(void) const
+{
+    return pimpl->error_message_.c_str();
+}
+
+
+bool Shm_scan_writer::open(const char* name, size_t slots, size_t max_values)
+{
+    return pimpl->open(name, slots, max_values);
+}
+
+
+void Shm_scan_writer::close(void)
+{
+    pimpl->close();
+}
+
+
+bool Shm_scan_writer::is_open(void) const
+{
+    return pimpl->memory_ != NULL;
+}
+
+
+const string& Shm_scan_writer::name(void) const
+{
+    return pimpl->name_;
+}
+
+
+void Shm_scan_writer::write(int type, int echo_size, int first_step,
+                            int group_steps, const vector<long>& distance,
+                            const vector<unsigned short>& intensity,
+                            long sensor_timestamp)
+{
+    pimpl->write(type, echo_size, first_step, group_steps,
+                 distance.begin(), distance.size(),
+                 intensity.begin(), intensity.size(), sensor_timestamp);
+}
+
+
+void Shm_scan_writer::write(int type, int echo_size, int first_step,
+                            int group_steps, const hrk::Scan_frame& frame,
+                            long sensor_timestamp)
+{
+    size_t intensity_size = frame.has_intensity() ? frame.size() : 0;
+    pimpl->write(type, echo_size, first_step, group_steps,
+                 frame.distance(), frame.size(),
+                 frame.intensity(), intensity_size, sensor_timestamp);
+}
+
+
+struct Shm_scan_reader::pImpl
+{
+    string error_message_;
+    string name_;
+    char* memory_;
+    size_t memory_size_;
+    uint32_t generation_;
+    size_t slots_;
+    size_t max_values_;
+    size_t slot_size_;
+    uint64_t next_sequence_;
+    size_t dropped_scans_;
+
+
+    pImpl(void)
+        : error_message_("no error."), memory_(NULL), memory_size_(0),
+          generation_(0), slots_(0), max_values_(0), slot_size_(0),
+          next_sequence_(0), dropped_scans_(0)
+    {
+    }
+
+
+    ~pImpl(void)
+    {
+        close();
+    }
+
+
+    const ring_header_t* header(void) const
+    {
+        return reinterpret_cast<const ring_header_t*>(memory_);
+    }
+
+
+    bool open(const char* name)
+    {
+        close();
+        name_ = name;
+        dropped_scans_ = 0;
+
+        if (!attach()) {
+            name_.clear();
+            return false;
+        }
+        next_sequence_ = load_published(header());
+        return true;
+    }
+
+
+    void close(void)
+    {
+        detach();
+        name_.clear();
+    }
+
+
+    bool attach(void)
+    {
+        void* memory =
+            map_memory(name_.c_str(), memory_size_, false, error_message_);
+        if (!memory) {
+            return false;
+        }
+        memory_ = static_cast<char*>(memory);
+
+        const ring_header_t* ring = header();
+        uint32_t generation = ring->generation;
+        memory_barrier();
+        if ((generation & 1) ||
+            (memcmp(ring->magic, Magic, Magic_size) != 0) ||
+            (ring->version != Layout_version) ||
+            (ring->slots == 0) ||
+            (header_size() + (ring->slots * ring->slot_size) >
+             memory_size_)) {
+            error_message_ = "invalid shared memory layout.";
+            detach();
+            return false;
+        }
+        slots_ = ring->slots;
+        max_values_ = ring->max_values;
+        slot_size_ = ring->slot_size;
+
+        memory_barrier();
+        if (ring->generation != generation) {
+            error_message_ = "shared memory layout is being updated.";
+            detach();
+            return false;
+        }
+        generation_ = generation;
+
+        return true;
+    }
+
+
+    void detach(void)
+    {
+        if (!memory_) {
+            return;
+        }
+        unmap_memory(memory_, memory_size_);
+        memory_ = NULL;
+    }
+
+
+    // 書き込み側が配置を変えたり削除したときは、接続し直す
+    bool update_attachment(void)
+    {
+        if (name_.empty()) {
+            return false;
+        }
+        if (memory_ && (header()->generation == generation_)) {
+            return true;
+        }
+
+        detach();
+        if (!attach()) {
+            return false;
+        }
+        // 新しい世代のスキャンは先頭から読み出す
+        next_sequence_ = 0;
+        return true;
+    }
+
+
+    // sequence 番目のスキャンを参照する。上書きされていたら false を返す
+    bool peek_slot(shm_scan_view_t& view, uint64_t sequence)
+    {
+        const slot_header_t* slot =
+            slot_header(memory_, slot_size_, sequence % slots_);
+        const int32_t* distance_p = reinterpret_cast<const int32_t*>(slot + 1);
+        const uint16_t* intensity_p =
+            reinterpret_cast<const uint16_t*>(distance_p + max_values_);
+
+        for (int retry = 0; retry < Max_read_retry; ++retry) {
+            uint32_t lock = slot->lock;
+            if (lock & 1) {
+                continue;
+            }
+            memory_barrier();
+
+            if (static_cast<uint64_t>(slot->sequence) != sequence) {
+                return false;
+            }
+            view.sequence = slot->sequence;
+            view.sensor_timestamp = slot->sensor_timestamp;
+            view.host_second = slot->host_second;
+            view.type = slot->type;
+            view.echo_size = slot->echo_size;
+            view.first_step = slot->first_step;
+            view.group_steps = slot->group_steps;
+            view.distance = distance_p;
+            view.distance_size =
+                min(static_cast<size_t>(slot->distance_size), max_values_);
+            view.intensity = intensity_p;
+            view.intensity_size =
+                min(static_cast<size_t>(slot->intensity_size), max_values_);
+            view.slot = slot;
+            view.lock = lock;
+
+            memory_barrier();
+            if (slot->lock == lock) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+
+    bool is_intact(const shm_scan_view_t& view) const
+    {
+        if (!memory_ || !view.slot) {
+            return false;
+        }
+        memory_barrier();
+        const slot_header_t* slot =
+            static_cast<const slot_header_t*>(view.slot);
+        return (slot->lock == view.lock) &&
+            (header()->generation == generation_);
+    }
+
+
+    bool peek_latest(shm_scan_view_t& view)
+    {
+        if (!update_attachment()) {
+            return false;
+        }
+
+        // 読み出し中に上書きされたら、より新しいスキャンを読み直す
+        for (int retry = 0; retry < Max_read_retry; ++retry) {
+            uint64_t published_scans = load_published(header());
+            if (published_scans == 0) {
+                return false;
+            }
+            if (peek_slot(view, published_scans - 1)) {
+                next_sequence_ = published_scans;
+                return true;
+            }
+        }
+        return false;
+    }
+
+
+    bool peek_next(shm_scan_view_t& view)
+    {
+        if (!update_attachment()) {
+            return false;
+        }
+
+        while (true) {
+            uint64_t published_scans = load_published(header());
+            if (next_sequence_ >= published_scans) {
+                return false;
+            }
+            if ((published_scans - next_sequence_) > slots_) {
+                // 上書きされたスキャンを読み飛ばす
+                uint64_t oldest = published_scans - slots_;
+                dropped_scans_ += oldest - next_sequence_;
+                next_sequence_ = oldest;
+            }
+            if (peek_slot(view, next_sequence_)) {
+                ++next_sequence_;
+                return true;
+            }
+            ++dropped_scans_;
+            ++next_sequence_;
+        }
+    }
+
+
+    bool copy_view(shm_scan_t& scan, const shm_scan_view_t& view)
+    {
+        scan.sequence = view.sequence;
+        scan.sensor_timestamp = view.sensor_timestamp;
+        scan.host_second = view.host_second;
+        scan.type = view.type;
+        scan.echo_size = view.echo_size;
+        scan.first_step = view.first_step;
+        scan.group_steps = view.group_steps;
+        scan.distance.assign(view.distance,
+                             view.distance + view.distance_size);
+        scan.intensity.assign(view.intensity,
+                              view.intensity + view.intensity_size);
+        return is_intact(view);
+    }
+
+
+    bool read_latest(shm_scan_t& scan)
+    {
+        shm_scan_view_t view;
+        for (int retry = 0; retry < Max_read_retry; ++retry) {
+            if (!peek_latest(view)) {
+                return false;
+            }
+            if (copy_view(scan, view)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+
+    bool read_next(shm_scan_t& scan)
+    {
+        shm_scan_view_t view;
+        while (peek_next(view)) {
+            if (copy_view(scan, view)) {
+                return true;
+            }
+            ++dropped_scans_;
+        }
+        return false;
+    }
+};
+
+
+Shm_scan_reader::Shm_scan_reader(void) : pimpl(new pImpl)
+{
+}
+
+
+Shm_scan_reader::~Shm_scan_reader(void)
+{
+}
+
+
+const char* Shm_scan_reader::what(void) const
+{
+    return pimpl->error_message_.c_str();
+}
+
+
+bool Shm_scan_reader::open(const char* name)
+{
+    return pimpl->open(name);
+}
+
+
+void Shm_scan_reader::close(void)
+{
+    pimpl->close();
+}
+
+
+bool Shm_scan_reader::is_open(void) const
+{
+    return !pimpl->name_.empty();
+}
+
+
+bool Shm_scan_reader::read_latest(shm_scan_t& scan)
+{
+    return pimpl->read_latest(scan);
+}
+
+
+bool Shm_scan_reader::read_next(shm_scan_t& scan)
+{
+    return pimpl->read_next(scan);
+}
+
+
+bool Shm_scan_reader::peek_latest(shm_scan_view_t& view)
+{
+    return pimpl->peek_latest(view);
+}
+
+
+bool Shm_scan_reader::peek_next(shm_scan_view_t& view)
+{
+    return pimpl->peek_next(view);
+}
+
+
+bool Shm_scan_reader::is_intact(const shm_scan_view_t& view) const
+{
+    return pimpl->is_intact(view);
+}
+
+
+size_t Shm_scan_reader::dropped_scans(void) const
+{
+    return pimpl->dropped_scans_;
+}
@@ -0,0 +1,159 @@
+#ifndef SHM_SCAN_RING_H
+#define SHM_SCAN_RING_H
+
+/*!
+  \file
+  \brief 共有メモリによるスキャンのリングバッファ
+
+  同じ計算機上の他のプロセスに、受信したスキャンを共有メモリ経由で渡す。
+  スロット毎に seqlock で保護するため、読み出し側はシステムコール無しに
+  最新、または次のスキャンを取り出せる。読み出し側は Qt に依存しない。
+
+  書き込み側がデータ配置を変えたり共有メモリを削除したときは、ヘッダの
+  世代番号が変わる。読み出し側はそれを検出して、同じ名前の共有メモリに
+  自動的に接続し直す。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace hrk
+{
+    class Scan_frame;
+}
+
+
+//! 共有メモリ上のスキャン
+typedef struct
+{
+    long sequence;              //!< 書き込み毎に増加する番号
+    long sensor_timestamp;      //!< センサのタイムスタンプ [msec]
+    double host_second;         //!< 書き込み時の CLOCK_MONOTONIC [sec]
+    int type;                   //!< hrk::Lidar::measurement_t
+    int echo_size;              //!< 1 ステップ当たりのエコー数
+    int first_step;
+    int group_steps;
+    std::vector<long> distance;
+    std::vector<unsigned short> intensity;
+} shm_scan_t;
+
+
+/*!
+  \brief 共有メモリ上のスキャンへの参照
+
+  distance, intensity は共有メモリを直接指す。書き込み側に上書きされる
+  可能性があるため、値を使い終えたら Shm_scan_reader::is_intact() で
+  確認する。
+*/
+typedef struct
+{
+    long sequence;
+    long sensor_timestamp;
+    double host_second;
+    int type;
+    int echo_size;
+    int first_step;
+    int group_steps;
+    const int* distance;
+    size_t distance_size;
+    const unsigned short* intensity;
+    size_t intensity_size;
+    const void* slot;           //!< 読み出し側が内部で使う
+    unsigned long lock;         //!< 読み出し側が内部で使う
+} shm_scan_view_t;
+
+
+class Shm_scan_writer
+{
+ public:
+    enum {
+        Default_slots = 16,
+    };
+
+    Shm_scan_writer(void);
+    ~Shm_scan_writer(void);
+
+    const char* what(void) const;
+
+    /*!
+      \brief 共有メモリを作成する
+
+      同じ名前と大きさで開いていれば、そのまま書き込みを続ける。
+      既存の共有メモリは縮めずに再利用し、世代番号を更新する。
+
+      \param[in] name 共有メモリの名前 ("/urg_scan" など)
+      \param[in] slots 保持するスキャンの数
+      \param[in] max_values 1 スキャンの距離データの最大数
+    */
+    bool open(const char* name, size_t slots, size_t max_values);
+
+    //! 読み出し側に終了を通知してから、共有メモリを削除する
+    void close(void);
+    bool is_open(void) const;
+    const std::string& name(void) const;
+
+    //! 格納できない大きさのスキャンは、最大数までを書き込む
+    void write(int type, int echo_size, int first_step, int group_steps,
+               const std::vector<long>& distance,
+               const std::vector<unsigned short>& intensity,
+               long sensor_timestamp);
+    void write(int type, int echo_size, int first_step, int group_steps,
+               const hrk::Scan_frame& frame, long sensor_timestamp);
+
+ private:
+    Shm_scan_writer(const Shm_scan_writer& rhs);
+    Shm_scan_writer& operator = (const Shm_scan_writer& rhs);
+
+    struct pImpl;
+    std::auto_ptr<pImpl> pimpl;
+};
+
+
+class Shm_scan_reader
+{
+ public:
+    Shm_scan_reader(void);
+    ~Shm_scan_reader(void);
+
+    const char* what(void) const;
+
+    bool open(const char* name);
+    void close(void);
+    bool is_open(void) const;
+
+    //! 最新のスキャンを取得する。まだ書き込まれていなければ false を返す
+    bool read_latest(shm_scan_t& scan);
+
+    /*!
+      \brief 前回の読み出しの次のスキャンを取得する
+
+      新しいスキャンが無ければ false を返す。読み出しが遅れて上書き
+      されたスキャンは読み飛ばし、その数を dropped_scans() に加える。
+    */
+    bool read_next(shm_scan_t& scan);
+
+    //! read_latest() と同じスキャンを、コピーせずに参照する
+    bool peek_latest(shm_scan_view_t& view);
+
+    //! read_next() と同じスキャンを、コピーせずに参照する
+    bool peek_next(shm_scan_view_t& view);
+
+    //! view の参照先が、取得してから上書きされていないか
+    bool is_intact(const shm_scan_view_t& view) const;
+
+    size_t dropped_scans(void) const;
+
+ private:
+    Shm_scan_reader(const Shm_scan_reader& rhs);
+    Shm_scan_reader& operator = (const Shm_scan_reader& rhs);
+
+    struct pImpl;
+    std::auto_ptr<pImpl> pimpl;
+};
+
+#endif
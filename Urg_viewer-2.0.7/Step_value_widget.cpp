@@ -9,6 +9,7 @@
 
 #include <QMutexLocker>
 #include "Step_value_widget.h"
+#include "Scan_frame.h"
 
 using namespace hrk;
 using namespace std;
@@ -21,14 +22,6 @@ namespace
         Default_max_echo_size = 3,
         Multiecho_row_height = 38,
     };
-
-
-    typedef struct
-    {
-        Lidar::measurement_t type;
-        vector<long> distance;
-        vector<unsigned short> intensity;
-    } step_data_t;
 }
 
 
@@ -39,7 +32,7 @@ struct Step_value_widget::pImpl
     size_t steps_;
     size_t step_offset_;
     size_t max_echo_size_;
-    step_data_t step_data_;
+    Scan_frame step_data_;
     Lidar::measurement_t current_type_;
     int selected_step_;
 
@@ -225,22 +218,27 @@ struct Step_value_widget::pImpl
     {
         QTableWidget* table = widget_->table_;
 
-        const vector<long>& distance = step_data_.distance;
-        const vector<unsigned short>& intensity = step_data_.intensity;
+        const uint32_t* distance = step_data_.distance();
+        const uint16_t* intensity = step_data_.intensity();
 
-        bool with_intensity = !intensity.empty();
+        bool with_intensity = (intensity != NULL);
         bool is_multiecho = widget_->multiecho_button_->isChecked();
         size_t echo_size = is_multiecho ? max_echo_size_ : 1;
+        size_t data_echo_size = step_data_.echo_size;
 
-        size_t n = min(table->rowCount(), static_cast<int>(distance.size()));
+        size_t n = min(static_cast<size_t>(table->rowCount()),
+                       step_data_.steps());
         for (size_t i = 0; i < n; ++i) {
             size_t echo_index;
             // 距離データの格納
             for (echo_index = 0; echo_index < echo_size; ++echo_index) {
+                if (echo_index >= data_echo_size) {
+                    break;
+                }
                 QString value;
                 QTableWidgetItem* item = table->item(i, echo_index);
 
-                int data_index = (echo_size * i) + echo_index;
+                int data_index = (data_echo_size * i) + echo_index;
                 long distance_value = distance[data_index];
                 if ((echo_index > 0) && (distance_value == 0)) {
                     break;
@@ -388,21 +386,17 @@ bool Step_value_widget::auto_update(void) const
 }
 
 
-bool Step_value_widget::set_value_data(hrk::Lidar::measurement_t type,
-                                       const std::vector<long>& distance,
-                                       const std::vector<unsigned short>&
-                                       intensity)
+bool Step_value_widget::set_value_data(const hrk::Scan_frame& frame)
 {
     QMutexLocker locker(&pimpl->mutex_);
 
-    if (pimpl->current_type_ != type) {
+    if (pimpl->current_type_ != frame.type) {
         // 要求している種類のデータでなければ、戻る
         return false;
     }
 
-    pimpl->step_data_.type = type;
-    pimpl->step_data_.distance = distance;
-    pimpl->step_data_.intensity = intensity;
+    // 確保済みの領域を使い回して複製する
+    pimpl->step_data_ = frame;
 
     return pimpl->update_values();
 }
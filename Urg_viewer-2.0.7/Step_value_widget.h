@@ -15,6 +15,11 @@
 #include "State.h"
 #include "Lidar.h"
 
+namespace hrk
+{
+    class Scan_frame;
+}
+
 
 class Step_value_widget
     : public QWidget, public State, private Ui::Step_value_widget_form
@@ -33,9 +38,7 @@ class Step_value_widget
     void set_auto_update(bool auto_update);
     bool auto_update(void) const;
 
-    bool set_value_data(hrk::Lidar::measurement_t type,
-                        const std::vector<long>& distance,
-                        const std::vector<unsigned short>& intensity);
+    bool set_value_data(const hrk::Scan_frame& frame);
 
  signals:
     void config_changed(bool with_intensity, bool is_multiecho);
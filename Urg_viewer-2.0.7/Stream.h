@@ -51,6 +51,10 @@ namespace hrk
         /*!
           \brief データの受信
 
+          max_data_size byte を受信するか、timeout が過ぎるまで待つ。
+          従来からの公開インターフェースの仕様のため、この動作は変えない。
+          受信したデータを直ちに処理するときは read_some() を使う。
+
           \param[in] data 受信データ用のバッファ
           \param[in] max_data_size 受信できるデータの最大 byte 数
           \param[in] timeout 受信を待つ時間 [msec]。無限に待つ場合には Timeout_infinity を指定する。
@@ -59,6 +63,22 @@ namespace hrk
           \retval <0 エラー ID
         */
         virtual int read(char* data, size_t max_data_size, int timeout) = 0;
+
+        /*!
+          \brief 受信済みのデータの受信
+
+          max_data_size byte が揃うのを待たずに、受信済みのデータを返す。
+          受信済みのデータが無いときのみ、timeout まで受信を待つ。
+
+          \param[in] data 受信データ用のバッファ
+          \param[in] max_data_size 受信できるデータの最大 byte 数
+          \param[in] timeout 受信を待つ時間 [msec]。無限に待つ場合には Timeout_infinity を指定する。
+
+          \retval >=0 受信した byte 数
+          \retval <0 エラー ID
+        */
+        virtual int read_some(char* data, size_t max_data_size,
+                              int timeout) = 0;
     };
 }
 
@@ -0,0 +1,346 @@
+/*!
+  \file
+  \brief 複数物体の追跡
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <algorithm>
+#include "Target_tracker.h"
+
+using namespace std;
+
+
+namespace
+{
+    enum {
+        Default_confirm_hits = 3,
+        Default_max_misses = 5,
+        Reserved_tracks = 64,
+
+        // センサのタイムスタンプは 24 bit で一周する
+        Timestamp_mask = 0xffffff,
+        Max_dt_msec = 1000,
+    };
+
+    const float Default_process_noise = 2000.0 * 2000.0;
+    const float Default_measurement_noise_mm = 30.0;
+    // 自由度 2 のカイ 2 乗分布の 99 %
+    const float Default_gate = 9.21;
+    const float Default_max_distance_mm = 500.0;
+    const float Initial_velocity_variance = 1000.0 * 1000.0;
+
+
+    // 1 軸分の位置と速度の推定
+    typedef struct
+    {
+        float position;
+        float velocity;
+        float p00;
+        float p01;
+        float p11;
+    } axis_t;
+
+
+    void initialize_axis(axis_t& axis, float position, float variance)
+    {
+        axis.position = position;
+        axis.velocity = 0.0;
+        axis.p00 = variance;
+        axis.p01 = 0.0;
+        axis.p11 = Initial_velocity_variance;
+    }
+
+
+    void predict_axis(axis_t& axis, float dt, float q)
+    {
+        // x' = F x, P' = F P F^T + Q (離散化した白色加速度モデル)
+        const float dt2 = dt * dt;
+        axis.position += axis.velocity * dt;
+        axis.p00 += dt * (2.0 * axis.p01 + dt * axis.p11) +
+            q * dt2 * dt / 3.0;
+        axis.p01 += dt * axis.p11 + q * dt2 / 2.0;
+        axis.p11 += q * dt;
+    }
+
+
+    void update_axis(axis_t& axis, float measured, float r)
+    {
+        const float s = axis.p00 + r;
+        const float k0 = axis.p00 / s;
+        const float k1 = axis.p01 / s;
+        const float innovation = measured - axis.position;
+
+        axis.position += k0 * innovation;
+        axis.velocity += k1 * innovation;
+        axis.p11 -= k1 * axis.p01;
+        axis.p01 -= k1 * axis.p00;
+        axis.p00 -= k0 * axis.p00;
+    }
+
+
+    typedef struct
+    {
+        float distance2;
+        size_t measurement;
+        size_t track;
+    } match_t;
+
+
+    bool operator < (const match_t& lhs, const match_t& rhs)
+    {
+        return lhs.distance2 < rhs.distance2;
+    }
+}
+
+
+struct Target_tracker::pImpl
+{
+    parameter_t parameter_;
+    float r_;
+    long next_id_;
+    long last_timestamp_;
+    bool has_timestamp_;
+
+    vector<track_t> tracks_;
+    vector<axis_t> x_axes_;
+    vector<axis_t> y_axes_;
+    vector<match_t> matches_;
+    vector<char> is_track_matched_;
+    vector<char> is_measurement_matched_;
+
+
+    pImpl(void) : next_id_(0), last_timestamp_(0), has_timestamp_(false)
+    {
+        set_parameter(default_parameter());
+        tracks_.reserve(Reserved_tracks);
+        x_axes_.reserve(Reserved_tracks);
+        y_axes_.reserve(Reserved_tracks);
+        matches_.reserve(Reserved_tracks * Reserved_tracks);
+    }
+
+
+    void set_parameter(const parameter_t& parameter)
+    {
+        parameter_ = parameter;
+        parameter_.confirm_hits = max(1, parameter.confirm_hits);
+        parameter_.max_misses = max(0, parameter.max_misses);
+        r_ = parameter_.measurement_noise_mm * parameter_.measurement_noise_mm;
+    }
+
+
+    float elapsed_second(long timestamp)
+    {
+        if (!has_timestamp_) {
+            return 0.0;
+        }
+        long dt_msec = (timestamp - last_timestamp_) & Timestamp_mask;
+        return (dt_msec > Max_dt_msec) ? 0.0 : dt_msec / 1000.0;
+    }
+
+
+    void associate(const float* x, const float* y, size_t n)
+    {
+        // ゲート内の組を距離の近い順に対応付ける
+        matches_.clear();
+        size_t tracks = tracks_.size();
+        const float max_distance2 =
+            parameter_.max_distance_mm * parameter_.max_distance_mm;
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t j = 0; j < tracks; ++j) {
+                const float dx = x[i] - x_axes_[j].position;
+                const float dy = y[i] - y_axes_[j].position;
+                const float distance2 = (dx * dx) + (dy * dy);
+                const float mahalanobis2 =
+                    (dx * dx) / (x_axes_[j].p00 + r_) +
+                    (dy * dy) / (y_axes_[j].p00 + r_);
+                if ((distance2 > max_distance2) ||
+                    (mahalanobis2 > parameter_.gate)) {
+                    continue;
+                }
+                match_t match;
+                match.distance2 = mahalanobis2;
+                match.measurement = i;
+                match.track = j;
+                matches_.push_back(match);
+            }
+        }
+        sort(matches_.begin(), matches_.end());
+
+        is_track_matched_.assign(tracks, 0);
+        is_measurement_matched_.assign(n, 0);
+        vector<match_t>::const_iterator end_it = matches_.end();
+        for (vector<match_t>::const_iterator it = matches_.begin();
+             it != end_it; ++it) {
+            if (is_track_matched_[it->track] ||
+                is_measurement_matched_[it->measurement]) {
+                continue;
+            }
+            is_track_matched_[it->track] = 1;
+            is_measurement_matched_[it->measurement] = 1;
+
+            size_t j = it->track;
+            update_axis(x_axes_[j], x[it->measurement], r_);
+            update_axis(y_axes_[j], y[it->measurement], r_);
+
+            track_t& track = tracks_[j];
+            ++track.hits;
+            track.misses = 0;
+            if (track.hits >= parameter_.confirm_hits) {
+                track.is_confirmed = true;
+            }
+        }
+    }
+
+
+    void remove_lost_tracks(void)
+    {
+        size_t filled = 0;
+        size_t n = tracks_.size();
+        for (size_t i = 0; i < n; ++i) {
+            track_t& track = tracks_[i];
+            if (!is_track_matched_[i]) {
+                ++track.misses;
+                track.hits = 0;
+            }
+
+            // 確定前のトラックは、1 度でも見失えば削除する
+            bool is_lost = track.is_confirmed ?
+                (track.misses > parameter_.max_misses) : (track.misses > 0);
+            if (is_lost) {
+                continue;
+            }
+            tracks_[filled] = tracks_[i];
+            x_axes_[filled] = x_axes_[i];
+            y_axes_[filled] = y_axes_[i];
+            ++filled;
+        }
+        tracks_.resize(filled);
+        x_axes_.resize(filled);
+        y_axes_.resize(filled);
+    }
+
+
+    void add_new_tracks(const float* x, const float* y, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i) {
+            if (is_measurement_matched_[i]) {
+                continue;
+            }
+
+            track_t track;
+            track.id = next_id_++;
+            track.age = 0;
+            track.hits = 1;
+            track.misses = 0;
+            track.is_confirmed = (parameter_.confirm_hits <= 1);
+            tracks_.push_back(track);
+
+            axis_t axis;
+            initialize_axis(axis, x[i], r_);
+            x_axes_.push_back(axis);
+            initialize_axis(axis, y[i], r_);
+            y_axes_.push_back(axis);
+        }
+    }
+
+
+    size_t update(const float* x, const float* y, size_t n, long timestamp,
+                  long latency_msec)
+    {
+        const float dt = elapsed_second(timestamp);
+        last_timestamp_ = timestamp;
+        has_timestamp_ = true;
+
+        size_t tracks = tracks_.size();
+        for (size_t i = 0; i < tracks; ++i) {
+            predict_axis(x_axes_[i], dt, parameter_.process_noise);
+            predict_axis(y_axes_[i], dt, parameter_.process_noise);
+        }
+
+        associate(x, y, n);
+        remove_lost_tracks();
+        add_new_tracks(x, y, n);
+
+        // 出力されるまでの遅延時間だけ先の位置を求める
+        const float latency = latency_msec / 1000.0;
+        size_t confirmed = 0;
+        tracks = tracks_.size();
+        for (size_t i = 0; i < tracks; ++i) {
+            track_t& track = tracks_[i];
+            const axis_t& x_axis = x_axes_[i];
+            const axis_t& y_axis = y_axes_[i];
+            track.x = x_axis.position;
+            track.y = y_axis.position;
+            track.velocity_x = x_axis.velocity;
+            track.velocity_y = y_axis.velocity;
+            track.predicted_x = x_axis.position + x_axis.velocity * latency;
+            track.predicted_y = y_axis.position + y_axis.velocity * latency;
+            ++track.age;
+            if (track.is_confirmed) {
+                ++confirmed;
+            }
+        }
+        return confirmed;
+    }
+};
+
+
+Target_tracker::Target_tracker(void) : pimpl(new pImpl)
+{
+}
+
+
+Target_tracker::~Target_tracker(void)
+{
+}
+
+
+Target_tracker::parameter_t Target_tracker::default_parameter(void)
+{
+    parameter_t parameter;
+    parameter.process_noise = Default_process_noise;
+    parameter.measurement_noise_mm = Default_measurement_noise_mm;
+    parameter.gate = Default_gate;
+    parameter.max_distance_mm = Default_max_distance_mm;
+    parameter.confirm_hits = Default_confirm_hits;
+    parameter.max_misses = Default_max_misses;
+
+    return parameter;
+}
+
+
+void Target_tracker::set_parameter(const parameter_t& parameter)
+{
+    pimpl->set_parameter(parameter);
+}
+
+
+const Target_tracker::parameter_t& Target_tracker::parameter(void) const
+{
+    return pimpl->parameter_;
+}
+
+
+size_t Target_tracker::update(const float* x, const float* y, size_t n,
+                              long timestamp, long latency_msec)
+{
+    return pimpl->update(x, y, n, timestamp, latency_msec);
+}
+
+
+const vector<Target_tracker::track_t>& Target_tracker::tracks(void) const
+{
+    return pimpl->tracks_;
+}
+
+
+void Target_tracker::clear(void)
+{
+    pimpl->tracks_.clear();
+    pimpl->x_axes_.clear();
+    pimpl->y_axes_.clear();
+    pimpl->has_timestamp_ = false;
+}
@@ -0,0 +1,89 @@
+#ifndef TARGET_TRACKER_H
+#define TARGET_TRACKER_H
+
+/*!
+  \file
+  \brief 複数物体の追跡
+
+  スキャン毎に検出した物体の位置を既存のトラックと対応付け、
+  等速度モデルのカルマンフィルタで位置と速度を推定する。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <memory>
+#include <vector>
+
+
+class Target_tracker
+{
+ public:
+    //! トラック。位置は [mm], 速度は [mm/sec]
+    typedef struct
+    {
+        long id;
+        float x;
+        float y;
+        float velocity_x;
+        float velocity_y;
+        float predicted_x;      //!< 遅延時間分だけ外挿した位置
+        float predicted_y;
+        long age;               //!< 生成されてからの更新回数
+        int hits;               //!< 連続して対応付けられた回数
+        int misses;             //!< 連続して対応付けられなかった回数
+        bool is_confirmed;
+    } track_t;
+
+    /*!
+      \brief 追跡の条件
+
+      process_noise は加速度の分散 [(mm/sec^2)^2], measurement_noise_mm は
+      観測位置の標準偏差。ゲートは 2 自由度のマハラノビス距離の 2 乗と
+      位置の差の上限の両方で判定する。confirm_hits 回連続して対応付けられると
+      確定し、max_misses 回を越えて対応付けられないと削除する。
+    */
+    typedef struct
+    {
+        float process_noise;
+        float measurement_noise_mm;
+        float gate;
+        float max_distance_mm;
+        int confirm_hits;
+        int max_misses;
+    } parameter_t;
+
+    Target_tracker(void);
+    ~Target_tracker(void);
+
+    static parameter_t default_parameter(void);
+    void set_parameter(const parameter_t& parameter);
+    const parameter_t& parameter(void) const;
+
+    /*!
+      \brief 観測した位置でトラックを更新する
+
+      \param[in] x, y 観測した n 個の位置 [mm]
+      \param[in] timestamp 観測したスキャンのタイムスタンプ [msec]
+      \param[in] latency_msec 観測から出力までの遅延時間 [msec]
+
+      \return 確定したトラックの数
+    */
+    size_t update(const float* x, const float* y, size_t n, long timestamp,
+                  long latency_msec);
+
+    //! 確定していないトラックも含む
+    const std::vector<track_t>& tracks(void) const;
+
+    void clear(void);
+
+ private:
+    Target_tracker(const Target_tracker& rhs);
+    Target_tracker& operator = (const Target_tracker& rhs);
+
+    struct pImpl;
+    std::auto_ptr<pImpl> pimpl;
+};
+
+#endif
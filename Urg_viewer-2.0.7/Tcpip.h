@@ -23,9 +23,34 @@ namespace hrk
         friend class Accept_server;
         friend class Socket_set;
 
+        typedef enum {
+            Socket_receive,     //!< epoll または select で受信を待つ
+            Io_uring_receive,   //!< io_uring で受信する (Linux のみ)
+        } receive_engine_t;
+
+        typedef enum {
+            Default_profile,      //!< OS の設定のまま
+            Low_latency_profile,  //!< TCP_NODELAY, SO_BUSY_POLL
+            Throughput_profile,   //!< 受信バッファを大きくする
+        } socket_profile_t;
+
         Tcpip(void);
         ~Tcpip(void);
 
+        /*!
+          \brief 以降に open() する接続の受信方法を指定する
+
+          io_uring が使えない環境では、Socket_receive で受信する。
+        */
+        static void set_receive_engine(receive_engine_t engine);
+
+        /*!
+          \brief 以降に open() する接続のソケットの設定を指定する
+
+          使えないオプションは設定しない。
+        */
+        static void set_socket_profile(socket_profile_t profile);
+
         /*!
           \brief 接続を開く
 
@@ -43,7 +68,11 @@ namespace hrk
         void close(void);
         int write(const char* data, size_t data_size);
         int read(char* data, size_t max_data_size, int timeout);
+        int read_some(char* data, size_t max_data_size, int timeout);
         void ungetc(int ch);
+        int read_line(span_t& line, int timeout);
+        size_t peek_buffer(span_t& buffer);
+        long long line_arrival_time(void) const;
 
     private:
         Tcpip(void* socket, void* socket_set = NULL);
@@ -13,11 +13,16 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <string>
 #include "Tcpip.h"
+#include "Io_reactor.h"
+#include "Uring_receiver.h"
 #include "Ring_buffer.hpp"
+#include "Arrival_log.hpp"
 
 using namespace hrk;
 using namespace std;
@@ -25,18 +30,37 @@ using namespace std;
 
 enum {
     Invalid_socket = -1,
+    Busy_poll_usec = 50,
+    Throughput_receive_buffer_size = 1024 * 1024,
 };
 
 
+namespace
+{
+    Tcpip::receive_engine_t default_receive_engine = Tcpip::Socket_receive;
+    Tcpip::socket_profile_t default_socket_profile = Tcpip::Default_profile;
+}
+
+
 struct Tcpip::pImpl
 {
     string error_message_;
     int socket_;
+    Io_reactor reactor_;
+    Uring_receiver uring_;
     Ring_buffer<char> ring_buffer_;
+    char last_received_;
+    bool is_block_end_;
+    bool is_timestamping_;
+    long long received_time_;
+    long long line_arrival_time_;
+    Arrival_log arrival_log_;
 
 
     pImpl(void)
-        : error_message_("not opened."), socket_(Invalid_socket)
+        : error_message_("not opened."), socket_(Invalid_socket),
+          last_received_('\0'), is_block_end_(false),
+          is_timestamping_(false), received_time_(0), line_arrival_time_(0)
     {
     }
 
@@ -72,6 +96,8 @@ struct Tcpip::pImpl
             error_message_ = strerror(errno);
             return false;
         }
+        // 受信バッファの大きさは、接続前に設定しないとウィンドウに反映されない
+        set_socket_options();
 
         struct sockaddr_in server_address;
         memset(&server_address, 0, sizeof(server_address));
@@ -137,12 +163,50 @@ struct Tcpip::pImpl
             set_block_mode();
         }
 
+        // io_uring が使えないときは、ソケットの受信を epoll で待つ
+        int wait_fd = socket_;
+        if ((default_receive_engine == Tcpip::Io_uring_receive) &&
+            Uring_receiver::is_available() && uring_.open(socket_)) {
+            wait_fd = uring_.event_fd();
+        }
+        if (!reactor_.open(wait_fd)) {
+            error_message_ = strerror(errno);
+            close();
+            return false;
+        }
+
         ring_buffer_.clear();
+        arrival_log_.clear();
+        line_arrival_time_ = 0;
+        last_received_ = '\0';
         error_message_ = "no error.";
         return true;
     }
 
 
+    void set_socket_options(void)
+    {
+        int on = 1;
+        if (default_socket_profile == Tcpip::Low_latency_profile) {
+            setsockopt(socket_, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+#if defined(SO_BUSY_POLL)
+            // 権限が無いときは、net.core.busy_read を超える値は設定できない
+            int usec = Busy_poll_usec;
+            setsockopt(socket_, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec));
+#endif
+        } else if (default_socket_profile == Tcpip::Throughput_profile) {
+            int size = Throughput_receive_buffer_size;
+            setsockopt(socket_, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        }
+
+        is_timestamping_ = false;
+#if defined(SO_TIMESTAMPNS)
+        is_timestamping_ = (setsockopt(socket_, SOL_SOCKET, SO_TIMESTAMPNS,
+                                       &on, sizeof(on)) == 0) ? true : false;
+#endif
+    }
+
+
     void set_connect_fail_error(const char* address, long port,
                                 const char* message = NULL)
     {
@@ -161,6 +225,8 @@ struct Tcpip::pImpl
     void close(void)
     {
         if (socket_ != Invalid_socket) {
+            uring_.close();
+            reactor_.close();
             ::close(socket_);
             socket_ = Invalid_socket;
         }
@@ -183,12 +249,10 @@ struct Tcpip::pImpl
         int read_size = max_data_size;
         int filled_size = 0;
         if (buffer_size < read_size) {
-            // リングバッファ内のデータで足りなければ、データを読み足す
-            enum { Buffer_size = 4096 };
-            char buffer[Buffer_size];
-            int n = internal_receive(buffer, Buffer_size, 0);
+            // リングバッファ内のデータで足りなければ、リングバッファに直接読み足す
+            int n = drain();
             if (n > 0) {
-                buffer_size += ring_buffer_.push(buffer, n);
+                buffer_size += n;
             }
         }
 
@@ -198,13 +262,139 @@ struct Tcpip::pImpl
             filled_size += ring_buffer_.pop(&data[filled_size], read_size);
         }
 
-        // データをタイムアウト付きで読み出す
+        // max_data_size byte に満たなければ、タイムアウトまで受信を待つ
+        // Urg_driver は遅延を増やさないよう、read_some() で読み出す
         filled_size += internal_receive(&data[filled_size],
                                         max_data_size - filled_size, timeout);
         return filled_size;
     }
 
 
+    int read_some(char* data, size_t max_data_size, int timeout)
+    {
+        if (max_data_size <= 0) {
+            return 0;
+        }
+
+        // リングバッファが空のときのみ、受信を待つ
+        if (ring_buffer_.empty() && wait_receive(timeout)) {
+            drain();
+        }
+        size_t n = ring_buffer_.pop(data, max_data_size);
+        if (n > 0) {
+            update_line_arrival_time(n);
+        }
+        return static_cast<int>(n);
+    }
+
+
+    int read_line(span_t& line, int timeout)
+    {
+        size_t searched = 0;
+        bool is_timeout = false;
+        bool is_waiting = false;
+        while (!ring_buffer_.read_line(line.data, line.size, searched)) {
+            if (is_timeout || !is_open()) {
+                // タイムアウト。それまでに受信したデータを返す
+                line.size = ring_buffer_.read_all(line.data);
+                update_line_arrival_time(line.size);
+                return (line.size > 0) ? static_cast<int>(line.size) : -1;
+            }
+            if (!is_waiting) {
+                reactor_.set_timeout(timeout);
+                is_waiting = true;
+            }
+            is_timeout = !receive_block();
+        }
+        update_line_arrival_time(line.size);
+
+        size_t n = line.size;
+        char last_ch = line.data[n - 1];
+        return static_cast<int>(((last_ch == '\n') || (last_ch == '\r')) ?
+                                n - 1 : n);
+    }
+
+
+    // 取り出した行の先頭の byte が届いた時刻を記録する
+    void update_line_arrival_time(size_t line_size)
+    {
+        // 受信していないデータが書き戻されていれば、到着時刻は不明とする
+        unsigned long long unread = ring_buffer_.size() + line_size;
+        if (unread > arrival_log_.received()) {
+            line_arrival_time_ = 0;
+            return;
+        }
+        line_arrival_time_ = arrival_log_.time(arrival_log_.received() -
+                                               unread);
+    }
+
+
+    // 応答の終端 (LF LF) を受信するか、期限を過ぎるまで受信バッファに読み足す
+    bool receive_block(void)
+    {
+        bool is_received = false;
+        is_block_end_ = false;
+        while (reactor_.wait()) {
+            int n = drain();
+            if (n < 0) {
+                break;
+            }
+            is_received |= (n > 0);
+
+            size_t span_size;
+            ring_buffer_.write_span(span_size);
+            if (is_block_end_ || (span_size == 0)) {
+                return true;
+            }
+        }
+        return is_received;
+    }
+
+
+    // 受信済みのデータを全て、受信バッファに読み出す
+    int drain(void)
+    {
+        int filled_size = 0;
+        while (true) {
+            size_t span_size;
+            char* span = ring_buffer_.write_span(span_size);
+            if (span_size == 0) {
+                break;
+            }
+
+            int n = receive_available(span, span_size);
+            if (n == 0) {
+                break;
+            } else if (n < 0) {
+                // 切断、または読み出しエラー。受信済みのデータは残す
+                close();
+                return (filled_size > 0) ? filled_size : -1;
+            }
+
+            find_block_end(span, n);
+            ring_buffer_.commit(n);
+            arrival_log_.add(n, received_time_);
+            filled_size += n;
+            if (static_cast<size_t>(n) < span_size) {
+                // 受信済みのデータを読み切ったので、EAGAIN を待たずに戻る
+                break;
+            }
+        }
+        return filled_size;
+    }
+
+
+    void find_block_end(const char* data, int size)
+    {
+        for (int i = 0; i < size; ++i) {
+            if ((data[i] == '\n') && (last_received_ == '\n')) {
+                is_block_end_ = true;
+            }
+            last_received_ = data[i];
+        }
+    }
+
+
     int internal_receive(char data[], int data_size_max, int timeout)
     {
         if (data_size_max <= 0) {
@@ -221,10 +411,9 @@ struct Tcpip::pImpl
             }
 
             require_n = data_size_max - filled_size;
-            read_n = recv(socket_, &data[filled_size], require_n, MSG_DONTWAIT);
-            if (read_n <= 0) {
+            read_n = receive_available(&data[filled_size], require_n);
+            if (read_n < 0) {
                 // 読み出しエラー。現在までの受信内容で戻る
-                error_message_ = strerror(errno);
                 close();
                 break;
             }
@@ -234,25 +423,79 @@ struct Tcpip::pImpl
     }
 
 
-    int wait_receive(int timeout)
+    // SO_TIMESTAMPNS が有効なときは、カーネルが受信した時刻も取得する
+    int receive_socket(char data[], size_t data_size_max)
     {
-        // タイムアウト設定
-        fd_set rfds;
-        FD_ZERO(&rfds);
-        FD_SET(socket_, &rfds);
-
-        struct timeval tv;
-        tv.tv_sec = timeout / 1000;
-        tv.tv_usec = (timeout % 1000) * 1000;
-        setsockopt(socket_, SOL_SOCKET, SO_RCVTIMEO,
-                   &tv, sizeof(struct timeval));
-
-        if (select(socket_ + 1, &rfds, NULL, NULL,
-                   (timeout < 0) ? NULL : &tv) <= 0) {
-            // タイムアウト発生
-            return 0;
+        received_time_ = 0;
+        if (!is_timestamping_) {
+            received_time_ = Arrival_log::now();
+            return recv(socket_, data, data_size_max, MSG_DONTWAIT);
+        }
+
+#if defined(SO_TIMESTAMPNS)
+        struct iovec iov;
+        iov.iov_base = data;
+        iov.iov_len = data_size_max;
+
+        char control[CMSG_SPACE(sizeof(struct timespec))];
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        int n = recvmsg(socket_, &message, MSG_DONTWAIT);
+        struct cmsghdr* cmsg = (n > 0) ? CMSG_FIRSTHDR(&message) : NULL;
+        for (; cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+            if ((cmsg->cmsg_level == SOL_SOCKET) &&
+                (cmsg->cmsg_type == SCM_TIMESTAMPNS)) {
+                struct timespec ts;
+                memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+                received_time_ =
+                    (static_cast<long long>(ts.tv_sec) * 1000000000LL) +
+                    ts.tv_nsec;
+            }
+        }
+        if (received_time_ == 0) {
+            received_time_ = Arrival_log::now();
+        }
+        return n;
+#else
+        return -1;
+#endif
+    }
+
+
+    // 受信済みのデータのみを読み出す。切断、またはエラーのときは負を返す
+    int receive_available(char data[], size_t data_size_max)
+    {
+        int n;
+        if (uring_.is_open()) {
+            n = uring_.receive(data, data_size_max);
+            received_time_ = Arrival_log::now();
+        } else {
+            n = receive_socket(data, data_size_max);
+            if ((n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) ||
+                            (errno == EINTR))) {
+                return 0;
+            } else if (n == 0) {
+                errno = 0;
+                n = -1;
+            }
         }
-        return 1;
+
+        if (n < 0) {
+            error_message_ = (errno == 0) ? "connection closed." :
+                strerror(errno);
+        }
+        return n;
+    }
+
+
+    bool wait_receive(int timeout)
+    {
+        return reactor_.wait(timeout);
     }
 };
 
@@ -327,16 +570,63 @@ int Tcpip::read(char* data, size_t max_data_size, int timeout)
 }
 
 
+int Tcpip::read_some(char* data, size_t max_data_size, int timeout)
+{
+    if (!is_open()) {
+        return -1;
+    }
+
+    return pimpl->read_some(data, max_data_size, timeout);
+}
+
+
+int Tcpip::read_line(span_t& line, int timeout)
+{
+    if (!is_open()) {
+        return -1;
+    }
+
+    return pimpl->read_line(line, timeout);
+}
+
+
+size_t Tcpip::peek_buffer(span_t& buffer)
+{
+    buffer.data = pimpl->ring_buffer_.read_span(buffer.size);
+    return buffer.size;
+}
+
+
 void Tcpip::ungetc(int ch)
 {
     if (!is_open()) {
         return ;
     }
 
+    // 読み出したデータを書き戻すと、受信済みの byte 数に対する位置も戻る
+    // ため、到着時刻の記録をそのまま使える
     pimpl->ring_buffer_.ungetc(ch);
 }
 
 
+void Tcpip::set_receive_engine(receive_engine_t engine)
+{
+    default_receive_engine = engine;
+}
+
+
+void Tcpip::set_socket_profile(socket_profile_t profile)
+{
+    default_socket_profile = profile;
+}
+
+
+long long Tcpip::line_arrival_time(void) const
+{
+    return pimpl->line_arrival_time_;
+}
+
+
 void Tcpip::set_socket_set(void* socket_set)
 {
     (void)socket_set;
@@ -25,9 +25,16 @@ using namespace std;
 
 enum {
     Invalid_socket = -1,
+    Throughput_receive_buffer_size = 1024 * 1024,
 };
 
 
+namespace
+{
+    Tcpip::socket_profile_t default_socket_profile = Tcpip::Default_profile;
+}
+
+
 struct Tcpip::pImpl
 {
     string error_message_;
@@ -63,6 +70,21 @@ struct Tcpip::pImpl
     }
 
 
+    // SO_BUSY_POLL, SO_TIMESTAMPNS は使えない
+    void set_socket_options(void)
+    {
+        if (default_socket_profile == Tcpip::Low_latency_profile) {
+            BOOL on = TRUE;
+            setsockopt(socket_, IPPROTO_TCP, TCP_NODELAY,
+                       (const char*)&on, sizeof(on));
+        } else if (default_socket_profile == Tcpip::Throughput_profile) {
+            int size = Throughput_receive_buffer_size;
+            setsockopt(socket_, SOL_SOCKET, SO_RCVBUF,
+                       (const char*)&size, sizeof(size));
+        }
+    }
+
+
     void set_connect_fail_error(const char* address, long port,
                                 const char* message = NULL)
     {
@@ -100,6 +122,7 @@ struct Tcpip::pImpl
             set_connect_fail_error(address, port, "socket create fail.");
             return false;
         }
+        set_socket_options();
 
         struct sockaddr_in server;
         memset((char*)&(server), 0, sockaddr_in_size);
@@ -180,12 +203,13 @@ struct Tcpip::pImpl
         int read_size = max_data_size;
         int filled_size = 0;
         if (buffer_size < read_size) {
-            // リングバッファ内のデータで足りなければ、データを読み足す
-            enum { Buffer_size = 4096 };
-            char buffer[Buffer_size];
-            int n = internal_receive(buffer, Buffer_size, 0);
+            // リングバッファ内のデータで足りなければ、リングバッファに直接読み足す
+            size_t span_size;
+            char* span = ring_buffer_.write_span(span_size);
+            int n = internal_receive(span, static_cast<int>(span_size), 0);
             if (n > 0) {
-                buffer_size += ring_buffer_.push(buffer, n);
+                ring_buffer_.commit(n);
+                buffer_size += n;
             }
         }
 
@@ -195,13 +219,66 @@ struct Tcpip::pImpl
             filled_size += ring_buffer_.pop(&data[filled_size], read_size);
         }
 
-        // データをタイムアウト付きで読み出す
+        // max_data_size byte に満たなければ、タイムアウトまで受信を待つ
+        // Urg_driver は遅延を増やさないよう、read_some() で読み出す
         filled_size += internal_receive(&data[filled_size],
                                         max_data_size - filled_size, timeout);
         return filled_size;
     }
 
 
+    int read_some(char* data, size_t max_data_size, int timeout)
+    {
+        if (max_data_size <= 0) {
+            return 0;
+        }
+
+        // リングバッファが空のときのみ、受信を待つ
+        if (ring_buffer_.empty()) {
+            size_t span_size;
+            char* span = ring_buffer_.write_span(span_size);
+            int n = receive_some(span, static_cast<int>(span_size), timeout);
+            if (n > 0) {
+                ring_buffer_.commit(n);
+            }
+        }
+        return static_cast<int>(ring_buffer_.pop(data, max_data_size));
+    }
+
+
+    int read_line(span_t& line, int timeout)
+    {
+        size_t searched = 0;
+        while (!ring_buffer_.read_line(line.data, line.size, searched)) {
+            size_t span_size;
+            char* span = ring_buffer_.write_span(span_size);
+            int n = receive_some(span, static_cast<int>(span_size), timeout);
+            if (n <= 0) {
+                // タイムアウト。それまでに受信したデータを返す
+                line.size = ring_buffer_.read_all(line.data);
+                return (line.size > 0) ? static_cast<int>(line.size) : -1;
+            }
+            ring_buffer_.commit(n);
+        }
+
+        size_t n = line.size;
+        char last_ch = line.data[n - 1];
+        return static_cast<int>(((last_ch == '\n') || (last_ch == '\r')) ?
+                                n - 1 : n);
+    }
+
+
+    // 1 byte を受信するまで待ち、その後は受信済みのデータのみを読み出す
+    int receive_some(char data[], int data_size_max, int timeout)
+    {
+        int n = internal_receive(data, min(data_size_max, 1), timeout);
+        if (n <= 0) {
+            return n;
+        }
+        return n + internal_receive(&data[n], data_size_max - n, 0);
+    }
+
+
     int internal_receive(char data[], int data_size_max, int timeout)
     {
         if (data_size_max <= 0) {
@@ -326,6 +403,34 @@ int Tcpip::read(char* data, size_t max_data_size, int timeout)
 }
 
 
+int Tcpip::read_some(char* data, size_t max_data_size, int timeout)
+{
+    if (!is_open()) {
+        pimpl->error_message_ = "not opened.";
+        return -1;
+    }
+
+    return pimpl->read_some(data, max_data_size, timeout);
+}
+
+
+int Tcpip::read_line(span_t& line, int timeout)
+{
+    if (!is_open()) {
+        return -1;
+    }
+
+    return pimpl->read_line(line, timeout);
+}
+
+
+size_t Tcpip::peek_buffer(span_t& buffer)
+{
+    buffer.data = pimpl->ring_buffer_.read_span(buffer.size);
+    return buffer.size;
+}
+
+
 void Tcpip::ungetc(int ch)
 {
     if (!is_open()) {
@@ -337,6 +442,26 @@ void Tcpip::ungetc(int ch)
 }
 
 
+void Tcpip::set_receive_engine(receive_engine_t engine)
+{
+    // io_uring は使えないため、常にソケットで受信する
+    static_cast<void>(engine);
+}
+
+
+void Tcpip::set_socket_profile(socket_profile_t profile)
+{
+    default_socket_profile = profile;
+}
+
+
+long long Tcpip::line_arrival_time(void) const
+{
+    // 計測しない
+    return 0;
+}
+
+
 void Tcpip::set_socket_set(void* socket_set)
 {
     (void)socket_set;
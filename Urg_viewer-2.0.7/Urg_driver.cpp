@@ -7,13 +7,30 @@
   $Id$
 */
 
+#include "detect_os.h"
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 #include <cmath>
+#include <fstream>
+#include <sstream>
+#include <map>
+#if defined(WINDOWS_OS)
+#if !defined(NOMINMAX)
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
 #include "Urg_driver.h"
 #include "Tcpip.h"
 #include "Serial.h"
 #include "connection_utils.h"
+#include "scip_decode.h"
+#include "Scip_stream_parser.h"
+#include "Scan_frame.h"
 
 using namespace hrk;
 using namespace std;
@@ -25,9 +42,11 @@ namespace
         Expected_end = -1,
         Max_timeout = 140,
         Buffer_size = 64 + 2 + 6,
+        Chunk_size = 4096,
         Urg_max_echo = 3,
 
-        Stop = Lidar::Multiecho_intensity + 16,
+        Hokuyo_vendor_id = 0x15d1,
+        Max_probe_threads = 8,
     };
 
 
@@ -103,6 +122,24 @@ namespace
     } received_setting_t;
 
 
+    // 起動時間の計測に使う、単調増加する時刻 [usec]
+    long long ticks_usec(void)
+    {
+#if defined(WINDOWS_OS)
+        LARGE_INTEGER frequency;
+        LARGE_INTEGER counter;
+        QueryPerformanceFrequency(&frequency);
+        QueryPerformanceCounter(&counter);
+        return counter.QuadPart * 1000000 / frequency.QuadPart;
+#else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (static_cast<long long>(ts.tv_sec) * 1000000) +
+            (ts.tv_nsec / 1000);
+#endif
+    }
+
+
     long decode_scip(const char data[], int size)
     {
         const char* p = data;
@@ -119,7 +156,217 @@ namespace
 }
 
 
-struct Urg_driver::pImpl
+namespace
+{
+    //! 接続に成功したセンサの情報
+    typedef struct
+    {
+        long baudrate;
+        string serial_id;
+        string product_type;
+        string product_version;
+        sensor_parameter_t sensor;
+    } connection_cache_t;
+
+
+    // probe_ports() で複数のスレッドから参照するため、排他して使う
+    class Connection_cache
+    {
+    public:
+        Connection_cache(void)
+        {
+#if !defined(WINDOWS_OS)
+            pthread_mutex_init(&mutex_, NULL);
+#endif
+        }
+
+
+        void set_file(const string& file_name)
+        {
+            lock();
+            file_name_ = file_name;
+            caches_.clear();
+            load();
+            unlock();
+        }
+
+
+        bool is_enabled(void)
+        {
+            lock();
+            bool enabled = !file_name_.empty();
+            unlock();
+            return enabled;
+        }
+
+
+        bool find(const string& key, connection_cache_t& cache)
+        {
+            lock();
+            map<string, connection_cache_t>::const_iterator it =
+                caches_.find(key);
+            bool found = (!file_name_.empty() && (it != caches_.end()));
+            if (found) {
+                cache = it->second;
+            }
+            unlock();
+            return found;
+        }
+
+
+        void store(const string& key, const connection_cache_t& cache)
+        {
+            lock();
+            if (!file_name_.empty()) {
+                caches_[key] = cache;
+                save();
+            }
+            unlock();
+        }
+
+
+        void erase(const string& key)
+        {
+            lock();
+            if (caches_.erase(key) > 0) {
+                save();
+            }
+            unlock();
+        }
+
+
+    private:
+        void lock(void)
+        {
+#if !defined(WINDOWS_OS)
+            pthread_mutex_lock(&mutex_);
+#endif
+        }
+
+
+        void unlock(void)
+        {
+#if !defined(WINDOWS_OS)
+            pthread_mutex_unlock(&mutex_);
+#endif
+        }
+
+
+        // 1 行に 1 つの接続先を、タブ区切りで記録する
+        void load(void)
+        {
+            ifstream fin(file_name_.c_str());
+            string line;
+            while (getline(fin, line)) {
+                vector<string> tokens;
+                istringstream sin(line);
+                string token;
+                while (getline(sin, token, '\t')) {
+                    tokens.push_back(token);
+                }
+
+                enum { Tokens_size = 12 };
+                if (tokens.size() != Tokens_size) {
+                    continue;
+                }
+                connection_cache_t cache;
+                cache.baudrate = strtol(tokens[1].c_str(), NULL, 10);
+                cache.serial_id = tokens[2];
+                cache.product_type = tokens[3];
+                cache.product_version = tokens[4];
+                sensor_parameter_t& sensor = cache.sensor;
+                sensor.front_index = strtol(tokens[5].c_str(), NULL, 10);
+                sensor.first_index = strtol(tokens[6].c_str(), NULL, 10);
+                sensor.last_index = strtol(tokens[7].c_str(), NULL, 10);
+                sensor.area_resolution = strtol(tokens[8].c_str(), NULL, 10);
+                sensor.scan_usec = strtol(tokens[9].c_str(), NULL, 10);
+                sensor.min_distance = strtol(tokens[10].c_str(), NULL, 10);
+                sensor.max_distance = strtol(tokens[11].c_str(), NULL, 10);
+                if ((cache.serial_id.empty()) || (sensor.scan_usec <= 0)) {
+                    continue;
+                }
+                caches_[tokens[0]] = cache;
+            }
+        }
+
+
+        void save(void)
+        {
+            ofstream fout(file_name_.c_str(), ios::out | ios::trunc);
+            for (map<string, connection_cache_t>::const_iterator it =
+                     caches_.begin(); it != caches_.end(); ++it) {
+                const connection_cache_t& cache = it->second;
+                const sensor_parameter_t& sensor = cache.sensor;
+                fout << it->first << '\t'
+                     << cache.baudrate << '\t'
+                     << cache.serial_id << '\t'
+                     << cache.product_type << '\t'
+                     << cache.product_version << '\t'
+                     << sensor.front_index << '\t'
+                     << sensor.first_index << '\t'
+                     << sensor.last_index << '\t'
+                     << sensor.area_resolution << '\t'
+                     << sensor.scan_usec << '\t'
+                     << sensor.min_distance << '\t'
+                     << sensor.max_distance << endl;
+            }
+        }
+
+
+        string file_name_;
+        map<string, connection_cache_t> caches_;
+#if !defined(WINDOWS_OS)
+        pthread_mutex_t mutex_;
+#endif
+    };
+
+    Connection_cache connection_cache;
+
+
+    // ポートの探索を複数のスレッドで分担する
+    struct probe_job_t
+    {
+        const vector<string>* ports;
+        long baudrate;
+        vector<char>* is_found;
+        size_t next_index;
+#if !defined(WINDOWS_OS)
+        pthread_mutex_t mutex;
+#endif
+    };
+
+
+    bool probe_port(const string& port, long baudrate)
+    {
+        Urg_driver urg;
+        bool ret = urg.open(port.c_str(), baudrate, Urg_driver::Serial);
+        urg.close();
+        return ret;
+    }
+
+
+#if !defined(WINDOWS_OS)
+    void* probe_thread(void* arg)
+    {
+        probe_job_t* job = static_cast<probe_job_t*>(arg);
+        while (true) {
+            pthread_mutex_lock(&job->mutex);
+            size_t index = job->next_index++;
+            pthread_mutex_unlock(&job->mutex);
+
+            if (index >= job->ports->size()) {
+                break;
+            }
+            (*job->is_found)[index] =
+                probe_port((*job->ports)[index], job->baudrate);
+        }
+        return NULL;
+    }
+#endif
+}
+
+
+struct Urg_driver::pImpl : public Scip_stream_parser::Handler
 {
     string error_message_;
     Connection* created_connection_;
@@ -137,6 +384,17 @@ struct Urg_driver::pImpl
     string sensor_product_version_;
     string sensor_product_serial_id_;
     bool is_booting_error_;
+    bool is_pipelined_startup_;
+    startup_timing_t startup_timing_;
+    long long measurement_started_;
+    Scip_stream_parser parser_;
+    Scip_stream_parser::response_t response_;
+    bool is_response_received_;
+    char chunk_[Chunk_size];
+    size_t chunk_first_;
+    size_t chunk_last_;
+    long long chunk_arrival_time_;
+    unsigned long scan_sequence_;
 
 
     pImpl(void)
@@ -145,8 +403,13 @@ struct Urg_driver::pImpl
           sensor_timeout_(Max_timeout),
           is_receiving_(true), is_laser_on_(false),
           remain_scan_times_(0), skip_scan_(0),
-          measurement_type_(Distance), is_booting_error_(false)
+          measurement_type_(Distance), is_booting_error_(false),
+          is_pipelined_startup_(false), measurement_started_(0),
+          parser_(*this, Urg_max_echo), is_response_received_(false),
+          chunk_first_(0), chunk_last_(0), chunk_arrival_time_(0),
+          scan_sequence_(0)
     {
+        clear_startup_timing();
         indicated_.timeout = 0;
 
         received_.is_multiecho = false;
@@ -196,30 +459,130 @@ struct Urg_driver::pImpl
     }
 
 
+    void clear_startup_timing(void)
+    {
+        startup_timing_.connect_usec = 0;
+        startup_timing_.baudrate_usec = 0;
+        startup_timing_.parameter_usec = 0;
+        startup_timing_.laser_on_usec = 0;
+        startup_timing_.first_scan_usec = 0;
+        measurement_started_ = 0;
+    }
+
+
+    // 前回の計測からの経過時間を返し、計測を始めた時刻を更新する
+    static long lap_usec(long long& started)
+    {
+        long long now = ticks_usec();
+        long usec = static_cast<long>(now - started);
+        started = now;
+        return usec;
+    }
+
+
     bool open(const char* device_name_or_ip_address,
               long baudrate_or_port_number, connection_t type)
     {
+        clear_startup_timing();
+        long long started = ticks_usec();
         if (!open_device(device_name_or_ip_address,
                          baudrate_or_port_number, type)) {
             close();
             return false;
         }
+        startup_timing_.connect_usec = lap_usec(started);
 
         long urg_baudrate = (type == Ethernet) ?
             115200 : baudrate_or_port_number;
+
+        ostringstream key;
+        key << device_name_or_ip_address;
+        if (type == Ethernet) {
+            key << ':' << baudrate_or_port_number;
+        }
+        if (open_by_cache(key.str(), urg_baudrate)) {
+            startup_timing_.baudrate_usec = lap_usec(started);
+            return true;
+        }
+
         if (!connect_urg_device(urg_baudrate)) {
             close();
             return false;
         }
         connection_ = created_connection_;
+        startup_timing_.baudrate_usec = lap_usec(started);
+
+        if (!update_sensor_information()) {
+            return false;
+        }
+        startup_timing_.parameter_usec = lap_usec(started);
+
+        if (connection_cache.is_enabled() &&
+            (!sensor_product_serial_id_.empty() || update_vv_information()) &&
+            !sensor_product_serial_id_.empty()) {
+            connection_cache_t cache;
+            cache.baudrate = urg_baudrate;
+            cache.serial_id = sensor_product_serial_id_;
+            cache.product_type = sensor_product_type_;
+            cache.product_version = sensor_product_version_;
+            cache.sensor = sensor_;
+            connection_cache.store(key.str(), cache);
+        }
+        return set_errno_and_return(Urg_no_error);
+    }
+
+
+    // 前回のボーレートで VV を送り、シリアル番号が一致すれば記録した
+    // パラメータを使う
+    bool open_by_cache(const string& key, long urg_baudrate)
+    {
+        connection_cache_t cache;
+        if (!connection_cache.find(key, cache)) {
+            return false;
+        }
+
+        created_connection_->change_baudrate(cache.baudrate);
+        connection_ = created_connection_;
+
+        // 前回の接続で MD を止めずに終えていても VV に応答できるよう、
+        // QT を送信し、受信データを読み捨てる
+        connection_->write("QT\n", 3);
+        clear_received();
+        ignore(connection_, Max_timeout);
+
+        bool is_responded = update_vv_information();
+        if (is_responded && (sensor_product_serial_id_ != cache.serial_id)) {
+            // 別のセンサが接続されている
+            connection_cache.erase(key);
+        }
+        if (!is_responded || (sensor_product_serial_id_ != cache.serial_id) ||
+            !change_sensor_baudrate(cache.baudrate, urg_baudrate)) {
+            // 応答しないときはボーレートが変わった可能性があるが、
+            // 記録は残し、ボーレートの探索からやり直す
+            connection_ = NULL;
+            sensor_product_version_.clear();
+            sensor_product_serial_id_.clear();
+            return false;
+        }
+
+        sensor_ = cache.sensor;
+        sensor_product_type_ = cache.product_type;
+        update_sensor_timeout();
+        set_scanning_parameter(sensor_.first_index, sensor_.last_index, 1);
 
-        return update_sensor_parameter();
+        if (cache.baudrate != urg_baudrate) {
+            cache.baudrate = urg_baudrate;
+            connection_cache.store(key, cache);
+        }
+        return set_errno_and_return(Urg_no_error);
     }
 
 
     bool open(Connection* connection)
     {
         enum { Urg_baudrate = 115200 };
+        clear_startup_timing();
+        long long started = ticks_usec();
         created_connection_ = connection;
         if (!connect_urg_device(Urg_baudrate)) {
             created_connection_ = NULL;
@@ -228,13 +591,43 @@ struct Urg_driver::pImpl
         }
         connection_ = created_connection_;
         created_connection_ = NULL;
+        startup_timing_.baudrate_usec = lap_usec(started);
 
-        return update_sensor_parameter();
+        bool ret = update_sensor_information();
+        startup_timing_.parameter_usec = lap_usec(started);
+        return ret;
+    }
+
+
+    // PP を送信する。パイプライン時は VV もまとめて送信する
+    bool update_sensor_information(void)
+    {
+        if (!is_pipelined_startup_) {
+            return update_sensor_parameter();
+        }
+
+        const char commands[] = "PP\nVV\n";
+        int commands_size = sizeof(commands) - 1;
+        if (connection_->write(commands, commands_size) != commands_size) {
+            return set_errno_and_return(Urg_send_error);
+        }
+        bool ret = update_sensor_parameter(true);
+        if (!update_vv_information(true)) {
+            // VV の応答の残りを読み捨てる。VV は必要になったときに送り直す
+            ignore(connection_, Max_timeout);
+            sensor_product_version_.clear();
+            sensor_product_serial_id_.clear();
+        }
+        if (!ret) {
+            return false;
+        }
+        return set_errno_and_return(Urg_no_error);
     }
 
 
     void close(void)
     {
+        clear_received();
         if (connection_) {
             connection_->close();
         }
@@ -280,27 +673,21 @@ struct Urg_driver::pImpl
 
 
     //! チェックサムの計算
-    char scip_checksum(const char buffer[], int size)
-    {
-        unsigned char sum = 0x00;
-        for (int i = 0; i < size; ++i) {
-            sum += buffer[i];
-        }
-
-        // 計算の意味は SCIP 仕様書を参照のこと
-        return (sum & 0x3f) + 0x30;
-    }
-
-
     // SCIP として受信データを処理し、受信した応答の行数を返す
+    // is_sent が true のときは、送信済みのコマンドの応答のみを受信する
     int scip_response(Connection* connection, const char* command,
                       const int expected_ret[], int timeout,
-                      char *receive_buffer, int receive_buffer_max_size)
+                      char *receive_buffer, int receive_buffer_max_size,
+                      bool is_sent = false)
     {
         size_t write_size = strlen(command);
-        int n = connection->write(command, write_size);
-        if (n != static_cast<int>(write_size)) {
-            return set_errno_and_return(Urg_send_error);
+        int n;
+        if (!is_sent) {
+            clear_received();
+            n = connection->write(command, write_size);
+            if (n != static_cast<int>(write_size)) {
+                return set_errno_and_return(Urg_send_error);
+            }
         }
 
         char *p = receive_buffer;
@@ -351,7 +738,9 @@ struct Urg_driver::pImpl
                     return set_errno_and_return(Urg_invalid_response_error);
 
                 } else {
+                    // 期待しないステータスは、負の値にして返す
                     int actual_ret = strtol(buffer, NULL, 10);
+                    ret = -actual_ret;
                     for (int i = 0; expected_ret[i] != Expected_end; ++i) {
                         if (expected_ret[i] == actual_ret) {
                             ret = Urg_no_error;
@@ -487,7 +876,7 @@ struct Urg_driver::pImpl
     }
 
 
-    bool update_sensor_parameter(void)
+    bool update_sensor_parameter(bool is_sent = false)
     {
         enum {
             Receive_buffer_size = Buffer_size * 9,
@@ -496,7 +885,7 @@ struct Urg_driver::pImpl
         char receive_buffer[Receive_buffer_size];
         int pp_expected[] = { 0, Expected_end };
         int ret = scip_response(connection_, "PP\n", pp_expected, Max_timeout,
-                                receive_buffer, Receive_buffer_size);
+                                receive_buffer, Receive_buffer_size, is_sent);
         if (ret < 0) {
             return false;
         } else if (ret < PP_response_lines) {
@@ -541,13 +930,8 @@ struct Urg_driver::pImpl
 
             } else if (!strncmp(p, "SCAN:", 5)) {
                 int rpm = strtol(p + 5, NULL, 10);
-                // タイムアウト時間は、計測周期の 16 倍程度の値にする
                 sensor_.scan_usec = 1000 * 1000 * 60 / rpm;
-                if (indicated_.timeout > 0) {
-                    sensor_timeout_ = indicated_.timeout;
-                } else {
-                    sensor_timeout_ = sensor_.scan_usec >> (10 - 4);
-                }
+                update_sensor_timeout();
                 received_bits |= 0x0040;
             }
             p += strlen(p) + 1;
@@ -564,7 +948,18 @@ struct Urg_driver::pImpl
     }
 
 
-    bool update_vv_information(void)
+    void update_sensor_timeout(void)
+    {
+        // タイムアウト時間は、計測周期の 16 倍程度の値にする
+        if (indicated_.timeout > 0) {
+            sensor_timeout_ = indicated_.timeout;
+        } else {
+            sensor_timeout_ = sensor_.scan_usec >> (10 - 4);
+        }
+    }
+
+
+    bool update_vv_information(bool is_sent = false)
     {
         enum {
             Receive_buffer_size = Buffer_size * 7,
@@ -573,7 +968,7 @@ struct Urg_driver::pImpl
         char receive_buffer[Receive_buffer_size];
         int vv_expected[] = { 0, Expected_end };
         int ret = scip_response(connection_, "VV\n", vv_expected, Max_timeout,
-                                receive_buffer, Receive_buffer_size);
+                                receive_buffer, Receive_buffer_size, is_sent);
         if (ret < 0) {
             return false;
         } else if (ret < VV_response_lines) {
@@ -616,6 +1011,7 @@ struct Urg_driver::pImpl
         }
 
         connection->write("QT\n", 3);
+        clear_received();
         ignore(connection, timeout);
         is_receiving_ = false;
     }
@@ -628,6 +1024,10 @@ struct Urg_driver::pImpl
             return set_errno_and_return(Urg_invalid_parameter_error);
         }
 
+        startup_timing_.laser_on_usec = 0;
+        startup_timing_.first_scan_usec = 0;
+        measurement_started_ = ticks_usec();
+
         // 指定されたタイプのパケットを生成し、送信する
         bool ret = false;
         switch (type) {
@@ -704,16 +1104,32 @@ struct Urg_driver::pImpl
         char buffer[Buffer_size];
         int write_size;
         if (remain_scan_times_ == 1) {
-            // レーザ発光を指示
-            if (!turn_on_laser()) {
-                return false;
-            }
-
             write_size = snprintf(buffer, Buffer_size, "%c%c%04d%04d%02d\n",
                                   single_scan_ch, scan_type_ch,
                                   indicated_.first_step,
                                   indicated_.last_step,
                                   indicated_.skip_step);
+
+            if (is_pipelined_startup_ && !is_laser_on_) {
+                // BM と GD をまとめて送信し、BM の応答を読み出す
+                string commands = string("BM\n") + buffer;
+                int n = connection_->write(commands.data(), commands.size());
+                if (n != static_cast<int>(commands.size())) {
+                    return set_errno_and_return(Urg_send_error);
+                }
+                if (!turn_on_laser(true)) {
+                    // 送信済みの GD の応答を読み捨てる
+                    clear_received();
+                    ignore(connection_, sensor_timeout_);
+                    return false;
+                }
+                return true;
+            }
+
+            // レーザ発光を指示
+            if (!turn_on_laser()) {
+                return false;
+            }
         } else {
             write_size = snprintf(buffer, Buffer_size,
                                   "%c%c%04d%04d%02d%01d%02d\n",
@@ -750,7 +1166,7 @@ struct Urg_driver::pImpl
     }
 
 
-    bool turn_on_laser(void)
+    bool turn_on_laser(bool is_sent = false)
     {
         if (is_laser_on_) {
             // 既にレーザが発光しているときは、コマンドを送信しない
@@ -758,10 +1174,11 @@ struct Urg_driver::pImpl
         }
 
         int expected[] = { 0, 2, Expected_end };
-        int ret = scip_response(connection_,
-                                "BM\n", expected, sensor_timeout_, NULL, 0);
+        int ret = scip_response(connection_, "BM\n", expected,
+                                sensor_timeout_, NULL, 0, is_sent);
         if (ret >= 0) {
             is_laser_on_ = true;
+            record_laser_on();
             return set_errno_and_return(Urg_no_error);
         } else {
             return set_errno_and_return(Urg_send_error);
@@ -769,113 +1186,120 @@ struct Urg_driver::pImpl
     }
 
 
-    int receive_data(long data[], unsigned short intensity[], long *time_stamp)
+    void record_laser_on(void)
     {
-        is_booting_error_ = false;
-        int extended_timeout = sensor_timeout_
-            + 2 * (sensor_.scan_usec * (indicated_.skip_scan) / 1000);
-
-        // エコーバックの取得
-        char buffer[Buffer_size];
-        int n = readline(connection_, buffer, Buffer_size, extended_timeout);
-        if (n <= 0) {
-            return set_errno_and_return(Urg_no_response_error);
+        if (measurement_started_ && (startup_timing_.laser_on_usec == 0)) {
+            startup_timing_.laser_on_usec =
+                static_cast<long>(ticks_usec() - measurement_started_);
         }
+    }
 
-        // エコーバックの解析
-        Lidar::measurement_t type =
-            static_cast<Lidar::measurement_t>(parse_distance_echoback(buffer));
 
-        // 応答の取得
-        n = readline(connection_, buffer, Buffer_size, sensor_timeout_);
-        if (n != 3) {
-            send_qt_and_ignore_response(connection_, sensor_timeout_);
-            return set_errno_and_return(Urg_invalid_response_error);
-        }
+    int receive_data(long data[], unsigned short intensity[], long *time_stamp,
+                     long long* arrival_time = NULL)
+    {
+        parser_.set_output(data, intensity,
+                           (sensor_.last_index + 1) * measurement_echo_size());
+        return receive_response_data(time_stamp, arrival_time);
+    }
 
-        if (buffer[n - 1] != scip_checksum(buffer, n - 1)) {
-            // チェックサムの評価
-            send_qt_and_ignore_response(connection_, sensor_timeout_);
-            return set_errno_and_return(Urg_checksum_error);
-        }
 
-        if (type == static_cast<Lidar::measurement_t>(Stop)) {
-            // QT 応答の場合には、最後の改行を読み捨て、正常応答として処理する
-            n = readline(connection_, buffer, Buffer_size, sensor_timeout_);
-            if (n == 0) {
-                return 0;
-            } else {
-                return set_errno_and_return(Urg_invalid_response_error);
-            }
+    bool receive_scan(Scan_frame& frame)
+    {
+        bool with_intensity = (measurement_type_ == Distance_intensity) ||
+            (measurement_type_ == Multiecho_intensity);
+        frame.resize(sensor_.last_index + 1, measurement_echo_size(),
+                     with_intensity);
+        parser_.set_output(frame.distance(), frame.intensity(), frame.size());
+
+        int ret = receive_response_data(&frame.sensor_timestamp,
+                                        &frame.host_timestamp);
+        if (ret <= 0) {
+            frame.clear();
+            return false;
         }
+        frame.type = measurement_type_;
+        frame.first_step = received_.first_index;
+        frame.last_step = received_.last_index;
+        frame.group_steps = max(received_.skip_step, 1);
+        frame.sequence = scan_sequence_++;
+        frame.set_steps(ret);
+        return true;
+    }
+
+
+    int measurement_echo_size(void)
+    {
+        bool is_multiecho = (measurement_type_ == Multiecho) ||
+            (measurement_type_ == Multiecho_intensity);
+        return is_multiecho ? max_echo_size() : 1;
+    }
+
+
+    // set_output() で指定した格納先に、応答のデータを受信する
+    int receive_response_data(long* time_stamp, long long* arrival_time)
+    {
+        is_booting_error_ = false;
+        int extended_timeout = sensor_timeout_
+            + 2 * (sensor_.scan_usec * (indicated_.skip_scan) / 1000);
 
-        if (!strncmp(buffer, "10", 2)) {
-            is_booting_error_ = true;
+        while (true) {
+            if (!receive_response(extended_timeout, arrival_time)) {
+                return set_errno_and_return(Urg_no_response_error);
+            }
+            const Scip_stream_parser::response_t& response = response_;
 
-            // 計測の準備ができていないときは、最後の空行を読み捨ててから
-            // エラーを返す
-            n = readline(connection_, buffer, Buffer_size, sensor_timeout_);
-            if (n != 0) {
+            if (response.error == Scip_stream_parser::Checksum_error) {
                 send_qt_and_ignore_response(connection_, sensor_timeout_);
+                return set_errno_and_return(Urg_checksum_error);
+            } else if (response.error != Scip_stream_parser::No_error) {
+                // データが多過ぎる場合は、残りのデータを無視して戻る
+                send_qt_and_ignore_response(connection_, sensor_timeout_);
+                return set_errno_and_return(Urg_receive_error);
             }
-            return set_errno_and_return(Urg_invalid_state_error);
-        }
 
-        if (indicated_.scan_times != 1) {
-            if (!strncmp(buffer, "00", 2)) {
-                // "00" 応答の場合は、エコーバック応答とみなし、
-                // 最後の空行を読み捨て、次からのデータを返す
-                n = readline(connection_, buffer, Buffer_size, sensor_timeout_);
-                if (n != 0) {
-                    send_qt_and_ignore_response(connection_, sensor_timeout_);
-                    return set_errno_and_return(Urg_invalid_response_error);
-                } else {
-                    return receive_data(data, intensity, time_stamp);
-                }
+            if (!strcmp(response.echo, "QT")) {
+                // QT 応答の場合は、正常応答として処理する
+                return 0;
             }
-        }
 
-        // Gx, Hx のときは 00P が返されたときがデータ
-        // Mx, Nx のときは 99b が返されたときがデータ
-        if (((indicated_.scan_times == 1) && (strncmp(buffer, "00", 2))) ||
-            ((indicated_.scan_times != 1) && (strncmp(buffer, "99", 2)))) {
-#if 0
-            // !!! エラーハンドリングを実装するときに、有効にして実装し直す
-            if (urg->error_handler) {
-                type = urg->error_handler(buffer, urg);
+            if (!strncmp(response.status, "10", 2)) {
+                // 計測の準備ができていない
+                is_booting_error_ = true;
+                return set_errno_and_return(Urg_invalid_state_error);
             }
 
-            if (type == URG_UNKNOWN) {
-                ignore_receive_data_with_qt(urg, urg->timeout);
-                return set_errno_and_return(urg, URG_INVALID_RESPONSE);
+            if (response.is_scan) {
+                break;
             }
-#endif
-        }
 
-        // タイムスタンプの取得
-        n = readline(connection_, buffer, Buffer_size, sensor_timeout_);
-        if (n > 0) {
-            if (time_stamp) {
-                *time_stamp = decode_scip(buffer, 4);
+            if (!strncmp(response.status, "00", 2) &&
+                ((response.echo[0] == 'M') || (response.echo[0] == 'N'))) {
+                // Mx, Nx の "00" 応答はエコーバック応答とみなし、
+                // 次の応答のデータを返す
+                record_laser_on();
+                continue;
             }
+            return set_errno_and_return(Urg_invalid_response_error);
         }
 
-        // データの取得
-        int ret = Urg_no_error;
-        switch (static_cast<int>(type)) {
-        case Lidar::Distance:
-        case Lidar::Multiecho:
-            ret = receive_length_data(data, NULL, type, buffer);
-            break;
-
-        case Lidar::Distance_intensity:
-        case Lidar::Multiecho_intensity:
-            ret = receive_length_data(data, intensity, type, buffer);
-            break;
-
-        case Stop:
-            ret = Urg_no_error;
-            break;
+        if (time_stamp) {
+            *time_stamp = response_.time_stamp;
+        }
+        received_.is_multiecho =
+            (response_.type == Lidar::Multiecho) ||
+            (response_.type == Lidar::Multiecho_intensity);
+        received_.first_index = response_.first_index;
+        received_.last_index = response_.last_index;
+        received_.range_data_byte = response_.range_data_byte;
+        received_.skip_step = response_.skip_step;
+        int ret = response_.steps;
+
+        if (measurement_started_) {
+            record_laser_on();
+            startup_timing_.first_scan_usec =
+                static_cast<long>(ticks_usec() - measurement_started_);
+            measurement_started_ = 0;
         }
 
         // specified_scan_times == 1 のときは Gx 系コマンドが使われるため
@@ -891,187 +1315,49 @@ struct Urg_driver::pImpl
     }
 
 
-    int receive_length_data(long length[], unsigned short intensity[],
-                            Lidar::measurement_t type, char buffer[])
+    // 応答を 1 つ解析し終えるまで、受信データを解析器に渡す
+    bool receive_response(int idle_timeout, long long* arrival_time)
     {
-        int n;
-        int step_filled = 0;
-        int line_filled = 0;
-        int multiecho_index = 0;
-
-        const int each_size = received_.range_data_byte;
-        int data_size = each_size;
-        bool is_intensity = false;
-        bool is_multiecho = false;
-        int multiecho_max_size = 1;
-
-        if ((type == Lidar::Distance_intensity) ||
-            (type == Lidar::Multiecho_intensity)) {
-            data_size *= 2;
-            is_intensity = true;
-        }
-        received_.is_multiecho = false;
-        if ((type == Lidar::Multiecho) ||
-            (type == Lidar::Multiecho_intensity)) {
-            received_.is_multiecho = true;
-            is_multiecho = true;
-            multiecho_max_size = max_echo_size();
-        }
-
-        int timeout = sensor_timeout_ + (skip_scan_ * sensor_.scan_usec / 1000);
-        do {
-            char *p = buffer;
-            char *last_p;
-
-            n = readline(connection_, &buffer[line_filled],
-                         Buffer_size - line_filled, timeout);
-
-            if (n > 0) {
-                // チェックサムの評価
-                if (buffer[line_filled + n - 1] !=
-                    scip_checksum(&buffer[line_filled], n - 1)) {
-                    send_qt_and_ignore_response(connection_, timeout);
-
-                    return set_errno_and_return(Urg_checksum_error);
+        is_response_received_ = false;
+        while (true) {
+            if (chunk_first_ >= chunk_last_) {
+                int timeout = parser_.is_receiving() ? (sensor_timeout_ +
+                    (skip_scan_ * sensor_.scan_usec / 1000)) : idle_timeout;
+                int n = connection_->read_some(chunk_, Chunk_size, timeout);
+                if (n <= 0) {
+                    return false;
                 }
+                chunk_first_ = 0;
+                chunk_last_ = n;
+                chunk_arrival_time_ = connection_->line_arrival_time();
             }
 
-            if (n > 0) {
-                line_filled += n - 1;
+            if (arrival_time && !parser_.is_receiving()) {
+                // 応答の先頭を含む塊の到着時刻
+                *arrival_time = chunk_arrival_time_;
             }
-            last_p = p + line_filled;
-
-            while ((last_p - p) >= data_size) {
-                int index;
-
-                if (*p == '&') {
-                    // 先頭文字が '&' だったときは、マルチエコーのデータとみなす
-
-                    if ((last_p - (p + 1)) < data_size) {
-                        // '&' を除いて、data_size 分データが無ければ抜ける
-                        break;
-                    }
-
-                    --step_filled;
-                    ++multiecho_index;
-                    ++p;
-                    --line_filled;
-
-                } else {
-                    // 次のデータ
-                    multiecho_index = 0;
-                }
-
-                index = (step_filled * multiecho_max_size) + multiecho_index;
-
-                if (step_filled >
-                    (received_.last_index - received_.first_index)) {
-                    // データが多過ぎる場合は、残りのデータを無視して戻る
-                    send_qt_and_ignore_response(connection_, timeout);
-                    return set_errno_and_return(Urg_receive_error);
-                }
-
-                if (is_multiecho && (multiecho_index == 0)) {
-                    // マルチエコーのデータ格納先をダミーデータで埋める
-                    int i;
-                    if (length) {
-                        for (i = 1; i < multiecho_max_size; ++i) {
-                            length[index + i] = 0;
-                        }
-                    }
-                    if (intensity) {
-                        for (i = 1; i < multiecho_max_size; ++i) {
-                            intensity[index + i] = 0;
-                        }
-                    }
-                }
-
-                // 距離データの格納
-                if (length) {
-                    length[index] = decode_scip(p, 3);
-                }
-                p += 3;
-
-                // 強度データの格納
-                if (is_intensity) {
-                    if (intensity) {
-                        intensity[index] =
-                            static_cast<unsigned short>(decode_scip(p, 3));
-                    }
-                    p += 3;
-                }
-
-                ++step_filled;
-                line_filled -= data_size;
+            chunk_first_ += parser_.push(&chunk_[chunk_first_],
+                                         chunk_last_ - chunk_first_);
+            if (is_response_received_) {
+                return true;
             }
-
-            // 次に処理する文字を退避
-            memmove(buffer, p, line_filled);
-        } while (n > 0);
-
-        return step_filled;
-    }
-
-
-    int parse_distance_echoback(const char echoback[])
-    {
-        if (!strcmp("QT", echoback)) {
-            return Stop;
         }
-
-        size_t line_length = strlen(echoback);
-        Lidar::measurement_t ret_type = static_cast<Lidar::measurement_t>(Stop);
-        if ((line_length == 12) &&
-            ((echoback[0] == 'G') || (echoback[0] == 'H'))) {
-            ret_type = parse_distance_parameter(echoback);
-
-        } else if ((line_length == 15) &&
-                   ((echoback[0] == 'M') || (echoback[0] == 'N'))) {
-            ret_type = parse_distance_parameter(echoback);
-        }
-        return ret_type;
     }
 
 
-    Lidar::measurement_t parse_distance_parameter(const char echoback[])
+    void response_received(const Scip_stream_parser::response_t& response)
     {
-        Lidar::measurement_t ret_type = static_cast<Lidar::measurement_t>(Stop);
-
-        received_.range_data_byte = 3;
-        if (echoback[1] == 'S') {
-            received_.range_data_byte = 2;
-            ret_type = Lidar::Distance;
-
-        } else if (echoback[1] == 'D') {
-            if ((echoback[0] == 'G') || (echoback[0] == 'M')) {
-                ret_type = Lidar::Distance;
-            } else if ((echoback[0] == 'H') || (echoback[0] == 'N')) {
-                ret_type = Lidar::Multiecho;
-            }
-        } else if (echoback[1] == 'E') {
-            if ((echoback[0] == 'G') || (echoback[0] == 'M')) {
-                ret_type = Lidar::Distance_intensity;
-            } else if ((echoback[0] == 'H') || (echoback[0] == 'N')) {
-                ret_type = Lidar::Multiecho_intensity;
-            }
-        }
-
-        // パラメータの格納
-        received_.first_index = parse_parameter(&echoback[2], 4);
-        received_.last_index = parse_parameter(&echoback[6], 4);
-        received_.skip_step = parse_parameter(&echoback[10], 2);
-
-        return ret_type;
+        response_ = response;
+        is_response_received_ = true;
     }
 
 
-    int parse_parameter(const char *parameter, int size)
+    // 解析途中の受信データを破棄する
+    void clear_received(void)
     {
-        char buffer[5];
-        memcpy(buffer, parameter, size);
-        buffer[size] = '\0';
-
-        return strtol(buffer, NULL, 10);
+        parser_.clear();
+        chunk_first_ = 0;
+        chunk_last_ = 0;
     }
 
 
@@ -1156,15 +1442,8 @@ std::vector<std::string> Urg_driver::find_ports(void)
 {
     vector<string> devices = Serial::find_ports();
 
-    // URG と思われる device を vector の先頭に移動させる
-    size_t replaced_index = 0;
-    size_t n = devices.size();
-    for (size_t i = 0; i < n; ++i) {
-        if (is_urg_port(devices[i]) && (i > replaced_index)) {
-            swap(devices[i], devices[replaced_index]);
-            ++replaced_index;
-        }
-    }
+    // URG と思われる device を、順序を保ったまま vector の先頭に移動させる
+    stable_partition(devices.begin(), devices.end(), is_urg_port);
 
     return devices;
 }
@@ -1172,6 +1451,13 @@ std::vector<std::string> Urg_driver::find_ports(void)
 
 bool Urg_driver::is_urg_port(const std::string& port)
 {
+    int vendor_id;
+    int product_id;
+    if (Serial::port_usb_id(port, vendor_id, product_id) &&
+        (vendor_id == Hokuyo_vendor_id)) {
+        return true;
+    }
+
     string driver_name = Serial::port_driver_name(port);
     if ((driver_name == "URG Series USB Device Driver") ||
         (driver_name == "URG-X002 USB Device Driver")) {
@@ -1181,6 +1467,55 @@ bool Urg_driver::is_urg_port(const std::string& port)
 }
 
 
+std::vector<std::string>
+Urg_driver::probe_ports(const std::vector<std::string>& ports, long baudrate)
+{
+    vector<char> is_found(ports.size(), false);
+    probe_job_t job;
+    job.ports = &ports;
+    job.baudrate = baudrate;
+    job.is_found = &is_found;
+    job.next_index = 0;
+
+#if defined(WINDOWS_OS)
+    for (size_t i = 0; i < ports.size(); ++i) {
+        is_found[i] = probe_port(ports[i], baudrate);
+    }
+#else
+    pthread_mutex_init(&job.mutex, NULL);
+    size_t threads_size = min(ports.size(),
+                              static_cast<size_t>(Max_probe_threads));
+    vector<pthread_t> threads;
+    for (size_t i = 0; i < threads_size; ++i) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, probe_thread, &job) == 0) {
+            threads.push_back(thread);
+        }
+    }
+    // スレッドを作れなかったときは、このスレッドで調べる
+    probe_thread(&job);
+    for (size_t i = 0; i < threads.size(); ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&job.mutex);
+#endif
+
+    vector<string> found_ports;
+    for (size_t i = 0; i < ports.size(); ++i) {
+        if (is_found[i]) {
+            found_ports.push_back(ports[i]);
+        }
+    }
+    return found_ports;
+}
+
+
+void Urg_driver::set_connection_cache_file(const std::string& file_name)
+{
+    connection_cache.set_file(file_name);
+}
+
+
 const char* Urg_driver::what(void) const
 {
     return pimpl->error_message_.c_str();
@@ -1242,6 +1577,18 @@ void Urg_driver::set_timeout_msec(int msec)
 }
 
 
+void Urg_driver::set_pipelined_startup(bool enable)
+{
+    pimpl->is_pipelined_startup_ = enable;
+}
+
+
+Urg_driver::startup_timing_t Urg_driver::startup_timing(void) const
+{
+    return pimpl->startup_timing_;
+}
+
+
 bool Urg_driver::reboot(void)
 {
     if (!is_open()) {
@@ -1291,7 +1638,8 @@ bool Urg_driver::start_measurement(measurement_t type,
 }
 
 
-bool Urg_driver::get_distance(std::vector<long>& data, long *time_stamp)
+bool Urg_driver::get_distance(std::vector<long>& data, long *time_stamp,
+                              long long* arrival_time)
 {
     if (!is_open()) {
         return pimpl->set_errno_and_return(Urg_not_connected);
@@ -1304,13 +1652,14 @@ bool Urg_driver::get_distance(std::vector<long>& data, long *time_stamp)
     }
 
     data.resize(max_data_size());
-    return pimpl->receive_data(&data[0], NULL, time_stamp);
+    return pimpl->receive_data(&data[0], NULL, time_stamp, arrival_time);
 }
 
 
 bool Urg_driver::get_distance_intensity(std::vector<long>& data,
                                         std::vector<unsigned short>& intensity,
-                                        long *time_stamp)
+                                        long *time_stamp,
+                                        long long* arrival_time)
 {
     if (!is_open()) {
         return pimpl->set_errno_and_return(Urg_not_connected);
@@ -1324,12 +1673,13 @@ bool Urg_driver::get_distance_intensity(std::vector<long>& data,
 
     data.resize(max_data_size());
     intensity.resize(max_data_size());
-    return pimpl->receive_data(&data[0], &intensity[0], time_stamp);
+    return pimpl->receive_data(&data[0], &intensity[0], time_stamp,
+                               arrival_time);
 }
 
 
 bool Urg_driver::get_multiecho(std::vector<long>& data_multiecho,
-                               long* time_stamp)
+                               long* time_stamp, long long* arrival_time)
 {
     if (!is_open()) {
         return pimpl->set_errno_and_return(Urg_not_connected);
@@ -1342,14 +1692,16 @@ bool Urg_driver::get_multiecho(std::vector<long>& data_multiecho,
     }
 
     data_multiecho.resize(max_data_size() * pimpl->max_echo_size());
-    return pimpl->receive_data(&data_multiecho[0], NULL, time_stamp);
+    return pimpl->receive_data(&data_multiecho[0], NULL, time_stamp,
+                               arrival_time);
 }
 
 
 bool Urg_driver::get_multiecho_intensity(std::vector<long>& data_multiecho,
                                          std::vector<unsigned short>&
                                          intensity_multiecho,
-                                         long* time_stamp)
+                                         long* time_stamp,
+                                         long long* arrival_time)
 {
     if (!is_open()) {
         return pimpl->set_errno_and_return(Urg_not_connected);
@@ -1364,7 +1716,18 @@ bool Urg_driver::get_multiecho_intensity(std::vector<long>& data_multiecho,
     data_multiecho.resize(max_data_size() * pimpl->max_echo_size());
     intensity_multiecho.resize(max_data_size() * pimpl->max_echo_size());
     return pimpl->receive_data(&data_multiecho[0],
-                               &intensity_multiecho[0], time_stamp);
+                               &intensity_multiecho[0], time_stamp,
+                               arrival_time);
+}
+
+
+bool Urg_driver::get_scan(Scan_frame& frame)
+{
+    if (!is_open()) {
+        frame.clear();
+        return pimpl->set_errno_and_return(Urg_not_connected);
+    }
+    return pimpl->receive_scan(frame);
 }
 
 
@@ -17,6 +17,9 @@
 
 namespace hrk
 {
+    class Scan_frame;
+
+
     class Urg_driver : public Lidar
     {
     public:
@@ -31,12 +34,49 @@ namespace hrk
             Ethernet,
         } connection_t;
 
+        //! 接続から最初の計測データを受信するまでの、各段階の所要時間 [usec]
+        typedef struct
+        {
+            long connect_usec;     //!< デバイスを開く
+            long baudrate_usec;    //!< ボーレートの確認と変更
+            long parameter_usec;   //!< PP (と VV) の応答
+            long laser_on_usec;    //!< 計測開始から、BM または MD の応答まで
+            long first_scan_usec;  //!< 計測開始から、最初のデータの受信まで
+        } startup_timing_t;
+
         Urg_driver(void);
         virtual ~Urg_driver(void);
 
         static std::vector<std::string> find_ports(void);
         static bool is_urg_port(const std::string& port);
 
+        /*!
+          \brief ポートに URG が接続されているかを、並行して調べる
+
+          各ポートを開いて URG との接続を試す。調べ終えたポートは閉じる。
+          ポートごとに接続を試す時間は、ボーレートの探索 1 回分になる。
+
+          \param[in] ports 調べるポート
+          \param[in] baudrate 接続後の URG のボーレート
+
+          \return URG が応答したポート。ports の順に並べる
+        */
+        static std::vector<std::string>
+        probe_ports(const std::vector<std::string>& ports,
+                    long baudrate = Default_baudrate);
+
+        /*!
+          \brief 接続情報のキャッシュを保存するファイルを指定する
+
+          接続に成功したセンサのボーレート、シリアル番号、PP, VV 応答を
+          接続先ごとに記録する。次に同じ接続先を開くときは VV 応答の
+          シリアル番号を確認するだけで接続を終え、一致しなければ
+          ボーレートの探索からやり直す。
+
+          \param[in] file_name ファイル名。空のときはキャッシュを使わない
+        */
+        static void set_connection_cache_file(const std::string& file_name);
+
         const char* what(void) const;
 
         bool open(const char* device_name_or_ip_address,
@@ -53,6 +93,21 @@ namespace hrk
 
         void set_timeout_msec(int msec);
 
+        /*!
+          \brief 起動時のコマンドを、応答を待たずに続けて送信する
+
+          有効なときは、open() で PP と VV を、1 回の計測では BM と GD
+          (HD) をまとめて送信し、応答を順に読み出す。
+        */
+        void set_pipelined_startup(bool enable);
+
+        /*!
+          \brief 直前の open(), start_measurement() の所要時間
+
+          laser_on_usec, first_scan_usec は、計測データを受信するまで 0
+        */
+        startup_timing_t startup_timing(void) const;
+
         bool reboot(void);
 
         bool sleep(void);
@@ -61,16 +116,34 @@ namespace hrk
         bool start_measurement(measurement_t type = Distance,
                                int scan_times = Infinity_scan_times,
                                int skip_scan = 0);
-        bool get_distance(std::vector<long>& data, long *time_stamp = NULL);
+        bool get_distance(std::vector<long>& data, long *time_stamp = NULL,
+                          long long* arrival_time = NULL);
         bool get_distance_intensity(std::vector<long>& data,
                                     std::vector<unsigned short>& intensity,
-                                    long *time_stamp = NULL);
+                                    long *time_stamp = NULL,
+                                    long long* arrival_time = NULL);
         bool get_multiecho(std::vector<long>& data_multiecho,
-                           long* time_stamp = NULL);
+                           long* time_stamp = NULL,
+                           long long* arrival_time = NULL);
         bool get_multiecho_intensity(std::vector<long>& data_multiecho,
                                      std::vector<unsigned short>&
                                      intensity_multiecho,
-                                     long* time_stamp = NULL);
+                                     long* time_stamp = NULL,
+                                     long long* arrival_time = NULL);
+
+        /*!
+          \brief start_measurement() で指定した種類のデータを受信する
+
+          frame の領域は、足りないときのみ確保し直す。データの配置、
+          タイムスタンプ、到着時刻、スキャンの番号も frame に格納する。
+
+          \param[out] frame 受信したスキャン
+
+          \retval true 成功
+          \retval false エラー
+        */
+        bool get_scan(Scan_frame& frame);
+
         bool set_scanning_parameter(int first_step, int last_step,
                                     int skip_step = 1);
         void stop_measurement(void);
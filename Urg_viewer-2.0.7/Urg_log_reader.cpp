@@ -48,6 +48,7 @@ struct Urg_log_reader::pImpl
     int skip_steps_;
     int scan_times_;
     int scan_skips_;
+    string line_;
 
 
     pImpl(void)
@@ -231,6 +232,34 @@ struct Urg_log_reader::pImpl
         fin_ = new ifstream(log_file_.c_str(), ios_base::binary);
         return fin_->is_open();
     }
+
+
+    int read_line(span_t& line)
+    {
+        // ストリームのバッファから直接取り出す
+        line_.clear();
+        streambuf* buffer = fin_->rdbuf();
+        bool has_linefeed = false;
+        while (true) {
+            int ch = buffer->sbumpc();
+            if (ch == char_traits<char>::eof()) {
+                fin_->setstate(ios_base::eofbit);
+                break;
+            }
+            line_.push_back(static_cast<char>(ch));
+            if ((ch == '\n') || (ch == '\r')) {
+                has_linefeed = true;
+                break;
+            }
+        }
+
+        line.data = line_.data();
+        line.size = line_.size();
+        if (line.size == 0) {
+            return -1;
+        }
+        return static_cast<int>(has_linefeed ? line.size - 1 : line.size);
+    }
 };
 
 
@@ -396,6 +425,48 @@ int Urg_log_reader::read(char* data, size_t max_data_size, int timeout)
 }
 
 
+int Urg_log_reader::read_some(char* data, size_t max_data_size, int timeout)
+{
+    static_cast<void>(timeout);
+
+    if (pimpl->fin_->eof()) {
+        return -1;
+    }
+
+    pimpl->fin_->read(data, max_data_size);
+    return static_cast<int>(pimpl->fin_->gcount());
+}
+
+
+int Urg_log_reader::read_line(span_t& line, int timeout)
+{
+    static_cast<void>(timeout);
+
+    if (pimpl->fin_->eof()) {
+        line.size = 0;
+        return -1;
+    }
+
+    return pimpl->read_line(line);
+}
+
+
+size_t Urg_log_reader::peek_buffer(span_t& buffer)
+{
+    // ファイルのバッファは参照できないため、常に空を返す
+    buffer.data = NULL;
+    buffer.size = 0;
+    return 0;
+}
+
+
+long long Urg_log_reader::line_arrival_time(void) const
+{
+    // ログには受信時刻が記録されていない
+    return 0;
+}
+
+
 void Urg_log_reader::ungetc(int ch)
 {
     pimpl->fin_->putback(ch);
@@ -41,7 +41,11 @@ namespace hrk
         void close(void);
         int write(const char* data, size_t data_size);
         int read(char* data, size_t max_data_size, int timeout);
+        int read_some(char* data, size_t max_data_size, int timeout);
         void ungetc(int ch);
+        int read_line(span_t& line, int timeout);
+        size_t peek_buffer(span_t& buffer);
+        long long line_arrival_time(void) const;
 
     private:
         Urg_log_reader(const Urg_log_reader& rhs);
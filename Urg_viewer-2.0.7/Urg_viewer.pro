@@ -14,6 +14,7 @@ INCLUDEPATH += .
 QMAKE_CXXFLAGS += -DNO_LIBLUABIND
 #QMAKE_LIBS += -static-libgcc -static-libstdc++
 win32:LIBS += -lsetupapi -lwsock32
+unix:!macx:LIBS += -lrt
 
 # Input
 HEADERS += Urg_viewer_window.h \
@@ -23,10 +24,20 @@ HEADERS += Urg_viewer_window.h \
         Player_widget.h \
         Recorder_widget.h \
         Connect_thread.h \
+        Probe_thread.h \
         Receive_thread.h \
+        Osc_publisher.h \
+        Region_filter.h \
+        Blob_detector.h \
+        Target_tracker.h \
+        Background_model.h \
+        Shm_scan_ring.h \
+        Fanout_server.h \
+        Scan_delta_codec.h \
         Connection_widget.h \
         Serial_connection_widget.h \
         Ethernet_connection_widget.h \
+        handle_osc_setting.h \
         Preview_widget.h \
         osc\MessageMappingOscPacketListener.h \
         osc\OscException.h \
@@ -57,18 +68,32 @@ SOURCES += main.cpp Urg_viewer_window.cpp \
         Player_widget.cpp \
         Recorder_widget.cpp \
         Connect_thread.cpp \
+        Probe_thread.cpp \
         Receive_thread.cpp \
+        Osc_publisher.cpp \
+        Region_filter.cpp \
+        Blob_detector.cpp \
+        Target_tracker.cpp \
+        Background_model.cpp \
+        Shm_scan_ring.cpp \
+        Fanout_server.cpp \
+        Scan_delta_codec.cpp \
         counter_utils.cpp \
         Csv_recorder.cpp \
         Connection_widget.cpp \
         Serial_connection_widget.cpp \
         Ethernet_connection_widget.cpp \
         handle_ethernet_setting.cpp \
+        handle_osc_setting.cpp \
         Urg_driver.cpp \
         Urg_log_reader.cpp \
         Serial.cpp \
         Tcpip.cpp \
         connection_utils.cpp \
+        scip_decode.cpp \
+        Scip_stream_parser.cpp \
+        Scan_frame.cpp \
+        Scan_frame_pool.cpp \
         Receive_recorder.cpp \
         Color.cpp \
         convert_path_codec.cpp \
@@ -79,11 +104,16 @@ SOURCES += main.cpp Urg_viewer_window.cpp \
         osc\OscPrintReceivedElements.cpp \
         osc\OscReceivedElements.cpp \
         osc\OscTypes.cpp \
-        ip\IpEndpointName.cpp \
-    ip/win32/NetworkingUtils.cpp \
+        ip\IpEndpointName.cpp
+
+win32:SOURCES += ip/win32/NetworkingUtils.cpp \
     ip/win32/UdpSocket.cpp
+unix:SOURCES += ip/posix/NetworkingUtils.cpp \
+    ip/posix/UdpSocket.cpp \
+    Io_reactor.cpp \
+    Uring_receiver.cpp
 
-DISTFILES += detect_os.h Lidar.h State.h Color.h Receive_recorder.h Stream.h Connection.h connection_utils.h convert_path_codec.h Scan_setting.h counter_utils.h Csv_recorder.h handle_ethernet_setting.h Urg_driver.h Ring_buffer.hpp Tcpip.h Serial.h Urg_log_reader.h product_utils.h plugin.h \
+DISTFILES += detect_os.h Lidar.h State.h Color.h Receive_recorder.h Stream.h Connection.h connection_utils.h scip_decode.h Scip_stream_parser.h Scan_frame.h Scan_frame_pool.h convert_path_codec.h Scan_setting.h counter_utils.h Csv_recorder.h handle_ethernet_setting.h Urg_driver.h Ring_buffer.hpp Tcpip.h Serial.h Io_reactor.h Uring_receiver.h Arrival_log.hpp Urg_log_reader.h product_utils.h plugin.h \
            Serial_windows.cpp Serial_linux.cpp Tcpip_windows.cpp Tcpip_linux.cpp \
            rescan_icon.png folder_icon.png play_icon.png pause_icon.png stop_icon.png record_icon.png zoom_in_icon.png zoom_out_icon.png Urg_viewer_icon.ico Urg_viewer_icon.png \
            README.txt COPYING.txt Urg_viewer.rc \
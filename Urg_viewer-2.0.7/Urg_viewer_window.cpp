@@ -8,6 +8,8 @@
 */
 
 #include <cmath>
+#include <algorithm>
+#include <iostream>
 #include <QCloseEvent>
 #include <QMessageBox>
 #include <QFileDialog>
@@ -22,13 +24,19 @@
 #include "Serial_connection_widget.h"
 #include "Ethernet_connection_widget.h"
 #include "handle_ethernet_setting.h"
+#include "handle_osc_setting.h"
 #include "Step_value_widget.h"
 #include "Plotter_2d_widget.h"
 #include "Recorder_widget.h"
 #include "Player_widget.h"
 #include "Scan_setting_widget.h"
 #include "Connect_thread.h"
+#include "Probe_thread.h"
 #include "Receive_thread.h"
+#include "Osc_publisher.h"
+#include "Fanout_server.h"
+#include "Background_model.h"
+#include "Shm_scan_ring.h"
 #include "Scan_setting.h"
 #include "Receive_recorder.h"
 #include "Urg_log_reader.h"
@@ -51,6 +59,8 @@ namespace
     const string Application_title = "Urg Viewer";
 
     const char* Completer_file = "address.txt";
+    const char* Background_file = "background.dat";
+    const char* Connection_cache_file = "connection_cache.txt";
 
     typedef vector<State*> State_forms;
 
@@ -127,6 +137,9 @@ struct Urg_viewer_window::pImpl
     Urg_log_reader urg_log_reader_;
     QTimer redraw_timer_;
     Connect_thread connect_thread_;
+    Probe_thread probe_thread_;
+    Osc_publisher osc_publisher_;
+    Fanout_server fanout_server_;
     Receive_thread receive_thread_;
     State_forms state_forms_;
     State::state_t current_state_;
@@ -153,6 +166,25 @@ struct Urg_viewer_window::pImpl
     int connect_retry_count_;
     bool load_default_when_connected_;
 
+    bool background_subtraction_;
+    QString background_file_;
+    int background_learning_scans_;
+    int background_margin_;
+
+    QString shm_ring_name_;
+    int shm_ring_slots_;
+
+    int fanout_port_;
+    QString fanout_bind_address_;
+    QString fanout_payload_;
+    int fanout_max_clients_;
+    int fanout_queue_packets_;
+
+    bool io_uring_receive_;
+    QString socket_profile_;
+    bool serial_low_latency_;
+    bool pipelined_startup_;
+
     Plugin_handler plugin_;
 
 
@@ -162,11 +194,21 @@ struct Urg_viewer_window::pImpl
           ethernet_connection_widget_(connection_widget_.ethernet()),
           plotter_2d_widget_(urg_, step_value_widget_),
           connect_thread_(urg_),
-          receive_thread_(urg_, urg_log_reader_, plotter_2d_widget_),
+          receive_thread_(urg_, urg_log_reader_, plotter_2d_widget_,
+                          osc_publisher_, fanout_server_),
           next_scan_interval_(0),
           original_connection_(NULL), is_pausing_(false),
           play_speed_magnification_(1.0), last_clicked_step_(Invalid_step),
-          connect_retry_count_(0), load_default_when_connected_(true)
+          connect_retry_count_(0), load_default_when_connected_(true),
+          background_subtraction_(false), background_file_(Background_file),
+          background_learning_scans_(Background_model::Default_learning_scans),
+          background_margin_(Background_model::Default_margin_mm),
+          shm_ring_slots_(Shm_scan_writer::Default_slots), fanout_port_(0),
+          fanout_bind_address_("127.0.0.1"), fanout_payload_("frame"),
+          fanout_max_clients_(Fanout_server::Default_max_clients),
+          fanout_queue_packets_(Fanout_server::Default_queue_packets),
+          io_uring_receive_(false), socket_profile_("default"),
+          serial_low_latency_(false), pipelined_startup_(false)
     {
         redraw_timer_.setInterval(Default_redraw_msec);
         state_forms_.push_back(&plotter_2d_widget_);
@@ -207,6 +249,8 @@ struct Urg_viewer_window::pImpl
                 widget_, SLOT(change_clicked()));
         connect(serial_connection_widget_, SIGNAL(rescan_clicked()),
                 widget_, SLOT(rescan_clicked()));
+        connect(&probe_thread_, SIGNAL(finished()),
+                widget_, SLOT(probe_finished()));
         connect(serial_connection_widget_,
                 SIGNAL(connect_clicked(const std::string&, long)),
                 widget_,
@@ -329,7 +373,8 @@ struct Urg_viewer_window::pImpl
 
         plugin_register_plotter(&plotter_2d_widget_);
 
-        // 描画の開始
+        // OSC 送信と描画の開始
+        osc_publisher_.start();
         redraw_timer_.start();
     }
 
@@ -350,6 +395,7 @@ struct Urg_viewer_window::pImpl
         if (connection_type != connection_widget_.connection_type()) {
             change_clicked();
         }
+        Urg_driver::set_connection_cache_file(Connection_cache_file);
         rescan_serial_devices();
         load_ethernet_setting(settings, ethernet_connection_widget_);
         completer_address_ = load_complete_address(Completer_file);
@@ -373,6 +419,93 @@ struct Urg_viewer_window::pImpl
 
         bool auto_update = settings.value("auto_update", false).toBool();
         step_value_widget_.set_auto_update(auto_update);
+
+        load_osc_setting(settings, osc_publisher_);
+
+        background_subtraction_ =
+            settings.value("background_subtraction", false).toBool();
+        background_file_ =
+            settings.value("background_file", Background_file).toString();
+        background_learning_scans_ =
+            settings.value("background_learning_scans",
+                           background_learning_scans_).toInt();
+        background_margin_ =
+            settings.value("background_margin", background_margin_).toInt();
+        receive_thread_.
+            set_background_subtraction(background_subtraction_,
+                                       background_file_.toStdString(),
+                                       max(background_learning_scans_, 1),
+                                       background_margin_);
+
+        // 名前が空のときは、共有メモリに書き込まない
+        shm_ring_name_ = settings.value("shm_ring_name", "").toString();
+        shm_ring_slots_ =
+            settings.value("shm_ring_slots", shm_ring_slots_).toInt();
+        receive_thread_.set_shared_memory(shm_ring_name_.toStdString(),
+                                          max(shm_ring_slots_, 2));
+
+        load_fanout_setting(settings);
+
+        // 使えない環境では、設定に関わらず epoll, select で受信する
+        io_uring_receive_ =
+            settings.value("io_uring_receive", io_uring_receive_).toBool();
+        Tcpip::set_receive_engine(io_uring_receive_ ?
+                                  Tcpip::Io_uring_receive :
+                                  Tcpip::Socket_receive);
+
+        // "low_latency", "throughput" 以外は OS の設定のまま使う
+        socket_profile_ =
+            settings.value("socket_profile", socket_profile_).toString();
+        Tcpip::set_socket_profile((socket_profile_ == "low_latency") ?
+                                  Tcpip::Low_latency_profile :
+                                  (socket_profile_ == "throughput") ?
+                                  Tcpip::Throughput_profile :
+                                  Tcpip::Default_profile);
+
+        serial_low_latency_ =
+            settings.value("serial_low_latency",
+                           serial_low_latency_).toBool();
+        Serial::set_serial_profile(serial_low_latency_ ?
+                                   Serial::Low_latency_profile :
+                                   Serial::Default_profile);
+
+        pipelined_startup_ =
+            settings.value("pipelined_startup", pipelined_startup_).toBool();
+        urg_.set_pipelined_startup(pipelined_startup_);
+    }
+
+
+    // ポート番号が 0 のときは、TCP での配信を行わない
+    // 他の計算機に配信するときは、fanout_bind_address を明示的に設定する
+    void load_fanout_setting(QSettings& settings)
+    {
+        fanout_port_ = settings.value("fanout_port", fanout_port_).toInt();
+        fanout_bind_address_ =
+            settings.value("fanout_bind_address",
+                           fanout_bind_address_).toString();
+        fanout_payload_ =
+            settings.value("fanout_payload", fanout_payload_).toString();
+        fanout_max_clients_ =
+            settings.value("fanout_max_clients", fanout_max_clients_).toInt();
+        fanout_queue_packets_ =
+            settings.value("fanout_queue_packets",
+                           fanout_queue_packets_).toInt();
+
+        fanout_server_.set_bind_address(fanout_bind_address_.toStdString());
+        fanout_server_.set_payload((fanout_payload_ == "raw") ?
+                                   Fanout_server::Raw_scip :
+                                   Fanout_server::Scan_frame);
+        fanout_server_.set_max_clients(max(fanout_max_clients_, 1));
+        fanout_server_.set_queue_packets(max(fanout_queue_packets_, 1));
+        if (fanout_port_ <= 0) {
+            return;
+        }
+
+        if (fanout_server_.listen(fanout_port_)) {
+            fanout_server_.start();
+        } else {
+            cerr << "Fanout_server: " << fanout_server_.what() << endl;
+        }
     }
 
 
@@ -400,6 +533,27 @@ struct Urg_viewer_window::pImpl
 
         settings.setValue("auto_update",
                           step_value_widget_.auto_update());
+
+        save_osc_setting(settings, osc_publisher_);
+
+        settings.setValue("background_subtraction", background_subtraction_);
+        settings.setValue("background_file", background_file_);
+        settings.setValue("background_learning_scans",
+                          background_learning_scans_);
+        settings.setValue("background_margin", background_margin_);
+
+        settings.setValue("shm_ring_name", shm_ring_name_);
+        settings.setValue("shm_ring_slots", shm_ring_slots_);
+
+        settings.setValue("fanout_port", fanout_port_);
+        settings.setValue("fanout_bind_address", fanout_bind_address_);
+        settings.setValue("fanout_payload", fanout_payload_);
+        settings.setValue("fanout_max_clients", fanout_max_clients_);
+        settings.setValue("fanout_queue_packets", fanout_queue_packets_);
+        settings.setValue("io_uring_receive", io_uring_receive_);
+        settings.setValue("socket_profile", socket_profile_);
+        settings.setValue("serial_low_latency", serial_low_latency_);
+        settings.setValue("pipelined_startup", pipelined_startup_);
     }
 
 
@@ -499,16 +653,57 @@ struct Urg_viewer_window::pImpl
     }
 
 
-    void rescan_serial_devices(void)
+    // probe が true のときは、URG と判定できなかったポートに接続を試す
+    void rescan_serial_devices(bool probe = false)
     {
         vector<string> device_names = Urg_driver::find_ports();
+        vector<string> urg_ports;
+        vector<string> candidates;
         for (vector<string>::iterator it = device_names.begin();
              it != device_names.end(); ++it) {
             if (Urg_driver::is_urg_port(*it)) {
-                *it = *it + " [URG]";
+                urg_ports.push_back(*it);
+            } else {
+                candidates.push_back(*it);
             }
         }
-        serial_connection_widget_->set_device_names(device_names);
+        if (probe && urg_ports.empty() && !candidates.empty() &&
+            !probe_thread_.isRunning()) {
+            // 接続を試す間も画面を更新できるよう、別スレッドで調べる
+            // 結果は probe_finished() で一覧に反映する
+            QApplication::setOverrideCursor(Qt::BusyCursor);
+            probe_thread_.set_ports(candidates);
+            probe_thread_.start();
+        }
+
+        set_device_names(device_names, urg_ports);
+    }
+
+
+    void probe_finished(void)
+    {
+        QApplication::restoreOverrideCursor();
+        set_device_names(probe_thread_.ports(), probe_thread_.found_ports());
+    }
+
+
+    // URG のポートを先頭に並べる
+    void set_device_names(const vector<string>& device_names,
+                          const vector<string>& urg_ports)
+    {
+        vector<string> labeled_names;
+        for (vector<string>::const_iterator it = urg_ports.begin();
+             it != urg_ports.end(); ++it) {
+            labeled_names.push_back(*it + " [URG]");
+        }
+        for (vector<string>::const_iterator it = device_names.begin();
+             it != device_names.end(); ++it) {
+            if (find(urg_ports.begin(), urg_ports.end(), *it) ==
+                urg_ports.end()) {
+                labeled_names.push_back(*it);
+            }
+        }
+        serial_connection_widget_->set_device_names(labeled_names);
     }
 
 
@@ -594,6 +789,7 @@ struct Urg_viewer_window::pImpl
         step_value_widget_.set_steps(scan_steps, next_scan_setting_.first_step);
 
         plotter_2d_widget_.set_scan_setting(next_scan_setting_);
+        osc_publisher_.set_scan_setting(next_scan_setting_);
         receive_thread_.set_scan_setting(next_scan_setting_,
                                          next_scan_interval_);
     }
@@ -620,6 +816,8 @@ struct Urg_viewer_window::pImpl
             error_message_ = receive_recorder_.what();
             return false;
         }
+        // 記録中は、受信した SCIP の応答をそのまま TCP で配信できる
+        receive_recorder_.set_mirror(fanout_server_.raw_stream());
 
         if (!urg_.open(&receive_recorder_)) {
             return false;
@@ -1121,7 +1319,13 @@ void Urg_viewer_window::disconnect_clicked(void)
 
 void Urg_viewer_window::rescan_clicked(void)
 {
-    pimpl->rescan_serial_devices();
+    pimpl->rescan_serial_devices(true);
+}
+
+
+void Urg_viewer_window::probe_finished(void)
+{
+    pimpl->probe_finished();
 }
 
 
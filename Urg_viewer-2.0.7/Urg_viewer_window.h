@@ -47,6 +47,7 @@ class Urg_viewer_window
     void ethernet_connect_clicked(const std::string& address, long port);
     void disconnect_clicked(void);
     void rescan_clicked(void);
+    void probe_finished(void);
     void folder_clicked(void);
     void record_clicked(void);
     void record_stop_clicked(void);
@@ -0,0 +1,817 @@
+/*!
+  \file
+  \brief io_uring による受信 (Linux)
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include "detect_os.h"
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <cerrno>
+#include <cstring>
+#include "Uring_receiver.h"
+#if defined(LINUX_OS)
+#include <linux/version.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 0, 0)
+// multishot recv と provided buffer ring が定義されているヘッダのみ使う
+#define HRK_URING_ENABLED
+#endif
+#endif
+
+#if defined(HRK_URING_ENABLED)
+#include <unistd.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <linux/io_uring.h>
+#endif
+
+using namespace hrk;
+using namespace std;
+
+
+namespace
+{
+    enum {
+        Invalid_fd = -1,
+    };
+
+
+    typedef struct
+    {
+        unsigned short id;
+        size_t size;
+        size_t offset;
+    } segment_t;
+
+
+    // 接続毎の受信状態。Engine::mutex_ をロックして参照する
+    typedef struct
+    {
+        int socket;
+        int event_fd;
+        deque<segment_t> segments;
+        bool is_armed;          // multishot recv が動作中
+        bool is_stalled;        // バッファプールが空で止まった
+        bool is_closed;
+        bool is_removing;
+        bool is_signaled;
+        int error;
+    } receive_queue_t;
+
+
+    void init_queue(receive_queue_t& queue, int socket, int event_fd)
+    {
+        queue.socket = socket;
+        queue.event_fd = event_fd;
+        queue.segments.clear();
+        queue.is_armed = false;
+        queue.is_stalled = false;
+        queue.is_closed = false;
+        queue.is_removing = false;
+        queue.is_signaled = false;
+        queue.error = 0;
+    }
+
+
+#if defined(HRK_URING_ENABLED)
+    enum {
+        Queue_entries = 64,
+        Buffer_entries = 256,
+        Buffer_size = 4096,
+        Buffer_group = 0,
+    };
+
+    // キューに関連付けない完了通知の user_data
+    const uint64_t Wakeup_data = 0;
+    const uint64_t Cancel_data = 1;
+
+
+    int io_uring_setup(unsigned entries, struct io_uring_params* params)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+    }
+
+
+    int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                       unsigned flags)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit,
+                                        min_complete, flags, NULL, 0));
+    }
+
+
+    int io_uring_register(int fd, unsigned opcode, void* arg, unsigned n)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_register,
+                                        fd, opcode, arg, n));
+    }
+
+
+    template <class T>
+    T* offset_pointer(void* base, unsigned offset)
+    {
+        return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+    }
+
+
+    // 全ての接続で共有する io_uring と、受信用のスレッド
+    class Engine
+    {
+    public:
+        static Engine& instance(void)
+        {
+            static Engine engine;
+            return engine;
+        }
+
+
+        bool is_available(void) const
+        {
+            return is_available_;
+        }
+
+
+        const char* what(void) const
+        {
+            return error_message_.c_str();
+        }
+
+
+        void add(receive_queue_t* queue)
+        {
+            pthread_mutex_lock(&mutex_);
+            arm(queue);
+            submit();
+            pthread_mutex_unlock(&mutex_);
+        }
+
+
+        // カーネルがキューを参照しなくなるまで待つ
+        void remove(receive_queue_t* queue)
+        {
+            pthread_mutex_lock(&mutex_);
+            queue->is_removing = true;
+            if (queue->is_armed) {
+                struct io_uring_sqe* sqe = get_sqe();
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->fd = -1;
+                sqe->addr = reinterpret_cast<uintptr_t>(queue);
+                sqe->user_data = Cancel_data;
+                submit();
+            }
+            while (queue->is_armed) {
+                pthread_cond_wait(&removed_, &mutex_);
+            }
+            stalled_.erase(std::remove(stalled_.begin(), stalled_.end(),
+                                       queue), stalled_.end());
+            while (!queue->segments.empty()) {
+                recycle(queue->segments.front().id);
+                queue->segments.pop_front();
+            }
+            rearm_stalled();
+            pthread_mutex_unlock(&mutex_);
+        }
+
+
+        int receive(receive_queue_t* queue, char* data, size_t max_data_size)
+        {
+            pthread_mutex_lock(&mutex_);
+
+            size_t filled = 0;
+            deque<segment_t>& segments = queue->segments;
+            while ((filled < max_data_size) && !segments.empty()) {
+                segment_t& segment = segments.front();
+                size_t n = min(max_data_size - filled,
+                               segment.size - segment.offset);
+                memcpy(&data[filled],
+                       buffer(segment.id) + segment.offset, n);
+                segment.offset += n;
+                filled += n;
+                if (segment.offset >= segment.size) {
+                    recycle(segment.id);
+                    segments.pop_front();
+                }
+            }
+
+            if (segments.empty() && queue->is_signaled &&
+                !queue->is_closed) {
+                // 次の受信を通知できるように、通知をクリアする
+                uint64_t value;
+                ssize_t n = ::read(queue->event_fd, &value, sizeof(value));
+                static_cast<void>(n);
+                queue->is_signaled = false;
+            }
+            rearm_stalled();
+
+            int ret = static_cast<int>(filled);
+            if ((filled == 0) && queue->is_closed) {
+                errno = queue->error;
+                ret = -1;
+            }
+            pthread_mutex_unlock(&mutex_);
+            return ret;
+        }
+
+
+    private:
+        Engine(void)
+            : is_available_(false), error_message_("no error."),
+              ring_fd_(Invalid_fd), sq_ring_(MAP_FAILED),
+              cq_ring_(MAP_FAILED), sq_ring_size_(0), cq_ring_size_(0),
+              sqes_(NULL), sqes_size_(0), sq_tail_(0), pending_(0),
+              buffer_ring_(NULL), buffers_(NULL), buffer_tail_(0),
+              free_buffers_(0), quit_(false), is_thread_started_(false)
+        {
+            pthread_mutex_init(&mutex_, NULL);
+            pthread_cond_init(&removed_, NULL);
+
+            if (!setup() || !setup_buffers() || !probe_multishot()) {
+                return;
+            }
+
+            if (pthread_create(&thread_, NULL, thread_entry, this) != 0) {
+                error_message_ = string("pthread_create: ") + strerror(errno);
+                return;
+            }
+            is_thread_started_ = true;
+            is_available_ = true;
+        }
+
+
+        ~Engine(void)
+        {
+            if (is_thread_started_) {
+                pthread_mutex_lock(&mutex_);
+                quit_ = true;
+                struct io_uring_sqe* sqe = get_sqe();
+                sqe->opcode = IORING_OP_NOP;
+                sqe->user_data = Wakeup_data;
+                submit();
+                pthread_mutex_unlock(&mutex_);
+                pthread_join(thread_, NULL);
+            }
+
+            if (buffer_ring_) {
+                munmap(buffer_ring_, buffer_ring_size());
+            }
+            delete [] buffers_;
+            if (sqes_) {
+                munmap(sqes_, sqes_size_);
+            }
+            if ((cq_ring_ != MAP_FAILED) && (cq_ring_ != sq_ring_)) {
+                munmap(cq_ring_, cq_ring_size_);
+            }
+            if (sq_ring_ != MAP_FAILED) {
+                munmap(sq_ring_, sq_ring_size_);
+            }
+            if (ring_fd_ != Invalid_fd) {
+                ::close(ring_fd_);
+            }
+            pthread_cond_destroy(&removed_);
+            pthread_mutex_destroy(&mutex_);
+        }
+
+
+        Engine(const Engine& rhs);
+        Engine& operator = (const Engine& rhs);
+
+
+        void set_error(const char* operation)
+        {
+            error_message_ = string(operation) + ": " + strerror(errno);
+        }
+
+
+        bool setup(void)
+        {
+            struct io_uring_params params;
+            memset(&params, 0, sizeof(params));
+            ring_fd_ = io_uring_setup(Queue_entries, &params);
+            if (ring_fd_ < 0) {
+                ring_fd_ = Invalid_fd;
+                set_error("io_uring_setup");
+                return false;
+            }
+
+            sq_ring_size_ =
+                params.sq_off.array + (params.sq_entries * sizeof(unsigned));
+            cq_ring_size_ = params.cq_off.cqes +
+                (params.cq_entries * sizeof(struct io_uring_cqe));
+            bool is_single_mmap =
+                (params.features & IORING_FEAT_SINGLE_MMAP) ? true : false;
+            if (is_single_mmap) {
+                sq_ring_size_ = max(sq_ring_size_, cq_ring_size_);
+                cq_ring_size_ = sq_ring_size_;
+            }
+
+            sq_ring_ = mmap(NULL, sq_ring_size_, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring_fd_,
+                            IORING_OFF_SQ_RING);
+            if (sq_ring_ == MAP_FAILED) {
+                set_error("mmap");
+                return false;
+            }
+            cq_ring_ = is_single_mmap ? sq_ring_ :
+                mmap(NULL, cq_ring_size_, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+            if (cq_ring_ == MAP_FAILED) {
+                set_error("mmap");
+                return false;
+            }
+
+            sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+            void* sqes = mmap(NULL, sqes_size_, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, ring_fd_,
+                              IORING_OFF_SQES);
+            if (sqes == MAP_FAILED) {
+                set_error("mmap");
+                return false;
+            }
+            sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+
+            sq_head_ = offset_pointer<unsigned>(sq_ring_, params.sq_off.head);
+            sq_tail_pointer_ =
+                offset_pointer<unsigned>(sq_ring_, params.sq_off.tail);
+            sq_mask_ =
+                *offset_pointer<unsigned>(sq_ring_, params.sq_off.ring_mask);
+            sq_entries_ = params.sq_entries;
+            sq_array_ = offset_pointer<unsigned>(sq_ring_, params.sq_off.array);
+            sq_tail_ = *sq_tail_pointer_;
+
+            cq_head_ = offset_pointer<unsigned>(cq_ring_, params.cq_off.head);
+            cq_tail_ = offset_pointer<unsigned>(cq_ring_, params.cq_off.tail);
+            cq_mask_ =
+                *offset_pointer<unsigned>(cq_ring_, params.cq_off.ring_mask);
+            cqes_ = offset_pointer<struct io_uring_cqe>(cq_ring_,
+                                                        params.cq_off.cqes);
+            return true;
+        }
+
+
+        static size_t buffer_ring_size(void)
+        {
+            return Buffer_entries * sizeof(struct io_uring_buf);
+        }
+
+
+        bool setup_buffers(void)
+        {
+            void* ring = mmap(NULL, buffer_ring_size(), PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (ring == MAP_FAILED) {
+                set_error("mmap");
+                return false;
+            }
+            // C++ では io_uring_buf_ring::bufs の位置がずれるため、
+            // 領域を io_uring_buf の配列として扱う。末尾の位置は先頭の
+            // io_uring_buf::resv に書き込む
+            buffer_ring_ = static_cast<struct io_uring_buf*>(ring);
+
+            struct io_uring_buf_reg reg;
+            memset(&reg, 0, sizeof(reg));
+            reg.ring_addr = reinterpret_cast<uintptr_t>(buffer_ring_);
+            reg.ring_entries = Buffer_entries;
+            reg.bgid = Buffer_group;
+            if (io_uring_register(ring_fd_, IORING_REGISTER_PBUF_RING,
+                                  &reg, 1) != 0) {
+                set_error("IORING_REGISTER_PBUF_RING");
+                return false;
+            }
+
+            buffers_ = new char[Buffer_entries * Buffer_size];
+            for (int i = 0; i < Buffer_entries; ++i) {
+                recycle(static_cast<unsigned short>(i));
+            }
+            return true;
+        }
+
+
+        // 受信したデータが multishot で通知されるかを、socketpair で確認する
+        bool probe_multishot(void)
+        {
+            int sockets[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0) {
+                set_error("socketpair");
+                return false;
+            }
+
+            receive_queue_t queue;
+            init_queue(queue, sockets[0], Invalid_fd);
+            arm(&queue);
+            submit();
+            char ch = 0;
+            ssize_t n = ::write(sockets[1], &ch, 1);
+            static_cast<void>(n);
+            while (queue.segments.empty() && !queue.is_closed &&
+                   queue.is_armed) {
+                wait_completions();
+            }
+            bool is_multishot = queue.is_armed && !queue.segments.empty();
+
+            queue.is_removing = true;
+            if (queue.is_armed) {
+                struct io_uring_sqe* sqe = get_sqe();
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->fd = -1;
+                sqe->addr = reinterpret_cast<uintptr_t>(&queue);
+                sqe->user_data = Cancel_data;
+                submit();
+            }
+            while (queue.is_armed) {
+                wait_completions();
+            }
+            while (!queue.segments.empty()) {
+                recycle(queue.segments.front().id);
+                queue.segments.pop_front();
+            }
+            ::close(sockets[0]);
+            ::close(sockets[1]);
+
+            if (!is_multishot) {
+                error_message_ = "multishot recv is not supported.";
+            }
+            return is_multishot;
+        }
+
+
+        void wait_completions(void)
+        {
+            if ((io_uring_enter(ring_fd_, 0, 1, IORING_ENTER_GETEVENTS) < 0)
+                && (errno != EINTR)) {
+                return;
+            }
+            reap();
+        }
+
+
+        char* buffer(unsigned short id)
+        {
+            return &buffers_[id * Buffer_size];
+        }
+
+
+        // mutex_ をロックして呼び出す
+        void recycle(unsigned short id)
+        {
+            struct io_uring_buf* entry =
+                &buffer_ring_[buffer_tail_ & (Buffer_entries - 1)];
+            entry->addr = reinterpret_cast<uintptr_t>(buffer(id));
+            entry->len = Buffer_size;
+            entry->bid = id;
+            ++buffer_tail_;
+            __atomic_store_n(&buffer_ring_[0].resv, buffer_tail_,
+                             __ATOMIC_RELEASE);
+            ++free_buffers_;
+        }
+
+
+        // mutex_ をロックして呼び出す
+        struct io_uring_sqe* get_sqe(void)
+        {
+            unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+            if ((sq_tail_ - head) >= sq_entries_) {
+                submit();
+            }
+
+            unsigned index = sq_tail_ & sq_mask_;
+            struct io_uring_sqe* sqe = &sqes_[index];
+            memset(sqe, 0, sizeof(*sqe));
+            sq_array_[index] = index;
+            ++sq_tail_;
+            ++pending_;
+            return sqe;
+        }
+
+
+        // mutex_ をロックして呼び出す
+        void submit(void)
+        {
+            if (pending_ == 0) {
+                return;
+            }
+            __atomic_store_n(sq_tail_pointer_, sq_tail_, __ATOMIC_RELEASE);
+            while ((io_uring_enter(ring_fd_, pending_, 0, 0) < 0) &&
+                   (errno == EINTR)) {
+                ;
+            }
+            pending_ = 0;
+        }
+
+
+        // mutex_ をロックして呼び出す
+        void arm(receive_queue_t* queue)
+        {
+            struct io_uring_sqe* sqe = get_sqe();
+            sqe->opcode = IORING_OP_RECV;
+            sqe->fd = queue->socket;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = Buffer_group;
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->user_data = reinterpret_cast<uintptr_t>(queue);
+            queue->is_armed = true;
+            queue->is_stalled = false;
+        }
+
+
+        // mutex_ をロックして呼び出す
+        void rearm_stalled(void)
+        {
+            if (stalled_.empty() || (free_buffers_ == 0)) {
+                return;
+            }
+            for (deque<receive_queue_t*>::iterator it = stalled_.begin();
+                 it != stalled_.end(); ++it) {
+                receive_queue_t* queue = *it;
+                if (queue->is_stalled && !queue->is_removing &&
+                    !queue->is_closed) {
+                    arm(queue);
+                }
+            }
+            stalled_.clear();
+            submit();
+        }
+
+
+        // mutex_ をロックして呼び出す
+        void signal(receive_queue_t* queue)
+        {
+            if (queue->is_signaled || (queue->event_fd == Invalid_fd)) {
+                return;
+            }
+            queue->is_signaled = true;
+            uint64_t value = 1;
+            ssize_t n = ::write(queue->event_fd, &value, sizeof(value));
+            static_cast<void>(n);
+        }
+
+
+        // mutex_ をロックして呼び出す
+        void handle(const struct io_uring_cqe& cqe)
+        {
+            if ((cqe.user_data == Wakeup_data) ||
+                (cqe.user_data == Cancel_data)) {
+                return;
+            }
+
+            receive_queue_t* queue =
+                reinterpret_cast<receive_queue_t*>(cqe.user_data);
+            if ((cqe.res > 0) && (cqe.flags & IORING_CQE_F_BUFFER)) {
+                unsigned short id =
+                    static_cast<unsigned short>(cqe.flags >>
+                                                IORING_CQE_BUFFER_SHIFT);
+                --free_buffers_;
+                if (queue->is_removing) {
+                    recycle(id);
+                } else {
+                    segment_t segment;
+                    segment.id = id;
+                    segment.size = cqe.res;
+                    segment.offset = 0;
+                    queue->segments.push_back(segment);
+                    signal(queue);
+                }
+            } else if (cqe.res == 0) {
+                queue->is_closed = true;
+                queue->error = 0;
+                signal(queue);
+            } else if ((cqe.res < 0) && (cqe.res != -ENOBUFS) &&
+                       (cqe.res != -ECANCELED)) {
+                queue->is_closed = true;
+                queue->error = -cqe.res;
+                signal(queue);
+            }
+
+            if (cqe.flags & IORING_CQE_F_MORE) {
+                return;
+            }
+
+            // multishot recv が終了した
+            queue->is_armed = false;
+            if (queue->is_removing) {
+                pthread_cond_broadcast(&removed_);
+            } else if (!queue->is_closed) {
+                if ((cqe.res == -ENOBUFS) && (free_buffers_ == 0)) {
+                    // バッファが返されたときに再開する
+                    queue->is_stalled = true;
+                    stalled_.push_back(queue);
+                } else {
+                    arm(queue);
+                }
+            }
+        }
+
+
+        // mutex_ をロックして呼び出す
+        void reap(void)
+        {
+            unsigned head = *cq_head_;
+            unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+            while (head != tail) {
+                handle(cqes_[head & cq_mask_]);
+                ++head;
+            }
+            __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+            submit();
+        }
+
+
+        static void* thread_entry(void* engine)
+        {
+            static_cast<Engine*>(engine)->run();
+            return NULL;
+        }
+
+
+        void run(void)
+        {
+            while (true) {
+                int ret = io_uring_enter(ring_fd_, 0, 1,
+                                         IORING_ENTER_GETEVENTS);
+                bool is_error = (ret < 0) && (errno != EINTR);
+                pthread_mutex_lock(&mutex_);
+                reap();
+                bool quit = quit_ || is_error;
+                pthread_mutex_unlock(&mutex_);
+                if (quit) {
+                    break;
+                }
+            }
+        }
+
+
+        bool is_available_;
+        string error_message_;
+        pthread_mutex_t mutex_;
+        pthread_cond_t removed_;
+
+        int ring_fd_;
+        void* sq_ring_;
+        void* cq_ring_;
+        size_t sq_ring_size_;
+        size_t cq_ring_size_;
+        struct io_uring_sqe* sqes_;
+        size_t sqes_size_;
+
+        unsigned* sq_head_;
+        unsigned* sq_tail_pointer_;
+        unsigned* sq_array_;
+        unsigned sq_mask_;
+        unsigned sq_entries_;
+        unsigned sq_tail_;
+        unsigned pending_;
+
+        unsigned* cq_head_;
+        unsigned* cq_tail_;
+        unsigned cq_mask_;
+        struct io_uring_cqe* cqes_;
+
+        struct io_uring_buf* buffer_ring_;
+        char* buffers_;
+        unsigned short buffer_tail_;
+        size_t free_buffers_;
+        deque<receive_queue_t*> stalled_;
+
+        bool quit_;
+        bool is_thread_started_;
+        pthread_t thread_;
+    };
+#endif
+}
+
+
+struct Uring_receiver::pImpl
+{
+    string error_message_;
+    receive_queue_t queue_;
+    bool is_open_;
+
+
+    pImpl(void) : error_message_("not opened."), is_open_(false)
+    {
+        init_queue(queue_, Invalid_fd, Invalid_fd);
+    }
+
+
+    ~pImpl(void)
+    {
+        close();
+    }
+
+
+    bool open(int socket)
+    {
+        close();
+
+#if defined(HRK_URING_ENABLED)
+        Engine& engine = Engine::instance();
+        if (!engine.is_available()) {
+            error_message_ = engine.what();
+            return false;
+        }
+
+        int event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (event_fd < 0) {
+            error_message_ = string("eventfd: ") + strerror(errno);
+            return false;
+        }
+        init_queue(queue_, socket, event_fd);
+        engine.add(&queue_);
+        is_open_ = true;
+        error_message_ = "no error.";
+        return true;
+#else
+        static_cast<void>(socket);
+        error_message_ = "io_uring is not supported.";
+        return false;
+#endif
+    }
+
+
+    void close(void)
+    {
+        if (!is_open_) {
+            return;
+        }
+
+#if defined(HRK_URING_ENABLED)
+        Engine::instance().remove(&queue_);
+        ::close(queue_.event_fd);
+#endif
+        init_queue(queue_, Invalid_fd, Invalid_fd);
+        is_open_ = false;
+    }
+};
+
+
+Uring_receiver::Uring_receiver(void) : pimpl(new pImpl)
+{
+}
+
+
+Uring_receiver::~Uring_receiver(void)
+{
+}
+
+
+bool Uring_receiver::is_available(void)
+{
+#if defined(HRK_URING_ENABLED)
+    return Engine::instance().is_available();
+#else
+    return false;
+#endif
+}
+
+
+const char* Uring_receiver::what(void) const
+{
+    return pimpl->error_message_.c_str();
+}
+
+
+bool Uring_receiver::open(int socket)
+{
+    return pimpl->open(socket);
+}
+
+
+void Uring_receiver::close(void)
+{
+    pimpl->close();
+}
+
+
+bool Uring_receiver::is_open(void) const
+{
+    return pimpl->is_open_;
+}
+
+
+int Uring_receiver::event_fd(void) const
+{
+    return pimpl->queue_.event_fd;
+}
+
+
+int Uring_receiver::receive(char* data, size_t max_data_size)
+{
+    if (!pimpl->is_open_) {
+        return -1;
+    }
+
+#if defined(HRK_URING_ENABLED)
+    return Engine::instance().receive(&pimpl->queue_, data, max_data_size);
+#else
+    static_cast<void>(data);
+    static_cast<void>(max_data_size);
+    return -1;
+#endif
+}
@@ -0,0 +1,85 @@
+#ifndef HRK_URING_RECEIVER_H
+#define HRK_URING_RECEIVER_H
+
+/*!
+  \file
+  \brief io_uring による受信 (Linux)
+
+  全ての接続の受信を、1 つのスレッドが io_uring の multishot recv で
+  行う。カーネルは共有のバッファプールに受信データを書き込み、
+  receive() でバッファを複製したときにプールへ返す。
+
+  io_uring、provided buffer ring、multishot recv のいずれかが使えない
+  環境では is_available() が false を返す。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <memory>
+#include <cstddef>
+
+
+namespace hrk
+{
+    //! io_uring による受信
+    class Uring_receiver
+    {
+    public:
+        Uring_receiver(void);
+        ~Uring_receiver(void);
+
+        /*!
+          \brief io_uring による受信が使えるか
+
+          最初に呼び出したときに、受信用のスレッドを起動する。
+        */
+        static bool is_available(void);
+
+        const char* what(void) const;
+
+        /*!
+          \brief ソケットの受信を開始する
+
+          \param[in] socket 接続済みのソケット
+
+          \retval true 成功
+          \retval false エラー
+        */
+        bool open(int socket);
+
+        //! 受信を止める。ソケットは close しない
+        void close(void);
+
+        bool is_open(void) const;
+
+        /*!
+          \brief 受信を通知するディスクリプタ
+
+          受信データがあるか、切断されたときに読み出し可能になる。
+        */
+        int event_fd(void) const;
+
+        /*!
+          \brief 受信済みのデータを読み出す
+
+          \param[out] data 受信データ用のバッファ
+          \param[in] max_data_size 受信できるデータの最大 byte 数
+
+          \retval >0 受信した byte 数
+          \retval 0 受信データなし
+          \retval <0 切断、またはエラー
+        */
+        int receive(char* data, size_t max_data_size);
+
+    private:
+        Uring_receiver(const Uring_receiver& rhs);
+        Uring_receiver& operator = (const Uring_receiver& rhs);
+
+        struct pImpl;
+        std::auto_ptr<pImpl> pimpl;
+    };
+}
+
+#endif
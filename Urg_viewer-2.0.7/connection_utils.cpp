@@ -8,22 +8,13 @@
 */
 
 #include <algorithm>
+#include <cstring>
 #include "connection_utils.h"
 #include "Connection.h"
 
 using namespace std;
 
 
-namespace
-{
-    // 改行かどうかの判定
-    int is_linefeed(const char ch)
-    {
-        return ((ch == '\r') || (ch == '\n')) ? 1 : 0;
-    }
-}
-
-
 void hrk::ignore(hrk::Connection* connection, int timeout, int size)
 {
     enum { Buffer_size = 256 };
@@ -33,7 +24,7 @@ void hrk::ignore(hrk::Connection* connection, int timeout, int size)
     while (true) {
         int read_size = (size == Connection_utils_infinity) ?
             Buffer_size : min(left_size, static_cast<int>(Buffer_size));
-        int n = connection->read(buffer, read_size, timeout);
+        int n = connection->read_some(buffer, read_size, timeout);
         if (n <= 0) {
             return;
         }
@@ -47,7 +38,7 @@ bool hrk::ignore_to(Connection* connection, int timeout, char ch)
     while (true) {
         char buffer;
 
-        int n = connection->read(&buffer, 1, timeout);
+        int n = connection->read_some(&buffer, 1, timeout);
         if (n <= 0) {
             return false;
         }
@@ -62,36 +53,28 @@ bool hrk::ignore_to(Connection* connection, int timeout, char ch)
 int hrk::readline(Connection* connection,
                   char* data, int max_data_size, int timeout)
 {
-    bool is_timeout = false;
-
-    int filled = 0;
-    while (filled < max_data_size) {
-        // １文字ずつ読み出して評価する
-        char recv_ch;
-        int n = connection->read(&recv_ch, 1, timeout);
-        if (n <= 0) {
-            is_timeout = true;
-            break;
-
-        } else if (is_linefeed(recv_ch)) {
-            break;
-        }
-        data[filled++] = recv_ch;
-    }
-    if (filled >= max_data_size) {
-        --filled;
-        if (filled < 0) {
-            return 0;
-        }
-        connection->ungetc(data[filled]);
+    if (max_data_size <= 0) {
+        return 0;
     }
-    data[filled] = '\0';
 
-    if ((filled == 0) && is_timeout) {
+    // 1 文字毎に read() せず、接続のバッファ上の 1 行をまとめて複製する
+    Connection::span_t line;
+    int n = connection->read_line(line, timeout);
+    if (n < 0) {
         enum { Timeout = -1 };
+        data[0] = '\0';
         return Timeout;
-    } else {
-        return filled;
     }
 
+    int filled = min(n, max_data_size - 1);
+    memcpy(data, line.data, filled);
+    data[filled] = '\0';
+
+    // 格納できなかった文字は、改行を含めて次の読み出しのために書き戻す
+    if (filled < n) {
+        for (int i = static_cast<int>(line.size) - 1; i >= filled; --i) {
+            connection->ungetc(line.data[i]);
+        }
+    }
+    return filled;
 }
@@ -0,0 +1,350 @@
+/*!
+  \file
+  \brief Osc_publisher 設定の管理
+
+  \author Satofumi KAMIMURA
+
+  $Id$
+*/
+
+#include <iostream>
+#include <QSettings>
+#include <QStringList>
+#include "handle_osc_setting.h"
+#include "Osc_publisher.h"
+
+using namespace hrk;
+using namespace std;
+
+
+namespace
+{
+    const char* Default_osc_destination = "127.0.0.1:7000";
+
+    const char* Framing_names[] = { "point", "bundle", "blob", "delta" };
+    enum { Framing_names_size = 4 };
+
+
+    bool parse_destination(Osc_publisher::destination_t& destination,
+                           const QString& text)
+    {
+        // "address:port" の形式
+        int colon = text.lastIndexOf(':');
+        if (colon <= 0) {
+            return false;
+        }
+
+        bool ok = false;
+        int port = text.mid(colon + 1).trimmed().toInt(&ok);
+        if (!ok || (port <= 0) || (port > 65535)) {
+            return false;
+        }
+        destination.address = text.left(colon).trimmed().toStdString();
+        destination.port = port;
+        return true;
+    }
+
+
+    vector<Osc_publisher::destination_t>
+    load_destinations(QSettings& settings, const char* key,
+                      const QStringList& default_value)
+    {
+        QStringList texts = settings.value(key, default_value).toStringList();
+
+        vector<Osc_publisher::destination_t> destinations;
+        int n = texts.size();
+        for (int i = 0; i < n; ++i) {
+            Osc_publisher::destination_t destination;
+            if (parse_destination(destination, texts.at(i))) {
+                destinations.push_back(destination);
+            }
+        }
+        return destinations;
+    }
+
+
+    void save_destinations(QSettings& settings, const char* key,
+                           const vector<Osc_publisher::destination_t>&
+                           destinations)
+    {
+        QStringList texts;
+        vector<Osc_publisher::destination_t>::const_iterator end_it =
+            destinations.end();
+        for (vector<Osc_publisher::destination_t>::const_iterator it =
+                 destinations.begin(); it != end_it; ++it) {
+            texts << QString("%1:%2").arg(it->address.c_str()).arg(it->port);
+        }
+        settings.setValue(key, texts);
+    }
+
+
+    void load_blob_parameter(QSettings& settings, Osc_publisher& osc_publisher)
+    {
+        Blob_detector::parameter_t parameter =
+            Blob_detector::default_parameter();
+
+        parameter.max_jump_mm =
+            settings.value("blob_max_jump", parameter.max_jump_mm).toDouble();
+        parameter.max_step_gap =
+            settings.value("blob_max_step_gap", parameter.max_step_gap).toInt();
+        parameter.min_width_mm =
+            settings.value("blob_min_width", parameter.min_width_mm).toDouble();
+        parameter.max_width_mm =
+            settings.value("blob_max_width", parameter.max_width_mm).toDouble();
+        parameter.match_distance_mm =
+            settings.value("blob_match_distance",
+                           parameter.match_distance_mm).toDouble();
+        parameter.area_x_mm =
+            settings.value("tuio_area_x", parameter.area_x_mm).toDouble();
+        parameter.area_y_mm =
+            settings.value("tuio_area_y", parameter.area_y_mm).toDouble();
+        parameter.area_width_mm =
+            settings.value("tuio_area_width",
+                           parameter.area_width_mm).toDouble();
+        parameter.area_height_mm =
+            settings.value("tuio_area_height",
+                           parameter.area_height_mm).toDouble();
+
+        osc_publisher.set_blob_parameter(parameter);
+    }
+
+
+    void load_tracker_parameter(QSettings& settings,
+                                Osc_publisher& osc_publisher)
+    {
+        Target_tracker::parameter_t parameter =
+            Target_tracker::default_parameter();
+
+        parameter.process_noise =
+            settings.value("track_process_noise",
+                           parameter.process_noise).toDouble();
+        parameter.measurement_noise_mm =
+            settings.value("track_measurement_noise",
+                           parameter.measurement_noise_mm).toDouble();
+        parameter.gate = settings.value("track_gate", parameter.gate).toDouble();
+        parameter.max_distance_mm =
+            settings.value("track_max_distance",
+                           parameter.max_distance_mm).toDouble();
+        parameter.confirm_hits =
+            settings.value("track_confirm_hits",
+                           parameter.confirm_hits).toInt();
+        parameter.max_misses =
+            settings.value("track_max_misses", parameter.max_misses).toInt();
+
+        osc_publisher.set_tracker_parameter(parameter);
+    }
+
+
+    void load_delta_parameter(QSettings& settings,
+                              Osc_publisher& osc_publisher)
+    {
+        Scan_delta_encoder::parameter_t parameter =
+            Scan_delta_encoder::default_parameter();
+
+        parameter.keyframe_interval =
+            max(settings.value("delta_keyframe_interval",
+                               static_cast<int>(parameter.keyframe_interval)).
+                toInt(), 1);
+        parameter.distance_threshold =
+            settings.value("delta_distance_threshold",
+                           static_cast<int>(parameter.distance_threshold)).
+            toInt();
+        parameter.intensity_threshold =
+            settings.value("delta_intensity_threshold",
+                           static_cast<int>(parameter.intensity_threshold)).
+            toInt();
+
+        osc_publisher.set_delta_parameter(parameter);
+    }
+
+
+    void save_delta_parameter(QSettings& settings,
+                              const Osc_publisher& osc_publisher)
+    {
+        Scan_delta_encoder::parameter_t parameter =
+            osc_publisher.delta_parameter();
+
+        settings.setValue("delta_keyframe_interval",
+                          static_cast<int>(parameter.keyframe_interval));
+        settings.setValue("delta_distance_threshold",
+                          static_cast<int>(parameter.distance_threshold));
+        settings.setValue("delta_intensity_threshold",
+                          static_cast<int>(parameter.intensity_threshold));
+    }
+
+
+    void save_tracker_parameter(QSettings& settings,
+                                const Osc_publisher& osc_publisher)
+    {
+        Target_tracker::parameter_t parameter =
+            osc_publisher.tracker_parameter();
+
+        settings.setValue("track_process_noise", parameter.process_noise);
+        settings.setValue("track_measurement_noise",
+                          parameter.measurement_noise_mm);
+        settings.setValue("track_gate", parameter.gate);
+        settings.setValue("track_max_distance", parameter.max_distance_mm);
+        settings.setValue("track_confirm_hits", parameter.confirm_hits);
+        settings.setValue("track_max_misses", parameter.max_misses);
+    }
+
+
+    void save_blob_parameter(QSettings& settings,
+                             const Osc_publisher& osc_publisher)
+    {
+        Blob_detector::parameter_t parameter = osc_publisher.blob_parameter();
+
+        settings.setValue("blob_max_jump", parameter.max_jump_mm);
+        settings.setValue("blob_max_step_gap", parameter.max_step_gap);
+        settings.setValue("blob_min_width", parameter.min_width_mm);
+        settings.setValue("blob_max_width", parameter.max_width_mm);
+        settings.setValue("blob_match_distance", parameter.match_distance_mm);
+        settings.setValue("tuio_area_x", parameter.area_x_mm);
+        settings.setValue("tuio_area_y", parameter.area_y_mm);
+        settings.setValue("tuio_area_width", parameter.area_width_mm);
+        settings.setValue("tuio_area_height", parameter.area_height_mm);
+    }
+
+
+    // "x,y x,y ..." の形式
+    bool parse_vertices(Region_filter::zone_t& zone, const QString& text)
+    {
+        QStringList points = text.split(' ', QString::SkipEmptyParts);
+        int n = points.size();
+        for (int i = 0; i < n; ++i) {
+            QStringList xy = points.at(i).split(',');
+            bool x_ok = false;
+            bool y_ok = false;
+            if (xy.size() != 2) {
+                return false;
+            }
+            zone.x.push_back(xy.at(0).toFloat(&x_ok));
+            zone.y.push_back(xy.at(1).toFloat(&y_ok));
+            if (!x_ok || !y_ok) {
+                return false;
+            }
+        }
+        return !zone.x.empty();
+    }
+
+
+    QString vertices_text(const Region_filter::zone_t& zone)
+    {
+        QStringList points;
+        size_t n = zone.x.size();
+        for (size_t i = 0; i < n; ++i) {
+            points << QString("%1,%2").arg(zone.x[i]).arg(zone.y[i]);
+        }
+        return points.join(" ");
+    }
+
+
+    void load_zones(QSettings& settings, Osc_publisher& osc_publisher)
+    {
+        // 設定が無ければ、Osc_publisher の既定の領域を使う
+        int n = settings.beginReadArray("osc_zones");
+        if (n <= 0) {
+            settings.endArray();
+            return;
+        }
+
+        vector<Region_filter::zone_t> zones;
+        for (int i = 0; i < n; ++i) {
+            settings.setArrayIndex(i);
+
+            Region_filter::zone_t zone;
+            zone.name = settings.value("name").toString().toStdString();
+            zone.shape = (settings.value("shape").toString() == "circle") ?
+                Region_filter::Circle : Region_filter::Polygon;
+            zone.is_exclude = (settings.value("mode").toString() == "exclude");
+            zone.radius = settings.value("radius", 0.0).toDouble();
+            if (parse_vertices(zone, settings.value("points").toString())) {
+                zones.push_back(zone);
+            }
+        }
+        settings.endArray();
+
+        osc_publisher.set_zones(zones);
+    }
+
+
+    void save_zones(QSettings& settings, const Osc_publisher& osc_publisher)
+    {
+        vector<Region_filter::zone_t> zones = osc_publisher.zones();
+        int n = zones.size();
+
+        settings.remove("osc_zones");
+        settings.beginWriteArray("osc_zones", n);
+        for (int i = 0; i < n; ++i) {
+            const Region_filter::zone_t& zone = zones[i];
+            settings.setArrayIndex(i);
+            settings.setValue("name", zone.name.c_str());
+            settings.setValue("shape", (zone.shape == Region_filter::Circle) ?
+                              "circle" : "polygon");
+            settings.setValue("mode", zone.is_exclude ? "exclude" : "include");
+            settings.setValue("points", vertices_text(zone));
+            if (zone.shape == Region_filter::Circle) {
+                settings.setValue("radius", zone.radius);
+            }
+        }
+        settings.endArray();
+    }
+}
+
+
+void hrk::load_osc_setting(QSettings& settings, Osc_publisher& osc_publisher)
+{
+    // 名前解決できない送信先も、保存するときのために保持される
+    QStringList default_destinations(Default_osc_destination);
+    vector<Osc_publisher::destination_t> destinations =
+        load_destinations(settings, "osc_destinations", default_destinations);
+    if (!osc_publisher.set_destinations(destinations)) {
+        cerr << "Osc_publisher: unresolved OSC destination." << endl;
+    }
+
+    QString framing_name =
+        settings.value("osc_framing", Framing_names[0]).toString();
+    for (int i = 0; i < Framing_names_size; ++i) {
+        if (framing_name == Framing_names[i]) {
+            osc_publisher.set_framing(static_cast<Osc_publisher::framing_t>(i));
+            break;
+        }
+    }
+
+    load_delta_parameter(settings, osc_publisher);
+    load_zones(settings, osc_publisher);
+
+    // TUIO は送信先が設定されたときのみ送信する
+    destinations =
+        load_destinations(settings, "tuio_destinations", QStringList());
+    if (!osc_publisher.set_tuio_destinations(destinations)) {
+        cerr << "Osc_publisher: unresolved TUIO destination." << endl;
+    }
+    load_blob_parameter(settings, osc_publisher);
+
+    osc_publisher.set_tracking(settings.value("osc_tracking", false).toBool());
+    load_tracker_parameter(settings, osc_publisher);
+}
+
+
+void hrk::save_osc_setting(QSettings& settings,
+                           const Osc_publisher& osc_publisher)
+{
+    save_destinations(settings, "osc_destinations",
+                      osc_publisher.destinations());
+
+    int framing = osc_publisher.framing();
+    if ((framing >= 0) && (framing < Framing_names_size)) {
+        settings.setValue("osc_framing", Framing_names[framing]);
+    }
+
+    save_delta_parameter(settings, osc_publisher);
+    save_zones(settings, osc_publisher);
+
+    save_destinations(settings, "tuio_destinations",
+                      osc_publisher.tuio_destinations());
+    save_blob_parameter(settings, osc_publisher);
+
+    settings.setValue("osc_tracking", osc_publisher.is_tracking());
+    save_tracker_parameter(settings, osc_publisher);
+}
@@ -0,0 +1,25 @@
+#ifndef HRK_HANDLE_OSC_SETTING_H
+#define HRK_HANDLE_OSC_SETTING_H
+
+/*!
+  \file
+  \brief Osc_publisher 設定の管理
+
+  \author Satofumi KAMIMURA
+
+  $Id$
+*/
+
+class QSettings;
+class Osc_publisher;
+
+
+namespace hrk
+{
+    extern void load_osc_setting(QSettings& settings,
+                                 Osc_publisher& osc_publisher);
+    extern void save_osc_setting(QSettings& settings,
+                                 const Osc_publisher& osc_publisher);
+}
+
+#endif
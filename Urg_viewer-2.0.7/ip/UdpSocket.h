@@ -119,6 +119,15 @@ public:
 	void Send( const char *data, std::size_t size );
     void SendTo( const IpEndpointName& remoteEndpoint, const char *data, std::size_t size );
 
+	// Send each of the packetCount datagrams to each of the
+	// endpointCount endpoints. Where sendmmsg() is available all the
+	// datagrams are handed to the kernel in a single batch. When
+	// non-null, sentCounts and errorCounts hold one counter per
+	// endpoint which is incremented for every datagram sent or failed.
+	void SendToMany( const IpEndpointName *remoteEndpoints, std::size_t endpointCount,
+			const char * const *data, const std::size_t *sizes, std::size_t packetCount,
+			unsigned long *sentCounts, unsigned long *errorCounts );
+
 
 	// Bind a local endpoint to receive incoming data. Endpoint
 	// can be 'any' for the system to choose an endpoint
@@ -44,6 +44,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <netinet/in.h> // for sockaddr_in
 
 #include <signal.h>
@@ -105,6 +106,12 @@ class UdpSocket::Implementation{
 	struct sockaddr_in connectedAddr_;
 	struct sockaddr_in sendToAddr_;
 
+	std::vector<struct sockaddr_in> sendToManyAddrs_;
+	std::vector<struct iovec> sendToManyIovecs_;
+#ifdef __linux__
+	std::vector<struct mmsghdr> sendToManyMsgs_;
+#endif
+
 public:
 
 	Implementation()
@@ -214,6 +221,75 @@ public:
         sendto( socket_, data, size, 0, (sockaddr*)&sendToAddr_, sizeof(sendToAddr_) );
 	}
 
+	void SendToMany( const IpEndpointName *remoteEndpoints, std::size_t endpointCount,
+			const char * const *data, const std::size_t *sizes, std::size_t packetCount,
+			unsigned long *sentCounts, unsigned long *errorCounts )
+	{
+		if( endpointCount == 0 || packetCount == 0 )
+			return;
+
+		// the buffers are kept between calls so that sending a batch
+		// doesn't allocate once they have grown to the working size
+		sendToManyAddrs_.resize( endpointCount );
+		for( std::size_t i = 0; i < endpointCount; ++i )
+			SockaddrFromIpEndpointName( sendToManyAddrs_[i], remoteEndpoints[i] );
+
+		// datagram k goes to endpoint (k % endpointCount), so every
+		// endpoint receives the packets of one batch in order
+		std::size_t messageCount = endpointCount * packetCount;
+		sendToManyIovecs_.resize( messageCount );
+		for( std::size_t k = 0; k < messageCount; ++k ){
+			std::size_t packet = k / endpointCount;
+			sendToManyIovecs_[k].iov_base = const_cast<char*>( data[packet] );
+			sendToManyIovecs_[k].iov_len = sizes[packet];
+		}
+
+#ifdef __linux__
+		sendToManyMsgs_.resize( messageCount );
+		for( std::size_t k = 0; k < messageCount; ++k ){
+			struct msghdr& header = sendToManyMsgs_[k].msg_hdr;
+			std::memset( &header, 0, sizeof(header) );
+			header.msg_name = &sendToManyAddrs_[k % endpointCount];
+			header.msg_namelen = sizeof(struct sockaddr_in);
+			header.msg_iov = &sendToManyIovecs_[k];
+			header.msg_iovlen = 1;
+		}
+
+		std::size_t k = 0;
+		while( k < messageCount ){
+			// the kernel sends at most UIO_MAXIOV messages per call and
+			// stops at the first failing one, so resume after it
+			int result = sendmmsg( socket_, &sendToManyMsgs_[k],
+					messageCount - k, 0 );
+			if( result < 0 ){
+				if( errno == EINTR )
+					continue;
+				if( errorCounts )
+					++errorCounts[k % endpointCount];
+				++k;
+				continue;
+			}
+			for( int i = 0; i < result; ++i, ++k ){
+				if( sentCounts )
+					++sentCounts[k % endpointCount];
+			}
+		}
+#else
+		for( std::size_t k = 0; k < messageCount; ++k ){
+			std::size_t endpoint = k % endpointCount;
+			ssize_t result = sendto( socket_,
+					sendToManyIovecs_[k].iov_base, sendToManyIovecs_[k].iov_len, 0,
+					(sockaddr*)&sendToManyAddrs_[endpoint], sizeof(struct sockaddr_in) );
+			if( result < 0 ){
+				if( errorCounts )
+					++errorCounts[endpoint];
+			}else if( sentCounts ){
+				++sentCounts[endpoint];
+			}
+		}
+#endif
+	}
+
 	void Bind( const IpEndpointName& localEndpoint )
 	{
 		struct sockaddr_in bindSockAddr;
@@ -289,6 +365,14 @@ void UdpSocket::SendTo( const IpEndpointName& remoteEndpoint, const char *data,
 	impl_->SendTo( remoteEndpoint, data, size );
 }
 
+void UdpSocket::SendToMany( const IpEndpointName *remoteEndpoints, std::size_t endpointCount,
+		const char * const *data, const std::size_t *sizes, std::size_t packetCount,
+		unsigned long *sentCounts, unsigned long *errorCounts )
+{
+	impl_->SendToMany( remoteEndpoints, endpointCount, data, sizes, packetCount,
+			sentCounts, errorCounts );
+}
+
 void UdpSocket::Bind( const IpEndpointName& localEndpoint )
 {
 	impl_->Bind( localEndpoint );
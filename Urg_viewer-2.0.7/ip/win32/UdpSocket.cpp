@@ -207,6 +207,27 @@ public:
         sendto( socket_, data, (int)size, 0, (sockaddr*)&sendToAddr_, sizeof(sendToAddr_) );
 	}
 
+	void SendToMany( const IpEndpointName *remoteEndpoints, std::size_t endpointCount,
+			const char * const *data, const std::size_t *sizes, std::size_t packetCount,
+			unsigned long *sentCounts, unsigned long *errorCounts )
+	{
+		// winsock has no sendmmsg(), send the batch one datagram at a time
+		struct sockaddr_in toAddr;
+		for( std::size_t packet = 0; packet < packetCount; ++packet ){
+			for( std::size_t endpoint = 0; endpoint < endpointCount; ++endpoint ){
+				SockaddrFromIpEndpointName( toAddr, remoteEndpoints[endpoint] );
+				int result = sendto( socket_, data[packet], (int)sizes[packet], 0,
+						(sockaddr*)&toAddr, sizeof(toAddr) );
+				if( result == SOCKET_ERROR ){
+					if( errorCounts )
+						++errorCounts[endpoint];
+				}else if( sentCounts ){
+					++sentCounts[endpoint];
+				}
+			}
+		}
+	}
+
 	void Bind( const IpEndpointName& localEndpoint )
 	{
 		struct sockaddr_in bindSockAddr;
@@ -282,6 +303,14 @@ void UdpSocket::SendTo( const IpEndpointName& remoteEndpoint, const char *data,
 	impl_->SendTo( remoteEndpoint, data, size );
 }
 
+void UdpSocket::SendToMany( const IpEndpointName *remoteEndpoints, std::size_t endpointCount,
+		const char * const *data, const std::size_t *sizes, std::size_t packetCount,
+		unsigned long *sentCounts, unsigned long *errorCounts )
+{
+	impl_->SendToMany( remoteEndpoints, endpointCount, data, sizes, packetCount,
+			sentCounts, errorCounts );
+}
+
 void UdpSocket::Bind( const IpEndpointName& localEndpoint )
 {
 	impl_->Bind( localEndpoint );
@@ -34,6 +34,7 @@ namespace
 #if defined(NO_LIBLUABIND)
 #else
     lua_State* lua_ = NULL;
+    bool is_plugin_loaded_ = false;
 #endif
     Plotter_2d_widget* plotter_ = NULL;
 
@@ -98,11 +99,22 @@ bool plguin_load_plugin_file(const char* plugin_file)
         return false;
     }
 
+    is_plugin_loaded_ = true;
     return true;
 #endif
 }
 
 
+bool plugin_is_loaded(void)
+{
+#if defined(NO_LIBLUABIND)
+    return false;
+#else
+    return is_plugin_loaded_;
+#endif
+}
+
+
 void plugin_open_device(void)
 {
 #if defined(NO_LIBLUABIND)
@@ -18,6 +18,9 @@ class Plotter_2d_widget;
 extern void plugin_register_plotter(Plotter_2d_widget* plotter);
 extern bool plguin_load_plugin_file(const char* plugin_file);
 
+//! プラグインのファイルを読み込んでいれば true
+extern bool plugin_is_loaded(void);
+
 extern void plugin_open_device(void);
 extern void plugin_get_measurement_data(const hrk::Lidar::measurement_t& type,
                                         int data_size,
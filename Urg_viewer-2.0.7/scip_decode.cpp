@@ -0,0 +1,363 @@
+/*!
+  \file
+  \brief SCIP データのチェックサム計算とデコード
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstddef>
+#include "scip_decode.h"
+
+#if defined(__GNUC__) && \
+    ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9))) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define HRK_SCIP_SIMD
+#include <immintrin.h>
+#endif
+
+using namespace hrk;
+
+
+namespace
+{
+    typedef char (*checksum_function_t)(const char data[], int size);
+    typedef void (*decode_function_t)(const char data[], int values_size,
+                                      int values[]);
+    typedef void (*decode_frame_function_t)(const char data[], int steps,
+                                            int stride, uint32_t length[],
+                                            uint16_t intensity[]);
+
+
+    char checksum_scalar(const char data[], int size)
+    {
+        unsigned char sum = 0x00;
+        for (int i = 0; i < size; ++i) {
+            sum += data[i];
+        }
+
+        // 計算の意味は SCIP 仕様書を参照のこと
+        return (sum & 0x3f) + 0x30;
+    }
+
+
+    // 左シフト後の下位 6 bit は 0 なので、decode_scip() の
+    // value &= ~0x3f は省略できる
+    template <int Byte>
+    int decode_value(const char p[]);
+
+
+    template <>
+    int decode_value<2>(const char p[])
+    {
+        return ((p[0] - 0x30) << 6) | (p[1] - 0x30);
+    }
+
+
+    template <>
+    int decode_value<3>(const char p[])
+    {
+        int value = p[0] - 0x30;
+        value = (value << 6) | (p[1] - 0x30);
+        return (value << 6) | (p[2] - 0x30);
+    }
+
+
+    template <int Byte>
+    void decode_scalar(const char data[], int values_size, int values[])
+    {
+        const char* p = data;
+        for (int i = 0; i < values_size; ++i, p += Byte) {
+            values[i] = decode_value<Byte>(p);
+        }
+    }
+
+
+    template <int Byte>
+    void decode_frame_scalar(const char data[], int steps, int stride,
+                             uint32_t length[], uint16_t intensity[])
+    {
+        const char* p = data;
+        if (stride == 1) {
+            for (int i = 0; i < steps; ++i, p += Byte) {
+                length[i] = decode_value<Byte>(p);
+            }
+            return;
+        }
+        for (int i = 0; i < steps; ++i, p += Byte * 2) {
+            length[i] = decode_value<Byte>(p);
+        }
+        if (intensity) {
+            p = data + Byte;
+            for (int i = 0; i < steps; ++i, p += Byte * 2) {
+                intensity[i] = static_cast<uint16_t>(decode_value<Byte>(p));
+            }
+        }
+    }
+
+
+#if defined(HRK_SCIP_SIMD)
+    __attribute__((target("sse2")))
+    char checksum_sse2(const char data[], int size)
+    {
+        // 16 byte ずつ、psadbw で byte の和を求める
+        __m128i zero = _mm_setzero_si128();
+        __m128i sum = zero;
+        int i = 0;
+        for (; (i + 16) <= size; i += 16) {
+            __m128i x =
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            sum = _mm_add_epi64(sum, _mm_sad_epu8(x, zero));
+        }
+        unsigned char total = static_cast<unsigned char>(
+            _mm_cvtsi128_si32(sum) +
+            _mm_cvtsi128_si32(_mm_srli_si128(sum, 8)));
+        for (; i < size; ++i) {
+            total += data[i];
+        }
+        return (total & 0x3f) + 0x30;
+    }
+
+
+    __attribute__((target("avx2")))
+    char checksum_avx2(const char data[], int size)
+    {
+        __m256i zero = _mm256_setzero_si256();
+        __m256i sum = zero;
+        int i = 0;
+        for (; (i + 32) <= size; i += 32) {
+            __m256i x = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(data + i));
+            sum = _mm256_add_epi64(sum, _mm256_sad_epu8(x, zero));
+        }
+        __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sum),
+                                     _mm256_extracti128_si256(sum, 1));
+        unsigned char total = static_cast<unsigned char>(
+            _mm_cvtsi128_si32(half) +
+            _mm_cvtsi128_si32(_mm_srli_si128(half, 8)));
+        for (; i < size; ++i) {
+            total += data[i];
+        }
+        return (total & 0x3f) + 0x30;
+    }
+
+
+    /*!
+      Byte 文字エンコードの 8 個の値を、各値の文字を集めて符号拡張し、
+      スカラー版と同じ式で組み立てる。p から Byte * 8 byte を読む
+    */
+    template <int Byte>
+    __m256i decode8_avx2(const char* p);
+
+
+    template <>
+    __attribute__((target("avx2")))
+    inline __m256i decode8_avx2<3>(const char* p)
+    {
+        // 前半 4 個は p, 後半 4 個は p + 8 からの 16 byte から取り出す
+        const __m128i low_order = _mm_setr_epi8(0, 3, 6, 9, 1, 4, 7, 10,
+                                                2, 5, 8, 11, -1, -1, -1, -1);
+        const __m128i high_order = _mm_setr_epi8(4, 7, 10, 13, 5, 8, 11, 14,
+                                                 6, 9, 12, 15, -1, -1, -1, -1);
+        const __m256i offset = _mm256_set1_epi32(0x30);
+
+        __m128i low = _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), low_order);
+        __m128i high = _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 8)),
+            high_order);
+        __m128i first_second = _mm_unpacklo_epi32(low, high);
+        __m128i third = _mm_unpackhi_epi32(low, high);
+
+        __m256i c0 = _mm256_sub_epi32(_mm256_cvtepi8_epi32(first_second),
+                                      offset);
+        __m256i c1 = _mm256_sub_epi32(
+            _mm256_cvtepi8_epi32(_mm_srli_si128(first_second, 8)), offset);
+        __m256i c2 = _mm256_sub_epi32(_mm256_cvtepi8_epi32(third), offset);
+
+        __m256i value = _mm256_or_si256(_mm256_slli_epi32(c0, 6), c1);
+        return _mm256_or_si256(_mm256_slli_epi32(value, 6), c2);
+    }
+
+
+    template <>
+    __attribute__((target("avx2")))
+    inline __m256i decode8_avx2<2>(const char* p)
+    {
+        const __m128i order = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14,
+                                            1, 3, 5, 7, 9, 11, 13, 15);
+        const __m256i offset = _mm256_set1_epi32(0x30);
+
+        __m128i chars = _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), order);
+        __m256i c0 = _mm256_sub_epi32(_mm256_cvtepi8_epi32(chars), offset);
+        __m256i c1 = _mm256_sub_epi32(
+            _mm256_cvtepi8_epi32(_mm_srli_si128(chars, 8)), offset);
+        return _mm256_or_si256(_mm256_slli_epi32(c0, 6), c1);
+    }
+
+
+    template <int Byte>
+    __attribute__((target("avx2")))
+    void decode_avx2(const char data[], int values_size, int values[])
+    {
+        int i = 0;
+        const char* p = data;
+        for (; (i + 8) <= values_size; i += 8, p += Byte * 8) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(values + i),
+                                decode8_avx2<Byte>(p));
+        }
+        decode_scalar<Byte>(p, values_size - i, values + i);
+    }
+
+
+    template <int Byte>
+    __attribute__((target("avx2")))
+    void decode_frame_avx2(const char data[], int steps, int stride,
+                           uint32_t length[], uint16_t intensity[])
+    {
+        int i = 0;
+        const char* p = data;
+        if (stride == 1) {
+            for (; (i + 8) <= steps; i += 8, p += Byte * 8) {
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(length + i),
+                                    decode8_avx2<Byte>(p));
+            }
+        } else {
+            // 距離、強度の順の 4 ステップを、距離 4 個と強度 4 個に分ける
+            const __m256i split = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+            const __m128i low_half = _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13,
+                                                   -1, -1, -1, -1,
+                                                   -1, -1, -1, -1);
+            for (; (i + 4) <= steps; i += 4, p += Byte * 8) {
+                __m256i value =
+                    _mm256_permutevar8x32_epi32(decode8_avx2<Byte>(p), split);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(length + i),
+                                 _mm256_castsi256_si128(value));
+                if (intensity) {
+                    _mm_storel_epi64(
+                        reinterpret_cast<__m128i*>(intensity + i),
+                        _mm_shuffle_epi8(_mm256_extracti128_si256(value, 1),
+                                         low_half));
+                }
+            }
+        }
+        decode_frame_scalar<Byte>(p, steps - i, stride, length + i,
+                                  intensity ? intensity + i : NULL);
+    }
+#endif
+
+
+    struct Kernel
+    {
+        const char* name;
+        checksum_function_t checksum;
+        decode_function_t decode2;
+        decode_function_t decode3;
+        decode_frame_function_t decode2_frame;
+        decode_frame_function_t decode3_frame;
+    };
+
+
+    Kernel scalar_kernel(void)
+    {
+        Kernel scalar = {
+            "scalar", checksum_scalar, decode_scalar<2>, decode_scalar<3>,
+            decode_frame_scalar<2>, decode_frame_scalar<3>,
+        };
+        return scalar;
+    }
+
+
+    bool select_kernel(scip_kernel_t kernel, Kernel& selected)
+    {
+#if defined(HRK_SCIP_SIMD)
+        __builtin_cpu_init();
+        bool has_sse2 = __builtin_cpu_supports("sse2");
+        bool has_avx2 = __builtin_cpu_supports("avx2");
+        if (kernel == Scip_auto_kernel) {
+            kernel = has_avx2 ? Scip_avx2_kernel :
+                has_sse2 ? Scip_sse2_kernel : Scip_scalar_kernel;
+        }
+        if ((kernel == Scip_avx2_kernel) && has_avx2) {
+            Kernel avx2 = {
+                "avx2", checksum_avx2, decode_avx2<2>, decode_avx2<3>,
+                decode_frame_avx2<2>, decode_frame_avx2<3>,
+            };
+            selected = avx2;
+            return true;
+        }
+        if ((kernel == Scip_sse2_kernel) && has_sse2) {
+            Kernel sse2 = {
+                "sse2", checksum_sse2, decode_scalar<2>, decode_scalar<3>,
+                decode_frame_scalar<2>, decode_frame_scalar<3>,
+            };
+            selected = sse2;
+            return true;
+        }
+#else
+        if (kernel == Scip_auto_kernel) {
+            kernel = Scip_scalar_kernel;
+        }
+#endif
+        if (kernel == Scip_scalar_kernel) {
+            selected = scalar_kernel();
+            return true;
+        }
+        return false;
+    }
+
+
+    Kernel& current_kernel(void)
+    {
+        static Kernel kernel = scalar_kernel();
+        static bool is_selected = select_kernel(Scip_auto_kernel, kernel);
+        static_cast<void>(is_selected);
+        return kernel;
+    }
+}
+
+
+bool hrk::scip_set_kernel(scip_kernel_t kernel)
+{
+    return select_kernel(kernel, current_kernel());
+}
+
+
+const char* hrk::scip_kernel_name(void)
+{
+    return current_kernel().name;
+}
+
+
+char hrk::scip_checksum(const char data[], int size)
+{
+    return current_kernel().checksum(data, size);
+}
+
+
+void hrk::scip_decode3(const char data[], int values_size, int values[])
+{
+    current_kernel().decode3(data, values_size, values);
+}
+
+
+void hrk::scip_decode3(const char data[], int steps, int stride,
+                       uint32_t length[], uint16_t intensity[])
+{
+    current_kernel().decode3_frame(data, steps, stride, length, intensity);
+}
+
+
+void hrk::scip_decode2(const char data[], int values_size, int values[])
+{
+    current_kernel().decode2(data, values_size, values);
+}
+
+
+void hrk::scip_decode2(const char data[], int steps, int stride,
+                       uint32_t length[], uint16_t intensity[])
+{
+    current_kernel().decode2_frame(data, steps, stride, length, intensity);
+}
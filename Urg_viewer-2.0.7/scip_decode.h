@@ -0,0 +1,91 @@
+#ifndef HRK_SCIP_DECODE_H
+#define HRK_SCIP_DECODE_H
+
+/*!
+  \file
+  \brief SCIP データのチェックサム計算とデコード
+
+  x86 の GCC では、CPU が対応していれば SSE2, AVX2 の実装を実行時に
+  選択する。それ以外の環境では 1 byte ずつ処理する。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <stdint.h>
+
+namespace hrk
+{
+    typedef enum {
+        Scip_auto_kernel,       //!< CPU に合わせて選択する
+        Scip_scalar_kernel,
+        Scip_sse2_kernel,       //!< チェックサムのみ SSE2, デコードは 1 値ずつ
+        Scip_avx2_kernel,
+    } scip_kernel_t;
+
+
+    /*!
+      \brief 使用する実装を指定する
+
+      \retval true 成功
+      \retval false CPU が対応していない
+    */
+    extern bool scip_set_kernel(scip_kernel_t kernel);
+
+    //! 使用している実装の名前
+    extern const char* scip_kernel_name(void);
+
+    /*!
+      \brief チェックサム文字を計算する
+
+      \param[in] data データ
+      \param[in] size data の byte 数
+
+      \return チェックサム文字
+    */
+    extern char scip_checksum(const char data[], int size);
+
+    /*!
+      \brief 3 文字エンコードの値を続けてデコードする
+
+      Urg_driver::decode_scip(data, 3) を values_size 回呼び出した結果と
+      一致する。
+
+      \param[in] data データ。values_size * 3 byte 以上
+      \param[in] values_size デコードする値の個数
+      \param[out] values デコードした値
+    */
+    extern void scip_decode3(const char data[], int values_size,
+                             int values[]);
+
+    /*!
+      \brief 3 文字エンコードの計測データを Scan_frame の配列にデコードする
+
+      stride が 2 のときは、距離、強度の順に並んだデータとして、距離を
+      length に、強度を intensity に格納する。強度は uint16_t に切り詰める。
+
+      \param[in] data データ。steps * stride * 3 byte 以上
+      \param[in] steps デコードするステップ数
+      \param[in] stride 1 ステップの値の個数。1 または 2
+      \param[out] length 距離の格納先
+      \param[out] intensity 強度の格納先。NULL のときは格納しない
+    */
+    extern void scip_decode3(const char data[], int steps, int stride,
+                             uint32_t length[], uint16_t intensity[]);
+
+    /*!
+      \brief 2 文字エンコードの値を続けてデコードする
+
+      Urg_driver::decode_scip(data, 2) を values_size 回呼び出した結果と
+      一致する。
+    */
+    extern void scip_decode2(const char data[], int values_size,
+                             int values[]);
+
+    //! 2 文字エンコードの計測データを Scan_frame の配列にデコードする
+    extern void scip_decode2(const char data[], int steps, int stride,
+                             uint32_t length[], uint16_t intensity[]);
+}
+
+#endif
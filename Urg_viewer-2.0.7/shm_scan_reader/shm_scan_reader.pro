@@ -0,0 +1,17 @@
+######################################################################
+# 共有メモリのスキャンを読み出すプロセス用のライブラリ
+#
+# Shm_scan_ring.h をインクルードし、liburg_shm_scan をリンクする。
+# Linux では -lrt も必要。
+######################################################################
+
+TEMPLATE = lib
+TARGET = urg_shm_scan
+CONFIG += staticlib
+CONFIG -= qt
+QT -= gui core
+DEPENDPATH += . ..
+INCLUDEPATH += . ..
+
+HEADERS += ../Shm_scan_ring.h ../detect_os.h
+SOURCES += ../Shm_scan_ring.cpp
@@ -0,0 +1,116 @@
+/*!
+  \file
+  \brief Arrival_log と、Tcpip の行の到着時刻の確認
+
+  上書きされた記録の時刻を返さないこと、書き戻した行が元の到着時刻を
+  返すことを確認する。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include "Arrival_log.hpp"
+#include "Tcpip.h"
+#include "Loopback_server.h"
+#include "Test_check.h"
+
+using namespace hrk;
+
+
+namespace
+{
+    enum {
+        Interval_msec = 50,
+        // 送信から受信バッファに読み出すまでの許容時間
+        Tolerance_msec = 20,
+    };
+
+
+    bool is_near(long long time, long long expected)
+    {
+        long long tolerance = Tolerance_msec * 1000000LL;
+        return (time >= expected - tolerance) && (time <= expected + tolerance);
+    }
+
+
+    void check_overwritten(void)
+    {
+        Arrival_log log;
+        check(log.time(0) == 0, "empty log");
+
+        log.add(10, 1000);
+        log.add(10, 2000);
+        check(log.time(5) == 1000, "first chunk");
+        check(log.time(15) == 2000, "second chunk");
+        check(log.time(20) == 0, "not received yet");
+
+        // 読み出されないまま記録を越えて格納すると、先頭の時刻は不明になる
+        log.clear();
+        for (long long i = 0; i <= Arrival_log::Max_entries; ++i) {
+            log.add(1, i + 1);
+        }
+        check(log.time(0) == 0, "overwritten entry");
+        check(log.time(1) == 2, "oldest kept entry");
+    }
+
+
+    void check_pushback(void)
+    {
+        Loopback_server server;
+        if (!server.listen()) {
+            check(false, "Loopback_server::listen()");
+            return;
+        }
+        Tcpip connection;
+        if (!connection.open("127.0.0.1", server.port()) || !server.accept()) {
+            check(false, "Tcpip::open()");
+            return;
+        }
+
+        // 複数の塊をまとめて受信すると最後の塊の時刻になるため、1 行ずつ読む
+        Connection::span_t line;
+        long long first_sent = Arrival_log::now();
+        server.send("AAAA\n", 5);
+        usleep(Interval_msec * 1000);
+        check((connection.read_line(line, 1000) == 4) &&
+              is_near(connection.line_arrival_time(), first_sent),
+              "first line");
+
+        long long second_sent = Arrival_log::now();
+        server.send("BBBB\n", 5);
+        usleep(Interval_msec * 1000);
+        check((connection.read_line(line, 1000) == 4) &&
+              is_near(connection.line_arrival_time(), second_sent),
+              "second line");
+
+        // 行の後半を書き戻しても、後半の到着時刻は変わらない
+        for (int i = static_cast<int>(line.size) - 1; i >= 2; --i) {
+            connection.ungetc(line.data[i]);
+        }
+        check((connection.read_line(line, 1000) == 2) &&
+              is_near(connection.line_arrival_time(), second_sent),
+              "pushed back line");
+
+        // 受信していないデータを書き戻したときは、到着時刻は不明
+        const char unknown[] = "CCCCCCCCCCC\n";
+        for (int i = static_cast<int>(strlen(unknown)) - 1; i >= 0; --i) {
+            connection.ungetc(unknown[i]);
+        }
+        check((connection.read_line(line, 1000) == 11) &&
+              (connection.line_arrival_time() == 0), "unknown line");
+    }
+}
+
+
+int main(void)
+{
+    check_overwritten();
+    check_pushback();
+
+    return check_result();
+}
@@ -0,0 +1,15 @@
+TEMPLATE = app
+TARGET = arrival_log_test
+QT -= gui core
+CONFIG += console
+CONFIG -= app_bundle qt
+DEPENDPATH += . ../.. ../common
+INCLUDEPATH += . ../.. ../common
+unix:!macx:LIBS += -lrt
+
+SOURCES += arrival_log_test.cpp \
+        ../../Tcpip.cpp \
+        ../../connection_utils.cpp
+
+unix:SOURCES += ../../Io_reactor.cpp \
+        ../../Uring_receiver.cpp
@@ -0,0 +1,36 @@
+#ifndef BENCH_TIMER_H
+#define BENCH_TIMER_H
+
+/*!
+  \file
+  \brief ベンチマーク用の時刻
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+
+//! 経過時間 [sec]。CLOCK_MONOTONIC
+inline double now_sec(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + (now.tv_nsec / 1000000000.0);
+}
+
+
+//! プロセスの CPU 時間 [sec]。ユーザとシステムの合計
+inline double cpu_sec(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + (usage.ru_utime.tv_usec / 1000000.0) +
+        usage.ru_stime.tv_sec + (usage.ru_stime.tv_usec / 1000000.0);
+}
+
+#endif
@@ -0,0 +1,194 @@
+#ifndef FAKE_LIDAR_H
+#define FAKE_LIDAR_H
+
+/*!
+  \file
+  \brief テスト用の Lidar
+
+  UTM-30LX の角度分解能と計測範囲を返す。データの取得はできない。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cmath>
+#include "Lidar.h"
+
+
+class Fake_lidar : public hrk::Lidar
+{
+public:
+    enum {
+        Area_resolution = 1440,
+        First_step = 0,
+        Last_step = 1080,
+        Front_step = 540,
+        Scan_usec = 25000,
+    };
+
+
+    const char* what(void) const
+    {
+        return "no error.";
+    }
+
+    void close(void)
+    {
+    }
+
+    bool is_open(void) const
+    {
+        return true;
+    }
+
+    void set_connection(hrk::Connection* connection)
+    {
+        static_cast<void>(connection);
+    }
+
+    hrk::Connection* connection(void)
+    {
+        return NULL;
+    }
+
+    bool start_measurement(measurement_t type, int scan_times, int skip_scan)
+    {
+        static_cast<void>(type);
+        static_cast<void>(scan_times);
+        static_cast<void>(skip_scan);
+        return true;
+    }
+
+    bool get_distance(std::vector<long>& data,
+                      long *time_stamp, long long* arrival_time)
+    {
+        static_cast<void>(data);
+        static_cast<void>(time_stamp);
+        static_cast<void>(arrival_time);
+        return false;
+    }
+
+    bool get_distance_intensity(std::vector<long>& data,
+                                std::vector<unsigned short>& intensity,
+                                long *time_stamp, long long* arrival_time)
+    {
+        static_cast<void>(intensity);
+        return get_distance(data, time_stamp, arrival_time);
+    }
+
+    bool get_multiecho(std::vector<long>& data_multi,
+                       long* time_stamp, long long* arrival_time)
+    {
+        return get_distance(data_multi, time_stamp, arrival_time);
+    }
+
+    bool get_multiecho_intensity(std::vector<long>& data_multiecho,
+                                 std::vector<unsigned short>&
+                                 intensity_multiecho,
+                                 long* time_stamp, long long* arrival_time)
+    {
+        static_cast<void>(intensity_multiecho);
+        return get_distance(data_multiecho, time_stamp, arrival_time);
+    }
+
+    bool set_scanning_parameter(int first_step, int last_step, int skip_step)
+    {
+        static_cast<void>(first_step);
+        static_cast<void>(last_step);
+        static_cast<void>(skip_step);
+        return true;
+    }
+
+    void stop_measurement(void)
+    {
+    }
+
+    double index2rad(int index) const
+    {
+        return step2rad(index + First_step);
+    }
+
+    double index2deg(int index) const
+    {
+        return index2rad(index) * 180.0 / M_PI;
+    }
+
+    int rad2index(double radian) const
+    {
+        return rad2step(radian) - First_step;
+    }
+
+    int deg2index(double degree) const
+    {
+        return rad2index(degree * M_PI / 180.0);
+    }
+
+    double step2rad(int step) const
+    {
+        return (step - Front_step) * 2.0 * M_PI / Area_resolution;
+    }
+
+    double step2deg(int step) const
+    {
+        return step2rad(step) * 180.0 / M_PI;
+    }
+
+    int rad2step(double radian) const
+    {
+        return static_cast<int>(floor((radian * Area_resolution / (2.0 * M_PI))
+                                      + 0.5)) + Front_step;
+    }
+
+    int deg2step(double degree) const
+    {
+        return rad2step(degree * M_PI / 180.0);
+    }
+
+    int min_step(void) const
+    {
+        return First_step;
+    }
+
+    int max_step(void) const
+    {
+        return Last_step;
+    }
+
+    int front_step(void) const
+    {
+        return Front_step;
+    }
+
+    int total_steps(void) const
+    {
+        return Area_resolution;
+    }
+
+    long min_distance(void) const
+    {
+        return 23;
+    }
+
+    long max_distance(void) const
+    {
+        return 60000;
+    }
+
+    long scan_usec(void) const
+    {
+        return Scan_usec;
+    }
+
+    int max_data_size(void) const
+    {
+        return Last_step + 1;
+    }
+
+    int max_echo_size(void) const
+    {
+        return 3;
+    }
+};
+
+#endif
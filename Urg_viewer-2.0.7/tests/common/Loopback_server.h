@@ -0,0 +1,145 @@
+#ifndef LOOPBACK_SERVER_H
+#define LOOPBACK_SERVER_H
+
+/*!
+  \file
+  \brief テスト用の TCP サーバ
+
+  127.0.0.1 の空いているポートで接続を 1 つだけ受け付け、データを
+  送受信する。send() は、chunk_size を指定したときはその byte 数ずつ
+  送信し、TCP_NODELAY により 1 つずつのセグメントで届ける。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+
+class Loopback_server
+{
+public:
+    Loopback_server(void)
+        : listen_socket_(-1), socket_(-1), port_(0), chunk_size_(0)
+    {
+    }
+
+
+    ~Loopback_server(void)
+    {
+        close();
+    }
+
+
+    //! 接続を待つ。接続は accept() で受け付ける
+    bool listen(void)
+    {
+        listen_socket_ = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = 0;
+        socklen_t size = sizeof(address);
+        struct sockaddr* p = reinterpret_cast<struct sockaddr*>(&address);
+        if ((listen_socket_ < 0) ||
+            (bind(listen_socket_, p, sizeof(address)) != 0) ||
+            (::listen(listen_socket_, 1) != 0) ||
+            (getsockname(listen_socket_, p, &size) != 0)) {
+            return false;
+        }
+        port_ = ntohs(address.sin_port);
+        return true;
+    }
+
+
+    long port(void) const
+    {
+        return port_;
+    }
+
+
+    //! 0 のときは、渡されたデータをまとめて送信する
+    void set_chunk_size(size_t size)
+    {
+        chunk_size_ = size;
+    }
+
+
+    bool accept(void)
+    {
+        socket_ = ::accept(listen_socket_, NULL, NULL);
+        if (socket_ < 0) {
+            return false;
+        }
+        int on = 1;
+        setsockopt(socket_, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        return true;
+    }
+
+
+    int send(const char* data, size_t size)
+    {
+        if (chunk_size_ == 0) {
+            return ::send(socket_, data, size, 0);
+        }
+
+        size_t sent = 0;
+        while (sent < size) {
+            size_t n = (size - sent < chunk_size_) ? size - sent : chunk_size_;
+            int written = ::send(socket_, data + sent, n, 0);
+            if (written < 0) {
+                return (sent > 0) ? static_cast<int>(sent) : -1;
+            }
+            sent += written;
+        }
+        return static_cast<int>(sent);
+    }
+
+
+    //! timeout [msec] まで受信を待つ。切断されたときは -1 を返す
+    int receive(char* data, size_t size, int timeout)
+    {
+        struct pollfd fds;
+        fds.fd = socket_;
+        fds.events = POLLIN;
+        fds.revents = 0;
+        if (poll(&fds, 1, timeout) <= 0) {
+            return 0;
+        }
+        int n = ::recv(socket_, data, size, 0);
+        return (n > 0) ? n : -1;
+    }
+
+
+    void close(void)
+    {
+        if (socket_ >= 0) {
+            ::close(socket_);
+            socket_ = -1;
+        }
+        if (listen_socket_ >= 0) {
+            ::close(listen_socket_);
+            listen_socket_ = -1;
+        }
+    }
+
+
+private:
+    Loopback_server(const Loopback_server& rhs);
+    Loopback_server& operator = (const Loopback_server& rhs);
+
+    int listen_socket_;
+    int socket_;
+    long port_;
+    size_t chunk_size_;
+};
+
+#endif
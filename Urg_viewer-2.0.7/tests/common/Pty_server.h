@@ -0,0 +1,162 @@
+#ifndef PTY_SERVER_H
+#define PTY_SERVER_H
+
+/*!
+  \file
+  \brief テスト用の擬似端末のサーバ
+
+  Loopback_server と同じ操作で、擬似端末のマスタ側を送受信する。
+  Serial で開く端末名は device() で取得する。
+
+  端末を開き直しても送受信を続けられるよう、スレーブ側を 1 つ
+  開いたままにする。send() は、chunk_size を指定したときはその byte 数
+  ずつ書き込み、シリアルの受信のように細切れに届ける。set_baudrate() を
+  指定したときは、そのボーレートで送信に掛かる時間だけ待ちながら書き込む。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstdlib>
+#include <string>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+
+class Pty_server
+{
+public:
+    enum {
+        Send_timeout_msec = 1000,
+        Paced_chunk_size = 64,
+    };
+
+
+    Pty_server(void) : master_(-1), slave_(-1), chunk_size_(0), baudrate_(0)
+    {
+    }
+
+
+    ~Pty_server(void)
+    {
+        close();
+    }
+
+
+    //! 擬似端末を開く。端末名は device() で取得する
+    bool listen(void)
+    {
+        master_ = posix_openpt(O_RDWR | O_NOCTTY);
+        if ((master_ < 0) || (grantpt(master_) != 0) ||
+            (unlockpt(master_) != 0)) {
+            return false;
+        }
+        device_ = ptsname(master_);
+        slave_ = ::open(device_.c_str(), O_RDWR | O_NOCTTY);
+        int flags = fcntl(master_, F_GETFL, 0);
+        fcntl(master_, F_SETFL, flags | O_NONBLOCK);
+        return slave_ >= 0;
+    }
+
+
+    const char* device(void) const
+    {
+        return device_.c_str();
+    }
+
+
+    //! 0 のときは、渡されたデータをまとめて書き込む
+    void set_chunk_size(size_t size)
+    {
+        chunk_size_ = size;
+    }
+
+
+    //! 0 のときは、待たずに書き込む
+    void set_baudrate(long baudrate)
+    {
+        baudrate_ = baudrate;
+    }
+
+
+    //! 擬似端末には接続の受け付けが無い
+    bool accept(void)
+    {
+        return master_ >= 0;
+    }
+
+
+    int send(const char* data, size_t size)
+    {
+        size_t sent = 0;
+        while (sent < size) {
+            struct pollfd fds;
+            fds.fd = master_;
+            fds.events = POLLOUT;
+            fds.revents = 0;
+            if (poll(&fds, 1, Send_timeout_msec) <= 0) {
+                break;
+            }
+            size_t chunk_size = ((chunk_size_ == 0) && (baudrate_ > 0)) ?
+                static_cast<size_t>(Paced_chunk_size) : chunk_size_;
+            size_t n = size - sent;
+            if ((chunk_size > 0) && (n > chunk_size)) {
+                n = chunk_size;
+            }
+            int written = ::write(master_, data + sent, n);
+            if (written < 0) {
+                break;
+            }
+            sent += written;
+            if (baudrate_ > 0) {
+                // 1 byte はスタートビットとストップビットを含めて 10 bit
+                usleep(static_cast<useconds_t>(written * 10000000LL /
+                                               baudrate_));
+            }
+        }
+        return static_cast<int>(sent);
+    }
+
+
+    //! timeout [msec] まで受信を待つ
+    int receive(char* data, size_t size, int timeout)
+    {
+        struct pollfd fds;
+        fds.fd = master_;
+        fds.events = POLLIN;
+        fds.revents = 0;
+        if ((poll(&fds, 1, timeout) <= 0) || !(fds.revents & POLLIN)) {
+            return 0;
+        }
+        int n = ::read(master_, data, size);
+        return (n > 0) ? n : 0;
+    }
+
+
+    void close(void)
+    {
+        if (slave_ >= 0) {
+            ::close(slave_);
+            slave_ = -1;
+        }
+        if (master_ >= 0) {
+            ::close(master_);
+            master_ = -1;
+        }
+    }
+
+
+private:
+    Pty_server(const Pty_server& rhs);
+    Pty_server& operator = (const Pty_server& rhs);
+
+    int master_;
+    int slave_;
+    std::string device_;
+    size_t chunk_size_;
+    long baudrate_;
+};
+
+#endif
@@ -0,0 +1,275 @@
+#ifndef SCIP_SCAN_DATA_H
+#define SCIP_SCAN_DATA_H
+
+/*!
+  \file
+  \brief テスト用の SCIP の計測データの応答
+
+  GD, GE, GS, HD, HE の応答を、期待する値と一緒に作る。HD, HE では
+  一部のステップに 2 つ、3 つのエコーを含め、'&' が行をまたぐ場合も
+  作る。
+
+  scip_generic_decode() は、応答全体を値毎に分岐しながらデコードする
+  最も単純な実装で、Scip_stream_parser の結果や処理時間の比較に使う。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+class Scip_scan_data
+{
+public:
+    enum {
+        Max_echo_size = 3,
+        Line_size = 64,
+    };
+
+
+    /*!
+      \param[in] command "GD", "GE", "GS", "HD", "HE" のいずれか
+      \param[in] steps ステップ数
+      \param[in] time_stamp タイムスタンプ [msec]
+    */
+    Scip_scan_data(const char* command, int steps, long time_stamp)
+        : steps_(steps),
+          byte_((command[1] == 'S') ? 2 : 3),
+          is_intensity_(command[1] == 'E'),
+          is_multiecho_(command[0] == 'H'),
+          echo_size_(is_multiecho_ ? Max_echo_size : 1),
+          distance_(steps * echo_size_, 0),
+          intensity_(steps * echo_size_, 0)
+    {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.2s0000%04d00", command,
+                 steps - 1);
+        echo_ = buffer;
+
+        std::string data;
+        for (int i = 0; i < steps; ++i) {
+            int echoes = is_multiecho_ ? echo_count(i) : 1;
+            for (int echo = 0; echo < echoes; ++echo) {
+                if (echo > 0) {
+                    data += '&';
+                }
+                long length = value(i, echo, time_stamp);
+                long intensity = (value(i, echo + 1, time_stamp) >> 2) & 0xffff;
+                distance_[(i * echo_size_) + echo] = length;
+                data += encode(length, byte_);
+                if (is_intensity_) {
+                    intensity_[(i * echo_size_) + echo] =
+                        static_cast<unsigned short>(intensity);
+                    data += encode(intensity, byte_);
+                }
+            }
+        }
+
+        body_ = line(encode(time_stamp, 4));
+        for (size_t i = 0; i < data.size(); i += Line_size) {
+            body_ += line(data.substr(i, Line_size));
+        }
+        body_ += '\n';
+    }
+
+
+    //! エコーバックから空行までの応答
+    std::string response(void) const
+    {
+        return echo_ + '\n' + line("00") + body_;
+    }
+
+
+    //! タイムスタンプから空行まで
+    const std::string& body(void) const
+    {
+        return body_;
+    }
+
+
+    int steps(void) const
+    {
+        return steps_;
+    }
+
+
+    //! 1 ステップ当たりの格納数
+    int echo_size(void) const
+    {
+        return echo_size_;
+    }
+
+
+    bool has_intensity(void) const
+    {
+        return is_intensity_;
+    }
+
+
+    //! 期待する距離。ステップ * echo_size() 個。無いエコーは 0
+    const std::vector<long>& distance(void) const
+    {
+        return distance_;
+    }
+
+
+    //! 期待する強度。has_intensity() が false のときは 0
+    const std::vector<unsigned short>& intensity(void) const
+    {
+        return intensity_;
+    }
+
+
+    static char checksum(const char* data, size_t size)
+    {
+        int sum = 0;
+        for (size_t i = 0; i < size; ++i) {
+            sum += static_cast<unsigned char>(data[i]);
+        }
+        return static_cast<char>((sum & 0x3f) + 0x30);
+    }
+
+
+    //! チェックサムと改行を付加する
+    static std::string line(const std::string& data)
+    {
+        return data + checksum(data.data(), data.size()) + '\n';
+    }
+
+
+    static std::string encode(long value, int size)
+    {
+        std::string data(size, '0');
+        for (int i = size - 1; i >= 0; --i) {
+            data[i] = static_cast<char>(0x30 + (value & 0x3f));
+            value >>= 6;
+        }
+        return data;
+    }
+
+
+private:
+    int echo_count(int step) const
+    {
+        return 1 + (((step % 3) == 0) ? 1 : 0) + (((step % 7) == 0) ? 1 : 0);
+    }
+
+
+    long value(int step, int echo, long time_stamp) const
+    {
+        long max_value = (1L << (6 * byte_)) - 1;
+        return ((time_stamp * 7) + (step * 13) + (echo * 1031)) % max_value;
+    }
+
+    int steps_;
+    int byte_;
+    bool is_intensity_;
+    bool is_multiecho_;
+    int echo_size_;
+    std::string echo_;
+    std::string body_;
+    std::vector<long> distance_;
+    std::vector<unsigned short> intensity_;
+};
+
+
+/*!
+  \brief Gx, Hx の応答を値毎に分岐しながらデコードする
+
+  Scip_stream_parser と同じく、マルチエコーは ステップ * max_echo_size の
+  位置に格納し、無いエコーは 0 にする。
+
+  \return ステップ数。チェックサムの不一致、格納先に収まらないときは -1
+*/
+inline int scip_generic_decode(const char* response, size_t size,
+                               long* length, unsigned short* intensity,
+                               size_t max_size, int max_echo_size)
+{
+    std::vector<std::string> lines;
+    const char* p = response;
+    const char* last_p = response + size;
+    while (p < last_p) {
+        const char* lf_p =
+            static_cast<const char*>(memchr(p, '\n', last_p - p));
+        if (!lf_p) {
+            return -1;
+        }
+        if (lf_p == p) {
+            break;
+        }
+        lines.push_back(std::string(p, lf_p));
+        p = lf_p + 1;
+    }
+    if ((lines.size() < 3) || (lines[0].size() < 2)) {
+        return -1;
+    }
+
+    std::string data;
+    for (size_t i = 3; i < lines.size(); ++i) {
+        const std::string& line = lines[i];
+        if ((line.size() < 2) ||
+            (line[line.size() - 1] !=
+             Scip_scan_data::checksum(line.data(), line.size() - 1))) {
+            return -1;
+        }
+        data.append(line, 0, line.size() - 1);
+    }
+
+    int byte = (lines[0][1] == 'S') ? 2 : 3;
+    bool is_intensity = (lines[0][1] == 'E');
+    int echo_size = (lines[0][0] == 'H') ? max_echo_size : 1;
+    int step = 0;
+    int echo = 0;
+    bool is_next_echo = false;
+    for (size_t i = 0; i < data.size();) {
+        if (data[i] == '&') {
+            ++echo;
+            --step;
+            is_next_echo = true;
+            ++i;
+            continue;
+        }
+        if (!is_next_echo) {
+            echo = 0;
+        }
+        is_next_echo = false;
+
+        int values = is_intensity ? 2 : 1;
+        long decoded[2] = { 0, 0 };
+        for (int k = 0; k < values; ++k) {
+            for (int n = 0; n < byte; ++n) {
+                if (i >= data.size()) {
+                    return -1;
+                }
+                decoded[k] = (decoded[k] << 6) | (data[i++] - 0x30);
+            }
+        }
+
+        size_t index = (step * echo_size) + echo;
+        if ((echo >= echo_size) ||
+            (static_cast<size_t>((step + 1) * echo_size) > max_size)) {
+            return -1;
+        }
+        if (echo == 0) {
+            for (int k = 1; k < echo_size; ++k) {
+                length[index + k] = 0;
+                if (intensity) {
+                    intensity[index + k] = 0;
+                }
+            }
+        }
+        length[index] = decoded[0];
+        if (intensity) {
+            intensity[index] = static_cast<unsigned short>(decoded[1]);
+        }
+        ++step;
+    }
+    return step;
+}
+
+#endif
@@ -0,0 +1,360 @@
+#ifndef SCIP_STAND_IN_H
+#define SCIP_STAND_IN_H
+
+/*!
+  \file
+  \brief テスト用の、SCIP に応答するセンサ
+
+  UTM-30LX として QT, PP, VV, BM, GD, MD, SS に応答する。MD を受信すると
+  Scan_msec 毎に距離データを送信し、各スキャンを送信した時刻を記録する。
+  タイムスタンプには、スキャンの番号に Scan_msec を掛けた値を入れる。
+  set_scan_msec(0) のときは、スキャンを待たずに続けて送信する。
+
+  Scip_stand_in はループバックの TCP で、Pty_scip_stand_in は擬似端末で
+  応答する。set_bm_error() で BM にエラーを返し、レーザが消灯している
+  ときの GD には "10" を返す。set_silent() の間は電源が切れたように
+  何も送信せず、計測も止める。
+  受信したコマンドは commands() で取得する。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <time.h>
+#include "Loopback_server.h"
+#include "Pty_server.h"
+
+
+template <class Server>
+class Basic_scip_stand_in
+{
+public:
+    enum {
+        Steps = 1081,
+        Scan_msec = 25,
+        First_distance = 1000,
+    };
+
+
+    explicit Basic_scip_stand_in(size_t scans)
+        : scan_msec_(Scan_msec), sent_time_(scans, 0), sent_scans_(0),
+          is_streaming_(false),
+          is_laser_on_(false), is_bm_error_(false), is_silent_(false),
+          serial_id_("H0000000"), quit_(false), thread_started_(false)
+    {
+        pthread_mutex_init(&mutex_, NULL);
+    }
+
+
+    ~Basic_scip_stand_in(void)
+    {
+        stop();
+        pthread_mutex_destroy(&mutex_);
+    }
+
+
+    //! 接続を待つ。接続先のポートは port() で取得する
+    bool start(void)
+    {
+        if (!server_.listen()) {
+            return false;
+        }
+        thread_started_ =
+            (pthread_create(&thread_, NULL, thread_function, this) == 0);
+        return thread_started_;
+    }
+
+
+    void stop(void)
+    {
+        quit_ = true;
+        if (thread_started_) {
+            pthread_join(thread_, NULL);
+            thread_started_ = false;
+        }
+        server_.close();
+    }
+
+
+    long port(void) const
+    {
+        return server_.port();
+    }
+
+
+    //! Pty_scip_stand_in の端末名
+    const char* device(void) const
+    {
+        return server_.device();
+    }
+
+
+    Server& server(void)
+    {
+        return server_;
+    }
+
+
+    //! MD で送信するスキャンの間隔 [msec]。start() の前に指定する
+    void set_scan_msec(int msec)
+    {
+        scan_msec_ = msec;
+    }
+
+
+    //! 送信したスキャン数
+    size_t sent_scans(void) const
+    {
+        return sent_scans_;
+    }
+
+
+    //! true のとき、BM に "01" を返してレーザを点灯しない
+    void set_bm_error(bool is_error)
+    {
+        pthread_mutex_lock(&mutex_);
+        is_bm_error_ = is_error;
+        pthread_mutex_unlock(&mutex_);
+    }
+
+
+    //! true の間は、コマンドに応答せず、計測を止める
+    void set_silent(bool is_silent)
+    {
+        pthread_mutex_lock(&mutex_);
+        is_silent_ = is_silent;
+        pthread_mutex_unlock(&mutex_);
+    }
+
+
+    //! VV 応答のシリアル番号
+    void set_serial_id(const std::string& serial_id)
+    {
+        pthread_mutex_lock(&mutex_);
+        serial_id_ = serial_id;
+        pthread_mutex_unlock(&mutex_);
+    }
+
+
+    //! 受信したコマンド。改行を含まない
+    std::vector<std::string> commands(void)
+    {
+        pthread_mutex_lock(&mutex_);
+        std::vector<std::string> commands = commands_;
+        pthread_mutex_unlock(&mutex_);
+        return commands;
+    }
+
+
+    //! index 番目のスキャンを送信した UNIX 時刻 [nsec]。未送信なら 0
+    long long sent_time(size_t index) const
+    {
+        return (index < sent_time_.size()) ? sent_time_[index] : 0;
+    }
+
+
+    static long long now(void)
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return (static_cast<long long>(ts.tv_sec) * 1000000000LL) +
+            ts.tv_nsec;
+    }
+
+
+private:
+    Basic_scip_stand_in(const Basic_scip_stand_in& rhs);
+    Basic_scip_stand_in& operator = (const Basic_scip_stand_in& rhs);
+
+
+    static void* thread_function(void* args)
+    {
+        static_cast<Basic_scip_stand_in*>(args)->run();
+        return NULL;
+    }
+
+
+    static std::string line(const std::string& data)
+    {
+        int sum = 0;
+        for (size_t i = 0; i < data.size(); ++i) {
+            sum += static_cast<unsigned char>(data[i]);
+        }
+        return data + static_cast<char>((sum & 0x3f) + 0x30) + "\n";
+    }
+
+
+    static std::string encode(long value, int size)
+    {
+        std::string encoded;
+        for (int i = size - 1; i >= 0; --i) {
+            encoded += static_cast<char>(((value >> (6 * i)) & 0x3f) + 0x30);
+        }
+        return encoded;
+    }
+
+
+    // タイムスタンプから空行まで
+    std::string scan_body(size_t index) const
+    {
+        std::string data;
+        for (int i = 0; i < Steps; ++i) {
+            data += encode(First_distance + i, 3);
+        }
+        std::string body =
+            line(encode(static_cast<long>(index) * Scan_msec, 4));
+        for (size_t i = 0; i < data.size(); i += 64) {
+            body += line(data.substr(i, 64));
+        }
+        return body + "\n";
+    }
+
+
+    std::string scan(size_t index) const
+    {
+        return md_echo_ + "\n99b\n" + scan_body(index);
+    }
+
+
+    std::string response(const std::string& command)
+    {
+        pthread_mutex_lock(&mutex_);
+        commands_.push_back(command);
+        bool is_bm_error = is_bm_error_;
+        bool is_silent = is_silent_;
+        std::string serial_id = serial_id_;
+        pthread_mutex_unlock(&mutex_);
+
+        if (is_silent) {
+            return "";
+        }
+
+        std::string echo = command + "\n";
+        if (command == "QT") {
+            is_streaming_ = false;
+            is_laser_on_ = false;
+            return echo + "00P\n\n";
+
+        } else if (command == "BM") {
+            if (is_bm_error) {
+                return echo + line("01") + "\n";
+            }
+            is_laser_on_ = true;
+            return echo + "00P\n\n";
+
+        } else if ((command.size() == 12) &&
+                   (command.compare(0, 2, "GD") == 0)) {
+            if (!is_laser_on_) {
+                return echo + line("10") + "\n";
+            }
+            return echo + "00P\n" + scan_body(0);
+
+        } else if ((command.size() == 8) &&
+                   (command.compare(0, 2, "SS") == 0)) {
+            // 擬似端末とループバックにはボーレートが無いため、応答のみ返す
+            return echo + "00P\n\n";
+
+        } else if (command == "PP") {
+            return echo + "00P\n" + line("MODL:UTM-30LX;") +
+                line("DMIN:23;") + line("DMAX:60000;") +
+                line("ARES:1440;") + line("AMIN:0;") + line("AMAX:1080;") +
+                line("AFRT:540;") + line("SCAN:2400;") + "\n";
+
+        } else if (command == "VV") {
+            return echo + "00P\n" + line("VEND:Hokuyo;") +
+                line("PROD:UTM-30LX;") + line("FIRM:1.1.0;") +
+                line("PROT:SCIP 2.0;") + line("SERI:" + serial_id + ";") + "\n";
+
+        } else if ((command.size() == 15) &&
+                   (command.compare(0, 2, "MD") == 0)) {
+            md_echo_ = command.substr(0, 13) + "99";
+            is_streaming_ = true;
+            is_laser_on_ = true;
+            next_scan_time_ = now();
+            return echo + "00P\n\n";
+        }
+        return echo + "0Ee\n\n";
+    }
+
+
+    void send(const std::string& data)
+    {
+        server_.send(data.data(), data.size());
+    }
+
+
+    void run(void)
+    {
+        if (!server_.accept()) {
+            return;
+        }
+
+        std::string received;
+        while (!quit_) {
+            int timeout = 10;
+            if (is_streaming_) {
+                long long wait_nsec = next_scan_time_ - now();
+                timeout = (wait_nsec > 0) ? (wait_nsec / 1000000) : 0;
+            }
+
+            char buffer[256];
+            int n = server_.receive(buffer, sizeof(buffer), timeout);
+            if (n < 0) {
+                break;
+            }
+            received.append(buffer, n);
+            size_t end;
+            while ((end = received.find('\n')) != std::string::npos) {
+                std::string command = received.substr(0, end);
+                received.erase(0, end + 1);
+                if (!command.empty() && (command[command.size() - 1] == '\r')) {
+                    command.erase(command.size() - 1);
+                }
+                if (!command.empty()) {
+                    send(response(command));
+                }
+            }
+
+            pthread_mutex_lock(&mutex_);
+            if (is_silent_) {
+                is_streaming_ = false;
+            }
+            pthread_mutex_unlock(&mutex_);
+            if (is_streaming_ && (now() >= next_scan_time_) &&
+                (sent_scans_ < sent_time_.size())) {
+                std::string data = scan(sent_scans_);
+                sent_time_[sent_scans_] = now();
+                send(data);
+                ++sent_scans_;
+                next_scan_time_ += scan_msec_ * 1000000LL;
+            }
+        }
+    }
+
+
+    Server server_;
+    pthread_t thread_;
+    pthread_mutex_t mutex_;
+    int scan_msec_;
+    std::vector<long long> sent_time_;
+    volatile size_t sent_scans_;
+    std::string md_echo_;
+    bool is_streaming_;
+    bool is_laser_on_;
+    bool is_bm_error_;
+    bool is_silent_;
+    std::string serial_id_;
+    std::vector<std::string> commands_;
+    long long next_scan_time_;
+    volatile bool quit_;
+    bool thread_started_;
+};
+
+typedef Basic_scip_stand_in<Loopback_server> Scip_stand_in;
+typedef Basic_scip_stand_in<Pty_server> Pty_scip_stand_in;
+
+#endif
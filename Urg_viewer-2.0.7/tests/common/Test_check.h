@@ -0,0 +1,60 @@
+#ifndef TEST_CHECK_H
+#define TEST_CHECK_H
+
+/*!
+  \file
+  \brief テストの確認と結果の出力
+
+  check() で条件を確認し、失敗した数を main() の最後に check_result() で
+  出力する。*_test は失敗したときに 0 以外を返す。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstdio>
+#include <cstdarg>
+
+
+//! 失敗した確認の数
+inline int& failed_checks(void)
+{
+    static int failed = 0;
+    return failed;
+}
+
+
+/*!
+  \brief 条件を確認する
+
+  condition が偽のときは、printf() と同じ書式のメッセージを出力する。
+*/
+inline bool check(bool condition, const char* format, ...)
+{
+    if (!condition) {
+        va_list args;
+        va_start(args, format);
+        fprintf(stderr, "FAILED: ");
+        vfprintf(stderr, format, args);
+        fprintf(stderr, "\n");
+        va_end(args);
+        ++failed_checks();
+    }
+    return condition;
+}
+
+
+//! 結果を出力し、main() の戻り値を返す
+inline int check_result(void)
+{
+    int failed = failed_checks();
+    if (failed > 0) {
+        fprintf(stderr, "%d check(s) failed.\n", failed);
+        return 1;
+    }
+    printf("ok\n");
+    return 0;
+}
+
+#endif
@@ -0,0 +1,126 @@
+/*!
+  \file
+  \brief 接続のキャッシュを使って開き直すときの動作確認
+
+  115200 bps の速さで送信する擬似端末のセンサに MD で計測させたまま
+  Urg_driver を閉じ、開き直す。スキャンの送信はスキャン周期より長く
+  掛かるため、開き直したときもセンサはスキャンを送信している。
+  キャッシュから接続でき (PP を送信しない)、計測を続けられることを
+  確認する。センサが応答しないときはキャッシュを残し、シリアル番号が
+  一致しないときのみ消すことも確認する。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "Urg_driver.h"
+#include "Scip_stand_in.h"
+#include "Test_check.h"
+
+using namespace hrk;
+using namespace std;
+
+
+namespace
+{
+    enum {
+        Baudrate = 115200,
+        Scans = 2000,
+        Closed_msec = 100,
+    };
+
+
+    // commands() の first 番目以降に command があるか
+    bool is_sent(Pty_scip_stand_in& sensor, size_t first, const char* command)
+    {
+        vector<string> commands = sensor.commands();
+        for (size_t i = first; i < commands.size(); ++i) {
+            if (commands[i] == command) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+
+    bool receive_scans(Urg_driver& urg)
+    {
+        vector<long> data;
+        for (int i = 0; i < 3; ++i) {
+            if (!urg.get_distance(data) ||
+                (data.size() != Pty_scip_stand_in::Steps)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+
+    // 計測を止めずに閉じ、受信されないスキャンが溜まってから開き直す
+    bool reopen(Urg_driver& urg, Pty_scip_stand_in& sensor)
+    {
+        urg.close();
+        usleep(Closed_msec * 1000);
+        return urg.open(sensor.device(), Baudrate, Urg_driver::Serial);
+    }
+}
+
+
+int main(void)
+{
+    char cache_file[] = "/tmp/connection_cache_testXXXXXX";
+    int fd = mkstemp(cache_file);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    Urg_driver::set_connection_cache_file(cache_file);
+
+    Pty_scip_stand_in sensor(Scans);
+    sensor.server().set_baudrate(Baudrate);
+    if (!sensor.start()) {
+        fprintf(stderr, "Pty_scip_stand_in: could not open a pty.\n");
+        return 1;
+    }
+
+    Urg_driver urg;
+    check(urg.open(sensor.device(), Baudrate, Urg_driver::Serial) &&
+          urg.start_measurement(Lidar::Distance) && receive_scans(urg),
+          "first open: %s", urg.what());
+    check(is_sent(sensor, 0, "PP"), "first open did not send PP");
+
+    // MD の送信中に開き直す
+    size_t first = sensor.commands().size();
+    check(reopen(urg, sensor), "reopen while streaming: %s", urg.what());
+    check(!is_sent(sensor, first, "PP"), "reopen did not use the cache");
+    check(urg.start_measurement(Lidar::Distance) && receive_scans(urg),
+          "measurement after reopen: %s", urg.what());
+
+    // 応答しないときは、キャッシュを残す
+    sensor.set_silent(true);
+    check(!reopen(urg, sensor), "reopen a silent sensor");
+    sensor.set_silent(false);
+    first = sensor.commands().size();
+    check(reopen(urg, sensor), "reopen after timeout: %s", urg.what());
+    check(!is_sent(sensor, first, "PP"), "timeout erased the cache");
+
+    // シリアル番号が一致しないときは、探索し直して記録し直す
+    sensor.set_serial_id("H0000001");
+    first = sensor.commands().size();
+    check(reopen(urg, sensor), "reopen another sensor: %s", urg.what());
+    check(is_sent(sensor, first, "PP"), "serial mismatch used the cache");
+    first = sensor.commands().size();
+    check(reopen(urg, sensor) && !is_sent(sensor, first, "PP"),
+          "cache was not stored again");
+
+    urg.close();
+    sensor.stop();
+    unlink(cache_file);
+    return check_result();
+}
@@ -0,0 +1,144 @@
+/*!
+  \file
+  \brief Osc_publisher の送信方式毎の送信パケット数と CPU 時間の計測
+
+  ループバックの UDP ポートを送信先にして、1081 ステップのスキャンを
+  送信方式毎に送信する。Point_message が点毎に bundle を送信する、
+  従来の送信方式に相当する。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include "Osc_publisher.h"
+#include "Scan_setting.h"
+#include "Fake_lidar.h"
+#include "Bench_timer.h"
+
+using namespace hrk;
+using namespace std;
+
+
+namespace
+{
+    enum {
+        Scans = 1000,
+        Steps = 1081,
+        Stable_msec = 200,
+    };
+
+
+    // 送信先の UDP ポート。受信はせず、あふれたデータはカーネルが破棄する
+    int open_sink(int& port)
+    {
+        int sock = socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in address;
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = 0;
+        socklen_t size = sizeof(address);
+        struct sockaddr* p = reinterpret_cast<struct sockaddr*>(&address);
+        if ((sock < 0) || (bind(sock, p, sizeof(address)) != 0) ||
+            (getsockname(sock, p, &size) != 0)) {
+            return -1;
+        }
+        port = ntohs(address.sin_port);
+        return sock;
+    }
+
+
+    unsigned long sent_packets(const Osc_publisher& publisher)
+    {
+        vector<unsigned long> sent;
+        vector<unsigned long> errors;
+        publisher.destination_counters(sent, errors);
+        return sent.empty() ? 0 : sent[0];
+    }
+
+
+    void run(Fake_lidar& lidar, int port,
+             Osc_publisher::framing_t framing, const char* name)
+    {
+        Osc_publisher publisher;
+        Scan_setting setting;
+        setting.first_step = Fake_lidar::First_step;
+        setting.last_step = Fake_lidar::Last_step;
+        setting.group_steps = 1;
+        setting.with_intensity = false;
+        setting.is_multiecho = false;
+        publisher.set_scan_setting(setting);
+        publisher.set_sensor(lidar);
+        publisher.set_framing(framing);
+        publisher.set_queue_scans(Scans);
+
+        vector<Osc_publisher::destination_t> destinations(1);
+        destinations[0].address = "127.0.0.1";
+        destinations[0].port = port;
+        publisher.set_destinations(destinations);
+        publisher.start();
+
+        // 既定の領域 (75 < |x|, |y| < 1300 [mm]) に多くの点が入る距離にする
+        vector<vector<long> > scans(Scans, vector<long>(Steps));
+        for (int i = 0; i < Scans; ++i) {
+            for (int step = 0; step < Steps; ++step) {
+                scans[i][step] = 900 + ((step * 7 + i) % 200);
+            }
+        }
+        vector<unsigned short> intensity;
+
+        double first_cpu = cpu_sec();
+        double first_time = now_sec();
+        for (int i = 0; i < Scans; ++i) {
+            publisher.push_scan(Lidar::Distance, scans[i], intensity, i);
+        }
+
+        // 送信パケット数が変化しなくなるまで待つ
+        unsigned long sent = 0;
+        double last_time = now_sec();
+        while ((now_sec() - last_time) < (Stable_msec / 1000.0)) {
+            usleep(1000);
+            unsigned long n = sent_packets(publisher);
+            if (n != sent) {
+                sent = n;
+                last_time = now_sec();
+            }
+        }
+        double cpu = cpu_sec() - first_cpu;
+        double elapsed = last_time - first_time;
+        publisher.stop();
+        publisher.wait();
+
+        printf("%-14s %8.1f packets/scan %10.0f packets/s "
+               "%8.1f us CPU/scan %6zu dropped\n",
+               name, static_cast<double>(sent) / Scans, sent / elapsed,
+               cpu * 1000000.0 / Scans, publisher.dropped_scans());
+    }
+}
+
+
+int main(void)
+{
+    int port = 0;
+    int sink = open_sink(port);
+    if (sink < 0) {
+        perror("socket");
+        return 1;
+    }
+
+    Fake_lidar lidar;
+    run(lidar, port, Osc_publisher::Point_message, "Point_message");
+    run(lidar, port, Osc_publisher::Scan_bundle, "Scan_bundle");
+    run(lidar, port, Osc_publisher::Scan_blob, "Scan_blob");
+    run(lidar, port, Osc_publisher::Scan_delta, "Scan_delta");
+
+    close(sink);
+    return 0;
+}
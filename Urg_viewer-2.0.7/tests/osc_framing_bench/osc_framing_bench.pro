@@ -0,0 +1,21 @@
+TEMPLATE = app
+TARGET = osc_framing_bench
+QT -= gui
+CONFIG += console
+CONFIG -= app_bundle
+DEPENDPATH += . ../.. ../common
+INCLUDEPATH += . ../.. ../common
+
+HEADERS += ../common/Fake_lidar.h
+
+SOURCES += osc_framing_bench.cpp \
+        ../../Osc_publisher.cpp \
+        ../../Region_filter.cpp \
+        ../../Blob_detector.cpp \
+        ../../Target_tracker.cpp \
+        ../../Scan_delta_codec.cpp \
+        ../../osc/OscOutboundPacketStream.cpp \
+        ../../osc/OscTypes.cpp \
+        ../../ip/IpEndpointName.cpp \
+        ../../ip/posix/NetworkingUtils.cpp \
+        ../../ip/posix/UdpSocket.cpp
@@ -0,0 +1,77 @@
+/*!
+  \file
+  \brief パイプライン起動で BM が失敗したときの動作確認
+
+  set_pipelined_startup(true) では BM と GD をまとめて送信する。
+  擬似端末のセンサに BM のエラーを返させ、start_measurement() が
+  失敗した後に、残った GD の応答を読み捨てていること、BM が成功する
+  ようになれば次の計測を受信できることを確認する。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstdio>
+#include <vector>
+#include "Urg_driver.h"
+#include "Scip_stand_in.h"
+#include "Test_check.h"
+
+using namespace hrk;
+using namespace std;
+
+
+namespace
+{
+    enum {
+        Baudrate = 115200,
+    };
+
+
+    bool is_scan(const vector<long>& data)
+    {
+        return (data.size() == Pty_scip_stand_in::Steps) &&
+            (data.back() == Pty_scip_stand_in::First_distance +
+             Pty_scip_stand_in::Steps - 1);
+    }
+}
+
+
+int main(void)
+{
+    Pty_scip_stand_in sensor(1);
+    if (!sensor.start()) {
+        fprintf(stderr, "Pty_scip_stand_in: could not open a pty.\n");
+        return 1;
+    }
+
+    Urg_driver urg;
+    urg.set_pipelined_startup(true);
+    if (!urg.open(sensor.device(), Baudrate, Urg_driver::Serial)) {
+        fprintf(stderr, "Urg_driver: %s\n", urg.what());
+        return 1;
+    }
+
+    sensor.set_bm_error(true);
+    check(!urg.start_measurement(Lidar::Distance, 1, 0),
+          "start_measurement() with a BM error");
+
+    // 失敗した GD の応答が残っていれば、次の BM のエコーバックが一致しない
+    sensor.set_bm_error(false);
+    vector<long> data;
+    check(urg.start_measurement(Lidar::Distance, 1, 0),
+          "start_measurement() after the BM error: %s", urg.what());
+    check(urg.get_distance(data) && is_scan(data),
+          "get_distance() after the BM error: %s", urg.what());
+
+    // もう 1 度、レーザが点灯した状態で計測する
+    data.clear();
+    check(urg.start_measurement(Lidar::Distance, 1, 0) &&
+          urg.get_distance(data) && is_scan(data),
+          "second measurement: %s", urg.what());
+
+    urg.close();
+    sensor.stop();
+    return check_result();
+}
@@ -0,0 +1,22 @@
+TEMPLATE = app
+TARGET = pipelined_startup_test
+QT -= gui core
+CONFIG += console
+CONFIG -= app_bundle qt
+DEPENDPATH += . ../.. ../common
+INCLUDEPATH += . ../.. ../common
+LIBS += -lpthread
+unix:!macx:LIBS += -lrt
+
+SOURCES += pipelined_startup_test.cpp \
+        ../../Urg_driver.cpp \
+        ../../Urg_log_reader.cpp \
+        ../../Serial.cpp \
+        ../../Tcpip.cpp \
+        ../../connection_utils.cpp \
+        ../../scip_decode.cpp \
+        ../../Scip_stream_parser.cpp \
+        ../../Scan_frame.cpp
+
+unix:SOURCES += ../../Io_reactor.cpp \
+        ../../Uring_receiver.cpp
@@ -0,0 +1,159 @@
+/*!
+  \file
+  \brief Ring_buffer の格納と取り出しの処理速度の計測
+
+  1 B, 64 B, 4 KB ずつ push() と pop() を繰り返して Total_bytes を
+  通過させ、1 秒当たりの byte 数を出力する。比較のため、以前の
+  std::deque による実装 (Deque_buffer) と、受信側が使う
+  write_span(), read_span() による格納と取り出しも計測する。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstdio>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include "Ring_buffer.hpp"
+#include "Bench_timer.h"
+
+using namespace hrk;
+using namespace std;
+
+
+namespace
+{
+    enum {
+        Total_bytes = 64 * 1024 * 1024,
+        Repeats = 3,
+    };
+
+
+    // std::deque による以前の Ring_buffer の push(), pop()
+    class Deque_buffer
+    {
+    public:
+        size_t push(const char* data, size_t size)
+        {
+            buffer_.insert(buffer_.end(), data, data + size);
+            return size;
+        }
+
+
+        size_t pop(char* data, size_t size)
+        {
+            size_t n = min(size, buffer_.size());
+            copy(buffer_.begin(), buffer_.begin() + n, data);
+            buffer_.erase(buffer_.begin(), buffer_.begin() + n);
+            return n;
+        }
+
+
+    private:
+        deque<char> buffer_;
+    };
+
+
+    template <class Buffer>
+    size_t push_pop(Buffer& buffer, const char* data, char* output,
+                    size_t chunk_size)
+    {
+        size_t checksum = 0;
+        for (size_t moved = 0; moved < Total_bytes; moved += chunk_size) {
+            buffer.push(data, chunk_size);
+            buffer.pop(output, chunk_size);
+            checksum += static_cast<unsigned char>(output[chunk_size - 1]);
+        }
+        return checksum;
+    }
+
+
+    size_t span_push_pop(Ring_buffer<char>& buffer, const char* data,
+                         size_t chunk_size)
+    {
+        size_t checksum = 0;
+        for (size_t moved = 0; moved < Total_bytes; moved += chunk_size) {
+            size_t span_size;
+            char* span = buffer.write_span(span_size);
+            size_t n = min(span_size, chunk_size);
+            copy(data, data + n, span);
+            buffer.commit(n);
+
+            const char* read_p = buffer.read_span(span_size);
+            checksum += static_cast<unsigned char>(read_p[span_size - 1]);
+            buffer.consume(span_size);
+        }
+        return checksum;
+    }
+
+
+    // Repeats 回のうち、最も速い結果 [MB/s]
+    template <class Buffer>
+    double measure(size_t chunk_size, size_t& checksum)
+    {
+        vector<char> data(chunk_size);
+        vector<char> output(chunk_size);
+        for (size_t i = 0; i < chunk_size; ++i) {
+            data[i] = static_cast<char>(i);
+        }
+
+        double best_sec = 0.0;
+        for (int i = 0; i < Repeats; ++i) {
+            Buffer buffer;
+            double first_sec = now_sec();
+            checksum += push_pop(buffer, &data[0], &output[0], chunk_size);
+            double sec = now_sec() - first_sec;
+            if ((i == 0) || (sec < best_sec)) {
+                best_sec = sec;
+            }
+        }
+        return Total_bytes / best_sec / 1000000.0;
+    }
+
+
+    double measure_span(size_t chunk_size, size_t& checksum)
+    {
+        vector<char> data(chunk_size);
+        for (size_t i = 0; i < chunk_size; ++i) {
+            data[i] = static_cast<char>(i);
+        }
+
+        double best_sec = 0.0;
+        for (int i = 0; i < Repeats; ++i) {
+            Ring_buffer<char> buffer;
+            double first_sec = now_sec();
+            checksum += span_push_pop(buffer, &data[0], chunk_size);
+            double sec = now_sec() - first_sec;
+            if ((i == 0) || (sec < best_sec)) {
+                best_sec = sec;
+            }
+        }
+        return Total_bytes / best_sec / 1000000.0;
+    }
+}
+
+
+int main(void)
+{
+    size_t chunk_sizes[] = { 1, 64, 4096 };
+    size_t checksum = 0;
+
+    printf("%d MiB of push + pop pairs [MB/s]\n", Total_bytes / 1024 / 1024);
+    printf("chunk    deque     ring  ring span\n");
+    size_t n = sizeof(chunk_sizes) / sizeof(chunk_sizes[0]);
+    for (size_t i = 0; i < n; ++i) {
+        size_t chunk_size = chunk_sizes[i];
+        double deque_rate = measure<Deque_buffer>(chunk_size, checksum);
+        double ring_rate = measure<Ring_buffer<char> >(chunk_size, checksum);
+        double span_rate = measure_span(chunk_size, checksum);
+        printf("%5lu  %7.0f  %7.0f  %9.0f\n",
+               static_cast<unsigned long>(chunk_size),
+               deque_rate, ring_rate, span_rate);
+    }
+
+    // 計算を省略させないため
+    printf("checksum: %lu\n", static_cast<unsigned long>(checksum));
+    return 0;
+}
@@ -0,0 +1,10 @@
+TEMPLATE = app
+TARGET = ring_buffer_bench
+QT -= gui core
+CONFIG += console
+CONFIG -= app_bundle qt
+DEPENDPATH += . ../.. ../common
+INCLUDEPATH += . ../.. ../common
+unix:!macx:LIBS += -lrt
+
+SOURCES += ring_buffer_bench.cpp
@@ -0,0 +1,144 @@
+/*!
+  \file
+  \brief Ring_buffer の動作確認
+
+  格納位置が領域の終端で折り返すとき、clear() や空になった直後に
+  ungetc() するとき、容量を越えて push(), ungetc() したときに、
+  データの順序が保たれることを確認する。write_span() は領域を
+  広げないことも確認する。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstdio>
+#include <string>
+#include "Ring_buffer.hpp"
+#include "Test_check.h"
+
+using namespace hrk;
+using namespace std;
+
+
+namespace
+{
+    enum {
+        Capacity = 16,
+    };
+
+
+    void push(Ring_buffer<char>& buffer, const string& data)
+    {
+        buffer.push(data.data(), data.size());
+    }
+
+
+    string pop(Ring_buffer<char>& buffer, size_t size)
+    {
+        string data(size, '\0');
+        size_t n = buffer.pop(&data[0], size);
+        data.resize(n);
+        return data;
+    }
+
+
+    string pop_all(Ring_buffer<char>& buffer)
+    {
+        return pop(buffer, buffer.size());
+    }
+
+
+    void test_wrap(void)
+    {
+        Ring_buffer<char> buffer(Capacity);
+        push(buffer, "0123456789ab");
+        check(pop(buffer, 8) == "01234567", "wrap: pop");
+        push(buffer, "cdefghij");
+        check(buffer.capacity() == Capacity, "wrap: grew to %lu",
+              static_cast<unsigned long>(buffer.capacity()));
+
+        // 折り返しまでを返す
+        size_t size;
+        const char* span = buffer.read_span(size);
+        check(string(span, size) == "89abcdef", "wrap: read_span");
+        char* write_p = buffer.write_span(size);
+        check((size == 4) && (write_p == span - 4), "wrap: write_span %lu",
+              static_cast<unsigned long>(size));
+
+        // 折り返した行を連続した領域で返す
+        push(buffer, "\nk");
+        const char* line;
+        size_t searched = 0;
+        check(buffer.read_line(line, size, searched) &&
+              (string(line, size) == "89abcdefghij\n"), "wrap: read_line");
+        check(pop_all(buffer) == "k", "wrap: rest");
+    }
+
+
+    void test_ungetc(void)
+    {
+        Ring_buffer<char> buffer(Capacity);
+        push(buffer, "abc");
+        buffer.clear();
+        buffer.ungetc('x');
+        push(buffer, "yz");
+        check(pop_all(buffer) == "xyz", "ungetc after clear");
+
+        // consume() で空になると、格納位置を先頭に戻す
+        push(buffer, "0123456789");
+        check(pop(buffer, 10) == "0123456789", "ungetc: pop");
+        buffer.ungetc('9');
+        buffer.ungetc('8');
+        push(buffer, "ab");
+        check(pop_all(buffer) == "89ab", "ungetc after empty");
+
+        // 満杯のときは広げる
+        push(buffer, "0123456789abcdef");
+        buffer.ungetc('-');
+        check((buffer.capacity() == 2 * Capacity) &&
+              (pop_all(buffer) == "-0123456789abcdef"), "ungetc when full");
+    }
+
+
+    void test_grow(void)
+    {
+        Ring_buffer<char> buffer(Capacity);
+        string data;
+        for (int i = 0; i < 40; ++i) {
+            data += static_cast<char>('A' + i);
+        }
+        push(buffer, data);
+        check((buffer.capacity() == 4 * Capacity) && (pop_all(buffer) == data),
+              "grow on push");
+
+        // 折り返した状態から広げる
+        Ring_buffer<char> wrapped(Capacity);
+        push(wrapped, "0123456789ab");
+        pop(wrapped, 8);
+        push(wrapped, "cdefghijklmnopqrst");
+        check((wrapped.capacity() == 2 * Capacity) &&
+              (pop_all(wrapped) == "89abcdefghijklmnopqrst"),
+              "grow while wrapped");
+
+        // write_span() は広げない
+        Ring_buffer<char> full(Capacity);
+        push(full, "0123456789abcdef");
+        size_t size;
+        full.write_span(size);
+        check((size == 0) && (full.capacity() == Capacity),
+              "write_span when full");
+        full.commit(1);
+        check(full.size() == Capacity, "commit when full");
+    }
+}
+
+
+int main(void)
+{
+    test_wrap();
+    test_ungetc();
+    test_grow();
+
+    return check_result();
+}
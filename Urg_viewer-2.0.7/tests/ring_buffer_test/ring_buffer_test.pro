@@ -0,0 +1,10 @@
+TEMPLATE = app
+TARGET = ring_buffer_test
+QT -= gui core
+CONFIG += console
+CONFIG -= app_bundle qt
+DEPENDPATH += . ../.. ../common
+INCLUDEPATH += . ../.. ../common
+unix:!macx:LIBS += -lrt
+
+SOURCES += ring_buffer_test.cpp
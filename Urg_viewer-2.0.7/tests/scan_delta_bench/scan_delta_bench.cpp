@@ -0,0 +1,221 @@
+/*!
+  \file
+  \brief URG ログを差分符号化したときの 1 スキャン当たりの byte 数
+
+  ログを Urg_driver で再生し、スキャン毎に Scan_delta_encoder で
+  符号化する。keyframe, delta, 全体の 1 スキャン当たりの平均 byte 数と、
+  ログの SCIP の 1 スキャン当たりの byte 数を出力する。
+  Scan_delta_decoder で復元し、元の値との差が閾値以下であることも
+  確認する。
+
+  ログを指定しないときは、壁までの距離に ±10 mm の揺らぎを加え、
+  1 つの物体が横切る UTM-30LX のログを生成して再生する。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include "Urg_driver.h"
+#include "Urg_log_reader.h"
+#include "Scan_frame.h"
+#include "Scan_delta_codec.h"
+#include "Scip_scan_data.h"
+
+using namespace hrk;
+using namespace std;
+
+
+namespace
+{
+    enum {
+        Generated_scans = 2000,
+        Scan_msec = 25,
+        Steps = 1081,
+        Wall_mm = 5000,
+        Noise_mm = 10,
+        Target_steps = 40,
+        Target_mm = 1500,
+    };
+
+    const char* Generated_log_file = "scan_delta_bench.log";
+
+
+    bool generate_log(const char* file)
+    {
+        ofstream fout(file, ios_base::binary);
+        if (!fout.is_open()) {
+            return false;
+        }
+
+        // 接続時の QT, PP の応答
+        fout << "QT\n00P\n\n";
+        fout << "PP\n00P\n"
+             << Scip_scan_data::line(
+                 "MODL:UTM-30LX(Hokuyo Automatic Co.,Ltd.);")
+             << Scip_scan_data::line("DMIN:23;")
+             << Scip_scan_data::line("DMAX:60000;")
+             << Scip_scan_data::line("ARES:1440;")
+             << Scip_scan_data::line("AMIN:0;")
+             << Scip_scan_data::line("AMAX:1080;")
+             << Scip_scan_data::line("AFRT:540;")
+             << Scip_scan_data::line("SCAN:2400;") << "\n";
+
+        const string echo = "MD0000108001000";
+        fout << echo << "\n00P\n\n";
+
+        srand(1);
+        for (int scan = 0; scan < Generated_scans; ++scan) {
+            // 物体は 1 スキャンに 1 ステップずつ進み、端で折り返す
+            int position = scan % (2 * (Steps - Target_steps));
+            if (position >= (Steps - Target_steps)) {
+                position = (2 * (Steps - Target_steps)) - position;
+            }
+
+            string data;
+            for (int step = 0; step < Steps; ++step) {
+                bool is_target =
+                    (step >= position) && (step < position + Target_steps);
+                long distance = (is_target ? Target_mm : Wall_mm) +
+                    (rand() % (2 * Noise_mm + 1)) - Noise_mm;
+                data += Scip_scan_data::encode(distance, 3);
+            }
+
+            fout << echo << "\n99b\n"
+                 << Scip_scan_data::line(
+                     Scip_scan_data::encode(scan * Scan_msec, 4));
+            for (size_t i = 0; i < data.size(); i += 64) {
+                fout << Scip_scan_data::line(data.substr(i, 64));
+            }
+            fout << "\n";
+        }
+        return true;
+    }
+
+
+    template <typename T>
+    long max_error(const vector<T>& values, const vector<T>& decoded)
+    {
+        long error = 0;
+        for (size_t i = 0; i < values.size(); ++i) {
+            error = max(error, labs(static_cast<long>(values[i]) -
+                                    static_cast<long>(decoded[i])));
+        }
+        return error;
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    const char* log_file = Generated_log_file;
+    if (argc > 1) {
+        log_file = argv[1];
+    } else if (!generate_log(log_file)) {
+        perror(log_file);
+        return 1;
+    }
+
+    Urg_log_reader reader;
+    if (!reader.load(log_file)) {
+        fprintf(stderr, "%s: %s\n", log_file, reader.what());
+        return 1;
+    }
+    bool with_intensity;
+    bool is_multiecho;
+    reader.log_measurement_type(with_intensity, is_multiecho);
+    int first_step;
+    int last_step;
+    int group_steps;
+    reader.log_range(first_step, last_step, group_steps);
+    group_steps = max(group_steps, 1);
+
+    Urg_driver urg;
+    if (!urg.open(&reader)) {
+        fprintf(stderr, "Urg_driver: %s\n", urg.what());
+        return 1;
+    }
+    urg.set_scanning_parameter(first_step, last_step, group_steps);
+    Lidar::measurement_t type = is_multiecho ?
+        (with_intensity ? Lidar::Multiecho_intensity : Lidar::Multiecho) :
+        (with_intensity ? Lidar::Distance_intensity : Lidar::Distance);
+    urg.start_measurement(type, Urg_driver::Infinity_scan_times, 0);
+
+    Scan_delta_encoder encoder;
+    Scan_delta_encoder::parameter_t parameter = encoder.parameter();
+    Scan_delta_decoder decoder;
+    Scan_frame frame;
+    vector<long> distance;
+    vector<unsigned short> intensity;
+    vector<char> data;
+    size_t scans = 0;
+    size_t keyframes = 0;
+    size_t keyframe_bytes = 0;
+    size_t delta_bytes = 0;
+    size_t undecoded_scans = 0;
+    long distance_error = 0;
+    long intensity_error = 0;
+
+    while (urg.get_scan(frame)) {
+        distance.assign(frame.distance(), frame.distance() + frame.size());
+        intensity.clear();
+        if (frame.has_intensity()) {
+            intensity.assign(frame.intensity(),
+                             frame.intensity() + frame.size());
+        }
+        encoder.encode(data, frame.type, frame.sensor_timestamp,
+                       frame.first_step, frame.group_steps, frame.echo_size,
+                       distance, intensity);
+        ++scans;
+
+        if (!decoder.decode(&data[0], data.size())) {
+            ++undecoded_scans;
+            continue;
+        }
+        if (decoder.is_keyframe()) {
+            ++keyframes;
+            keyframe_bytes += data.size();
+        } else {
+            delta_bytes += data.size();
+        }
+        distance_error =
+            max(distance_error, max_error(distance, decoder.distance()));
+        intensity_error =
+            max(intensity_error, max_error(intensity, decoder.intensity()));
+    }
+
+    if (scans == 0) {
+        fprintf(stderr, "no scans: %s\n", urg.what());
+        return 1;
+    }
+
+    ifstream fin(log_file, ios_base::binary | ios_base::ate);
+    double log_bytes = static_cast<double>(fin.tellg());
+    size_t deltas = scans - keyframes - undecoded_scans;
+    printf("%lu scans, keyframe interval %lu, thresholds %ld mm, %ld\n",
+           static_cast<unsigned long>(scans),
+           static_cast<unsigned long>(parameter.keyframe_interval),
+           parameter.distance_threshold, parameter.intensity_threshold);
+    printf("SCIP log: %.0f B/scan\n", log_bytes / scans);
+    printf("encoded: %.0f B/scan (keyframe %.0f B, delta %.0f B)\n",
+           static_cast<double>(keyframe_bytes + delta_bytes) / scans,
+           keyframes ? static_cast<double>(keyframe_bytes) / keyframes : 0.0,
+           deltas ? static_cast<double>(delta_bytes) / deltas : 0.0);
+    printf("max error: %ld mm, intensity %ld\n",
+           distance_error, intensity_error);
+
+    if ((undecoded_scans > 0) ||
+        (distance_error > parameter.distance_threshold) ||
+        (intensity_error > parameter.intensity_threshold)) {
+        fprintf(stderr, "%lu scans were not decoded within the thresholds.\n",
+                static_cast<unsigned long>(undecoded_scans));
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,23 @@
+TEMPLATE = app
+TARGET = scan_delta_bench
+QT -= gui core
+CONFIG += console
+CONFIG -= app_bundle qt
+DEPENDPATH += . ../.. ../common
+INCLUDEPATH += . ../.. ../common
+LIBS += -lpthread
+unix:!macx:LIBS += -lrt
+
+SOURCES += scan_delta_bench.cpp \
+        ../../Scan_delta_codec.cpp \
+        ../../Urg_driver.cpp \
+        ../../Urg_log_reader.cpp \
+        ../../Serial.cpp \
+        ../../Tcpip.cpp \
+        ../../connection_utils.cpp \
+        ../../scip_decode.cpp \
+        ../../Scip_stream_parser.cpp \
+        ../../Scan_frame.cpp
+
+unix:SOURCES += ../../Io_reactor.cpp \
+        ../../Uring_receiver.cpp
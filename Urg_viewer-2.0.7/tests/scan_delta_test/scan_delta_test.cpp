@@ -0,0 +1,256 @@
+/*!
+  \file
+  \brief Scan_delta_encoder, Scan_delta_decoder の動作確認
+
+  - 閾値が 0 のとき、keyframe と delta のどちらも元のスキャンに戻ること
+  - delta が欠落しても次のスキャンを復元し、keyframe が欠落したときは
+    次の keyframe まで復元せず、そこから復元を再開すること
+  - 閾値ちょうどの変化は送らず、閾値を超えた変化は送ること
+  - データの数が変わったときは keyframe にすること
+
+  を確認する。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "Scan_delta_codec.h"
+#include "Test_check.h"
+
+using namespace std;
+
+
+namespace
+{
+    enum {
+        Type = 2,
+        First_step = 0,
+        Group_steps = 1,
+        Echo_size = 1,
+        Steps = 1081,
+        Scan_msec = 25,
+        Scans = 50,
+        Keyframe_interval = 5,
+        Distance_threshold = 30,
+        Intensity_threshold = 100,
+    };
+
+    typedef struct
+    {
+        long timestamp;
+        vector<long> distance;
+        vector<unsigned short> intensity;
+    } scan_t;
+
+
+    // 距離には小さな揺らぎと、スキャン毎に動く物体を含める
+    scan_t make_scan(int index, size_t steps)
+    {
+        scan_t scan;
+        scan.timestamp = index * Scan_msec;
+        scan.distance.resize(steps);
+        scan.intensity.resize(steps);
+        for (size_t i = 0; i < steps; ++i) {
+            long noise = (rand() % 21) - 10;
+            bool is_target = (i >= static_cast<size_t>(index * 10)) &&
+                (i < static_cast<size_t>(index * 10 + 40));
+            scan.distance[i] = (is_target ? 1500 : 5000) + (i % 100) + noise;
+            scan.intensity[i] =
+                static_cast<unsigned short>((is_target ? 3000 : 1000) +
+                                            (rand() % 50));
+        }
+        return scan;
+    }
+
+
+    Scan_delta_encoder::parameter_t parameter(long distance_threshold,
+                                              long intensity_threshold)
+    {
+        Scan_delta_encoder::parameter_t parameter;
+        parameter.keyframe_interval = Keyframe_interval;
+        parameter.distance_threshold = distance_threshold;
+        parameter.intensity_threshold = intensity_threshold;
+        return parameter;
+    }
+
+
+    void encode(Scan_delta_encoder& encoder, vector<char>& output,
+                const scan_t& scan)
+    {
+        encoder.encode(output, Type, scan.timestamp, First_step, Group_steps,
+                       Echo_size, scan.distance, scan.intensity);
+    }
+
+
+    bool decode(Scan_delta_decoder& decoder, const vector<char>& data)
+    {
+        return decoder.decode(&data[0], data.size());
+    }
+
+
+    void test_roundtrip(void)
+    {
+        Scan_delta_encoder encoder;
+        encoder.set_parameter(parameter(0, 0));
+        Scan_delta_decoder decoder;
+        vector<char> data;
+
+        size_t keyframes = 0;
+        for (int i = 0; i < Scans; ++i) {
+            scan_t scan = make_scan(i, Steps);
+            encode(encoder, data, scan);
+            if (!check(decode(decoder, data), "roundtrip: scan %d", i)) {
+                continue;
+            }
+            keyframes += decoder.is_keyframe() ? 1 : 0;
+            check((decoder.sequence() == static_cast<unsigned long>(i)) &&
+                  (decoder.type() == Type) &&
+                  (decoder.timestamp() == scan.timestamp) &&
+                  (decoder.first_step() == First_step) &&
+                  (decoder.group_steps() == Group_steps) &&
+                  (decoder.echo_size() == Echo_size),
+                  "roundtrip: header of scan %d", i);
+            check((decoder.distance() == scan.distance) &&
+                  (decoder.intensity() == scan.intensity),
+                  "roundtrip: values of scan %d", i);
+        }
+        check(keyframes == Scans / Keyframe_interval,
+              "roundtrip: %lu keyframes",
+              static_cast<unsigned long>(keyframes));
+        check((decoder.lost_scans() == 0) && (decoder.undecodable_scans() == 0),
+              "roundtrip: lost or undecodable scans");
+    }
+
+
+    void test_resync(void)
+    {
+        Scan_delta_encoder encoder;
+        encoder.set_parameter(parameter(0, 0));
+        Scan_delta_decoder decoder;
+        vector<char> data;
+
+        // 2 番目の delta と、2 番目の keyframe を欠落させる
+        const int Lost_delta = 2;
+        const int Lost_keyframe = Keyframe_interval;
+        for (int i = 0; i < 3 * Keyframe_interval; ++i) {
+            scan_t scan = make_scan(i, Steps);
+            encode(encoder, data, scan);
+            if ((i == Lost_delta) || (i == Lost_keyframe)) {
+                continue;
+            }
+
+            bool is_decoded = decode(decoder, data);
+            bool is_undecodable =
+                (i > Lost_keyframe) && (i < 2 * Keyframe_interval);
+            if (is_undecodable) {
+                check(!is_decoded, "resync: scan %d was decoded", i);
+                continue;
+            }
+            check(is_decoded && (decoder.distance() == scan.distance) &&
+                  (decoder.intensity() == scan.intensity),
+                  "resync: scan %d", i);
+            if (i == 2 * Keyframe_interval) {
+                check(decoder.is_keyframe(), "resync: scan %d is a delta", i);
+            }
+        }
+        check(decoder.lost_scans() == 2, "resync: %lu lost scans",
+              static_cast<unsigned long>(decoder.lost_scans()));
+        check(decoder.undecodable_scans() == Keyframe_interval - 1,
+              "resync: %lu undecodable scans",
+              static_cast<unsigned long>(decoder.undecodable_scans()));
+    }
+
+
+    void test_threshold(void)
+    {
+        Scan_delta_encoder encoder;
+        encoder.set_parameter(parameter(Distance_threshold,
+                                        Intensity_threshold));
+        Scan_delta_decoder decoder;
+        vector<char> data;
+
+        scan_t key = make_scan(0, Steps);
+        encode(encoder, data, key);
+        check(decode(decoder, data) && decoder.is_keyframe(),
+              "threshold: keyframe");
+
+        scan_t scan = key;
+        scan.timestamp = Scan_msec;
+        scan.distance[10] += Distance_threshold;
+        scan.distance[20] -= Distance_threshold;
+        scan.distance[30] += Distance_threshold + 1;
+        scan.distance[40] -= Distance_threshold + 1;
+        scan.intensity[50] += Intensity_threshold;
+        scan.intensity[60] += Intensity_threshold + 1;
+        encode(encoder, data, scan);
+        if (!check(decode(decoder, data) && !decoder.is_keyframe(),
+                   "threshold: delta")) {
+            return;
+        }
+
+        const vector<long>& distance = decoder.distance();
+        const vector<unsigned short>& intensity = decoder.intensity();
+        check((distance[10] == key.distance[10]) &&
+              (distance[20] == key.distance[20]),
+              "threshold: a change of %d mm was sent", Distance_threshold);
+        check((distance[30] == scan.distance[30]) &&
+              (distance[40] == scan.distance[40]),
+              "threshold: a change of %d mm was not sent",
+              Distance_threshold + 1);
+        check(intensity[50] == key.intensity[50],
+              "threshold: an intensity change of %d was sent",
+              Intensity_threshold);
+        check(intensity[60] == scan.intensity[60],
+              "threshold: an intensity change of %d was not sent",
+              Intensity_threshold + 1);
+
+        // 閾値ちょうどの変化のみのときは、run を含まない
+        scan_t quiet = key;
+        quiet.distance[10] += Distance_threshold;
+        encode(encoder, data, quiet);
+        vector<char> unchanged;
+        encode(encoder, unchanged, key);
+        check(data.size() == unchanged.size(),
+              "threshold: %lu bytes for a change at the threshold",
+              static_cast<unsigned long>(data.size()));
+    }
+
+
+    void test_layout_change(void)
+    {
+        Scan_delta_encoder encoder;
+        Scan_delta_decoder decoder;
+        vector<char> data;
+
+        encode(encoder, data, make_scan(0, Steps));
+        encode(encoder, data, make_scan(1, Steps));
+        check(decode(decoder, data) == false,
+              "layout: a delta without its keyframe was decoded");
+
+        scan_t scan = make_scan(2, Steps / 2);
+        encode(encoder, data, scan);
+        check(decode(decoder, data) && decoder.is_keyframe() &&
+              (decoder.distance().size() == Steps / 2),
+              "layout: a resized scan was not a keyframe");
+
+        data.resize(data.size() / 2);
+        check(!decode(decoder, data), "layout: truncated data was decoded");
+    }
+}
+
+
+int main(void)
+{
+    srand(1);
+
+    test_roundtrip();
+    test_resync();
+    test_threshold();
+    test_layout_change();
+
+    return check_result();
+}
@@ -0,0 +1,10 @@
+TEMPLATE = app
+TARGET = scan_delta_test
+QT -= gui core
+CONFIG += console
+CONFIG -= app_bundle qt
+DEPENDPATH += . ../.. ../common
+INCLUDEPATH += . ../.. ../common
+
+SOURCES += scan_delta_test.cpp \
+        ../../Scan_delta_codec.cpp
@@ -0,0 +1,238 @@
+/*!
+  \file
+  \brief 受信ループがスキャン毎にメモリを確保しないことの確認
+
+  Receive_thread と同じ順に、Scan_frame_pool から取り出した Scan_frame に
+  ループバックの SCIP のセンサから MD のスキャンを受信し、Fanout_server
+  への送信、Csv_recorder への記録を行ってから、
+  描画側と同じく次のスキャンの受信後に戻す。
+
+  operator new を置き換え、ウォームアップ後の受信スレッドでの確保の
+  回数を数える。1 回でも確保したら失敗とする。Scan_frame は
+  posix_memalign() で確保するため、領域の先頭が変わらないことも確認する。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "Urg_driver.h"
+#include "Scan_frame.h"
+#include "Scan_frame_pool.h"
+#include "Fanout_server.h"
+#include "Csv_recorder.h"
+#include "Scan_setting.h"
+#include "Scip_stand_in.h"
+#include "Test_check.h"
+
+using namespace hrk;
+using namespace std;
+
+
+namespace
+{
+    enum {
+        Warmup_scans = 20,
+        Scans = 120,
+        Pool_frames = Scan_frame_pool::Default_frames,
+    };
+
+    pthread_t counted_thread;
+    volatile bool is_counting = false;
+    volatile size_t allocations = 0;
+
+    void* allocate(size_t size)
+    {
+        if (is_counting && pthread_equal(pthread_self(), counted_thread)) {
+            ++allocations;
+        }
+        void* p = malloc((size > 0) ? size : 1);
+        if (!p) {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+
+
+    // Fanout_server のクライアント。受信したデータは読み捨てる
+    int connect_client(long port)
+    {
+        int client = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(static_cast<unsigned short>(port));
+        if ((client < 0) ||
+            (connect(client, reinterpret_cast<struct sockaddr*>(&address),
+                     sizeof(address)) != 0)) {
+            return -1;
+        }
+        return client;
+    }
+
+
+    void drain(int client)
+    {
+        char buffer[16 * 1024];
+        while (recv(client, buffer, sizeof(buffer), MSG_DONTWAIT) > 0) {
+            ;
+        }
+    }
+
+
+    // 空いているポートを探す
+    long free_port(void)
+    {
+        Loopback_server server;
+        return server.listen() ? server.port() : 0;
+    }
+}
+
+
+void* operator new(size_t size) throw(std::bad_alloc)
+{
+    return allocate(size);
+}
+
+
+void* operator new[](size_t size) throw(std::bad_alloc)
+{
+    return allocate(size);
+}
+
+
+void operator delete(void* p) throw()
+{
+    free(p);
+}
+
+
+void operator delete[](void* p) throw()
+{
+    free(p);
+}
+
+
+int main(void)
+{
+    counted_thread = pthread_self();
+
+    Scip_stand_in sensor(Scans);
+    if (!sensor.start()) {
+        fprintf(stderr, "Scip_stand_in: could not listen.\n");
+        return 1;
+    }
+
+    Urg_driver urg;
+    if (!urg.open("127.0.0.1", sensor.port(), Urg_driver::Ethernet) ||
+        !urg.start_measurement(Lidar::Distance)) {
+        fprintf(stderr, "Urg_driver: %s\n", urg.what());
+        return 1;
+    }
+
+    Fanout_server fanout_server;
+    long port = free_port();
+    if (!fanout_server.listen(port)) {
+        fprintf(stderr, "Fanout_server: %s\n", fanout_server.what().c_str());
+        return 1;
+    }
+    fanout_server.start();
+    int client = connect_client(port);
+    for (int i = 0; (i < 100) && (fanout_server.clients() == 0); ++i) {
+        usleep(10 * 1000);
+    }
+    check((client >= 0) && (fanout_server.clients() == 1),
+          "Fanout_server client");
+
+    Scan_setting setting;
+    setting.first_step = urg.min_step();
+    setting.last_step = urg.max_step();
+    setting.group_steps = 1;
+    setting.with_intensity = false;
+    setting.is_multiecho = false;
+    Csv_recorder csv_recorder;
+    csv_recorder.set_scan_setting(urg.sensor_product_type(), setting, 1);
+
+    Scan_frame_pool frame_pool(Pool_frames);
+    frame_pool.reserve(urg.max_data_size(), 1, false);
+
+    Scan_frame* shown_frame = NULL;
+    const uint32_t* frame_memory[Pool_frames] = { NULL };
+    Scan_frame* frames[Pool_frames] = { NULL };
+    size_t invalid_scans = 0;
+    size_t moved_frames = 0;
+
+    for (int i = 0; i < Scans; ++i) {
+        if (i == Warmup_scans) {
+            is_counting = true;
+        }
+
+        Scan_frame* frame = frame_pool.acquire();
+        if (!frame) {
+            check(false, "Scan_frame_pool::acquire()");
+            break;
+        }
+        if (!urg.get_scan(*frame)) {
+            check(false, "Urg_driver: %s", urg.what());
+            frame_pool.release(frame);
+            break;
+        }
+        if ((frame->size() != Scip_stand_in::Steps) ||
+            (frame->distance()[frame->size() - 1] !=
+             Scip_stand_in::First_distance + Scip_stand_in::Steps - 1)) {
+            ++invalid_scans;
+        }
+
+        // 取り出した Scan_frame の領域が確保し直されていないか
+        for (size_t k = 0; k < Pool_frames; ++k) {
+            if (!frames[k] || (frames[k] == frame)) {
+                if (frames[k] && (frame_memory[k] != frame->distance())) {
+                    ++moved_frames;
+                }
+                frames[k] = frame;
+                frame_memory[k] = frame->distance();
+                break;
+            }
+        }
+
+        if (i >= Warmup_scans) {
+            csv_recorder.set_receive_data(*frame);
+        }
+
+        fanout_server.push_scan(frame->type, *frame, frame->sensor_timestamp);
+        drain(client);
+
+        // 描画側は、次のスキャンを受け取るまで Scan_frame を保持する
+        frame_pool.release(shown_frame);
+        shown_frame = frame;
+    }
+    is_counting = false;
+    frame_pool.release(shown_frame);
+
+    check(fanout_server.evicted_clients() == 0, "Fanout_server eviction");
+    fanout_server.stop();
+    fanout_server.wait();
+    close(client);
+    urg.stop_measurement();
+    urg.close();
+    sensor.stop();
+
+    printf("%lu allocations in %d scans after %d warm-up scans.\n",
+           static_cast<unsigned long>(allocations),
+           Scans - Warmup_scans, Warmup_scans);
+    check(invalid_scans == 0, "invalid scan");
+    check(moved_frames == 0, "Scan_frame was reallocated");
+    check(allocations == 0, "allocation in the receive loop");
+
+    return check_result();
+}
@@ -0,0 +1,26 @@
+TEMPLATE = app
+TARGET = scan_frame_pool_test
+QT -= gui
+CONFIG += console
+CONFIG -= app_bundle
+DEPENDPATH += . ../.. ../common
+INCLUDEPATH += . ../.. ../common
+LIBS += -lpthread
+unix:!macx:LIBS += -lrt
+
+SOURCES += scan_frame_pool_test.cpp \
+        ../../Urg_driver.cpp \
+        ../../Urg_log_reader.cpp \
+        ../../Serial.cpp \
+        ../../Tcpip.cpp \
+        ../../connection_utils.cpp \
+        ../../scip_decode.cpp \
+        ../../Scip_stream_parser.cpp \
+        ../../Scan_frame.cpp \
+        ../../Scan_frame_pool.cpp \
+        ../../Fanout_server.cpp \
+        ../../Csv_recorder.cpp \
+        ../../ip/posix/NetworkingUtils.cpp
+
+unix:SOURCES += ../../Io_reactor.cpp \
+        ../../Uring_receiver.cpp
@@ -0,0 +1,101 @@
+/*!
+  \file
+  \brief scip_decode3(), scip_checksum() の実装毎の処理時間の計測
+
+  UTM-30LX の 1 スキャン (1081 ステップ、3 文字エンコード) を、
+  Urg_driver::decode_scip() と各実装でデコードし、64 byte の行毎の
+  チェックサムを計算する。1 スキャン当たりの時間を出力する。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include "scip_decode.h"
+#include "Urg_driver.h"
+#include "Bench_timer.h"
+
+using namespace hrk;
+using namespace std;
+
+
+namespace
+{
+    enum {
+        Steps = 1081,
+        Line_size = 64,
+        Repeat = 20000,
+    };
+
+
+    double decode_scip_usec(const vector<char>& data, vector<int>& values)
+    {
+        double first = now_sec();
+        for (int n = 0; n < Repeat; ++n) {
+            for (int i = 0; i < Steps; ++i) {
+                values[i] = Urg_driver::decode_scip(&data[i * 3], 3);
+            }
+        }
+        return (now_sec() - first) * 1000000.0 / Repeat;
+    }
+
+
+    double decode3_usec(const vector<char>& data, vector<int>& values)
+    {
+        double first = now_sec();
+        for (int n = 0; n < Repeat; ++n) {
+            scip_decode3(&data[0], Steps, &values[0]);
+        }
+        return (now_sec() - first) * 1000000.0 / Repeat;
+    }
+
+
+    double checksum_usec(const vector<char>& data, int& sum)
+    {
+        int size = static_cast<int>(data.size());
+        double first = now_sec();
+        for (int n = 0; n < Repeat; ++n) {
+            for (int i = 0; i < size; i += Line_size) {
+                int line_size = min(static_cast<int>(Line_size), size - i);
+                sum += scip_checksum(&data[i], line_size);
+            }
+        }
+        return (now_sec() - first) * 1000000.0 / Repeat;
+    }
+}
+
+
+int main(void)
+{
+    vector<char> data(Steps * 3);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<char>(0x30 + (rand() % 0x40));
+    }
+    vector<int> values(Steps);
+    int sum = 0;
+
+    printf("decode_scip: decode %.2f us/scan\n",
+           decode_scip_usec(data, values));
+    sum += values[Steps - 1];
+
+    const scip_kernel_t kernels[] = {
+        Scip_scalar_kernel, Scip_sse2_kernel, Scip_avx2_kernel,
+    };
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); ++i) {
+        if (!scip_set_kernel(kernels[i])) {
+            continue;
+        }
+        double decode = decode3_usec(data, values);
+        sum += values[Steps - 1];
+        double checksum = checksum_usec(data, sum);
+        printf("%s: decode %.2f us/scan, checksum %.2f us/scan\n",
+               scip_kernel_name(), decode, checksum);
+    }
+    printf("(%d)\n", sum);
+
+    return 0;
+}
@@ -0,0 +1,21 @@
+TEMPLATE = app
+TARGET = scip_decode_bench
+QT -= gui core
+CONFIG += console
+CONFIG -= app_bundle qt
+DEPENDPATH += . ../.. ../common
+INCLUDEPATH += . ../.. ../common
+unix:!macx:LIBS += -lrt
+
+SOURCES += scip_decode_bench.cpp \
+        ../../scip_decode.cpp \
+        ../../Urg_driver.cpp \
+        ../../Urg_log_reader.cpp \
+        ../../Serial.cpp \
+        ../../Tcpip.cpp \
+        ../../connection_utils.cpp \
+        ../../Scip_stream_parser.cpp \
+        ../../Scan_frame.cpp
+
+unix:SOURCES += ../../Io_reactor.cpp \
+        ../../Uring_receiver.cpp
@@ -0,0 +1,189 @@
+/*!
+  \file
+  \brief scip_decode2(), scip_decode3(), scip_checksum() の実装毎の動作確認
+
+  CPU が対応している全ての実装について、ランダムなデータの
+  デコード結果を Urg_driver::decode_scip() と、チェックサムを
+  SCIP 仕様書の計算と比較する。データの長さと先頭のアドレスの
+  ずれも変える。Scan_frame の配列へのデコードは、距離のみ、強度付き、
+  強度を格納しない場合を確認する。
+
+  乱数の種を引数で指定できる。失敗したときは、その種を出力する。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+#include "scip_decode.h"
+#include "Urg_driver.h"
+#include "Test_check.h"
+
+using namespace hrk;
+using namespace std;
+
+
+namespace
+{
+    enum {
+        Trials = 5000,
+        Max_values = 1200,
+        Max_offset = 32,
+    };
+
+
+    char reference_checksum(const char data[], int size)
+    {
+        unsigned char sum = 0x00;
+        for (int i = 0; i < size; ++i) {
+            sum += data[i];
+        }
+        return (sum & 0x3f) + 0x30;
+    }
+
+
+    // SCIP の文字 (0x30 - 0x6f) か、任意の byte でデータを埋める
+    void fill_random(vector<char>& data, bool is_scip_character)
+    {
+        for (size_t i = 0; i < data.size(); ++i) {
+            data[i] = static_cast<char>(is_scip_character ?
+                                        (0x30 + (rand() % 0x40)) :
+                                        (rand() % 0x100));
+        }
+    }
+
+
+    // 範囲外に書き込まないことも確認する
+    bool check_values(const char* name, int byte, const char* data,
+                      int values_size, vector<int>& values)
+    {
+        const int Guard = 0x5a5a5a5a;
+        values[values_size] = Guard;
+        if (byte == 2) {
+            scip_decode2(data, values_size, &values[0]);
+        } else {
+            scip_decode3(data, values_size, &values[0]);
+        }
+        for (int i = 0; i < values_size; ++i) {
+            long expected = Urg_driver::decode_scip(&data[i * byte], byte);
+            if (!check(values[i] == expected,
+                       "%s decode%d: size %d, index %d: %d != %ld", name,
+                       byte, values_size, i, values[i], expected)) {
+                return false;
+            }
+        }
+        return check(values[values_size] == Guard,
+                     "%s decode%d wrote past the end", name, byte);
+    }
+
+
+    // Scan_frame の配列へのデコード。intensity が NULL でも確認する
+    bool check_frame(const char* name, int byte, int stride,
+                     bool with_intensity, const char* data, int steps)
+    {
+        const uint32_t Length_guard = 0x5a5a5a5a;
+        const uint16_t Intensity_guard = 0x5a5a;
+        vector<uint32_t> length(steps + 1, Length_guard);
+        vector<uint16_t> intensity(steps + 1, Intensity_guard);
+        uint16_t* intensity_p = with_intensity ? &intensity[0] : NULL;
+        if (byte == 2) {
+            scip_decode2(data, steps, stride, &length[0], intensity_p);
+        } else {
+            scip_decode3(data, steps, stride, &length[0], intensity_p);
+        }
+
+        for (int i = 0; i < steps; ++i) {
+            const char* p = &data[i * stride * byte];
+            uint32_t expected =
+                static_cast<uint32_t>(Urg_driver::decode_scip(p, byte));
+            uint16_t expected_intensity = Intensity_guard;
+            if ((stride == 2) && with_intensity) {
+                expected_intensity = static_cast<uint16_t>(
+                    Urg_driver::decode_scip(p + byte, byte));
+            }
+            if (!check((length[i] == expected) &&
+                       (intensity[i] == expected_intensity),
+                       "%s decode%d, stride %d, intensity %d: steps %d, "
+                       "index %d", name, byte, stride, with_intensity,
+                       steps, i)) {
+                return false;
+            }
+        }
+        return check((length[steps] == Length_guard) &&
+                     (intensity[steps] == Intensity_guard),
+                     "%s decode%d, stride %d wrote past the end", name,
+                     byte, stride);
+    }
+
+
+    void check_kernel(scip_kernel_t kernel, const char* label,
+                      unsigned int seed)
+    {
+        if (!scip_set_kernel(kernel)) {
+            printf("%s: not supported by this CPU\n", label);
+            return;
+        }
+        const char* name = scip_kernel_name();
+        size_t tested = 0;
+
+        vector<char> buffer((Max_values * 3) + Max_offset);
+        vector<int> values(Max_values + 1);
+        for (int trial = 0; trial < Trials; ++trial) {
+            fill_random(buffer, (trial % 4) != 0);
+            int offset = rand() % Max_offset;
+            int values_size = rand() % Max_values;
+            const char* data = &buffer[offset];
+
+            bool is_decoded = true;
+            for (int byte = 2; is_decoded && (byte <= 3); ++byte) {
+                is_decoded =
+                    check_values(name, byte, data, values_size, values) &&
+                    check_frame(name, byte, 1, true, data, values_size) &&
+                    check_frame(name, byte, 2, true, data, values_size / 2) &&
+                    check_frame(name, byte, 2, false, data, values_size / 2);
+            }
+            if (!is_decoded) {
+                fprintf(stderr, "seed %u, trial %d, offset %d\n",
+                        seed, trial, offset);
+                return;
+            }
+
+            int checksum_size = rand() % (values_size * 3 + 1);
+            char checksum = scip_checksum(data, checksum_size);
+            char expected = reference_checksum(data, checksum_size);
+            if (!check(checksum == expected,
+                       "%s checksum: seed %u, trial %d, offset %d, "
+                       "size %d: %c != %c", name, seed, trial, offset,
+                       checksum_size, checksum, expected)) {
+                return;
+            }
+            ++tested;
+        }
+        printf("%s: %lu trials\n", name, static_cast<unsigned long>(tested));
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    unsigned int seed = (argc > 1) ?
+        static_cast<unsigned int>(strtoul(argv[1], NULL, 0)) :
+        static_cast<unsigned int>(time(NULL));
+    printf("seed: %u\n", seed);
+
+    const scip_kernel_t kernels[] = {
+        Scip_scalar_kernel, Scip_sse2_kernel, Scip_avx2_kernel,
+    };
+    const char* labels[] = { "scalar", "sse2", "avx2" };
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); ++i) {
+        srand(seed);
+        check_kernel(kernels[i], labels[i], seed);
+    }
+    scip_set_kernel(Scip_auto_kernel);
+
+    return check_result();
+}
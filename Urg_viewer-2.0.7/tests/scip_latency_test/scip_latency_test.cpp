@@ -0,0 +1,106 @@
+/*!
+  \file
+  \brief 受信から距離データの取得までの遅延の確認
+
+  ループバックの SCIP のセンサに Urg_driver で接続し、MD で受信した
+  スキャン毎に、データが届いてから get_distance() が戻るまでの時間と、
+  センサが送信してから戻るまでの時間を計測する。到着から取得までの
+  中央値が 1 msec を越えたら失敗とする。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+#include "Urg_driver.h"
+#include "Scip_stand_in.h"
+#include "Test_check.h"
+
+using namespace hrk;
+using namespace std;
+
+
+namespace
+{
+    enum {
+        Scans = 200,
+        Max_median_usec = 1000,
+    };
+
+
+    void print(const char* title, vector<double>& usec)
+    {
+        sort(usec.begin(), usec.end());
+        printf("%s: median %.1f us, 99%% %.1f us, max %.1f us\n", title,
+               usec[usec.size() / 2], usec[(usec.size() * 99) / 100],
+               usec.back());
+    }
+}
+
+
+int main(void)
+{
+    Scip_stand_in sensor(Scans);
+    if (!sensor.start()) {
+        fprintf(stderr, "Scip_stand_in: could not listen.\n");
+        return 1;
+    }
+
+    Urg_driver urg;
+    if (!urg.open("127.0.0.1", sensor.port(), Urg_driver::Ethernet)) {
+        fprintf(stderr, "Urg_driver: %s\n", urg.what());
+        return 1;
+    }
+    if (!urg.start_measurement(Lidar::Distance)) {
+        fprintf(stderr, "Urg_driver: %s\n", urg.what());
+        return 1;
+    }
+
+    vector<long> distance;
+    vector<double> arrival_usec;
+    vector<double> sent_usec;
+    size_t invalid_scans = 0;
+    for (int i = 0; i < Scans; ++i) {
+        long time_stamp = 0;
+        long long arrival_time = 0;
+        if (!urg.get_distance(distance, &time_stamp, &arrival_time)) {
+            fprintf(stderr, "Urg_driver: %s\n", urg.what());
+            return 1;
+        }
+        long long decoded_time = Scip_stand_in::now();
+
+        if ((distance.size() != Scip_stand_in::Steps) ||
+            (distance.back() != Scip_stand_in::First_distance +
+             Scip_stand_in::Steps - 1)) {
+            ++invalid_scans;
+            continue;
+        }
+        if (arrival_time > 0) {
+            arrival_usec.push_back((decoded_time - arrival_time) / 1000.0);
+        }
+        long long sent_time =
+            sensor.sent_time(time_stamp / Scip_stand_in::Scan_msec);
+        if (sent_time > 0) {
+            sent_usec.push_back((decoded_time - sent_time) / 1000.0);
+        }
+    }
+    urg.stop_measurement();
+    urg.close();
+    sensor.stop();
+
+    if (!check((invalid_scans == 0) && !arrival_usec.empty() &&
+               !sent_usec.empty(), "%lu invalid scans, %lu arrival times.",
+               static_cast<unsigned long>(invalid_scans),
+               static_cast<unsigned long>(arrival_usec.size()))) {
+        return check_result();
+    }
+
+    print("arrival to decode", arrival_usec);
+    print("send to decode", sent_usec);
+    check(arrival_usec[arrival_usec.size() / 2] <= Max_median_usec,
+          "arrival to decode is over %d us.", Max_median_usec);
+    return check_result();
+}
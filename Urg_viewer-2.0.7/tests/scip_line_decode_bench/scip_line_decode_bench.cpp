@@ -0,0 +1,162 @@
+/*!
+  \file
+  \brief Scip_stream_parser の計測の種類毎のデコードの処理時間の計測
+
+  UTM-30LX の 1081 ステップの GD, GE, GS, HD, HE の応答を 1000 スキャン
+  並べ、4 KiB 毎に Scip_stream_parser::push() に渡したときの 1 スキャン
+  当たりの時間を、値毎に分岐する scip_generic_decode() と比較する。
+  Scip_stream_parser は long の配列と Scan_frame と同じ uint32_t の
+  配列のそれぞれに格納する。
+  デコードした値が期待する値と一致することも確認する。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "Scip_stream_parser.h"
+#include "Scip_scan_data.h"
+#include "Bench_timer.h"
+#include "Test_check.h"
+
+using namespace hrk;
+using namespace std;
+
+
+namespace
+{
+    enum {
+        Steps = 1081,
+        Scans = 1000,
+        Chunk_size = 4096,
+        Repeat = 5,
+    };
+
+
+    class Counter : public Scip_stream_parser::Handler
+    {
+    public:
+        size_t responses;
+        size_t invalid_responses;
+
+        Counter(void) : responses(0), invalid_responses(0)
+        {
+        }
+
+
+        void response_received(const Scip_stream_parser::response_t& response)
+        {
+            ++responses;
+            if ((response.error != Scip_stream_parser::No_error) ||
+                (response.steps != Steps)) {
+                ++invalid_responses;
+            }
+        }
+    };
+
+
+    template <typename Length, typename Intensity>
+    bool is_expected(const Scip_scan_data& scan, const vector<Length>& length,
+                     const vector<Intensity>& intensity)
+    {
+        for (size_t i = 0; i < scan.distance().size(); ++i) {
+            if ((length[i] != static_cast<Length>(scan.distance()[i])) ||
+                (scan.has_intensity() &&
+                 (intensity[i] != scan.intensity()[i]))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+
+    // 4 KiB 毎に push() したときの 1 スキャン当たりの時間
+    template <typename Length, typename Intensity>
+    double parse_usec(const char* command, const Scip_scan_data& scan,
+                      const string& stream)
+    {
+        size_t max_size = Steps * scan.echo_size();
+        vector<Length> length(max_size, 0);
+        vector<Intensity> intensity(max_size, 0);
+        Counter counter;
+        Scip_stream_parser parser(counter);
+        parser.set_output(&length[0], &intensity[0], max_size);
+
+        double first = now_sec();
+        for (int n = 0; n < Repeat; ++n) {
+            for (size_t i = 0; i < stream.size(); i += Chunk_size) {
+                const char* data = stream.data() + i;
+                size_t size = min(static_cast<size_t>(Chunk_size),
+                                  stream.size() - i);
+                while (size > 0) {
+                    size_t parsed = parser.push(data, size);
+                    data += parsed;
+                    size -= parsed;
+                }
+            }
+        }
+        double usec = (now_sec() - first) * 1000000.0 / (Repeat * Scans);
+        check((counter.responses == static_cast<size_t>(Scans * Repeat)) &&
+              (counter.invalid_responses == 0) &&
+              is_expected(scan, length, intensity),
+              "%s: Scip_stream_parser, %lu byte output", command,
+              static_cast<unsigned long>(sizeof(Length)));
+        return usec;
+    }
+
+
+    void measure(const char* command)
+    {
+        Scip_scan_data scan(command, Steps, 0);
+        string response = scan.response();
+        string stream;
+        stream.reserve(response.size() * Scans);
+        for (int i = 0; i < Scans; ++i) {
+            stream += response;
+        }
+
+        size_t max_size = Steps * scan.echo_size();
+        vector<long> length(max_size);
+        vector<unsigned short> intensity(max_size);
+
+        int steps = 0;
+        double first = now_sec();
+        for (int n = 0; n < Repeat; ++n) {
+            for (int i = 0; i < Scans; ++i) {
+                steps += scip_generic_decode(response.data(), response.size(),
+                                             &length[0], &intensity[0],
+                                             max_size,
+                                             Scip_scan_data::Max_echo_size);
+            }
+        }
+        double generic_usec =
+            (now_sec() - first) * 1000000.0 / (Repeat * Scans);
+        check((steps == Steps * Scans * Repeat) &&
+              is_expected(scan, length, intensity),
+              "%s: scip_generic_decode()", command);
+
+        double parser_usec =
+            parse_usec<long, unsigned short>(command, scan, stream);
+        double frame_usec =
+            parse_usec<uint32_t, uint16_t>(command, scan, stream);
+
+        printf("%s: %lu byte/scan, generic %.2f us/scan, "
+               "parser %.2f us/scan, Scan_frame %.2f us/scan\n", command,
+               static_cast<unsigned long>(response.size()),
+               generic_usec, parser_usec, frame_usec);
+    }
+}
+
+
+int main(void)
+{
+    const char* commands[] = { "GD", "GE", "GS", "HD", "HE" };
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); ++i) {
+        measure(commands[i]);
+    }
+    return check_result();
+}
@@ -0,0 +1,396 @@
+/*!
+  \file
+  \brief Scip_stream_parser の受信データの区切り毎の動作確認
+
+  GD, GE, GS, HD, HE の応答を 1 byte 毎、乱数の長さ毎、4 KiB 毎に区切って
+  push() に渡し、デコードした値が scip_generic_decode() と同じ期待値に
+  なることを確認する。チェックサムの不一致、格納先のあふれ、MD の "00" の
+  応答と "99b" の応答が同じ区切りに含まれる場合、Max_line_size より
+  長い行も確認する。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "Scip_stream_parser.h"
+#include "Scip_scan_data.h"
+#include "Test_check.h"
+
+using namespace hrk;
+using namespace std;
+
+
+namespace
+{
+    enum {
+        Steps = 1081,
+        Scans = 3,
+        Max_random_chunk = 300,
+        Page_chunk = 4096,
+        Long_line_size = 2000,
+    };
+
+    typedef enum {
+        One_byte,
+        Random_size,
+        Page_size,
+    } split_t;
+
+    const char* split_names[] = { "1 byte", "random", "4 KiB" };
+
+
+    //! 受信した応答と、そのときの格納先の値
+    struct received_t
+    {
+        string echo;
+        string status;
+        bool is_scan;
+        Lidar::measurement_t type;
+        long time_stamp;
+        int steps;
+        Scip_stream_parser::error_t error;
+        vector<long> length;
+        vector<unsigned short> intensity;
+    };
+
+
+    class Recorder : public Scip_stream_parser::Handler
+    {
+    public:
+        vector<received_t> responses;
+
+        Recorder(void) : length_(NULL), intensity_(NULL),
+                         length32_(NULL), intensity16_(NULL), size_(0)
+        {
+        }
+
+
+        void set_output(Scip_stream_parser& parser, long* length,
+                        unsigned short* intensity, size_t size)
+        {
+            parser.set_output(length, intensity, size);
+            length_ = length;
+            intensity_ = intensity;
+            length32_ = NULL;
+            intensity16_ = NULL;
+            size_ = size;
+        }
+
+
+        void set_output(Scip_stream_parser& parser, uint32_t* length,
+                        uint16_t* intensity, size_t size)
+        {
+            parser.set_output(length, intensity, size);
+            length_ = NULL;
+            intensity_ = NULL;
+            length32_ = length;
+            intensity16_ = intensity;
+            size_ = size;
+        }
+
+
+        void response_received(const Scip_stream_parser::response_t& response)
+        {
+            received_t received;
+            received.echo = response.echo;
+            received.status = response.status;
+            received.is_scan = response.is_scan;
+            received.type = response.type;
+            received.time_stamp = response.time_stamp;
+            received.steps = response.steps;
+            received.error = response.error;
+            for (size_t i = 0; i < size_; ++i) {
+                received.length.push_back(length32_ ? length32_[i] :
+                                          length_[i]);
+                received.intensity.push_back(intensity16_ ? intensity16_[i] :
+                                             intensity_[i]);
+            }
+            responses.push_back(received);
+        }
+
+    private:
+        long* length_;
+        unsigned short* intensity_;
+        uint32_t* length32_;
+        uint16_t* intensity16_;
+        size_t size_;
+    };
+
+
+    size_t chunk_size(split_t split)
+    {
+        switch (split) {
+        case One_byte:
+            return 1;
+        case Random_size:
+            return 1 + (rand() % Max_random_chunk);
+        case Page_size:
+            return Page_chunk;
+        }
+        return 1;
+    }
+
+
+    // push() は応答毎に戻るため、区切りを解析し終えるまで呼び出す
+    void feed(Scip_stream_parser& parser, const string& stream,
+              split_t split)
+    {
+        for (size_t i = 0; i < stream.size();) {
+            size_t size = min(chunk_size(split), stream.size() - i);
+            const char* data = stream.data() + i;
+            i += size;
+            while (size > 0) {
+                size_t parsed = parser.push(data, size);
+                data += parsed;
+                size -= parsed;
+            }
+        }
+    }
+
+
+    bool is_expected(const received_t& received, const Scip_scan_data& scan)
+    {
+        if ((received.error != Scip_stream_parser::No_error) ||
+            !received.is_scan || (received.steps != scan.steps()) ||
+            (received.length.size() < scan.distance().size())) {
+            return false;
+        }
+        if (!equal(scan.distance().begin(), scan.distance().end(),
+                   received.length.begin())) {
+            return false;
+        }
+        return !scan.has_intensity() ||
+            equal(scan.intensity().begin(), scan.intensity().end(),
+                  received.intensity.begin());
+    }
+
+
+    template <typename Length, typename Intensity>
+    void check_split(const char* command, split_t split)
+    {
+        vector<Scip_scan_data> scans;
+        string stream;
+        for (int i = 0; i < Scans; ++i) {
+            scans.push_back(Scip_scan_data(command, Steps, 100 + (i * 25)));
+            stream += scans.back().response();
+        }
+
+        size_t max_size = Steps * Scip_scan_data::Max_echo_size;
+        vector<Length> length(max_size);
+        vector<Intensity> intensity(max_size);
+        Recorder recorder;
+        Scip_stream_parser parser(recorder);
+        recorder.set_output(parser, &length[0], &intensity[0], max_size);
+        feed(parser, stream, split);
+
+        const char* output = (sizeof(Length) == sizeof(uint32_t)) ?
+            "uint32_t" : "long";
+        if (!check(recorder.responses.size() == Scans,
+                   "%s, %s, %s: %lu responses", command, split_names[split],
+                   output,
+                   static_cast<unsigned long>(recorder.responses.size()))) {
+            return;
+        }
+        for (int i = 0; i < Scans; ++i) {
+            const received_t& received = recorder.responses[i];
+            check(is_expected(received, scans[i]) &&
+                  (received.time_stamp == 100 + (i * 25)) &&
+                  (received.echo == scans[i].response().substr(0, 12)),
+                  "%s, %s, %s: scan %d", command, split_names[split],
+                  output, i);
+        }
+        check(!parser.is_receiving(), "%s, %s, %s: is_receiving()",
+              command, split_names[split], output);
+    }
+
+
+    void check_splits(void)
+    {
+        const char* commands[] = { "GD", "GE", "GS", "HD", "HE" };
+        const split_t splits[] = { One_byte, Random_size, Page_size };
+        for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); ++i) {
+            for (size_t k = 0; k < sizeof(splits) / sizeof(splits[0]); ++k) {
+                check_split<long, unsigned short>(commands[i], splits[k]);
+                check_split<uint32_t, uint16_t>(commands[i], splits[k]);
+            }
+        }
+    }
+
+
+    void check_checksum_error(split_t split)
+    {
+        Scip_scan_data first("GE", Steps, 0);
+        Scip_scan_data second("GE", Steps, 25);
+        Scip_scan_data third("GE", Steps, 50);
+        string broken = second.response();
+
+        // 2 行目のデータ行の 1 文字を、範囲内の別の文字に変える
+        size_t line_head = 0;
+        for (int i = 0; i < 4; ++i) {
+            line_head = broken.find('\n', line_head) + 1;
+        }
+        char& c = broken[line_head + 10];
+        c = (c == '0') ? '1' : '0';
+
+        size_t max_size = Steps;
+        vector<long> length(max_size);
+        vector<unsigned short> intensity(max_size);
+        Recorder recorder;
+        Scip_stream_parser parser(recorder);
+        recorder.set_output(parser, &length[0], &intensity[0], max_size);
+        feed(parser, first.response() + broken + third.response(), split);
+
+        const vector<received_t>& responses = recorder.responses;
+        if (!check(responses.size() == 3, "checksum, %s: %lu responses",
+                   split_names[split],
+                   static_cast<unsigned long>(responses.size()))) {
+            return;
+        }
+        check(is_expected(responses[0], first),
+              "checksum, %s: scan before the error", split_names[split]);
+        check(responses[1].error == Scip_stream_parser::Checksum_error,
+              "checksum, %s: error %d", split_names[split],
+              responses[1].error);
+        check(is_expected(responses[2], third),
+              "checksum, %s: scan after the error", split_names[split]);
+    }
+
+
+    void check_overflow_error(split_t split)
+    {
+        // 格納先が 1 スキャンより小さい
+        Scip_scan_data scan("GD", Steps, 0);
+        Scip_scan_data next("GD", Steps, 25);
+        vector<long> length(Steps);
+        vector<unsigned short> intensity(Steps);
+        Recorder recorder;
+        Scip_stream_parser parser(recorder);
+        recorder.set_output(parser, &length[0], &intensity[0], Steps - 1);
+        feed(parser, scan.response(), split);
+        recorder.set_output(parser, &length[0], &intensity[0], Steps);
+        feed(parser, next.response(), split);
+
+        if (check(recorder.responses.size() == 2,
+                  "overflow, %s: %lu responses", split_names[split],
+                  static_cast<unsigned long>(recorder.responses.size()))) {
+            check(recorder.responses[0].error ==
+                  Scip_stream_parser::Overflow_error,
+                  "overflow, %s: error %d", split_names[split],
+                  recorder.responses[0].error);
+            check(is_expected(recorder.responses[1], next),
+                  "overflow, %s: scan after the error", split_names[split]);
+        }
+
+        // 格納できるエコーの数より多いエコー
+        Scip_scan_data multiecho("HD", Steps, 0);
+        Recorder echo_recorder;
+        Scip_stream_parser single_echo_parser(echo_recorder, 1);
+        echo_recorder.set_output(single_echo_parser, &length[0],
+                                 &intensity[0], Steps);
+        feed(single_echo_parser, multiecho.response(), split);
+        check((echo_recorder.responses.size() == 1) &&
+              (echo_recorder.responses[0].error ==
+               Scip_stream_parser::Overflow_error),
+              "overflow, %s: multiecho", split_names[split]);
+    }
+
+
+    void check_md_acknowledge(void)
+    {
+        // MD の "00" の応答と、最初のスキャンの "99b" の応答を 1 度に渡す
+        Scip_scan_data scan("GD", Steps, 1234);
+        string echo = "MD0000108000000";
+        string stream = echo + '\n' + Scip_scan_data::line("00") + '\n' +
+            echo + '\n' + Scip_scan_data::line("99") + scan.body();
+
+        vector<long> length(Steps);
+        vector<unsigned short> intensity(Steps);
+        Recorder recorder;
+        Scip_stream_parser parser(recorder);
+        recorder.set_output(parser, &length[0], &intensity[0], Steps);
+        size_t parsed = parser.push(stream.data(), stream.size());
+        check((recorder.responses.size() == 1) &&
+              (parsed < stream.size()), "MD ack: push() did not return");
+        while (parsed < stream.size()) {
+            parsed += parser.push(stream.data() + parsed,
+                                  stream.size() - parsed);
+        }
+
+        const vector<received_t>& responses = recorder.responses;
+        if (!check(responses.size() == 2, "MD ack: %lu responses",
+                   static_cast<unsigned long>(responses.size()))) {
+            return;
+        }
+        check((responses[0].echo == echo) && (responses[0].status == "00") &&
+              !responses[0].is_scan &&
+              (responses[0].error == Scip_stream_parser::No_error),
+              "MD ack: \"00\" response");
+        check((responses[1].echo == echo) && (responses[1].status == "99") &&
+              (responses[1].time_stamp == 1234) &&
+              is_expected(responses[1], scan), "MD ack: \"99b\" response");
+    }
+
+
+    void check_long_line(split_t split)
+    {
+        // Max_line_size を超えるデータ行を含む応答
+        Scip_scan_data scan("GD", Steps, 0);
+        Scip_scan_data next("GD", Steps, 25);
+        string response = scan.response();
+        size_t line_head = 0;
+        for (int i = 0; i < 3; ++i) {
+            line_head = response.find('\n', line_head) + 1;
+        }
+        response.insert(line_head,
+                        Scip_scan_data::line(string(Long_line_size, '0')));
+
+        vector<long> length(Steps);
+        vector<unsigned short> intensity(Steps);
+        Recorder recorder;
+        Scip_stream_parser parser(recorder);
+        recorder.set_output(parser, &length[0], &intensity[0], Steps);
+        feed(parser, response + next.response(), split);
+
+        const vector<received_t>& responses = recorder.responses;
+        if (!check(responses.size() == 2, "long line, %s: %lu responses",
+                   split_names[split],
+                   static_cast<unsigned long>(responses.size()))) {
+            return;
+        }
+        check(responses[0].error == Scip_stream_parser::Line_length_error,
+              "long line, %s: error %d", split_names[split],
+              responses[0].error);
+        check(is_expected(responses[1], next),
+              "long line, %s: scan after the error", split_names[split]);
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    unsigned int seed = (argc > 1) ?
+        static_cast<unsigned int>(strtoul(argv[1], NULL, 0)) :
+        static_cast<unsigned int>(time(NULL));
+    printf("seed: %u\n", seed);
+    srand(seed);
+
+    check_splits();
+    check_checksum_error(One_byte);
+    check_checksum_error(Random_size);
+    check_checksum_error(Page_size);
+    check_overflow_error(One_byte);
+    check_overflow_error(Random_size);
+    check_overflow_error(Page_size);
+    check_md_acknowledge();
+    check_long_line(One_byte);
+    check_long_line(Random_size);
+
+    return check_result();
+}
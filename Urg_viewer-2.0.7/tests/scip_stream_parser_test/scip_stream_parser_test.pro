@@ -0,0 +1,11 @@
+TEMPLATE = app
+TARGET = scip_stream_parser_test
+QT -= gui core
+CONFIG += console
+CONFIG -= app_bundle qt
+DEPENDPATH += . ../.. ../common
+INCLUDEPATH += . ../.. ../common
+
+SOURCES += scip_stream_parser_test.cpp \
+        ../../Scip_stream_parser.cpp \
+        ../../scip_decode.cpp
@@ -0,0 +1,185 @@
+/*!
+  \file
+  \brief 表に無いボーレートの指定の動作確認
+
+  擬似端末を Serial で開き、表に無いボーレートを指定する。ioctl() を
+  置き換えて TCSETS2 を拒否させ、ASYNC_SPD_CUST の分周比で指定する
+  経路と、分周比でも指定できないときに失敗することを確認する。
+  擬似端末は TIOCGSERIAL に対応しないため、分周比の経路では
+  serial_struct の読み書きも置き換える。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+#include "Serial.h"
+#include "Pty_server.h"
+#include "Test_check.h"
+
+using namespace hrk;
+using namespace std;
+
+
+namespace
+{
+    // Serial_linux.cpp と同じく、<asm/termbits.h> の定義をここで行う
+    struct termios2_t
+    {
+        tcflag_t c_iflag;
+        tcflag_t c_oflag;
+        tcflag_t c_cflag;
+        tcflag_t c_lflag;
+        cc_t c_line;
+        cc_t c_cc[19];
+        speed_t c_ispeed;
+        speed_t c_ospeed;
+    };
+
+    enum {
+        Termios2_get = _IOR('T', 0x2A, termios2_t),
+        Termios2_set = _IOW('T', 0x2B, termios2_t),
+        Custom_baudrate = 250000,
+        Ftdi_baud_base = 24000000,
+        Uart_baud_base = 115200,
+    };
+
+    typedef int (*ioctl_t)(int, unsigned long, ...);
+
+    bool is_termios2_rejected = false;
+    bool is_serial_emulated = false;
+    struct serial_struct emulated_serial;
+    size_t termios2_set_calls = 0;
+
+
+    ioctl_t real_ioctl(void)
+    {
+        static ioctl_t function =
+            reinterpret_cast<ioctl_t>(dlsym(RTLD_NEXT, "ioctl"));
+        return function;
+    }
+
+
+    void emulate_serial(int baud_base)
+    {
+        is_serial_emulated = true;
+        memset(&emulated_serial, 0, sizeof(emulated_serial));
+        emulated_serial.baud_base = baud_base;
+    }
+
+
+    // 端末に設定されている出力のボーレート
+    speed_t termios2_speed(const char* device)
+    {
+        termios2_t tio;
+        int fd = open(device, O_RDWR | O_NOCTTY);
+        if ((fd < 0) || (real_ioctl()(fd, Termios2_get, &tio) < 0)) {
+            tio.c_ospeed = 0;
+        }
+        close(fd);
+        return tio.c_ospeed;
+    }
+
+
+    speed_t termios_speed(const char* device)
+    {
+        struct termios tio;
+        int fd = open(device, O_RDWR | O_NOCTTY);
+        speed_t speed = B0;
+        if ((fd >= 0) && (tcgetattr(fd, &tio) == 0)) {
+            speed = cfgetospeed(&tio);
+        }
+        close(fd);
+        return speed;
+    }
+}
+
+
+extern "C" int ioctl(int fd, unsigned long request, ...) throw()
+{
+    va_list args;
+    va_start(args, request);
+    void* argument = va_arg(args, void*);
+    va_end(args);
+
+    if (request == static_cast<unsigned long>(Termios2_set)) {
+        ++termios2_set_calls;
+        if (is_termios2_rejected) {
+            errno = EINVAL;
+            return -1;
+        }
+    } else if (is_serial_emulated && (request == TIOCGSERIAL)) {
+        memcpy(argument, &emulated_serial, sizeof(emulated_serial));
+        return 0;
+    } else if (is_serial_emulated && (request == TIOCSSERIAL)) {
+        memcpy(&emulated_serial, argument, sizeof(emulated_serial));
+        return 0;
+    }
+    return real_ioctl()(fd, request, argument);
+}
+
+
+int main(void)
+{
+    Pty_server pty;
+    if (!pty.listen()) {
+        fprintf(stderr, "Pty_server: could not open.\n");
+        return 1;
+    }
+    const char* device = pty.device();
+    Serial serial;
+
+    // TCSETS2/BOTHER で指定できる
+    bool is_opened = serial.open(device, Custom_baudrate);
+    check(is_opened, "TCSETS2: %s", serial.what());
+    check(termios2_set_calls > 0, "TCSETS2 was not called");
+    check(termios2_speed(device) == Custom_baudrate,
+          "TCSETS2: %u bps", static_cast<unsigned>(termios2_speed(device)));
+    serial.close();
+
+    // TCSETS2 を拒否し、TIOCGSERIAL にも対応しない
+    is_termios2_rejected = true;
+    is_opened = serial.open(device, Custom_baudrate);
+    check(!is_opened, "no fallback: opened");
+    check(!strcmp(serial.what(), "invalid baudrate."),
+          "no fallback: %s", serial.what());
+    check(serial.open(device, 115200), "table baudrate: %s", serial.what());
+    serial.close();
+
+    // TCSETS2 を拒否し、分周比で指定する
+    emulate_serial(Ftdi_baud_base);
+    is_opened = serial.open(device, Custom_baudrate);
+    check(is_opened, "divisor: %s", serial.what());
+    check((emulated_serial.flags & ASYNC_SPD_MASK) == ASYNC_SPD_CUST,
+          "divisor: ASYNC_SPD_CUST was not set");
+    check(emulated_serial.custom_divisor == Ftdi_baud_base / Custom_baudrate,
+          "divisor: %d", emulated_serial.custom_divisor);
+    check(termios_speed(device) == B38400, "divisor: B38400 was not set");
+
+    // 表のボーレートに戻すと、分周比の指定を解除する
+    check(serial.change_baudrate(115200), "table baudrate: %s", serial.what());
+    check((emulated_serial.flags & ASYNC_SPD_MASK) == 0,
+          "table baudrate: ASYNC_SPD_CUST remains");
+    check(termios_speed(device) == B115200, "table baudrate: B115200");
+    serial.close();
+
+    // 分周比では誤差が大きすぎる
+    emulate_serial(Uart_baud_base);
+    is_opened = serial.open(device, Custom_baudrate);
+    check(!is_opened, "divisor error: opened");
+    check((emulated_serial.flags & ASYNC_SPD_MASK) == 0,
+          "divisor error: ASYNC_SPD_CUST was set");
+    serial.close();
+
+    return check_result();
+}
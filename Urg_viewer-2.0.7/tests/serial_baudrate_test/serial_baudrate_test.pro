@@ -0,0 +1,14 @@
+TEMPLATE = app
+TARGET = serial_baudrate_test
+QT -= gui core
+CONFIG += console
+CONFIG -= app_bundle qt
+DEPENDPATH += . ../.. ../common
+INCLUDEPATH += . ../.. ../common
+LIBS += -lpthread -ldl
+unix:!macx:LIBS += -lrt
+
+SOURCES += serial_baudrate_test.cpp \
+        ../../Serial.cpp \
+        ../../Io_reactor.cpp
+
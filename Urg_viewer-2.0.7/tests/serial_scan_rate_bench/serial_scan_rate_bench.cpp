@@ -0,0 +1,124 @@
+/*!
+  \file
+  \brief 擬似端末のセンサから受信できるスキャン数の計測
+
+  擬似端末の SCIP のセンサに Urg_driver でシリアル接続し、MD の
+  スキャンを待たずに続けて送信させて、1 秒当たりに受信できたスキャン数と
+  1 スキャン当たりの CPU 時間を出力する。センサは Chunk_size byte ずつ
+  書き込み、シリアルの受信のように細切れに届ける。
+
+  115200 bps の標準のプロファイルと、SS で指定できて表に無い 750000 bps
+  (TCSETS2/BOTHER) の Low_latency_profile で計測する。擬似端末には
+  ボーレートや USB の受信遅延が無いため、受信側の処理だけの比較になる。
+  タイムスタンプの抜けが無いことも確認する。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Urg_driver.h"
+#include "Serial.h"
+#include "Scip_stand_in.h"
+#include "Bench_timer.h"
+
+using namespace hrk;
+using namespace std;
+
+
+namespace
+{
+    enum {
+        Scans = 300,
+        Chunk_size = 512,
+    };
+
+    typedef struct
+    {
+        const char* title;
+        long baudrate;
+        Serial::serial_profile_t profile;
+    } setting_t;
+
+
+    bool measure(const setting_t& setting)
+    {
+        Pty_scip_stand_in sensor(Scans);
+        sensor.set_scan_msec(0);
+        sensor.server().set_chunk_size(Chunk_size);
+        if (!sensor.start()) {
+            fprintf(stderr, "Pty_scip_stand_in: could not open.\n");
+            return false;
+        }
+
+        Serial::set_serial_profile(setting.profile);
+        Urg_driver urg;
+        if (!urg.open(sensor.device(), setting.baudrate, Urg_driver::Serial) ||
+            !urg.start_measurement(Lidar::Distance, Scans)) {
+            fprintf(stderr, "Urg_driver: %s\n", urg.what());
+            return false;
+        }
+
+        vector<long> distance;
+        size_t lost_scans = 0;
+        long next_index = -1;
+        double first_sec = now_sec();
+        double first_cpu_sec = cpu_sec();
+        int received = 0;
+        for (; received < Scans; ++received) {
+            long time_stamp = 0;
+            if (!urg.get_distance(distance, &time_stamp)) {
+                fprintf(stderr, "Urg_driver: %s\n", urg.what());
+                break;
+            }
+            long index = time_stamp / Pty_scip_stand_in::Scan_msec;
+            if ((next_index >= 0) && (index != next_index)) {
+                ++lost_scans;
+            }
+            next_index = index + 1;
+        }
+        double sec = now_sec() - first_sec;
+        double used_cpu_sec = cpu_sec() - first_cpu_sec;
+        urg.stop_measurement();
+        urg.close();
+        sensor.stop();
+
+        // 115200 bps 以外は、SS でセンサのボーレートを変更している
+        vector<string> commands = sensor.commands();
+        char ss_command[16];
+        snprintf(ss_command, sizeof(ss_command), "SS%06ld", setting.baudrate);
+        bool is_changed = (setting.baudrate == 115200);
+        for (size_t i = 0; i < commands.size(); ++i) {
+            is_changed |= (commands[i] == ss_command);
+        }
+        if (!is_changed) {
+            fprintf(stderr, "%s: SS was not sent.\n", setting.title);
+        }
+
+        printf("%s: %d scans, %.0f scans/s, %.1f us cpu/scan, "
+               "%lu lost scans\n", setting.title, received,
+               received / sec, used_cpu_sec * 1000000.0 / received,
+               static_cast<unsigned long>(lost_scans));
+        return (received == Scans) && (lost_scans == 0) && is_changed;
+    }
+}
+
+
+int main(void)
+{
+    setting_t settings[] = {
+        { "115200, default profile", 115200, Serial::Default_profile },
+        { "750000, low-latency profile", 750000,
+          Serial::Low_latency_profile },
+    };
+
+    bool is_valid = true;
+    size_t n = sizeof(settings) / sizeof(settings[0]);
+    for (size_t i = 0; i < n; ++i) {
+        is_valid &= measure(settings[i]);
+    }
+    return is_valid ? 0 : 1;
+}
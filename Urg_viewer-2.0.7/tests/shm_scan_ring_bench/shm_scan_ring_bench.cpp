@@ -0,0 +1,191 @@
+/*!
+  \file
+  \brief 共有メモリのリングバッファの遅延と処理時間の計測
+
+  子プロセスで読み出し、書き込みから読み出しまでの遅延の平均、
+  99% 値、最大を出力する。また、同じプロセス内で書き込み、コピーする
+  読み出し (read_next)、コピーしない読み出し (peek_next) の 1 スキャン
+  当たりの処理時間を出力する。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "Shm_scan_ring.h"
+#include "Bench_timer.h"
+
+using namespace std;
+
+
+namespace
+{
+    enum {
+        Slots = 16,
+        Steps = 1081,
+        Echo_size = 3,
+        Latency_scans = 5000,
+        Latency_interval_usec = 1000,
+        Throughput_scans = 20000,
+        End_timestamp = -1,
+    };
+
+
+    // 書き込みから peek_next() で参照できるまでの時間を記録する
+    int read_latency(const char* name)
+    {
+        Shm_scan_reader reader;
+        if (!reader.open(name)) {
+            fprintf(stderr, "Shm_scan_reader: %s\n", reader.what());
+            return 1;
+        }
+
+        vector<double> latency;
+        latency.reserve(Latency_scans);
+        size_t torn = 0;
+        while (true) {
+            shm_scan_view_t view;
+            if (!reader.peek_next(view)) {
+                sched_yield();
+                continue;
+            }
+            double received = now_sec();
+            if (view.sensor_timestamp == End_timestamp) {
+                break;
+            }
+            long sum = 0;
+            for (size_t i = 0; i < view.distance_size; ++i) {
+                sum += view.distance[i];
+            }
+            if (!reader.is_intact(view) ||
+                (sum != static_cast<long>(view.distance_size) *
+                 view.sensor_timestamp)) {
+                ++torn;
+                continue;
+            }
+            latency.push_back(received - view.host_second);
+        }
+
+        if (latency.empty()) {
+            fprintf(stderr, "no scans received.\n");
+            return 1;
+        }
+        double total = 0.0;
+        for (size_t i = 0; i < latency.size(); ++i) {
+            total += latency[i];
+        }
+        double average = total / latency.size();
+        sort(latency.begin(), latency.end());
+        printf("latency: %lu scans, average %.1f us, 99%% %.1f us, "
+               "max %.1f us, dropped %lu, torn %lu\n",
+               static_cast<unsigned long>(latency.size()),
+               average * 1000000.0,
+               latency[(latency.size() * 99) / 100] * 1000000.0,
+               latency.back() * 1000000.0,
+               static_cast<unsigned long>(reader.dropped_scans()),
+               static_cast<unsigned long>(torn));
+
+        // _exit() では出力がフラッシュされない
+        fflush(stdout);
+        return 0;
+    }
+
+
+    void fill(vector<long>& distance, long timestamp)
+    {
+        fill(distance.begin(), distance.end(), timestamp);
+    }
+
+
+    void measure_latency(Shm_scan_writer& writer, const char* name)
+    {
+        fflush(stdout);
+        pid_t child = fork();
+        if (child == 0) {
+            _exit(read_latency(name));
+        }
+
+        // 読み出し側が接続するまで待つ
+        usleep(100 * 1000);
+        vector<long> distance(Steps * Echo_size);
+        vector<unsigned short> intensity;
+        for (long i = 0; i < Latency_scans; ++i) {
+            fill(distance, i);
+            writer.write(0, Echo_size, 0, 1, distance, intensity, i);
+            usleep(Latency_interval_usec);
+        }
+        writer.write(0, Echo_size, 0, 1, distance, intensity, End_timestamp);
+
+        int status = 0;
+        waitpid(child, &status, 0);
+    }
+
+
+    void measure_throughput(Shm_scan_writer& writer, const char* name)
+    {
+        Shm_scan_reader reader;
+        if (!reader.open(name)) {
+            fprintf(stderr, "Shm_scan_reader: %s\n", reader.what());
+            return;
+        }
+
+        vector<long> distance(Steps * Echo_size);
+        vector<unsigned short> intensity(Steps * Echo_size);
+        shm_scan_t scan;
+        shm_scan_view_t view;
+        double write_sec = 0.0;
+        double copy_sec = 0.0;
+        double peek_sec = 0.0;
+        long sum = 0;
+        for (long i = 0; i < Throughput_scans; ++i) {
+            fill(distance, i);
+            double first = now_sec();
+            writer.write(0, Echo_size, 0, 1, distance, intensity, i);
+            double second = now_sec();
+            if ((i & 1) == 0) {
+                reader.read_next(scan);
+                sum += scan.distance.back();
+                copy_sec += now_sec() - second;
+            } else {
+                reader.peek_next(view);
+                sum += view.distance[view.distance_size - 1];
+                reader.is_intact(view);
+                peek_sec += now_sec() - second;
+            }
+            write_sec += second - first;
+        }
+
+        size_t half = Throughput_scans / 2;
+        printf("write: %.2f us/scan, read_next: %.2f us/scan, "
+               "peek_next: %.2f us/scan (%ld)\n",
+               write_sec * 1000000.0 / Throughput_scans,
+               copy_sec * 1000000.0 / half, peek_sec * 1000000.0 / half,
+               sum);
+    }
+}
+
+
+int main(void)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/urg_shm_scan_bench_%d",
+             static_cast<int>(getpid()));
+
+    Shm_scan_writer writer;
+    if (!writer.open(name, Slots, Steps * Echo_size)) {
+        fprintf(stderr, "Shm_scan_writer: %s\n", writer.what());
+        return 1;
+    }
+    printf("%d values/scan, %d slots\n", Steps * Echo_size, Slots);
+
+    measure_latency(writer, name);
+    measure_throughput(writer, name);
+
+    return 0;
+}
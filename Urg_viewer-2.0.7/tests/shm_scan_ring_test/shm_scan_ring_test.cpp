@@ -0,0 +1,140 @@
+/*!
+  \file
+  \brief Shm_scan_writer と Shm_scan_reader の動作確認
+
+  読み出し側が、上書きされたスキャンの読み飛ばし、書き込み側の再オープン、
+  データ配置の変更、共有メモリの作り直しに追従できることを確認する。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "Shm_scan_ring.h"
+#include "Test_check.h"
+
+using namespace std;
+
+
+namespace
+{
+    enum {
+        Slots = 4,
+        Steps = 1081,
+        Echo_size = 3,
+    };
+
+
+    void write_scan(Shm_scan_writer& writer, size_t steps, long timestamp)
+    {
+        vector<long> distance(steps);
+        vector<unsigned short> intensity(steps);
+        for (size_t i = 0; i < steps; ++i) {
+            distance[i] = timestamp + i;
+            intensity[i] = static_cast<unsigned short>(i);
+        }
+        writer.write(0, 1, 0, 1, distance, intensity, timestamp);
+    }
+
+
+    bool is_scan(const shm_scan_t& scan, size_t steps, long timestamp)
+    {
+        if ((scan.sensor_timestamp != timestamp) ||
+            (scan.distance.size() != steps) ||
+            (scan.intensity.size() != steps)) {
+            return false;
+        }
+        for (size_t i = 0; i < steps; ++i) {
+            if ((scan.distance[i] != static_cast<long>(timestamp + i)) ||
+                (scan.intensity[i] != static_cast<unsigned short>(i))) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+
+int main(void)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/urg_shm_scan_test_%d",
+             static_cast<int>(getpid()));
+
+    Shm_scan_writer writer;
+    if (!writer.open(name, Slots, Steps * Echo_size)) {
+        fprintf(stderr, "Shm_scan_writer: %s\n", writer.what());
+        return 1;
+    }
+    Shm_scan_reader reader;
+    if (!reader.open(name)) {
+        fprintf(stderr, "Shm_scan_reader: %s\n", reader.what());
+        return 1;
+    }
+
+    shm_scan_t scan;
+    check(!reader.read_next(scan), "empty ring");
+
+    // 順に読み出す
+    for (long i = 0; i < 3; ++i) {
+        write_scan(writer, Steps, 100 + i);
+    }
+    for (long i = 0; i < 3; ++i) {
+        check(reader.read_next(scan) && is_scan(scan, Steps, 100 + i),
+              "read_next");
+    }
+    check(!reader.read_next(scan), "no more scans");
+
+    // 上書きされたスキャンは読み飛ばす
+    for (long i = 0; i < 10; ++i) {
+        write_scan(writer, Steps, 200 + i);
+    }
+    for (long i = 10 - Slots; i < 10; ++i) {
+        check(reader.read_next(scan) && is_scan(scan, Steps, 200 + i),
+              "read_next after overrun");
+    }
+    check(reader.dropped_scans() == 10 - Slots, "dropped_scans");
+
+    // 共有メモリ上のスキャンをコピーせずに参照する
+    write_scan(writer, Steps, 300);
+    shm_scan_view_t view;
+    check(reader.peek_latest(view) && (view.sensor_timestamp == 300) &&
+          (view.distance_size == Steps) && (view.distance[Steps - 1] ==
+                                              300 + Steps - 1) &&
+          reader.is_intact(view), "peek_latest");
+    for (long i = 0; i < Slots; ++i) {
+        write_scan(writer, Steps, 400 + i);
+    }
+    check(!reader.is_intact(view), "overwritten view");
+
+    // 同じ設定で開き直しても、読み出し側はそのまま読み出しを続ける
+    check(reader.peek_latest(view), "peek_latest before reopen");
+    check(writer.open(name, Slots, Steps * Echo_size), "reopen");
+    write_scan(writer, Steps, 500);
+    check(reader.is_intact(view), "view after reopen");
+    check(reader.read_next(scan) && is_scan(scan, Steps, 500),
+          "read_next after reopen");
+
+    // 配置を変えたら、読み出し側は新しい世代を先頭から読み出す
+    check(writer.open(name, Slots * 2, Steps), "change layout");
+    check(!reader.is_intact(view), "view after layout change");
+    write_scan(writer, Steps, 600);
+    check(reader.read_next(scan) && is_scan(scan, Steps, 600) &&
+          (scan.sequence == 0), "read_next after layout change");
+
+    // 削除して作り直した共有メモリに接続し直す
+    writer.close();
+    check(!reader.read_next(scan), "read_next after close");
+    Shm_scan_writer next_writer;
+    check(next_writer.open(name, Slots, Steps), "create again");
+    write_scan(next_writer, Steps / 2, 700);
+    check(reader.read_next(scan) && is_scan(scan, Steps / 2, 700),
+          "read_next after create again");
+    next_writer.close();
+
+    return check_result();
+}
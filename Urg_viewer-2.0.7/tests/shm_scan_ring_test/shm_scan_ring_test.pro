@@ -0,0 +1,13 @@
+TEMPLATE = app
+TARGET = shm_scan_ring_test
+QT -= gui core
+CONFIG += console
+CONFIG -= app_bundle qt
+DEPENDPATH += . ../.. ../common
+INCLUDEPATH += . ../.. ../common
+
+LIBS += -L../../shm_scan_reader -lurg_shm_scan
+unix:!macx:LIBS += -lrt
+PRE_TARGETDEPS += ../../shm_scan_reader/liburg_shm_scan.a
+
+SOURCES += shm_scan_ring_test.cpp
@@ -0,0 +1,248 @@
+/*!
+  \file
+  \brief 1 スキャンの受信に使うシステムコールの回数の計測
+
+  SCIP のセンサにループバックの TCP と擬似端末で Urg_driver から接続し、
+  MD の 1 スキャンを get_distance() で受け取るまでに、受信待ちと
+  受信のシステムコールを何回呼んだかを出力する。
+
+  リンク時に -Wl,--wrap で recv(), recvmsg(), read(), select(), poll(),
+  epoll_wait(), setsockopt() を置き換え、Urg_driver を呼ぶスレッドでの
+  呼び出しのみを数える。センサのスレッドでの呼び出しは数えない。
+
+  - TCP: Tcp_scans スキャンを Tcp_segment_size byte のセグメントで送信
+  - 擬似端末: Pty_scans スキャンを Pty_chunk_size byte ずつ書き込む
+
+  センサはスキャンを Scan_msec 毎に送信し、受信側が受信待ちに戻るように
+  する。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstdio>
+#include <vector>
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include "Urg_driver.h"
+#include "Scip_stand_in.h"
+
+using namespace hrk;
+using namespace std;
+
+
+namespace
+{
+    enum {
+        Scan_msec = 1,
+        Tcp_scans = 2000,
+        Tcp_segment_size = 1448,
+        Pty_scans = 300,
+        Pty_chunk_size = 512,
+        Tcpip_baudrate = 0,
+        Serial_baudrate = 115200,
+    };
+
+    enum {
+        Recv,
+        Recvmsg,
+        Read,
+        Select,
+        Poll,
+        Epoll_wait,
+        Setsockopt,
+        Syscall_types,
+    };
+
+    const char* syscall_names[] = {
+        "recv", "recvmsg", "read", "select", "poll", "epoll_wait",
+        "setsockopt",
+    };
+
+    pthread_t counted_thread;
+    volatile bool is_counting = false;
+    size_t syscalls[Syscall_types];
+
+
+    void count(int type)
+    {
+        if (is_counting && pthread_equal(pthread_self(), counted_thread)) {
+            ++syscalls[type];
+        }
+    }
+
+
+    // 1 スキャン目を受信してから数え始める
+    template <class Sensor>
+    bool measure(const char* title, Sensor& sensor, Urg_driver& urg,
+                 int scans)
+    {
+        vector<long> distance;
+        size_t invalid_scans = 0;
+        for (int i = 0; i < Syscall_types; ++i) {
+            syscalls[i] = 0;
+        }
+
+        for (int i = 0; i < scans; ++i) {
+            if (!urg.get_distance(distance)) {
+                fprintf(stderr, "%s: %s\n", title, urg.what());
+                is_counting = false;
+                return false;
+            }
+            if (distance.size() != Sensor::Steps) {
+                ++invalid_scans;
+            }
+            is_counting = true;
+        }
+        is_counting = false;
+        urg.stop_measurement();
+        urg.close();
+        sensor.stop();
+
+        size_t total = 0;
+        for (int i = 0; i < Syscall_types; ++i) {
+            total += syscalls[i];
+        }
+        int counted_scans = scans - 1;
+        printf("%s: %.1f syscalls/scan (", title,
+               static_cast<double>(total) / counted_scans);
+        const char* separator = "";
+        for (int i = 0; i < Syscall_types; ++i) {
+            if (syscalls[i] > 0) {
+                printf("%s%s %.1f", separator, syscall_names[i],
+                       static_cast<double>(syscalls[i]) / counted_scans);
+                separator = ", ";
+            }
+        }
+        printf(")\n");
+
+        if (invalid_scans > 0) {
+            fprintf(stderr, "%s: %lu invalid scans.\n", title,
+                    static_cast<unsigned long>(invalid_scans));
+            return false;
+        }
+        return true;
+    }
+
+
+    bool measure_tcpip(void)
+    {
+        Scip_stand_in sensor(Tcp_scans);
+        sensor.set_scan_msec(Scan_msec);
+        sensor.server().set_chunk_size(Tcp_segment_size);
+        if (!sensor.start()) {
+            fprintf(stderr, "Scip_stand_in: could not listen.\n");
+            return false;
+        }
+
+        Urg_driver urg;
+        if (!urg.open("127.0.0.1", sensor.port(), Urg_driver::Ethernet) ||
+            !urg.start_measurement(Lidar::Distance, Tcp_scans)) {
+            fprintf(stderr, "Tcpip: %s\n", urg.what());
+            return false;
+        }
+        return measure("Tcpip", sensor, urg, Tcp_scans);
+    }
+
+
+    bool measure_serial(void)
+    {
+        Pty_scip_stand_in sensor(Pty_scans);
+        sensor.set_scan_msec(Scan_msec);
+        sensor.server().set_chunk_size(Pty_chunk_size);
+        if (!sensor.start()) {
+            fprintf(stderr, "Pty_scip_stand_in: could not open.\n");
+            return false;
+        }
+
+        Urg_driver urg;
+        if (!urg.open(sensor.device(), Serial_baudrate, Urg_driver::Serial) ||
+            !urg.start_measurement(Lidar::Distance, Pty_scans)) {
+            fprintf(stderr, "Serial: %s\n", urg.what());
+            return false;
+        }
+        return measure("Serial", sensor, urg, Pty_scans);
+    }
+}
+
+
+extern "C"
+{
+    ssize_t __real_recv(int fd, void* buffer, size_t size, int flags);
+    ssize_t __real_recvmsg(int fd, struct msghdr* message, int flags);
+    ssize_t __real_read(int fd, void* buffer, size_t size);
+    int __real_select(int n, fd_set* read_fds, fd_set* write_fds,
+                      fd_set* except_fds, struct timeval* timeout);
+    int __real_poll(struct pollfd* fds, nfds_t n, int timeout);
+    int __real_epoll_wait(int epoll_fd, struct epoll_event* events,
+                          int max_events, int timeout);
+    int __real_setsockopt(int fd, int level, int name, const void* value,
+                          socklen_t size);
+
+
+    ssize_t __wrap_recv(int fd, void* buffer, size_t size, int flags)
+    {
+        count(Recv);
+        return __real_recv(fd, buffer, size, flags);
+    }
+
+
+    ssize_t __wrap_recvmsg(int fd, struct msghdr* message, int flags)
+    {
+        count(Recvmsg);
+        return __real_recvmsg(fd, message, flags);
+    }
+
+
+    ssize_t __wrap_read(int fd, void* buffer, size_t size)
+    {
+        count(Read);
+        return __real_read(fd, buffer, size);
+    }
+
+
+    int __wrap_select(int n, fd_set* read_fds, fd_set* write_fds,
+                      fd_set* except_fds, struct timeval* timeout)
+    {
+        count(Select);
+        return __real_select(n, read_fds, write_fds, except_fds, timeout);
+    }
+
+
+    int __wrap_poll(struct pollfd* fds, nfds_t n, int timeout)
+    {
+        count(Poll);
+        return __real_poll(fds, n, timeout);
+    }
+
+
+    int __wrap_epoll_wait(int epoll_fd, struct epoll_event* events,
+                          int max_events, int timeout)
+    {
+        count(Epoll_wait);
+        return __real_epoll_wait(epoll_fd, events, max_events, timeout);
+    }
+
+
+    int __wrap_setsockopt(int fd, int level, int name, const void* value,
+                          socklen_t size)
+    {
+        count(Setsockopt);
+        return __real_setsockopt(fd, level, name, value, size);
+    }
+}
+
+
+int main(void)
+{
+    counted_thread = pthread_self();
+
+    bool is_valid = measure_tcpip();
+    is_valid &= measure_serial();
+    return is_valid ? 0 : 1;
+}
@@ -0,0 +1,26 @@
+TEMPLATE = app
+TARGET = syscalls_per_scan_bench
+QT -= gui core
+CONFIG += console
+CONFIG -= app_bundle qt
+DEPENDPATH += . ../.. ../common
+INCLUDEPATH += . ../.. ../common
+LIBS += -lpthread
+unix:!macx:LIBS += -lrt
+
+# 受信待ちと受信のシステムコールを数える
+QMAKE_LFLAGS += -Wl,--wrap=recv,--wrap=recvmsg,--wrap=read,--wrap=select \
+        -Wl,--wrap=poll,--wrap=epoll_wait,--wrap=setsockopt
+
+SOURCES += syscalls_per_scan_bench.cpp \
+        ../../Urg_driver.cpp \
+        ../../Urg_log_reader.cpp \
+        ../../Serial.cpp \
+        ../../Tcpip.cpp \
+        ../../connection_utils.cpp \
+        ../../scip_decode.cpp \
+        ../../Scip_stream_parser.cpp \
+        ../../Scan_frame.cpp
+
+unix:SOURCES += ../../Io_reactor.cpp \
+        ../../Uring_receiver.cpp
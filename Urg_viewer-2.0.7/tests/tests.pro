@@ -0,0 +1,34 @@
+######################################################################
+# テストとベンチマーク
+#
+# qmake && make でビルドし、各ディレクトリに生成された実行ファイルを
+# 実行する。*_test は失敗したときに 0 以外を返す。
+######################################################################
+
+TEMPLATE = subdirs
+CONFIG += ordered
+
+unix:SUBDIRS += ../shm_scan_reader \
+        shm_scan_ring_test \
+        shm_scan_ring_bench \
+        arrival_log_test \
+        ring_buffer_test \
+        ring_buffer_bench \
+        scip_latency_test \
+        pipelined_startup_test \
+        connection_cache_test \
+        serial_scan_rate_bench \
+        scan_frame_pool_test \
+        scip_decode_test \
+        scip_decode_bench \
+        scip_line_decode_bench \
+        scip_stream_parser_test \
+        osc_framing_bench \
+        scan_delta_test \
+        scan_delta_bench \
+        tracker_replay_bench \
+        uring_receive_bench
+
+# ioctl() の置き換えと GNU ld の --wrap を使うため、Linux のみ
+unix:!macx:SUBDIRS += serial_baudrate_test \
+        syscalls_per_scan_bench
@@ -0,0 +1,302 @@
+/*!
+  \file
+  \brief URG ログを再生した、blob 検出と追跡の処理時間の計測
+
+  ログを Urg_driver で再生し、スキャン毎に Blob_detector と
+  Target_tracker を実行する。1 スキャンの処理時間の平均と最大、
+  1 秒当たりに更新したトラック数を出力する。
+
+  ログを指定しないときは、50 個の物体が等速で動く UTM-30LX の
+  ログを生成して再生する。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <time.h>
+#include "Urg_driver.h"
+#include "Urg_log_reader.h"
+#include "Scan_frame.h"
+#include "Blob_detector.h"
+#include "Target_tracker.h"
+#include "scip_decode.h"
+
+using namespace hrk;
+using namespace std;
+
+
+namespace
+{
+    enum {
+        Targets = 50,
+        Generated_scans = 2000,
+        Scan_msec = 25,
+        Steps = 1081,
+        Front_step = 540,
+        Area_resolution = 1440,
+        Wall_mm = 12000,
+    };
+
+    const char* Generated_log_file = "tracker_replay_bench.log";
+    const double Target_radius_mm = 120.0;
+
+
+    typedef struct
+    {
+        double x;
+        double y;
+        double vx;
+        double vy;
+    } target_t;
+
+
+    long long now_nsec(void)
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (static_cast<long long>(ts.tv_sec) * 1000000000LL) + ts.tv_nsec;
+    }
+
+
+    string encode(long value, int size)
+    {
+        string encoded;
+        for (int i = size - 1; i >= 0; --i) {
+            encoded += static_cast<char>(((value >> (6 * i)) & 0x3f) + 0x30);
+        }
+        return encoded;
+    }
+
+
+    string scip_line(const string& data)
+    {
+        return data + scip_checksum(data.data(), data.size()) + "\n";
+    }
+
+
+    // センサから見た、最も近い物体までの距離
+    long ray_distance(const vector<target_t>& targets, double radian)
+    {
+        double dx = cos(radian);
+        double dy = sin(radian);
+        double nearest = Wall_mm;
+        for (vector<target_t>::const_iterator it = targets.begin();
+             it != targets.end(); ++it) {
+            double along = (it->x * dx) + (it->y * dy);
+            if (along <= 0.0) {
+                continue;
+            }
+            double cross = (it->x * dy) - (it->y * dx);
+            double r2 = Target_radius_mm * Target_radius_mm;
+            if ((cross * cross) > r2) {
+                continue;
+            }
+            double distance = along - sqrt(r2 - (cross * cross));
+            if (distance < nearest) {
+                nearest = distance;
+            }
+        }
+        return static_cast<long>(nearest);
+    }
+
+
+    // センサの前方 ±120 [deg], 1.5 m から 9 m の扇形の中を等速で動かす
+    void move_targets(vector<target_t>& targets, double dt)
+    {
+        for (vector<target_t>::iterator it = targets.begin();
+             it != targets.end(); ++it) {
+            it->x += it->vx * dt;
+            it->y += it->vy * dt;
+            double r = sqrt((it->x * it->x) + (it->y * it->y));
+            if (((r < 1500.0) && (((it->x * it->vx) + (it->y * it->vy)) < 0)) ||
+                ((r > 9000.0) && (((it->x * it->vx) + (it->y * it->vy)) > 0))) {
+                it->vx = -it->vx;
+                it->vy = -it->vy;
+            }
+            if (fabs(atan2(it->y, it->x)) > (M_PI * 2.0 / 3.0)) {
+                // 扇形の端では、扇形の内側に向けて反射する
+                double tangent_x = -it->y / r;
+                double tangent_y = it->x / r;
+                double along = (it->vx * tangent_x) + (it->vy * tangent_y);
+                if ((it->y > 0) == (along > 0)) {
+                    it->vx -= 2.0 * along * tangent_x;
+                    it->vy -= 2.0 * along * tangent_y;
+                }
+            }
+        }
+    }
+
+
+    bool generate_log(const char* file)
+    {
+        ofstream fout(file, ios_base::binary);
+        if (!fout.is_open()) {
+            return false;
+        }
+
+        // 接続時の QT, PP の応答
+        fout << "QT\n00P\n\n";
+        fout << "PP\n00P\n"
+             << scip_line("MODL:UTM-30LX(Hokuyo Automatic Co.,Ltd.);")
+             << scip_line("DMIN:23;") << scip_line("DMAX:60000;")
+             << scip_line("ARES:1440;") << scip_line("AMIN:0;")
+             << scip_line("AMAX:1080;") << scip_line("AFRT:540;")
+             << scip_line("SCAN:2400;") << "\n";
+
+        const string echo = "MD0000108001000";
+        fout << echo << "\n00P\n\n";
+
+        srand(1);
+        vector<target_t> targets(Targets);
+        for (int i = 0; i < Targets; ++i) {
+            // 物体が重ならないよう、角度と距離をずらして配置する
+            double radian = (M_PI * 2.0 / 3.0) * ((2.0 * i / Targets) - 1.0);
+            double r = 2000.0 + 1400.0 * (i % 5);
+            double speed = 500.0 + (rand() % 1000);
+            double direction = 2.0 * M_PI * (rand() % 360) / 360.0;
+            targets[i].x = r * cos(radian);
+            targets[i].y = r * sin(radian);
+            targets[i].vx = speed * cos(direction);
+            targets[i].vy = speed * sin(direction);
+        }
+
+        for (int scan = 0; scan < Generated_scans; ++scan) {
+            string data;
+            for (int step = 0; step < Steps; ++step) {
+                double radian =
+                    (step - Front_step) * 2.0 * M_PI / Area_resolution;
+                data += encode(ray_distance(targets, radian), 3);
+            }
+
+            fout << echo << "\n99b\n"
+                 << scip_line(encode(scan * Scan_msec, 4));
+            for (size_t i = 0; i < data.size(); i += 64) {
+                fout << scip_line(data.substr(i, 64));
+            }
+            fout << "\n";
+            move_targets(targets, Scan_msec / 1000.0);
+        }
+        return true;
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    const char* log_file = Generated_log_file;
+    if (argc > 1) {
+        log_file = argv[1];
+    } else if (!generate_log(log_file)) {
+        perror(log_file);
+        return 1;
+    }
+
+    Urg_log_reader reader;
+    if (!reader.load(log_file)) {
+        fprintf(stderr, "%s: %s\n", log_file, reader.what());
+        return 1;
+    }
+    bool with_intensity;
+    bool is_multiecho;
+    reader.log_measurement_type(with_intensity, is_multiecho);
+    int first_step;
+    int last_step;
+    int group_steps;
+    reader.log_range(first_step, last_step, group_steps);
+    group_steps = max(group_steps, 1);
+
+    Urg_driver urg;
+    if (!urg.open(&reader)) {
+        fprintf(stderr, "Urg_driver: %s\n", urg.what());
+        return 1;
+    }
+    urg.set_scanning_parameter(first_step, last_step, group_steps);
+    Lidar::measurement_t type = is_multiecho ?
+        (with_intensity ? Lidar::Multiecho_intensity : Lidar::Multiecho) :
+        (with_intensity ? Lidar::Distance_intensity : Lidar::Distance);
+    urg.start_measurement(type, Urg_driver::Infinity_scan_times, 0);
+
+    Blob_detector blob_detector;
+    Target_tracker tracker;
+    Scan_frame frame;
+    vector<float> xs;
+    vector<float> ys;
+    vector<int> steps;
+    vector<float> blob_xs;
+    vector<float> blob_ys;
+    long scans = 0;
+    long long total_nsec = 0;
+    vector<long long> scan_nsecs;
+    long long updated_tracks = 0;
+    long long total_blobs = 0;
+    long long total_confirmed = 0;
+
+    while (urg.get_scan(frame)) {
+        // Osc_publisher と同じく、最初のエコーの点を (x, y) にする
+        long long first_nsec = now_nsec();
+        xs.clear();
+        ys.clear();
+        steps.clear();
+        int n = static_cast<int>(frame.steps());
+        for (int i = 0; i < n; ++i) {
+            long distance = frame.distance()[i * frame.echo_size];
+            if (distance <= urg.min_distance()) {
+                continue;
+            }
+            int step = frame.first_step + (i * frame.group_steps);
+            double radian = urg.step2rad(step) + (M_PI / 2.0);
+            xs.push_back(distance * cos(radian));
+            ys.push_back(distance * sin(radian));
+            steps.push_back(step);
+        }
+
+        size_t blobs = 0;
+        if (!xs.empty()) {
+            blobs = blob_detector.detect(&xs[0], &ys[0], &steps[0],
+                                         xs.size(), frame.sensor_timestamp);
+        }
+        const vector<Blob_detector::cursor_t>& cursors =
+            blob_detector.cursors();
+        blob_xs.resize(blobs);
+        blob_ys.resize(blobs);
+        for (size_t i = 0; i < blobs; ++i) {
+            blob_xs[i] = cursors[i].x_mm;
+            blob_ys[i] = cursors[i].y_mm;
+        }
+        size_t confirmed = tracker.update(blobs ? &blob_xs[0] : NULL,
+                                   blobs ? &blob_ys[0] : NULL, blobs,
+                                   frame.sensor_timestamp, 0);
+        long long nsec = now_nsec() - first_nsec;
+
+        total_nsec += nsec;
+        scan_nsecs.push_back(nsec);
+        updated_tracks += tracker.tracks().size();
+        total_blobs += blobs;
+        total_confirmed += confirmed;
+        ++scans;
+    }
+
+    if (scans == 0) {
+        fprintf(stderr, "no scans: %s\n", urg.what());
+        return 1;
+    }
+    printf("%ld scans, %.1f blobs/scan, %.1f confirmed tracks/scan\n",
+           scans, static_cast<double>(total_blobs) / scans,
+           static_cast<double>(total_confirmed) / scans);
+    // 最大値は OS のスケジューリングの影響も受けるため、99% 値も出力する
+    sort(scan_nsecs.begin(), scan_nsecs.end());
+    printf("per scan: average %.1f us, 99%% %.1f us, worst %.1f us\n",
+           total_nsec / 1000.0 / scans,
+           scan_nsecs[(scans * 99) / 100] / 1000.0,
+           scan_nsecs.back() / 1000.0);
+    printf("%.0f track updates/s\n", updated_tracks * 1e9 / total_nsec);
+    return 0;
+}
@@ -0,0 +1,23 @@
+TEMPLATE = app
+TARGET = tracker_replay_bench
+QT -= gui core
+CONFIG += console
+CONFIG -= app_bundle qt
+DEPENDPATH += . ../..
+INCLUDEPATH += . ../..
+unix:!macx:LIBS += -lrt
+
+SOURCES += tracker_replay_bench.cpp \
+        ../../Blob_detector.cpp \
+        ../../Target_tracker.cpp \
+        ../../Urg_driver.cpp \
+        ../../Urg_log_reader.cpp \
+        ../../Serial.cpp \
+        ../../Tcpip.cpp \
+        ../../connection_utils.cpp \
+        ../../scip_decode.cpp \
+        ../../Scip_stream_parser.cpp \
+        ../../Scan_frame.cpp
+
+unix:SOURCES += ../../Io_reactor.cpp \
+        ../../Uring_receiver.cpp
@@ -0,0 +1,163 @@
+/*!
+  \file
+  \brief Tcpip の受信方式 (epoll, io_uring) の比較
+
+  ループバックの TCP で 1, 4, 16 本の接続を作り、各接続に MD の
+  スキャン (約 3.3 KB) を Scans 個、待たずに続けて送信する。受信側は
+  接続毎のスレッドで read_line() により空行までを 1 スキャンとして読み、
+  全接続の合計の 1 秒当たりのスキャン数を出力する。
+
+  io_uring は Tcpip::set_receive_engine(Tcpip::Io_uring_receive) で
+  選び、使えない環境では epoll の結果のみを出力する。
+
+  \author Satofumi Kamimura
+
+  $Id$
+*/
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include "Tcpip.h"
+#include "Uring_receiver.h"
+#include "Loopback_server.h"
+#include "Scip_scan_data.h"
+#include "Bench_timer.h"
+
+using namespace hrk;
+using namespace std;
+
+
+namespace
+{
+    enum {
+        Scans = 3000,
+        Steps = 1081,
+        Timeout = 1000,
+    };
+
+    string md_scan;
+
+
+    void* send_scans(void* args)
+    {
+        Loopback_server* server = static_cast<Loopback_server*>(args);
+        if (!server->accept()) {
+            return NULL;
+        }
+        for (int i = 0; i < Scans; ++i) {
+            if (server->send(md_scan.data(), md_scan.size()) !=
+                static_cast<int>(md_scan.size())) {
+                break;
+            }
+        }
+        return NULL;
+    }
+
+
+    typedef struct
+    {
+        Tcpip* connection;
+        int scans;
+    } receiver_t;
+
+
+    // 空行までを 1 スキャンとして数える
+    void* receive_scans(void* args)
+    {
+        receiver_t* receiver = static_cast<receiver_t*>(args);
+        Connection::span_t line;
+        while (receiver->scans < Scans) {
+            int n = receiver->connection->read_line(line, Timeout);
+            if (n < 0) {
+                break;
+            } else if (n == 0) {
+                ++receiver->scans;
+            }
+        }
+        return NULL;
+    }
+
+
+    // 全接続の合計の scans/s。受信できなかったスキャンがあれば負
+    double measure(int streams)
+    {
+        vector<Loopback_server*> servers;
+        vector<Tcpip*> connections;
+        vector<receiver_t> receivers(streams);
+        vector<pthread_t> senders(streams);
+        vector<pthread_t> threads(streams);
+
+        for (int i = 0; i < streams; ++i) {
+            servers.push_back(new Loopback_server);
+            servers[i]->listen();
+            pthread_create(&senders[i], NULL, send_scans, servers[i]);
+            connections.push_back(new Tcpip);
+            connections[i]->open("127.0.0.1", servers[i]->port());
+            receivers[i].connection = connections[i];
+            receivers[i].scans = 0;
+        }
+
+        double first_sec = now_sec();
+        for (int i = 0; i < streams; ++i) {
+            pthread_create(&threads[i], NULL, receive_scans, &receivers[i]);
+        }
+        int total_scans = 0;
+        for (int i = 0; i < streams; ++i) {
+            pthread_join(threads[i], NULL);
+            total_scans += receivers[i].scans;
+        }
+        double sec = now_sec() - first_sec;
+
+        for (int i = 0; i < streams; ++i) {
+            pthread_join(senders[i], NULL);
+            connections[i]->close();
+            servers[i]->close();
+            delete connections[i];
+            delete servers[i];
+        }
+
+        double scans_per_sec = total_scans / sec;
+        return (total_scans == (streams * Scans)) ?
+            scans_per_sec : -scans_per_sec;
+    }
+}
+
+
+int main(void)
+{
+    Scip_scan_data data("GD", Steps, 0);
+    md_scan = "MD0000108001000\n99b\n" + data.body();
+
+    bool is_uring_available = Uring_receiver::is_available();
+    if (!is_uring_available) {
+        printf("io_uring is not available.\n");
+    }
+
+    printf("streams  epoll [scans/s]  io_uring [scans/s]\n");
+    bool is_valid = true;
+    int streams[] = { 1, 4, 16 };
+    size_t n = sizeof(streams) / sizeof(streams[0]);
+    for (size_t i = 0; i < n; ++i) {
+        Tcpip::set_receive_engine(Tcpip::Socket_receive);
+        double epoll_rate = measure(streams[i]);
+        is_valid &= (epoll_rate > 0);
+        printf("%7d  %15.0f", streams[i], (epoll_rate > 0) ? epoll_rate : 0.0);
+
+        if (is_uring_available) {
+            Tcpip::set_receive_engine(Tcpip::Io_uring_receive);
+            double uring_rate = measure(streams[i]);
+            is_valid &= (uring_rate > 0);
+            printf("  %18.0f", (uring_rate > 0) ? uring_rate : 0.0);
+        }
+        printf("\n");
+    }
+    Tcpip::set_receive_engine(Tcpip::Socket_receive);
+
+    if (!is_valid) {
+        fprintf(stderr, "some scans were not received.\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,14 @@
+TEMPLATE = app
+TARGET = uring_receive_bench
+QT -= gui core
+CONFIG += console
+CONFIG -= app_bundle qt
+DEPENDPATH += . ../.. ../common
+INCLUDEPATH += . ../.. ../common
+LIBS += -lpthread
+unix:!macx:LIBS += -lrt
+
+SOURCES += uring_receive_bench.cpp \
+        ../../Tcpip.cpp \
+        ../../Io_reactor.cpp \
+        ../../Uring_receiver.cpp